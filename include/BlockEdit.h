@@ -0,0 +1,76 @@
+#pragma once
+#include <windows.h>
+#include <string>
+#include <vector>
+
+struct BlockInsert;
+struct BlockSelection;
+
+// A visual block's lines, fetched once, with where each line enters and
+// leaves the block. Columns count the way SCI_GETCOLUMN does: a tab runs to
+// the next tab stop and any other character is one column. As in Vim, a tab
+// across an edge of the block is split into spaces. Every edit builds the
+// text of all the lines and writes it back with one replace, so a block of
+// any height is one change and one undo action.
+class BlockEdit {
+public:
+    // With toLineEnd, after $, every line's block runs to its end and endCol
+    // is not used.
+    BlockEdit(HWND hwnd, int startLine, int endLine, int startCol, int endCol, bool toLineEnd);
+
+    // True when line startLine + index has text inside the block.
+    bool reaches(size_t index) const;
+
+    // Each edit returns where its text starts on the first line. With only,
+    // just the lines it marks change.
+
+    // I: text at the left edge of the lines that reach the block.
+    int insert(const std::string& text, const std::vector<bool>* only = nullptr);
+    // A: text at the right edge, with short lines padded out to it; at the
+    // end of every line after $.
+    int append(const std::string& text, const std::vector<bool>* only = nullptr);
+    // c: the block's text becomes text on the lines that reach it.
+    int change(const std::string& text);
+    // r: every column of the block becomes ch.
+    void fill(const std::string& ch);
+    // p and P of a block, with startCol the column to put at: pieces[i]
+    // goes in on line startLine + index, short lines are padded out to the
+    // column and pieces past the end of the document get new lines.
+    int put(const std::vector<std::string>& pieces, const std::string& eol);
+
+    // Block I, A and c type on the first line only. beginInsert prepares it
+    // and returns where insert mode starts; finishInsert, when insert mode
+    // ends, puts what was typed on the other lines in one edit.
+    static int beginInsert(HWND hwnd, BlockInsert& pending, char op, const BlockSelection& blk, bool toLineEnd);
+    static void finishInsert(HWND hwnd, BlockInsert& pending);
+
+private:
+    enum Op { OP_INSERT, OP_APPEND, OP_CHANGE, OP_FILL };
+
+    struct Cut {
+        size_t pos;     // in text
+        int col;
+        int before;     // columns of a tab at pos left of the edge, 0 if none is split
+        int after;
+    };
+
+    struct Line {
+        size_t end;     // in text
+        Cut left;
+        Cut right;
+    };
+
+    HWND hwnd;
+    int first;
+    int last;
+    int startCol;
+    int endCol;
+    bool toLineEnd;
+    int codePage;
+    int tabWidth;
+    std::string text;
+    std::vector<Line> lines;
+
+    Cut cutAt(size_t pos, int col, size_t end, int target) const;
+    int apply(Op op, const std::string& piece, const std::vector<bool>* only);
+};
@@ -0,0 +1,70 @@
+#pragma once
+#include <windows.h>
+#include <array>
+#include <map>
+#include <vector>
+
+struct BracketPair {
+    int open = -1;
+    int close = -1;
+    bool valid() const { return open >= 0; }
+};
+
+// Matching (), [], {} and <> pairs per document. Built on first use from one
+// pass over the buffer and kept current from SCN_MODIFIED, so lookups are a
+// binary search instead of a scan of the document. An edit with brackets in
+// it rescans only the innermost pair around it, as long as the brackets
+// there still balance.
+class BracketIndex {
+public:
+    static BracketIndex& getInstance();
+
+    // Innermost pair of the given kind containing pos (brackets included).
+    BracketPair enclosing(HWND hwnd, int pos, char openChar);
+    // Pair opening on pos's line that is closest to pos.
+    BracketPair nearestOnLine(HWND hwnd, int pos, char openChar);
+    // Partner of the bracket at pos, or -1.
+    int match(HWND hwnd, int pos);
+
+    void notifyModified(HWND hwnd, bool inserted, int pos, int length, const char* text);
+    // The views may show other documents now. Documents out of view can be
+    // edited without SCN_MODIFIED reaching us, so each is rebuilt on next use.
+    void viewsChanged() { viewDocs.clear(); }
+    // The document was closed and its pointer may be reused.
+    void forget(void* doc);
+
+private:
+    BracketIndex() = default;
+
+    static constexpr int KIND_COUNT = 4;
+    static constexpr size_t MAX_DOCUMENTS = 16;
+
+    struct Pairs {
+        std::vector<BracketPair> byOpen;
+        std::vector<int> parent;   // enclosing pair of the same kind, or -1
+        std::vector<int> byClose;  // indices into byOpen ordered by close
+    };
+
+    struct DocIndex {
+        std::array<Pairs, KIND_COUNT> kinds;
+        int length = -1;
+        bool dirty = true;
+        // Positions we may still shift before a rebuild becomes cheaper.
+        long long shiftBudget = 0;
+        unsigned lastUse = 0;
+    };
+
+    DocIndex& sync(HWND hwnd);
+    void rebuild(HWND hwnd, DocIndex& index);
+    // Both return false when the index has to be rebuilt instead.
+    bool shift(DocIndex& index, Pairs& pairs, int pos, int delta);
+    bool repair(HWND hwnd, DocIndex& index, int kind, int pos, int end, int delta);
+
+    static int kindOf(char ch, bool& isOpen);
+    static int innermost(const Pairs& pairs, int pos);
+    static int around(const Pairs& pairs, int start, int end);
+
+    std::map<void*, DocIndex> docs;
+    std::map<HWND, void*> viewDocs;
+    unsigned useCounter = 0;
+};
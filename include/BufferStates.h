@@ -0,0 +1,39 @@
+#pragma once
+#include <windows.h>
+#include <list>
+#include <unordered_map>
+#include "NppVim.h"
+
+// Per-buffer part of VimState for every buffer seen recently, keyed by
+// Notepad++ buffer ID. Bounded by MAX_BUFFERS, least recently used first out.
+class BufferStates {
+public:
+    static BufferStates& getInstance();
+
+    // Park the active buffer's state and bring in bufferId's (fresh if new).
+    void activate(UINT_PTR bufferId, VimState& state);
+    void close(UINT_PTR bufferId, VimState& state);
+
+    void setChangeListCapacity(size_t capacity, VimState& state);
+
+private:
+    BufferStates() = default;
+
+    static constexpr size_t MAX_BUFFERS = 256;
+
+    struct Entry {
+        BufferState state;
+        std::list<UINT_PTR>::iterator order;
+    };
+
+    static void release(BufferState& buffer);
+    BufferState fresh() const;
+    // Move bufferId's parked state into `into`, if it has one.
+    bool unpark(UINT_PTR bufferId, BufferState& into);
+
+    std::unordered_map<UINT_PTR, Entry> parked;
+    std::list<UINT_PTR> recent;     // most recently used first
+    UINT_PTR active = 0;
+    bool hasActive = false;
+    size_t changeListCapacity = 100;
+};
@@ -0,0 +1,114 @@
+#pragma once
+#include <windows.h>
+#include <cstdint>
+#include <string>
+
+enum CharClass : unsigned char {
+    CC_SPACE,
+    CC_NEWLINE,
+    CC_WORD,
+    CC_PUNCT,
+    CC_CJK,         // ideographs, kana and hangul; UTF-8 documents only
+    CC_EMOJI,
+    CC_COUNT
+};
+
+// Sets of classes for the scanners, one bit per class.
+constexpr unsigned CLASS_BLANK = (1u << CC_SPACE) | (1u << CC_NEWLINE);
+constexpr unsigned CLASS_NONBLANK = (1u << CC_WORD) | (1u << CC_PUNCT) | (1u << CC_CJK) | (1u << CC_EMOJI);
+
+inline unsigned classBit(CharClass c) { return 1u << c; }
+
+// Byte classes for word motions. Word characters come from 'iskeyword', or
+// from Scintilla's word characters while it is empty, so w/b/e land where
+// SCI_WORDRIGHT and friends would. Every class is a handful of byte ranges;
+// with SSE2 a range test is three instructions per 16 bytes, so 64 bytes are
+// classified at once into one bitmask per class. In a UTF-8 document the
+// table only decides ASCII; ClassScanner gives every byte of a multi-byte
+// character the class of its code point.
+class CharClasses {
+public:
+    explicit CharClasses(HWND hwnd);
+
+    CharClass operator()(char c) const { return table[(unsigned char)c]; }
+    bool isUtf8() const { return utf8; }
+
+    // Bit i of masks[k] is set when text[i] is of class k; n is at most 64
+    // and the bits from n up are clear in every mask. Returns the bytes
+    // above 0x7F.
+    uint64_t classify(const char* text, size_t n, uint64_t masks[CC_COUNT]) const;
+    // The same a byte at a time; classify falls back to it without SSE2 or
+    // with more than MAX_RANGES ranges.
+    uint64_t classifyScalar(const char* text, size_t n, uint64_t masks[CC_COUNT]) const;
+
+    // Vim's 'iskeyword' syntax: "@" for letters, numbers and ranges such as
+    // "48-57" or "a-z", single characters, "^" to exclude. Bytes from 0x80
+    // up, which matter in code page documents, are word characters unless
+    // excluded. False on a malformed spec.
+    static bool parseKeywordSpec(const std::string& spec, bool word[256]);
+
+private:
+    static constexpr int MAX_RANGES = 16;
+
+    struct Range {
+        unsigned char low;
+        unsigned char span;     // high - low
+        CharClass cls;
+    };
+
+    CharClass table[256];
+    // Space, newline and word ranges; punctuation is what none of them match.
+    Range ranges[MAX_RANGES];
+    int rangeCount = 0;
+    bool vectorized = false;
+    bool utf8 = false;
+
+    void buildRanges();
+};
+
+// Skips runs of classes through the document 64 bytes at a time. Text is
+// read in place through SCI_GETRANGEPOINTER in windows that never straddle
+// the gap, so the gap never moves and only a block across a window edge is
+// copied, however long the line. The document must not change while a
+// scanner is alive.
+class ClassScanner {
+public:
+    ClassScanner(HWND hwnd, const CharClasses& classes);
+
+    int length() const { return docLength; }
+
+    // CC_NEWLINE outside the document, so runs end there.
+    CharClass at(int pos);
+
+    // First position from pos, before limit, whose class is not in classSet;
+    // limit when there is none.
+    int skipForward(int pos, unsigned classSet, int limit);
+    // Start of the run of classSet characters ending at pos, not before limit.
+    int skipBackward(int pos, unsigned classSet, int limit);
+
+    int skipForward(int pos, unsigned classSet) { return skipForward(pos, classSet, docLength); }
+    int skipBackward(int pos, unsigned classSet) { return skipBackward(pos, classSet, 0); }
+
+private:
+    static constexpr int WINDOW = 64 * 1024;
+    static constexpr int BLOCK = 64;
+
+    HWND hwnd;
+    const CharClasses& classes;
+    int docLength;
+    int gap;
+
+    const char* windowText = nullptr;
+    int windowStart = 0;
+    int windowEnd = 0;
+
+    int blockStart = -1;
+    const char* blockText = nullptr;    // into the window, or copy
+    char copy[BLOCK];
+    uint64_t masks[CC_COUNT];
+
+    void loadWindow(int pos);
+    void loadBlock(int pos);
+    void classifyMultiByte(uint64_t high, int n);
+    uint64_t select(unsigned classSet) const;
+};
@@ -0,0 +1,68 @@
+#pragma once
+#include <windows.h>
+#include <memory>
+#include <string>
+#include "Registers.h"
+
+// Platform side of the system clipboard.
+class ClipboardBackend {
+public:
+    virtual ~ClipboardBackend() = default;
+
+    // Announce that text is available without copying it (delayed rendering).
+    // Returns false if the platform cannot defer, in which case text is
+    // published on flush() instead.
+    virtual bool claim() = 0;
+    // Answer a render request for a previous claim().
+    virtual void render(const std::string& text) = 0;
+    virtual void write(const std::string& text) = 0;
+    virtual std::string read() = 0;
+};
+
+// In-memory backend for hosts without a system clipboard.
+class MemoryClipboardBackend : public ClipboardBackend {
+public:
+    bool claim() override { return false; }
+    void render(const std::string& text) override { contents = text; }
+    void write(const std::string& text) override { contents = text; }
+    std::string read() override { return contents; }
+
+private:
+    std::string contents;
+};
+
+// Keeps the unnamed register and the system clipboard in sync lazily: yanks and
+// deletes only mark the text as pending, and it is copied out when another
+// application asks for it, when Notepad++ loses focus, or on an explicit "+.
+class Clipboard {
+public:
+    static Clipboard& getInstance();
+
+    void setOwner(HWND owner);
+    void setBackend(std::unique_ptr<ClipboardBackend> backend);
+
+    void setDeferred(const RegisterText& text);
+    void setText(const std::string& text);
+    std::string getText();
+    // The same text, shared rather than copied while it is the text this
+    // plugin last put on the clipboard. Null if the clipboard is empty.
+    RegisterText getShared();
+
+    void flush();
+    bool isDirty() const { return pending != nullptr; }
+
+    // Owner window messages; returns true if the message was handled.
+    bool handleMessage(HWND hwnd, UINT msg, WPARAM wParam);
+
+private:
+    Clipboard();
+
+    void write(const RegisterText& text);
+
+    std::unique_ptr<ClipboardBackend> backend;
+    HWND owner = nullptr;
+    RegisterText pending;
+    RegisterText current;   // ours and still on the clipboard
+    bool claimed = false;
+    bool publishing = false;
+};
@@ -0,0 +1,55 @@
+#pragma once
+#include <map>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// Bounded command-line history with Vim's prefix recall. Entries carry a
+// running sequence number; a trie over their first characters lists, per
+// prefix, the sequence numbers of the entries below it in the order they
+// were added, so the next older or newer match is a binary search.
+// Re-entering a line moves it to the newest place instead of adding a copy.
+class HistoryRing {
+public:
+    explicit HistoryRing(size_t capacity);
+
+    void setCapacity(size_t capacity);
+    size_t size() const { return live.size(); }
+
+    void add(const std::string& line);
+
+    // Position before the newest entry, where recall starts.
+    unsigned long long end() const { return nextSeq; }
+
+    // Step from cursor to the next older / newer entry starting with prefix.
+    // Stepping newer past the newest entry returns false and leaves cursor
+    // at end().
+    bool older(std::string_view prefix, unsigned long long& cursor, std::string& out) const;
+    bool newer(std::string_view prefix, unsigned long long& cursor, std::string& out) const;
+
+private:
+    // Prefixes longer than this share the deepest node and are checked in full.
+    static constexpr size_t MAX_DEPTH = 32;
+
+    struct Node {
+        std::vector<std::pair<char, int>> children;     // sorted by key
+        std::vector<unsigned long long> seqs;           // ascending, may hold retired ones
+    };
+
+    size_t capacity;
+    std::unordered_map<std::string, unsigned long long> live;
+    std::map<unsigned long long, const std::string*> bySeq;    // oldest first; points at keys of live
+    unsigned long long nextSeq = 1;
+    size_t staleRefs = 0;
+    size_t liveRefs = 0;
+
+    std::vector<Node> trie;
+
+    const std::string* find(unsigned long long seq) const;
+    int descend(std::string_view prefix) const;
+    void index(const std::string& line, unsigned long long seq);
+    void retire(std::unordered_map<std::string, unsigned long long>::iterator entry);
+    void rebuild();
+};
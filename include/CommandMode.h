@@ -1,7 +1,13 @@
 #pragma once
 #include "NppVim.h"
+#include "CommandRegistry.h"
+#include "CommandHistory.h"
+#include "DirectoryCache.h"
 #include <windows.h>
+#include <memory>
 #include <string>
+#include <string_view>
+#include <vector>
 
 #define IND_SUB_MATCH    20
 #define IND_SUB_REPL     21
@@ -10,13 +16,20 @@ class CommandMode {
 public:
     CommandMode(VimState& state);
 
-    void enter(char prompt);
+    // text prefills the command line, as !{motion} does with its range.
+    void enter(char prompt, const std::string& text = "");
     void exit();
     void handleKey(HWND hwndEdit, wchar_t wChar);
     void handleBackspace(HWND hwndEdit);
     void handleEnter(HWND hwndEdit);
     void updateStatus();
 
+    // Up/Down: older/newer history lines starting with what was typed.
+    void recallHistory(HWND hwndEdit, bool older);
+    // Tab/Shift-Tab: cycle through completions of the word before the cursor.
+    void completeCommandLine(HWND hwndEdit, bool forward);
+    void setHistoryCapacity(int lines);
+
     // Search functions
     void performSearch(HWND hwndEdit, const std::string& searchTerm, int searchFlags = 0);
     void searchNext(HWND hwndEdit);
@@ -25,8 +38,8 @@ public:
 
     // User Commands (Aliases)
     static void addUserCommand(const std::string& alias, const std::string& target);
+    static void removeUserCommand(const std::string& alias);
     static void clearUserCommands();
-    static std::string resolveUserCommand(const std::string& alias);
 
     void handleColonCommand(HWND hwndEdit, const std::string& cmd);
     void handleSearchCommand(HWND hwndEdit, const std::string& searchTerm, int searchFlags = 0);
@@ -36,14 +49,50 @@ private:
     VimState& state;
     std::string lastPreviewBuffer;
 
+    HistoryRing colonHistory;
+    HistoryRing searchHistory;      // shared by / and ?
+
+    bool recalling = false;
+    std::string recallPrefix;
+    unsigned long long recallCursor = 0;
+
+    // Candidates are either in completions or, for file names, a range of a
+    // directory listing so a large directory is never copied.
+    bool completing = false;
+    std::string completionBase;     // command line before the completed word
+    std::vector<std::string> completions;
+    std::shared_ptr<const DirectoryListing> completionListing;
+    std::string completionDir;      // typed directory part of file candidates
+    size_t completionFirst = 0;
+    size_t completionCount = 0;
+    size_t completionIndex = 0;
+
+    HistoryRing& historyFor(char prompt) { return prompt == ':' ? colonHistory : searchHistory; }
+    void endLineEditing();
+    void bufferChanged(HWND hwndEdit);
+    bool gatherCompletions();
+    std::string completionAt(size_t index) const;
+
     void handleCommand(HWND hwndEdit);
+    void goToLine(HWND hwndEdit, std::string_view range);
+    // Line numbers are 1-based; an address may be 0 (before the first line).
+    bool resolveAddress(HWND hwndEdit, std::string_view& text, int current, int& line);
+    bool resolveRange(HWND hwndEdit, std::string_view range, int& first, int& last);
+    void transferLines(HWND hwndEdit, const CommandCall& call, bool copy);
+
+    std::string lastShellCommand;
+    void shellCommand(HWND hwndEdit, const CommandCall& call);
+    void readCommand(HWND hwndEdit, const CommandCall& call);
+    // output is converted to codePage, a Scintilla code page (0 for ANSI).
+    bool runShell(const std::string& command, std::string_view input, std::string& output, int codePage = CP_UTF8);
+    void insertBelow(HWND hwndEdit, int line, std::string text);
     void performSubstitution(HWND hwndEdit, const std::string& pattern, const std::string& replacement,
          bool useRegex, bool caseInsensitive, bool replaceAll, bool confirmEach, bool globalReplace, int startPos, int endPos);
 
     void initSubstitutionIndicators(HWND h);
     void clearSubstitutionPreview(HWND h);
     void previewSubstitutionFromBuffer(HWND h);
-    void showRegisters();
+    void showRegisters(const std::string& only = "");
     void previewSubstitution(HWND h, const std::string &pat, const std::string &rep, bool regex, bool global);
     bool parseSubstitution(const std::string& buf,std::string& pat,std::string& rep,bool& regex,bool& global, bool& confirm);
 };
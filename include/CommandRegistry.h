@@ -0,0 +1,107 @@
+#pragma once
+#include <windows.h>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include "Keymap.h"
+
+enum class CommandArgs : unsigned char {
+    None,
+    Optional,
+    Required
+};
+
+// What Tab completes in a command's arguments.
+enum class CommandCompletion : unsigned char {
+    None,
+    Option,
+    Register,
+    File
+};
+
+// A colon command line split into its parts; the views point into the line.
+struct CommandCall {
+    std::string_view line;
+    std::string_view range;     // as typed, empty when none
+    std::string_view name;      // as typed, possibly abbreviated
+    std::string_view args;      // without surrounding blanks
+    bool bang = false;
+};
+
+using CommandHandler = std::function<void(HWND, const CommandCall&)>;
+
+struct ColonCommand {
+    std::string name;
+    size_t abbreviation = 0;    // shortest accepted prefix; 0 for the shortest unique one
+    CommandArgs args = CommandArgs::None;
+    bool range = false;
+    bool bang = false;
+    CommandCompletion completion = CommandCompletion::None;
+    std::string description;
+    CommandHandler handler;
+    std::string replacement;    // user commands: the command line they stand for
+    bool user = false;
+};
+
+// Every spelling a command accepts, its full name and each abbreviation,
+// sits in a perfect hash (hash and displace), so resolving a typed name is
+// two hashes and one compare. A trie over the names gives the shortest
+// unique prefixes and prefix completion. Both are rebuilt on the first
+// lookup after the set of commands changes.
+class CommandRegistry {
+public:
+    static CommandRegistry& getInstance();
+
+    // A built-in command; one with the same name is replaced.
+    void add(const ColonCommand& command);
+
+    // User commands take their exact name before any built-in, and the
+    // shortest unique prefix when no built-in claims it.
+    void addUser(const std::string& name, const std::string& replacement);
+    bool removeUser(const std::string& name);
+    void clearUser();
+
+    const ColonCommand* find(std::string_view name) const;
+
+    // Splits without allocating; false if nothing resembling a command name
+    // follows the range.
+    static bool parse(std::string_view line, CommandCall& call);
+
+    // Full names starting with prefix, in name order.
+    void complete(std::string_view prefix, std::vector<const ColonCommand*>& out) const;
+
+    // "s[ubstitute]" style entries for help listings.
+    std::vector<KeyBinding> listing(bool userOnly = false) const;
+
+private:
+    CommandRegistry() = default;
+
+    struct TrieNode {
+        std::vector<std::pair<char, int>> children;    // sorted by key
+        int command = -1;                              // a name ends here
+        int count = 0;                                 // names at or below
+    };
+
+    struct Slot {
+        unsigned int offset = 0;
+        unsigned int length = 0;
+        int command = -1;
+    };
+
+    void index() const;
+    void buildTrie() const;
+    void buildHash(const std::unordered_map<std::string, int>& spellings) const;
+    size_t uniquePrefix(const std::string& name) const;
+    int childOf(int node, char key) const;
+    void collect(int node, std::vector<const ColonCommand*>& out) const;
+
+    std::vector<ColonCommand> commands;
+
+    mutable bool dirty = true;
+    mutable std::vector<TrieNode> trie;
+    mutable std::vector<unsigned int> displacement;
+    mutable std::vector<Slot> slots;
+    mutable std::string spellingPool;
+};
@@ -12,6 +12,7 @@ public:
     
     std::string getRcPath();
     std::string getConfigPath();
+    std::string getRcCachePath();
     
     void ensureDefaultFiles();
     
@@ -0,0 +1,42 @@
+#pragma once
+#include <windows.h>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+struct DirectoryListing {
+    std::vector<std::string> names;     // UTF-8; directories end in a backslash
+    std::vector<std::string> folded;    // lower-cased names, sorted; names follow this order
+};
+
+// Directory listings for file name completion, read on a worker thread so a
+// large directory never stalls the prompt. A listing is served as soon as it
+// exists; one older than REFRESH_MS is read again in the background.
+class DirectoryCache {
+public:
+    static DirectoryCache& getInstance();
+
+    // Null while the first read of dir is still running.
+    std::shared_ptr<const DirectoryListing> lookup(const std::string& dir);
+    void prefetch(const std::string& dir) { lookup(dir); }
+
+    // Index range of the names starting with prefix, ignoring case.
+    static std::pair<size_t, size_t> matching(const DirectoryListing& listing, std::string_view prefix);
+
+    static std::string fold(std::string_view name);
+
+private:
+    DirectoryCache();
+
+    static constexpr ULONGLONG REFRESH_MS = 5000;
+    static constexpr size_t MAX_DIRECTORIES = 32;
+
+    struct Shared;
+    // Workers hold their own reference, so one finishing late never
+    // touches freed state.
+    std::shared_ptr<Shared> shared;
+
+    static void read(std::shared_ptr<Shared> shared, std::string dir);
+};
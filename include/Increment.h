@@ -0,0 +1,43 @@
+#pragma once
+#include <windows.h>
+#include <string>
+#include <string_view>
+
+struct BlockSelection;
+
+// CTRL-A and CTRL-X. Numbers are found in fetched line text and changed
+// digit by digit, so any number of digits works; 'nrformats' picks the
+// formats besides decimal.
+class Increment {
+public:
+    enum Format : unsigned {
+        FORMAT_BIN = 1,
+        FORMAT_HEX = 2,
+        FORMAT_OCTAL = 4,
+        FORMAT_ALPHA = 8,
+        FORMAT_UNSIGNED = 16,
+        FORMAT_BLANK = 32,      // '-' is a sign only after a blank
+    };
+
+    struct Edit {
+        size_t start;
+        size_t end;
+        std::string text;
+    };
+
+    // 'nrformats' as flags; false on an unknown name.
+    static bool parseFormats(const std::string& spec, unsigned& formats);
+
+    // Adds delta to the first number in line that ends after from. False
+    // when there is none.
+    static bool adjust(std::string_view line, size_t from, long long delta, unsigned formats, Edit& edit);
+
+    // The number under or after the caret; the caret ends on its last
+    // character.
+    static void atCaret(HWND hwnd, long long delta);
+
+    // The first number on every line of the selected text, in one edit. With
+    // progressive the n-th number changed gets n * delta, as g CTRL-A does.
+    static void inRange(HWND hwnd, int start, int end, long long delta, bool progressive);
+    static void inBlock(HWND hwnd, const BlockSelection& blk, long long delta, bool progressive);
+};
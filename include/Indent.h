@@ -0,0 +1,36 @@
+#pragma once
+#include <windows.h>
+#include <string>
+
+// The = operator. Target indents come from one forward pass over the text
+// that tracks brackets, comments and strings; the rules for each kind of
+// language are a Rules class in Indent.cpp. The range is written back with
+// one replace.
+class Indent {
+public:
+    enum Language {
+        LANG_C,         // braces: C, C++, Java, JavaScript, C#, CSS and the rest
+        LANG_PYTHON,
+        LANG_XML,
+        LANG_HTML,      // XML plus void elements and <pre>, <script> and <style>
+    };
+
+    struct Settings {
+        int shiftWidth;
+        int tabWidth;
+        bool useTabs;
+        Language language;
+    };
+
+    // The rules for the buffer's lexer.
+    static Language languageOf(HWND hwnd);
+
+    // text is whole lines. The lines before offset from are read for
+    // context only; the rest are returned reindented. Blank lines lose their
+    // blanks.
+    static std::string format(const std::string& text, size_t from, const Settings& settings);
+
+    // Reindents lines firstLine to lastLine and leaves the caret on the first
+    // non-blank of firstLine.
+    static void apply(HWND hwnd, int firstLine, int lastLine);
+};
@@ -12,7 +12,6 @@ class Keymap;
 
 extern std::unique_ptr<Keymap> g_normalKeymap;
 extern std::unique_ptr<Keymap> g_visualKeymap;
-extern std::unique_ptr<Keymap> g_commandKeymap;
 extern std::unique_ptr<Keymap> g_insertKeymap;
 
 using KeyHandler = std::function<void(HWND, int)>;
@@ -49,6 +48,8 @@ public:
     // Support for dynamic mappings
     void addMapping(const std::string& from, const std::string& to, bool recursive);
     void removeMapping(const std::string& from);
+    // Puts back whatever from did before it was first mapped or unmapped.
+    void restoreMapping(const std::string& from);
     void clearDynamicMappings();
 
     std::string getPendingSequence() const { return pendingKeys; }
@@ -62,6 +63,17 @@ private:
 
     bool allowCount = true;
     std::vector<KeyBinding> bindings;
+
+    struct Shadowed {
+        KeyHandler handler;
+        char motionChar = 0;
+        bool isLeaf = false;
+    };
+    std::unordered_map<std::string, Shadowed> shadowed;
+
+    std::shared_ptr<KeymapNode> findNode(const std::string& keys) const;
+    void shadow(const std::string& from, const std::shared_ptr<KeymapNode>& node);
+    void prune(const std::string& keys);
     
     void insertKeySequence(const std::string& keys, KeyHandler handler, char motionChar = 0);
     bool processKey(HWND hwnd, char key, int count);
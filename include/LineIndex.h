@@ -0,0 +1,64 @@
+#pragma once
+#include <windows.h>
+#include <map>
+#include <vector>
+
+// Plugin-side copy of the line starts of the documents shown in the two
+// editor views. Built on first use after a buffer activation and kept current
+// from SCN_MODIFIED, so line/position conversions don't need a SendMessage.
+//
+// Build with NPPVIM_VERIFY_LINE_INDEX to cross-check every answer against
+// Scintilla and log mismatches with OutputDebugString.
+class LineIndex {
+public:
+    static LineIndex& getInstance();
+
+    // Same results as SCI_GETLINECOUNT, SCI_POSITIONFROMLINE,
+    // SCI_GETLINEENDPOSITION and SCI_LINEFROMPOSITION.
+    int lineCount(HWND hwnd);
+    int lineStart(HWND hwnd, int line);
+    int lineEnd(HWND hwnd, int line);
+    int lineFromPosition(HWND hwnd, int pos);
+
+    void notifyModified(HWND hwnd, bool inserted, int pos, int length, int linesAdded, const char* text);
+    // Either view may now show another document. Documents out of view can
+    // be edited without SCN_MODIFIED reaching us, so every table is dropped.
+    void viewsChanged();
+    // The document was closed and its pointer may be reused.
+    void forget(void* doc);
+    // Forget every document.
+    void reset();
+
+private:
+    LineIndex() = default;
+
+    // Line starts use Scintilla's Partitioning trick: entries after
+    // stepPartition still owe stepLength, so a run of edits on one line
+    // shifts nothing until a lookup crosses the step.
+    struct Lines {
+        std::vector<int> starts;          // one per line plus the document length
+        std::vector<unsigned char> eolKind;
+        int stepPartition = 0;
+        int stepLength = 0;
+        bool dirty = true;
+
+        int count() const { return (int)starts.size() - 1; }
+        int position(int partition) const;
+        int partitionFromPosition(int pos) const;
+        void applyStep(int partitionUpTo);
+        void backStep(int partitionDownTo);
+        void insertText(int partition, int delta);
+        void insertPartition(int partition, int pos);
+        void removePartition(int partition);
+
+        // pos is fromEnd characters before the end of a line ending in kind.
+        bool endsWith(int pos, unsigned char kind, int fromEnd) const;
+        bool afterLoneCR(int pos) const;
+    };
+
+    Lines* lookup(HWND hwnd);
+    void rebuild(HWND hwnd, Lines& lines);
+
+    std::map<HWND, void*> viewDocs;
+    std::map<void*, Lines> docs;
+};
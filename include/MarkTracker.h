@@ -0,0 +1,61 @@
+#pragma once
+#include <windows.h>
+#include <map>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// Document positions that move with the text. Every document keeps its
+// positions sorted with a lazily applied shift (the same step trick as
+// LineIndex), so an edit costs a binary search plus whatever positions fall
+// inside a deleted range, however many marks exist.
+class MarkTracker {
+public:
+    static MarkTracker& getInstance();
+
+    // Handles are unique across documents; a handle from another document is
+    // simply not found.
+    int track(HWND hwnd, int pos);
+    void move(HWND hwnd, int handle, int pos);
+    // Current position, or -1 if the handle does not belong to this document.
+    int position(HWND hwnd, int handle);
+    // Handles and positions of everything in [start, end).
+    void collect(HWND hwnd, int start, int end, std::vector<std::pair<int, int>>& out);
+
+    // Drop a handle whichever document holds it.
+    void forget(int handle);
+    // Drop every handle of a closed document.
+    void forgetDocument(void* doc);
+
+    void notifyModified(HWND hwnd, bool inserted, int pos, int length);
+
+    static void* documentOf(HWND hwnd);
+
+private:
+    MarkTracker() = default;
+
+    struct Positions {
+        std::vector<int> raw;      // sorted once the pending step is added
+        std::vector<int> handles;
+        std::unordered_map<int, size_t> slots;  // handle -> index
+        size_t stepStart = 0;      // entries from here on still owe stepDelta
+        int stepDelta = 0;
+
+        int value(size_t i) const { return raw[i] + (i >= stepStart ? stepDelta : 0); }
+        size_t lowerBound(int pos) const;
+        size_t find(int handle) const;
+        void shiftFrom(size_t first, int delta);
+        void insert(int handle, int pos);
+        void erase(size_t i);
+        void assign(size_t i, int pos);
+        // pos may replace entry i without breaking the order.
+        bool fits(size_t i, int pos) const;
+        void reindexFrom(size_t first);
+    };
+
+    Positions* lookup(HWND hwnd);
+
+    std::map<void*, Positions> docs;
+    std::unordered_map<int, void*> owners;  // handle -> document
+    int nextHandle = 1;
+};
@@ -12,6 +12,9 @@ struct MarkInfo {
     int column;
     std::string filename;
     bool isGlobal;
+    // MarkTracker handle; line/column are only a fallback once the document
+    // that held the handle is gone.
+    int handle = -1;
     MarkInfo() : line(-1), column(-1), isGlobal(false) {}
     MarkInfo(int l, int c, const std::string& f, bool g) : line(l), column(c), filename(f), isGlobal(g) {}
 };
@@ -20,6 +23,8 @@ class Marks {
 public:
     static void setMark(HWND hwndEdit, char mark);
     static bool jumpToMark(HWND hwndEdit, char mark, bool isBacktick = false);
+    // Position of a mark in this document, or -1 if unset or in another file.
+    static int position(HWND hwndEdit, char mark);
     static void deleteMark(HWND hwndEdit, char mark);
     static void clearAllMarks(HWND hwndEdit);
     static std::string listMarks(HWND hwndEdit);
@@ -27,13 +32,23 @@ public:
     static int getMarkerNumber(char mark);
     static bool isValidMark(char mark);
 
+    // '. follows the most recent edit of each document.
+    static void noteChange(HWND hwndEdit, int pos);
+    // '< and '> as anchor/caret of the last visual selection.
+    static void setVisualMarks(HWND hwndEdit, int anchor, int caret);
+    static bool getVisualMarks(HWND hwndEdit, int& anchor, int& caret);
+    // The document closed; its '. and '< '> go with it.
+    static void forgetDocument(void* doc);
+
+    // Show margin markers for marks on the visible lines only.
+    static void syncMarkers(HWND hwndEdit);
+
 private:
-    static std::map<char, MarkInfo> localMarks;
     static std::map<char, MarkInfo> globalMarks;
-    static MarkInfo lastJumpMark;
-    static MarkInfo lastChangeMark;
+    static std::map<void*, int> changeHandles;
+    static std::map<void*, std::pair<int, int>> visualHandles;
 
     static std::string getCurrentFilename();
-    static void updateMarkerDisplay(HWND hwndEdit, char mark);
-    static void removeMarkerDisplay(HWND hwndEdit, char mark);
+    static int markPosition(HWND hwndEdit, const MarkInfo& info);
+    static void trackMark(HWND hwndEdit, MarkInfo& info, int pos);
 };
\ No newline at end of file
@@ -15,13 +15,17 @@ public:
     static void wordEnd(HWND hwndEdit, int count);
     static void wordEndBig(HWND hwndEdit, int count);
     static void wordEndPrev(HWND hwndEdit, int count);
+    static void wordEndPrevBig(HWND hwndEdit, int count);
+    // Where count ge / gE steps from pos, for callers that place the caret
+    // themselves.
+    static int wordEndPrevTarget(HWND hwndEdit, int pos, int count, bool bigWord);
     static void lineEnd(HWND hwndEdit, int count);
     static void lineStart(HWND hwndEdit, int count);
 
-    static void nextChar(HWND hwndEdit, int count, char target);
-    static void prevChar(HWND hwndEdit, int count, char target);
-    static void tillChar(HWND hwndEdit, int count, char target);
-    static void tillCharBack(HWND hwndEdit, int count, char target);
+    static void nextChar(HWND hwndEdit, int count, char32_t target);
+    static void prevChar(HWND hwndEdit, int count, char32_t target);
+    static void tillChar(HWND hwndEdit, int count, char32_t target);
+    static void tillCharBack(HWND hwndEdit, int count, char32_t target);
 
     static void paragraphUp(HWND hwndEdit, int count);
     static void paragraphDown(HWND hwndEdit, int count);
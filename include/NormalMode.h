@@ -11,12 +11,11 @@ public:
     
     void enter();
     void handleKey(HWND hwnd, char c);
+    void handleCharArgument(HWND hwnd, char32_t c);
     void enterInsertMode();
 
-    void incrementNumber(HWND hwnd, int count);
-    void decrementNumber(HWND hwnd, int count);
-    void jumpBackward(HWND hwnd);
-    void jumpForward(HWND hwnd);
+    void jumpBackward(HWND hwnd, int count = 1);
+    void jumpForward(HWND hwnd, int count = 1);
     
 private:
     VimState& state;
@@ -24,17 +23,21 @@ private:
     
     void setupKeyMaps();
     
-    void deleteLineOnce(HWND hwnd);
-    void yankLineOnce(HWND hwnd);
+    void deleteLines(HWND hwnd, int count);
+    void changeLines(HWND hwnd, int count);
+    void yankLines(HWND hwnd, int count);
+    void formatLines(HWND hwnd, char op, int count);
+    void storeDeletedLines(const std::string& text, bool shouldStore);
     void applyOperatorToMotion(HWND hwnd, char op, char motion, int count);
 
     void handlePasteFromRegister(HWND hwnd, char pasteCmd, char reg);
     void handleDeleteCharToRegister(HWND hwnd, char deleteCmd, char reg);
 
-    void handleCharSearchInput(HWND hwnd, char searchChar, char searchType, int count);
+    void handleCharSearchInput(HWND hwnd, char32_t searchChar, char searchType, int count);
     void handleMarkSetInput(HWND hwnd, char mark);
     void handleMarkJumpInput(HWND hwnd, char mark, bool exactPosition);
-    void handleReplaceInput(HWND hwnd, char replaceChar);
+    void handleReplaceInput(HWND hwnd, char32_t replaceChar);
+    void jumpToLastLine(HWND hwnd);
     void gotoDefinition(HWND h, VimState& state, bool applyOp);
 };
 
@@ -6,6 +6,9 @@
 #include <string>
 #include <map>
 
+#include "PositionRing.h"
+#include "Marks.h"
+
 auto constexpr DEFAULT_VIM_ENABLED = false;
 
 enum VimMode {
@@ -66,15 +69,29 @@ struct LastOperation {
     OperationType type = OP_NONE;
     int count = 0;
     char motion = 0;
-    char searchChar = 0;
+    char32_t searchChar = 0;
 
     char textModifier = 0;
     char textObject = 0;
 };
 
-struct JumpPosition {
-    long position = -1;
-    int lineNumber = -1;
+// visualPreferredColumn after $ in block visual: the block runs to the end
+// of every line until a horizontal motion.
+constexpr int COLUMN_LINE_END = 0x7FFFFFFF;
+
+// A block I, A or c waiting for insert mode to end, when the text typed on
+// the first line goes to the other lines.
+struct BlockInsert {
+    char op = 0;                // 0 when none is pending
+    int startLine = 0;
+    int endLine = 0;
+    int startCol = 0;
+    int endCol = 0;
+    bool toLineEnd = false;
+    int insertPos = 0;
+    int lineLength = 0;         // of the first line once insert mode began
+    int lineCount = 0;
+    std::vector<bool> reaches;  // lines after the first that get the text
 };
 
 extern HKL g_userLayout;
@@ -83,24 +100,35 @@ extern HKL g_englishLayout;
 extern int g_macroDepth;
 const int MAX_MACRO_DEPTH = 10;
 
-struct VimState {
+// State that belongs to one buffer; BufferStates swaps it in and out of the
+// global VimState on buffer activation.
+struct BufferState {
+    int lastVisualAnchor = -1;
+    int lastVisualCaret = -1;
+    int lastInsertPos = -1;
+    bool lastVisualWasLine = false;
+    bool lastVisualWasBlock = false;
+
+    int lastSearchMatchCount = -1;
+
+    std::map<char, MarkInfo> localMarks;
+    PositionRing changeList{ 100, true };
+};
+
+struct VimState : BufferState {
     VimMode mode = NORMAL;
     bool vimEnabled = DEFAULT_VIM_ENABLED;
     bool commandMode = false;
     bool isLineVisual = false;
     bool isBlockVisual = false;
     bool lastYankLinewise = false;
+    bool lastYankBlockwise = false;
     int visualPreferredColumn = -1;
+    BlockInsert blockInsert;
 
     HKL savedInsertLayout = nullptr;
 
-    int lastVisualAnchor = -1;
-    int lastVisualCaret = -1;
-    int lastInsertPos = -1;
-
     bool restoringVisual = false;
-    bool lastVisualWasLine = false;
-    bool lastVisualWasBlock = false;
 
     int repeatCount = 0;
     char opPending = 0;
@@ -108,7 +136,6 @@ struct VimState {
     bool replacePending = false;
     bool visualReplacePending = false;
 
-    std::map<char, std::string> registers;
     char defaultRegister = '"';
     bool deleteToBlackhole = false;
     bool awaitingRegister = false;
@@ -120,19 +147,17 @@ struct VimState {
     int visualAnchor = -1;
     int visualAnchorLine = -1;
 
-    char lastSearchChar = 0;
+    char32_t lastSearchChar = 0;
     bool lastSearchForward = true;
     bool lastSearchTill = false;
 
     LastOperation lastOp;
 
-    std::vector<JumpPosition> jumpList;
-    int jumpIndex = -1;
+    PositionRing jumpList{ 100, false };
 
     std::string commandBuffer;
     std::string lastSearchTerm;
     int searchFlags = 0;
-    int lastSearchMatchCount = -1;
     int visualSearchAnchor = -1;
 
     bool awaitingMarkSet = false;
@@ -171,44 +196,14 @@ struct VimState {
         visualReplacePending = false;
     }
 
-    void recordLastOp(OperationType type, int count, char motion = 0, char searchChar = 0) {
+    void recordLastOp(OperationType type, int count, char motion = 0, char32_t searchChar = 0) {
         lastOp.type = type;
         lastOp.count = count;
         lastOp.motion = motion;
         lastOp.searchChar = searchChar;
     }
 
-    void recordJump(long position, int lineNumber) {
-        if (!jumpList.empty()) {
-            auto& last = jumpList.back();
-            if (abs(last.position - position) < 5 && last.lineNumber == lineNumber) {
-                return;
-            }
-        }
-
-        JumpPosition jump;
-        jump.position = position;
-        jump.lineNumber = lineNumber;
-
-        if (jumpList.size() >= 100) {
-            jumpList.erase(jumpList.begin());
-        }
-
-        jumpList.push_back(jump);
-        jumpIndex = (int)jumpList.size() - 1;
-    }
-
-    int getJumpStackSize() const {
-        return (int)jumpList.size();
-    }
-
-    JumpPosition getLastJump() {
-        if (jumpList.size() < 2) {
-            return JumpPosition();
-        }
-
-        return jumpList[jumpList.size() - 2];
-    }
+    void recordJump(long position, int lineNumber);
 };
 
 void showConfigDialog();
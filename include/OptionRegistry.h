@@ -3,6 +3,7 @@
 #include <unordered_map>
 #include <functional>
 #include <variant>
+#include <utility>
 #include <vector>
 
 enum class OptionType {
@@ -11,8 +12,40 @@ enum class OptionType {
     String
 };
 
+// Every option has a fixed slot; name lookups are only needed when parsing
+// :set and the rc file.
+enum class OptionId {
+    Number,
+    RelativeNumber,
+    HlSearch,
+    IgnoreCase,
+    SmartCase,
+    Clipboard,
+    ExpandTab,
+    TabStop,
+    ShiftWidth,
+    Wrap,
+    CursorLine,
+    List,
+    ScrollOff,
+    JumpListSize,
+    ChangeListSize,
+    KeyLayout,
+    NormalLayout,
+    InsertLayout,
+    Langmap,
+    TextWidth,
+    History,
+    Shell,
+    IsKeyword,
+    NrFormats,
+    OptimalBreak,
+    Count
+};
+
 using OptionValue = std::variant<bool, int, std::string>;
 using OptionSetter = std::function<void(const OptionValue&)>;
+using OptionAssignment = std::pair<OptionId, OptionValue>;
 
 struct OptionInfo {
     std::string name;
@@ -27,18 +60,86 @@ class OptionRegistry {
 public:
     static OptionRegistry& getInstance();
 
-    void registerOption(const std::string& name, OptionType type, OptionValue defaultValue, OptionSetter setter = nullptr, const std::string& desc = "");
-    
+    void registerOption(OptionId id, const std::string& name, OptionType type, OptionValue defaultValue, OptionSetter setter = nullptr, const std::string& desc = "");
+
     bool setOption(const std::string& name, const OptionValue& value);
+    bool setOption(OptionId id, const OptionValue& value);
     bool setOptionFromString(const std::string& line); // parses "set nu", "set nonu", "set clipboard=unnamed"
-    
+    // The assignments a :set line makes, already converted to each option's
+    // type; false if any of them names no option or has a bad value.
+    bool parseAssignments(const std::string& line, std::vector<OptionAssignment>& out) const;
+    // Options take the assigned values, the rest their defaults; setters only
+    // run for options whose value actually changes.
+    void applyConfiguration(const std::vector<OptionAssignment>& assignments);
+
     void resetToDefaults();
 
     OptionValue getOption(const std::string& name) const;
-    
+    // Values are stored as the option's declared type, so this never throws
+    // for a registered option read with the matching handle.
+    template <typename T>
+    const T& get(OptionId id) const { return std::get<T>(options[(size_t)id].value); }
+    const OptionValue& value(OptionId id) const { return options[(size_t)id].value; }
+
     std::vector<OptionInfo> getAllOptions() const;
 
+    // Inside a batch, setters run once per changed option when the
+    // outermost batch ends, with the final value.
+    void beginBatch();
+    void endBatch();
+
 private:
-    OptionRegistry() = default;
-    std::unordered_map<std::string, OptionInfo> options;
+    OptionRegistry();
+
+    bool convert(OptionType type, const OptionValue& in, OptionValue& out) const;
+    void applySetter(size_t index);
+
+    std::vector<OptionInfo> options;
+    std::vector<bool> registered;
+    std::vector<bool> pending;
+    std::unordered_map<std::string, size_t> byName;
+    int batchDepth = 0;
+};
+
+template <typename T>
+struct OptionHandle {
+    OptionId id;
+    const T& get() const { return OptionRegistry::getInstance().get<T>(id); }
+};
+
+namespace Options {
+    constexpr OptionHandle<bool> number{ OptionId::Number };
+    constexpr OptionHandle<bool> relativenumber{ OptionId::RelativeNumber };
+    constexpr OptionHandle<bool> hlsearch{ OptionId::HlSearch };
+    constexpr OptionHandle<bool> ignorecase{ OptionId::IgnoreCase };
+    constexpr OptionHandle<bool> smartcase{ OptionId::SmartCase };
+    constexpr OptionHandle<std::string> clipboard{ OptionId::Clipboard };
+    constexpr OptionHandle<bool> expandtab{ OptionId::ExpandTab };
+    constexpr OptionHandle<int> tabstop{ OptionId::TabStop };
+    constexpr OptionHandle<int> shiftwidth{ OptionId::ShiftWidth };
+    constexpr OptionHandle<bool> wrap{ OptionId::Wrap };
+    constexpr OptionHandle<bool> cursorline{ OptionId::CursorLine };
+    constexpr OptionHandle<bool> list{ OptionId::List };
+    constexpr OptionHandle<int> scrolloff{ OptionId::ScrollOff };
+    constexpr OptionHandle<int> jumplistsize{ OptionId::JumpListSize };
+    constexpr OptionHandle<int> changelistsize{ OptionId::ChangeListSize };
+    constexpr OptionHandle<bool> keylayout{ OptionId::KeyLayout };
+    constexpr OptionHandle<std::string> normallayout{ OptionId::NormalLayout };
+    constexpr OptionHandle<std::string> insertlayout{ OptionId::InsertLayout };
+    constexpr OptionHandle<std::string> langmap{ OptionId::Langmap };
+    constexpr OptionHandle<int> textwidth{ OptionId::TextWidth };
+    constexpr OptionHandle<int> history{ OptionId::History };
+    constexpr OptionHandle<std::string> shell{ OptionId::Shell };
+    constexpr OptionHandle<std::string> iskeyword{ OptionId::IsKeyword };
+    constexpr OptionHandle<std::string> nrformats{ OptionId::NrFormats };
+    constexpr OptionHandle<bool> optimalbreak{ OptionId::OptimalBreak };
+}
+
+// Defers option setters for the lifetime of the object.
+class OptionBatch {
+public:
+    OptionBatch() { OptionRegistry::getInstance().beginBatch(); }
+    ~OptionBatch() { OptionRegistry::getInstance().endBatch(); }
+    OptionBatch(const OptionBatch&) = delete;
+    OptionBatch& operator=(const OptionBatch&) = delete;
 };
@@ -0,0 +1,23 @@
+#pragma once
+#include <windows.h>
+#include <string>
+#include "Registers.h"
+
+// p and P. The text for every copy of a count is built first and goes into
+// the document with one edit, so 10000p is one change and one undo action.
+class Paste {
+public:
+    enum Shape { CHARWISE, LINEWISE, BLOCKWISE };
+
+    // The text of reg. "+ and "* share the text this plugin last put on the
+    // clipboard while it is still there instead of reading it back.
+    static RegisterText source(char reg);
+
+    // count copies of text.
+    static std::string repeat(const std::string& text, int count);
+
+    // Puts count copies of reg after or before the caret. Returns false,
+    // changing nothing, when the register is empty.
+    static bool put(HWND hwnd, char reg, int count, Shape shape, bool after);
+    static void put(HWND hwnd, const std::string& text, int count, Shape shape, bool after);
+};
@@ -0,0 +1,79 @@
+#pragma once
+#include <windows.h>
+#include <algorithm>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+struct JumpPosition {
+    long position = -1;
+    int lineNumber = -1;
+    int handle = -1;        // MarkTracker handle following the text
+    void* doc = nullptr;    // document the entry was recorded in
+    bool live = false;
+};
+
+// Fixed-capacity history of positions with Vim's jumplist/changelist
+// navigation. Entries are addressed by a running sequence number, so pushing
+// and evicting never move the others. An older entry on the same line of the
+// same document is found through a hash and removed, and the newer entries
+// close the gap so it does not keep taking up capacity.
+class PositionRing {
+public:
+    // Jumps travel across documents; changes are only visited in their own.
+    PositionRing(size_t capacity, bool currentDocumentOnly);
+
+    void setCapacity(size_t capacity);
+    size_t capacity() const { return slots.size(); }
+    size_t size() const;
+    void clear();
+
+    // New newest entry; navigation restarts from the end.
+    void push(HWND hwnd, long position, int line);
+    // Changelist flavour: a change on the newest entry's line moves that
+    // entry instead of adding another.
+    void note(HWND hwnd, long position, int line);
+
+    // Ctrl-O / g; step back count entries; from the end the current
+    // position is pushed first so stepping forward returns to it.
+    bool back(HWND hwnd, long currentPos, int currentLine, int count, long& target);
+    // Ctrl-I / g, step forward count entries.
+    bool forward(HWND hwnd, int count, long& target);
+
+    // Newest entry, for `` and ''.
+    const JumpPosition* newest(HWND hwnd) const;
+    // Where an entry's text is now; the recorded position if it belongs to
+    // another document.
+    long target(HWND hwnd, const JumpPosition& entry) const;
+
+    // "position line" per entry, oldest first; restored entries no longer
+    // follow edits and belong to no particular document.
+    std::string serialize(HWND hwnd) const;
+    void deserialize(const std::string& data);
+
+private:
+    struct LineKey {
+        void* doc;
+        int line;
+        bool operator==(const LineKey& other) const { return doc == other.doc && line == other.line; }
+    };
+    struct LineKeyHash {
+        size_t operator()(const LineKey& key) const {
+            return std::hash<void*>()(key.doc) * 31 + std::hash<int>()(key.line);
+        }
+    };
+
+    std::vector<JumpPosition> slots;
+    unsigned long long nextSeq = 0;    // sequence number of the next push
+    unsigned long long cursor = 0;     // == nextSeq when not navigating
+    std::unordered_map<LineKey, unsigned long long, LineKeyHash> lineSeq;
+    bool currentDocumentOnly;
+
+    unsigned long long oldest() const { return nextSeq - (std::min)((unsigned long long)slots.size(), nextSeq); }
+    JumpPosition& at(unsigned long long seq) { return slots[seq % slots.size()]; }
+    const JumpPosition& at(unsigned long long seq) const { return slots[seq % slots.size()]; }
+    bool visible(HWND hwnd, const JumpPosition& entry) const;
+    void retire(JumpPosition& entry);
+    void compact(unsigned long long gap);
+    void add(HWND hwnd, long position, int line);
+};
@@ -0,0 +1,35 @@
+#pragma once
+#include <functional>
+#include <string>
+#include <string_view>
+
+enum class ProcessResult {
+    Finished,
+    Failed,      // the shell could not be started
+    Cancelled
+};
+
+// Runs a command through the shell, feeding input to its stdin while its
+// stdout and stderr are collected, so a command that writes before it has
+// read everything never deadlocks against us. The input is streamed from
+// the caller's buffer; only the output is held in memory.
+//
+// Bytes pass through unconverted both ways. Input goes out in the document's
+// encoding, and on Windows console tools usually answer in the OEM code
+// page; converting the output is up to the caller.
+class Process {
+public:
+    // Called every PROGRESS_MS or so with the bytes written and read so far;
+    // returning false kills the command and everything it started.
+    using Progress = std::function<bool(size_t written, size_t read)>;
+
+    static ProcessResult filter(const std::string& shell, const std::string& command, std::string_view input,
+        std::string& output, int& exitCode, const Progress& progress = nullptr);
+
+    // COMSPEC on Windows, /bin/sh elsewhere.
+    static std::string defaultShell();
+
+private:
+    static constexpr unsigned PROGRESS_MS = 100;
+    static constexpr size_t CHUNK = 64 * 1024;
+};
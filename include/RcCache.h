@@ -0,0 +1,60 @@
+#pragma once
+#include <string>
+#include <vector>
+#include "OptionRegistry.h"
+
+enum class RcEntryKind : unsigned char {
+    Option,
+    Map,
+    Unmap,
+    Command,
+    Colon
+};
+
+// One effect of an rc line, with everything that does not depend on the
+// editor already worked out.
+struct RcEntry {
+    RcEntryKind kind = RcEntryKind::Colon;
+    char mode = 0;              // mappings: 0 for all modes, or 'n', 'i', 'v'
+    bool recursive = false;
+    OptionId option = OptionId::Count;
+    OptionValue value;
+    std::string from;           // as written: mapping lhs, command alias or colon line
+    std::string to;
+    std::string keysFrom;       // key notation translated
+    std::string keysTo;
+};
+
+struct RcSource {
+    std::string path;
+    unsigned long long writeTime = 0;
+    unsigned long long size = 0;
+    unsigned long long hash = 0;
+    bool exists = false;
+};
+
+// The rc file and everything it sources, reduced to entries in execution order.
+struct CompiledRc {
+    std::vector<RcSource> sources;
+    std::vector<RcEntry> entries;
+};
+
+// Binary copy of a CompiledRc. It is only trusted while every source file
+// still has the recorded timestamp and size, or failing that the recorded
+// content hash.
+class RcCache {
+public:
+    // restamp is set when a source was touched without being changed, so the
+    // cache is worth rewriting with the new timestamps.
+    static bool read(const std::string& cachePath, const std::string& rcPath, CompiledRc& rc, bool& restamp);
+    static bool write(const std::string& cachePath, const CompiledRc& rc);
+
+    // Records path's current state; content is the text just read from it.
+    static RcSource describe(const std::string& path, const std::string* content);
+
+    static unsigned long long hash(const std::string& data);
+
+private:
+    static bool fileInfo(const std::string& path, unsigned long long& writeTime, unsigned long long& size);
+    static bool fresh(RcSource& source, bool& restamp);
+};
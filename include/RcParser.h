@@ -2,6 +2,7 @@
 #include <string>
 #include <vector>
 #include <windows.h>
+#include "RcCache.h"
 
 class RcParser {
 public:
@@ -10,15 +11,30 @@ public:
     bool parseFile(const std::string& path, HWND hwndEdit = nullptr);
     bool executeLine(const std::string& line, HWND hwndEdit = nullptr);
 
+    // Brings the editor in line with the rc file. The compiled form comes from
+    // the cache while the sources are unchanged, and only the options,
+    // mappings and commands that differ from the last load are touched, in
+    // the order the file gives them.
+    bool loadRc(const std::string& path, HWND hwndEdit = nullptr);
+
 private:
     RcParser() = default;
-    
+
     std::string trim(const std::string& s);
     bool isComment(const std::string& line);
-    
-    void handleSet(const std::string& args);
-    void handleMapping(const std::string& cmd, const std::string& args);
-    void handleUnmapping(const std::string& cmd, const std::string& args);
-    void handleSource(const std::string& path, HWND hwndEdit);
-    void handleCommandDefinition(const std::string& args);
+
+    bool compileFile(const std::string& path, CompiledRc& rc, int depth);
+    void compileLine(const std::string& line, CompiledRc& rc, int depth);
+
+    void handleSet(const std::string& args, CompiledRc& rc);
+    void handleMapping(const std::string& cmd, const std::string& args, CompiledRc& rc);
+    void handleUnmapping(const std::string& cmd, const std::string& args, CompiledRc& rc);
+    void handleSource(const std::string& path, CompiledRc& rc, int depth);
+    void handleCommandDefinition(const std::string& args, CompiledRc& rc);
+
+    bool apply(const RcEntry& entry, HWND hwndEdit);
+    void applyChanges(const CompiledRc& next, HWND hwndEdit);
+
+    // What the last loadRc put in effect.
+    CompiledRc loaded;
 };
@@ -0,0 +1,33 @@
+#pragma once
+#include <windows.h>
+#include <string>
+
+// gq and gw. Whole lines are fetched once, split into paragraphs and
+// refilled, and the result is written back with one replace.
+//
+// A paragraph is a run of lines with the same prefix: indent plus an
+// optional comment leader (//, ///, //!, #, ;, --, %, > or * inside a
+// /* block). Blank and prefix-only lines separate paragraphs and are kept,
+// as are fenced code, rules and the lines opening or closing a block
+// comment. A list item ("- ", "* ", "+ ", "1. ", "1) ") starts a paragraph
+// and takes the more indented lines after it; its continuation lines are
+// indented past the marker.
+class Reflow {
+public:
+    struct Settings {
+        int width;
+        int tabWidth;
+        bool optimal;       // minimum raggedness instead of first fit
+        bool utf8;          // widths count characters, not bytes
+        std::string eol;
+    };
+
+    // text is whole lines. When cursor is given it is an offset in text and
+    // is moved to the same character of the same word in the result.
+    static std::string format(const std::string& text, const Settings& settings, size_t* cursor = nullptr);
+
+    // Formats lines firstLine to lastLine of the document. With keepPos, as
+    // gw does, the caret stays on the text that was at keepPos; otherwise,
+    // as gq does, it ends on the first non-blank of the last line formatted.
+    static void apply(HWND hwnd, int firstLine, int lastLine, int keepPos = -1);
+};
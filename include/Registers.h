@@ -0,0 +1,48 @@
+#pragma once
+#include <array>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Immutable, shareable register text. Copying a RegisterText only bumps a refcount.
+using RegisterText = std::shared_ptr<const std::string>;
+
+class RegisterStore {
+public:
+    static RegisterStore& getInstance();
+
+    void set(char reg, std::string text);
+    void set(char reg, const RegisterText& text);
+    void append(char reg, const std::string& text);
+
+    // Returns the register as a single contiguous block (null if empty).
+    // Appended registers are collapsed once and the result is kept.
+    RegisterText get(char reg);
+    std::string_view view(char reg);
+
+    bool empty(char reg) const;
+    size_t size(char reg) const;
+
+    // Shift "1.."9 down by one and store text in "1 without copying any strings.
+    void shiftNumbered(const RegisterText& text);
+
+    void clear();
+
+private:
+    RegisterStore() = default;
+
+    struct Slot {
+        std::vector<RegisterText> chunks;
+        size_t length = 0;
+    };
+
+    static constexpr int NUMBERED_COUNT = 9;
+
+    Slot& slotFor(char reg);
+    const Slot& slotFor(char reg) const;
+
+    std::array<Slot, 256> slots;
+    std::array<Slot, NUMBERED_COUNT> numbered;
+    int numberedHead = 0;
+};
@@ -0,0 +1,66 @@
+#pragma once
+#include <windows.h>
+#include <map>
+#include <string>
+
+// Collects status text, caret style, line number margin and mark marker
+// updates while an input event is handled and applies each once when the
+// outermost batch ends. Outside a batch requests apply immediately. Either
+// way an update that would change nothing is skipped and counted.
+class UiUpdates {
+public:
+    static UiUpdates& getInstance();
+
+    struct Counters {
+        unsigned long statusSent = 0;
+        unsigned long statusSuppressed = 0;
+        unsigned long caretSent = 0;
+        unsigned long caretSuppressed = 0;
+        unsigned long marginRuns = 0;
+        unsigned long marginSuppressed = 0;
+        unsigned long markerRuns = 0;
+        unsigned long markerSuppressed = 0;
+    };
+
+    void begin();
+    void end();
+    // Apply what is pending now, even inside a batch; for when the handler
+    // is about to wait for input.
+    void flushNow() { flush(); }
+
+    void setStatus(const TCHAR* msg);
+    void setCaretStyle(HWND hwnd, int style);
+    void requestMargin(HWND hwnd, bool force = false);
+    void requestMarkers(HWND hwnd);
+
+    // Notepad++ wrote the status field itself (e.g. on buffer activation).
+    void statusOverwritten() { statusKnown = false; }
+
+    const Counters& counters() const { return stats; }
+
+private:
+    UiUpdates() = default;
+    void flush();
+
+    int depth = 0;
+
+    std::basic_string<TCHAR> pendingStatus;
+    std::basic_string<TCHAR> shownStatus;
+    bool statusDirty = false;
+    bool statusKnown = false;
+
+    std::map<HWND, int> pendingCaret;
+    std::map<HWND, bool> pendingMargin;   // value: forced
+    std::map<HWND, bool> pendingMarkers;
+
+    Counters stats;
+};
+
+// Batches UI updates for the lifetime of the object.
+class UiBatch {
+public:
+    UiBatch() { UiUpdates::getInstance().begin(); }
+    ~UiBatch() { UiUpdates::getInstance().end(); }
+    UiBatch(const UiBatch&) = delete;
+    UiBatch& operator=(const UiBatch&) = delete;
+};
@@ -0,0 +1,57 @@
+#pragma once
+#include <cstddef>
+#include <string>
+#include "CharClass.h"
+
+enum class CaseChange { Upper, Lower, Toggle, Rot13 };
+
+// UTF-8 decoding plus compact case and class tables. Everything has an
+// ASCII path that touches no table, so text without multi-byte characters
+// costs little more than a byte loop. Malformed bytes decode one at a time
+// as themselves and are never changed.
+class Utf8 {
+public:
+    // Bytes in the sequence a lead byte starts; 1 for ASCII, continuation and
+    // invalid bytes.
+    static size_t sequenceLength(unsigned char lead) {
+        if (lead < 0xC2) return 1;
+        if (lead < 0xE0) return 2;
+        if (lead < 0xF0) return 3;
+        return lead < 0xF5 ? 4 : 1;
+    }
+
+    static bool isContinuation(unsigned char c) { return (c & 0xC0) == 0x80; }
+
+    // The code point at text[0]; used is its length in bytes. A malformed
+    // sequence gives its first byte with used = 1.
+    static char32_t decode(const char* text, size_t n, size_t& used) {
+        unsigned char c = (unsigned char)text[0];
+        used = 1;
+        if (c < 0x80) return c;
+        return decodeMultiByte(text, n, used);
+    }
+
+    // Writes the one to four bytes of cp; returns how many.
+    static size_t encodeTo(char32_t cp, char out[4]);
+    static void append(std::string& out, char32_t cp);
+    static std::string encode(char32_t cp);
+
+    static char32_t toUpper(char32_t cp);
+    static char32_t toLower(char32_t cp);
+
+    // Vim's classes for characters beyond ASCII: spaces, punctuation and
+    // symbols, CJK and emoji each separate from letters.
+    static CharClass classOf(char32_t cp);
+
+    // Bytes before the first one above 0x7F, eight at a time.
+    static size_t asciiPrefix(const char* text, size_t n);
+    static bool isAscii(const char* text, size_t n);
+
+    // Changes every letter in place; false if none changed. ASCII runs go
+    // through an SSE2 kernel. With utf8 false only ASCII letters change, for
+    // documents in a code page; rot13 is ASCII only, as in Vim.
+    static bool changeCase(std::string& text, CaseChange change, bool utf8);
+
+private:
+    static char32_t decodeMultiByte(const char* text, size_t n, size_t& used);
+};
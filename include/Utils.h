@@ -4,6 +4,8 @@
 #include <windows.h>
 #include <string>
 #include <utility>
+#include "Registers.h"
+#include "Utf8.h"
 
 struct VimState;
 
@@ -20,6 +22,7 @@ class Utils {
 public:
     static HWND getCurrentScintillaHandle();
     static void setStatus(const TCHAR* msg);
+    static void setCaretStyle(HWND hwnd, int style);
     static void clearSearchHighlights(HWND hwndEdit);
     static std::pair<int, int> findWordBounds(HWND hwndEdit, int pos);
     static std::pair<int, int> findWordBoundsEx(HWND hwndEdit, int pos, bool bigWord);
@@ -33,11 +36,12 @@ public:
 
     static void handleIndent(HWND hwndEdit, int count);
     static void handleUnindent(HWND hwndEdit, int count);
-    static void handleAutoIndent(HWND hwndEdit, int count);
+    static void appendIndent(std::string& out, int columns, bool useTabs, int tabWidth);
 
     static int caretPos(HWND hwnd);
     static int caretColumn(HWND hwnd);
     static int caretLine(HWND hwnd);
+    static int lineFromPosition(HWND hwnd, int pos);
     static int lineStart(HWND hwnd, int line);
     static int lineEnd(HWND hwnd, int line);
     static int lineCount(HWND hwnd);
@@ -55,25 +59,31 @@ public:
 
     static void toUpper(HWND hwnd, int start, int end);
     static void toLower(HWND hwnd, int start, int end);
+    static void toggleCase(HWND hwnd, int start, int end);
+    static void changeCase(HWND hwnd, int start, int end, CaseChange change);
+    static void changeCaseBlock(HWND hwnd, const BlockSelection& blk, CaseChange change);
 
-    static void replaceChar(HWND hwnd, int pos, char ch);
-    static void replaceRange(HWND hwnd, int start, int end, char ch);
+    static size_t charLength(const std::string& text, size_t i, int codePage);
+    static void replaceChar(HWND hwnd, int pos, char32_t ch);
+    static void replaceRange(HWND hwnd, int start, int end, char32_t ch);
 
     static BlockSelection blockSelection(HWND hwnd);
 
     static void setBlockSelection(HWND hwnd, int anchor, int caret);
     static void clearBlockSelection(HWND hwnd);
 
-    static void forEachBlockCell(HWND hwnd, const BlockSelection& blk, void (*fn)(HWND, int));
-
     static void pasteAfter(HWND hwnd, int count, bool linewise);
     static void pasteBefore(HWND hwnd, int count, bool linewise);
 
     static void joinLines(HWND hwnd, int startLine, int count, bool withSpace);
 
-    static void charSearch(HWND hwnd, VimState& state, char type, char ch, int count);
+    static std::string eolString(HWND hwnd);
+    static void replaceTarget(HWND hwnd, int start, int end, const std::string& text);
+
+    static void charSearch(HWND hwnd, VimState& state, char type, char32_t ch, int count);
 
     static void setClipboardText(const std::string& text);
+    static std::string getClipboardText();
 
     static std::string buildTutorText();
     static std::string getPluginPath();
@@ -81,6 +91,7 @@ public:
     static int getCharBlocking();
 
     static std::string getRegisterContent(char reg);
+    static RegisterText getRegisterText(char reg);
     static void setRegisterContent(char reg, const std::string &content);
     static void appendToRegister(char reg, const std::string &content);
     static bool isValidRegister(char c);
@@ -89,6 +100,7 @@ public:
     static void storeRegister(char reg, const std::string& text, bool syncClipboard = true);
 
     static std::string toUtf8(wchar_t wch);
+    static std::string documentChar(HWND hwnd, char32_t cp);
     static std::string toUtf8(const std::wstring& wstr);
     static std::string trim(const std::string& s);
     static std::string translateKeyNotation(const std::string& input);
@@ -3,6 +3,7 @@
 #include "NppVim.h"
 #include "Keymap.h"
 #include "Motion.h"
+#include "Utf8.h"
 #include <windows.h>
 
 class VisualMode {
@@ -14,6 +15,7 @@ public:
     void enterBlock(HWND hwnd);
     void exitToNormal(HWND hwnd);
     void handleKey(HWND hwnd, char c);
+    void handleCharArgument(HWND hwnd, char32_t c);
     void visualMoveCursor(HWND hwndEdit, int newPos);
     
 private:
@@ -22,16 +24,21 @@ private:
     
     void setupKeyMaps();
     
-    void handleCharSearchInput(HWND hwnd, char searchChar, char searchType, int count);
+    void handleCharSearchInput(HWND hwnd, char32_t searchChar, char searchType, int count);
     
     std::string getSelectedText(HWND h);
-    void updateBlockAfterMove(HWND h, int newCaret);
-    void handleBlockWordRight(HWND hwnd, bool bigWord);
-    void handleBlockWordLeft(HWND hwnd, bool bigWord);
-    void handleBlockWordEnd(HWND hwnd, bool bigWord);
+    void updateBlockAfterMove(HWND h, int newCaret, bool vertical = false);
+    void handleBlockWordRight(HWND hwnd, bool bigWord, int count);
+    void handleBlockWordLeft(HWND hwnd, bool bigWord, int count);
+    void handleBlockWordEnd(HWND hwnd, bool bigWord, int count);
 
     void extendSelection(HWND hwndEdit, int newPos);
-    void handleVisualReplaceInput(HWND hwnd, char replaceChar);
+    void handleVisualReplaceInput(HWND hwnd, char32_t replaceChar);
+    void changeSelectionCase(HWND h, CaseChange change);
+    void changeSelectionNumbers(HWND h, long long delta, bool progressive);
+    void selectionLines(HWND h, int& startLine, int& endLine);
+    void formatSelection(HWND h, bool keepCursor);
+    void startBlockInsert(HWND h, char op);
     void saveVisualSelection(HWND h);
 };
 
@@ -0,0 +1,200 @@
+#include "../include/BlockEdit.h"
+#include "../include/NppVim.h"
+#include "../include/Utils.h"
+#include "../plugin/Scintilla.h"
+#include <algorithm>
+
+BlockEdit::BlockEdit(HWND hwnd, int startLine, int endLine, int startCol, int endCol, bool toLineEnd)
+    : hwnd(hwnd),
+      first(Utils::lineStart(hwnd, startLine)),
+      last(Utils::lineEnd(hwnd, endLine)),
+      startCol(startCol),
+      endCol(toLineEnd ? COLUMN_LINE_END : endCol),
+      toLineEnd(toLineEnd),
+      codePage((int)::SendMessage(hwnd, SCI_GETCODEPAGE, 0, 0)),
+      tabWidth((std::max)((int)::SendMessage(hwnd, SCI_GETTABWIDTH, 0, 0), 1)) {
+    text = Utils::getTextRange(hwnd, first, last);
+    lines.reserve(endLine - startLine + 1);
+
+    size_t start = 0;
+    for (int line = startLine; line <= endLine; line++) {
+        size_t end = (std::min)(text.find_first_of("\r\n", start), text.size());
+        Cut left = cutAt(start, 0, end, this->startCol);
+        Cut right = cutAt(left.pos, left.col, end, this->endCol);
+        lines.push_back({ end, left, right });
+
+        start = end;
+        if (start < text.size() && text[start] == '\r') start++;
+        if (start < text.size() && text[start] == '\n') start++;
+    }
+}
+
+BlockEdit::Cut BlockEdit::cutAt(size_t pos, int col, size_t end, int target) const {
+    while (pos < end && col < target) {
+        if (text[pos] == '\t') {
+            int next = (col / tabWidth + 1) * tabWidth;
+            if (next > target) return { pos, col, target - col, next - target };
+            col = next;
+            pos++;
+        } else {
+            pos = (std::min)(pos + Utils::charLength(text, pos, codePage), end);
+            col++;
+        }
+    }
+    return { pos, col, 0, 0 };
+}
+
+bool BlockEdit::reaches(size_t index) const {
+    return index < lines.size() && lines[index].left.pos < lines[index].end;
+}
+
+int BlockEdit::insert(const std::string& text, const std::vector<bool>* only) {
+    return apply(OP_INSERT, text, only);
+}
+
+int BlockEdit::append(const std::string& text, const std::vector<bool>* only) {
+    return apply(OP_APPEND, text, only);
+}
+
+int BlockEdit::change(const std::string& text) {
+    return apply(OP_CHANGE, text, nullptr);
+}
+
+void BlockEdit::fill(const std::string& ch) {
+    apply(OP_FILL, ch, nullptr);
+}
+
+int BlockEdit::apply(Op op, const std::string& piece, const std::vector<bool>* only) {
+    std::string out;
+    out.reserve(text.size() + lines.size() * (piece.size() + 2));
+    std::string mid;
+    size_t copied = 0;
+    int firstPos = first;
+    bool changed = false;
+
+    for (size_t i = 0; i < lines.size(); i++) {
+        const Line& line = lines[i];
+        Cut lo = line.left;
+        Cut hi = line.right;
+        int pad = 0;
+        if (op == OP_INSERT) {
+            hi = lo;
+        } else if (op == OP_APPEND) {
+            lo = hi;
+            if (!toLineEnd && hi.before == 0 && hi.col < endCol) pad = endCol - hi.col;
+        }
+
+        bool wanted = only ? (i < only->size() && (*only)[i]) : (op == OP_APPEND || reaches(i));
+        if (!wanted) {
+            if (i == 0) firstPos = first + (int)lo.pos;
+            continue;
+        }
+
+        mid.assign(lo.before + pad, ' ');
+        size_t textAt = mid.size();
+        if (op == OP_FILL) {
+            int width = (hi.before ? endCol : hi.col) - startCol;
+            for (int k = 0; k < width; k++) mid += piece;
+        } else {
+            mid += piece;
+        }
+        mid.append(hi.after, ' ');
+
+        size_t to = hi.pos + (hi.before ? 1 : 0);
+        if (i == 0) firstPos = first + (int)(lo.pos + textAt);
+        if (text.compare(lo.pos, to - lo.pos, mid) == 0) continue;
+
+        out.append(text, copied, lo.pos - copied);
+        out += mid;
+        copied = to;
+        changed = true;
+    }
+
+    if (changed) {
+        out.append(text, copied, std::string::npos);
+        ::SendMessage(hwnd, SCI_SETTARGETRANGE, first, last);
+        ::SendMessage(hwnd, SCI_REPLACETARGETMINIMAL, out.size(), (LPARAM)out.data());
+    }
+    return firstPos;
+}
+
+int BlockEdit::put(const std::vector<std::string>& pieces, const std::string& eol) {
+    size_t added = 0;
+    for (const std::string& piece : pieces) added += piece.size() + startCol + eol.size();
+
+    std::string out;
+    out.reserve(text.size() + added);
+    size_t copied = 0;
+    int firstPos = first;
+
+    for (size_t i = 0; i < pieces.size(); i++) {
+        if (i < lines.size()) {
+            const Line& line = lines[i];
+            Cut at = line.left;
+            int pad = (at.before == 0 && at.col < startCol) ? startCol - at.col : 0;
+            out.append(text, copied, at.pos - copied);
+            out.append(at.before + pad, ' ');
+            if (i == 0) firstPos = first + (int)out.size();
+            out += pieces[i];
+            out.append(at.after, ' ');
+            copied = at.pos + (at.before ? 1 : 0);
+        } else {
+            // The block ran past the last line
+            if (copied < text.size()) {
+                out.append(text, copied, std::string::npos);
+                copied = text.size();
+            }
+            out += eol;
+            out.append(startCol, ' ');
+            out += pieces[i];
+        }
+    }
+
+    out.append(text, copied, std::string::npos);
+    ::SendMessage(hwnd, SCI_SETTARGETRANGE, first, last);
+    ::SendMessage(hwnd, SCI_REPLACETARGETMINIMAL, out.size(), (LPARAM)out.data());
+    return firstPos;
+}
+
+int BlockEdit::beginInsert(HWND hwnd, BlockInsert& pending, char op, const BlockSelection& blk, bool toLineEnd) {
+    BlockEdit block(hwnd, blk.startLine, blk.endLine, blk.startCol, blk.endCol, toLineEnd);
+
+    pending = BlockInsert();
+    pending.op = op;
+    pending.startLine = blk.startLine;
+    pending.endLine = blk.endLine;
+    pending.startCol = blk.startCol;
+    pending.endCol = blk.endCol;
+    pending.toLineEnd = toLineEnd;
+    for (size_t i = 1; i < block.lines.size(); i++) pending.reaches.push_back(block.reaches(i));
+
+    std::vector<bool> firstOnly(block.lines.size(), false);
+    firstOnly[0] = true;
+    int pos;
+    if (op == 'c') pos = block.change("");
+    else if (op == 'A') pos = block.append("", &firstOnly);
+    else pos = block.insert("", &firstOnly);
+
+    pending.insertPos = pos;
+    pending.lineLength = Utils::lineEnd(hwnd, blk.startLine) - Utils::lineStart(hwnd, blk.startLine);
+    pending.lineCount = Utils::lineCount(hwnd);
+    return pos;
+}
+
+// Like Vim, nothing is copied when the insert left the first line or
+// broke it.
+void BlockEdit::finishInsert(HWND hwnd, BlockInsert& pending) {
+    BlockInsert p = std::move(pending);
+    pending = BlockInsert();
+    if (!p.op || p.endLine <= p.startLine) return;
+    if (Utils::lineCount(hwnd) != p.lineCount || Utils::caretLine(hwnd) != p.startLine) return;
+
+    int lineEnd = Utils::lineEnd(hwnd, p.startLine);
+    int grown = lineEnd - Utils::lineStart(hwnd, p.startLine) - p.lineLength;
+    if (grown <= 0 || p.insertPos + grown > lineEnd) return;
+
+    std::string typed = Utils::getTextRange(hwnd, p.insertPos, p.insertPos + grown);
+    BlockEdit rest(hwnd, p.startLine + 1, p.endLine, p.startCol, p.endCol, p.toLineEnd);
+    if (p.op == 'A') rest.append(typed);
+    else rest.insert(typed, &p.reaches);
+}
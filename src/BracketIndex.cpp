@@ -0,0 +1,311 @@
+#include "../include/BracketIndex.h"
+#include "../plugin/Scintilla.h"
+#include "../include/Utils.h"
+#include <algorithm>
+#include <climits>
+#include <cstdlib>
+
+static const char OPEN_CHARS[] = "([{<";
+static const char CLOSE_CHARS[] = ")]}>";
+
+BracketIndex& BracketIndex::getInstance() {
+    static BracketIndex instance;
+    return instance;
+}
+
+int BracketIndex::kindOf(char ch, bool& isOpen) {
+    for (int k = 0; k < KIND_COUNT; k++) {
+        if (ch == OPEN_CHARS[k]) { isOpen = true; return k; }
+        if (ch == CLOSE_CHARS[k]) { isOpen = false; return k; }
+    }
+    return -1;
+}
+
+BracketIndex::DocIndex& BracketIndex::sync(HWND hwnd) {
+    void* doc = (void*)::SendMessage(hwnd, SCI_GETDOCPOINTER, 0, 0);
+
+    auto it = docs.find(doc);
+    if (it == docs.end()) {
+        if (docs.size() >= MAX_DOCUMENTS) {
+            auto oldest = std::min_element(docs.begin(), docs.end(),
+                [](const auto& a, const auto& b) { return a.second.lastUse < b.second.lastUse; });
+            docs.erase(oldest);
+        }
+        it = docs.emplace(doc, DocIndex()).first;
+    }
+
+    DocIndex& index = it->second;
+    index.lastUse = ++useCounter;
+
+    // Edits made while the document was out of every view never passed
+    // through notifyModified, and a changed length only catches some.
+    void*& shown = viewDocs[hwnd];
+    if (shown != doc) {
+        shown = doc;
+        index.dirty = true;
+    }
+
+    int length = Utils::sci(hwnd, SCI_GETLENGTH);
+    if (index.dirty || index.length != length) rebuild(hwnd, index);
+    return index;
+}
+
+void BracketIndex::forget(void* doc) {
+    docs.erase(doc);
+    for (auto it = viewDocs.begin(); it != viewDocs.end();) {
+        if (it->second == doc) it = viewDocs.erase(it);
+        else ++it;
+    }
+}
+
+void BracketIndex::rebuild(HWND hwnd, DocIndex& index) {
+    int length = Utils::sci(hwnd, SCI_GETLENGTH);
+    const char* text = (const char*)::SendMessage(hwnd, SCI_GETCHARACTERPOINTER, 0, 0);
+
+    std::array<std::vector<int>, KIND_COUNT> stacks;
+    for (auto& pairs : index.kinds) {
+        pairs.byOpen.clear();
+        pairs.parent.clear();
+        pairs.byClose.clear();
+    }
+
+    for (int pos = 0; text && pos < length; pos++) {
+        bool isOpen;
+        int k = kindOf(text[pos], isOpen);
+        if (k < 0) continue;
+
+        Pairs& pairs = index.kinds[k];
+        std::vector<int>& stack = stacks[k];
+        if (isOpen) {
+            pairs.parent.push_back(stack.empty() ? -1 : stack.back());
+            stack.push_back((int)pairs.byOpen.size());
+            pairs.byOpen.push_back({ pos, -1 });
+        } else if (!stack.empty()) {
+            int i = stack.back();
+            stack.pop_back();
+            pairs.byOpen[i].close = pos;
+            pairs.byClose.push_back(i);
+        }
+    }
+
+    // Drop unclosed openers. Everything still on a stack is an ancestor of
+    // whatever it encloses, so their children simply become top level.
+    for (auto& pairs : index.kinds) {
+        std::vector<int> remap(pairs.byOpen.size(), -1);
+        size_t kept = 0;
+        for (size_t i = 0; i < pairs.byOpen.size(); i++) {
+            if (pairs.byOpen[i].close < 0) continue;
+            int parent = pairs.parent[i];
+            remap[i] = (int)kept;
+            pairs.byOpen[kept] = pairs.byOpen[i];
+            pairs.parent[kept] = (parent >= 0) ? remap[parent] : -1;
+            kept++;
+        }
+        pairs.byOpen.resize(kept);
+        pairs.parent.resize(kept);
+        for (int& i : pairs.byClose) i = remap[i];
+    }
+
+    index.length = length;
+    index.dirty = false;
+    index.shiftBudget = (std::max)(length, 65536);
+}
+
+bool BracketIndex::shift(DocIndex& index, Pairs& pairs, int pos, int delta) {
+    size_t first = std::lower_bound(pairs.byOpen.begin(), pairs.byOpen.end(), pos,
+        [](const BracketPair& p, int v) { return p.open < v; }) - pairs.byOpen.begin();
+
+    // Past this point a fresh scan is cheaper than moving every pair again.
+    long long moved = (long long)(pairs.byOpen.size() - first);
+    if (moved > index.shiftBudget) return false;
+    index.shiftBudget -= moved;
+
+    for (size_t i = first; i < pairs.byOpen.size(); i++) {
+        pairs.byOpen[i].open += delta;
+        pairs.byOpen[i].close += delta;
+    }
+    // Pairs opening before pos but closing after it all enclose the
+    // pair just before pos, so they are on its parent chain.
+    for (int i = (int)first - 1; i >= 0; i = pairs.parent[i]) {
+        if (pairs.byOpen[i].close >= pos) pairs.byOpen[i].close += delta;
+    }
+    return true;
+}
+
+template <typename T>
+static void replaceRange(std::vector<T>& v, size_t first, size_t last, const std::vector<T>& with) {
+    v.erase(v.begin() + first, v.begin() + last);
+    v.insert(v.begin() + first, with.begin(), with.end());
+}
+
+// The old pairs in from..to are replaced by a scan of the same span after
+// the edit. The span is the innermost pair around the edit, or the edit
+// itself when there is none. Brackets outside it keep their partners as
+// long as the scan pairs up every bracket inside.
+bool BracketIndex::repair(HWND hwnd, DocIndex& index, int kind, int pos, int end, int delta) {
+    Pairs& pairs = index.kinds[kind];
+    auto openAtOrAfter = [&pairs](int v) {
+        return (size_t)(std::lower_bound(pairs.byOpen.begin(), pairs.byOpen.end(), v,
+            [](const BracketPair& p, int x) { return p.open < x; }) - pairs.byOpen.begin());
+    };
+    auto closeAtOrAfter = [&pairs](int v) {
+        return (size_t)(std::lower_bound(pairs.byClose.begin(), pairs.byClose.end(), v,
+            [&pairs](int i, int x) { return pairs.byOpen[i].close < x; }) - pairs.byClose.begin());
+    };
+
+    int outer = around(pairs, pos, end);
+    int parent = (outer >= 0) ? pairs.parent[outer] : -1;
+    int from = (outer >= 0) ? pairs.byOpen[outer].open : pos;
+    int to = (outer >= 0) ? pairs.byOpen[outer].close + 1 : end;
+
+    size_t first = openAtOrAfter(from);
+    size_t last = openAtOrAfter(to);
+    size_t firstClose = closeAtOrAfter(from);
+    size_t lastClose = closeAtOrAfter(to);
+    // A deleted bracket whose partner is outside the span
+    if (lastClose - firstClose != last - first) return false;
+    for (size_t i = first; i < last; i++) {
+        if (pairs.byOpen[i].close >= to) return false;
+    }
+
+    long long cost = (long long)(pairs.byOpen.size() - last) + (to + delta - from);
+    if (cost > index.shiftBudget) return false;
+    index.shiftBudget -= cost;
+
+    const char* text = (const char*)::SendMessage(hwnd, SCI_GETCHARACTERPOINTER, 0, 0);
+    if (!text) return false;
+
+    std::vector<BracketPair> found;
+    std::vector<int> foundParent;
+    std::vector<int> foundByClose;
+    std::vector<int> stack;
+    for (int p = from; p < to + delta; p++) {
+        if (text[p] == OPEN_CHARS[kind]) {
+            foundParent.push_back(stack.empty() ? parent : (int)first + stack.back());
+            stack.push_back((int)found.size());
+            found.push_back({ p, -1 });
+        } else if (text[p] == CLOSE_CHARS[kind]) {
+            if (stack.empty()) return false;
+            found[stack.back()].close = p;
+            foundByClose.push_back((int)first + stack.back());
+            stack.pop_back();
+        }
+    }
+    if (!stack.empty()) return false;
+
+    int added = (int)found.size() - (int)(last - first);
+    for (int a = parent; a >= 0; a = pairs.parent[a]) {
+        pairs.byOpen[a].close += delta;
+    }
+    for (size_t i = last; i < pairs.byOpen.size(); i++) {
+        pairs.byOpen[i].open += delta;
+        pairs.byOpen[i].close += delta;
+        if (pairs.parent[i] >= (int)last) pairs.parent[i] += added;
+    }
+    for (size_t i = lastClose; i < pairs.byClose.size(); i++) {
+        if (pairs.byClose[i] >= (int)last) pairs.byClose[i] += added;
+    }
+
+    replaceRange(pairs.byOpen, first, last, found);
+    replaceRange(pairs.parent, first, last, foundParent);
+    replaceRange(pairs.byClose, firstClose, lastClose, foundByClose);
+    return true;
+}
+
+void BracketIndex::notifyModified(HWND hwnd, bool inserted, int pos, int length, const char* text) {
+    void* doc = (void*)::SendMessage(hwnd, SCI_GETDOCPOINTER, 0, 0);
+    auto it = docs.find(doc);
+    if (it == docs.end()) return;
+
+    DocIndex& index = it->second;
+    if (index.dirty) return;
+
+    if (!text) {
+        index.dirty = true;
+        return;
+    }
+    std::array<bool, KIND_COUNT> touched = {};
+    for (int i = 0; i < length; i++) {
+        bool isOpen;
+        int k = kindOf(text[i], isOpen);
+        if (k >= 0) touched[k] = true;
+    }
+
+    int delta = inserted ? length : -length;
+    int end = inserted ? pos : pos + length;
+    for (int k = 0; k < KIND_COUNT; k++) {
+        bool kept = touched[k] ? repair(hwnd, index, k, pos, end, delta) : shift(index, index.kinds[k], pos, delta);
+        if (!kept) {
+            index.dirty = true;
+            return;
+        }
+    }
+    index.length += delta;
+}
+
+int BracketIndex::innermost(const Pairs& pairs, int pos) {
+    auto it = std::upper_bound(pairs.byOpen.begin(), pairs.byOpen.end(), pos,
+        [](int v, const BracketPair& p) { return v < p.open; });
+    int i = (int)(it - pairs.byOpen.begin()) - 1;
+    while (i >= 0 && pairs.byOpen[i].close < pos) i = pairs.parent[i];
+    return i;
+}
+
+// The innermost pair with start..end between its brackets.
+int BracketIndex::around(const Pairs& pairs, int start, int end) {
+    int i = innermost(pairs, start);
+    while (i >= 0 && (pairs.byOpen[i].open >= start || pairs.byOpen[i].close < end)) i = pairs.parent[i];
+    return i;
+}
+
+BracketPair BracketIndex::enclosing(HWND hwnd, int pos, char openChar) {
+    bool isOpen;
+    int k = kindOf(openChar, isOpen);
+    if (k < 0) return {};
+
+    const Pairs& pairs = sync(hwnd).kinds[k];
+    int i = innermost(pairs, pos);
+    return (i >= 0) ? pairs.byOpen[i] : BracketPair();
+}
+
+BracketPair BracketIndex::nearestOnLine(HWND hwnd, int pos, char openChar) {
+    bool isOpen;
+    int k = kindOf(openChar, isOpen);
+    if (k < 0) return {};
+
+    const Pairs& pairs = sync(hwnd).kinds[k];
+    int line = Utils::lineFromPosition(hwnd, pos);
+    int lineStart = Utils::lineStart(hwnd, line);
+    int lineEnd = Utils::lineEnd(hwnd, line);
+
+    auto it = std::lower_bound(pairs.byOpen.begin(), pairs.byOpen.end(), lineStart,
+        [](const BracketPair& p, int v) { return p.open < v; });
+
+    BracketPair best;
+    int minDistance = INT_MAX;
+    for (; it != pairs.byOpen.end() && it->open <= lineEnd; ++it) {
+        int distance = (std::min)(abs(pos - it->open), abs(pos - it->close));
+        if (distance < minDistance) {
+            minDistance = distance;
+            best = *it;
+        }
+    }
+    return best;
+}
+
+int BracketIndex::match(HWND hwnd, int pos) {
+    bool isOpen;
+    int k = kindOf((char)Utils::sci(hwnd, SCI_GETCHARAT, pos), isOpen);
+    if (k < 0) return -1;
+
+    const Pairs& pairs = sync(hwnd).kinds[k];
+    if (isOpen) {
+        auto it = std::lower_bound(pairs.byOpen.begin(), pairs.byOpen.end(), pos,
+            [](const BracketPair& p, int v) { return p.open < v; });
+        return (it != pairs.byOpen.end() && it->open == pos) ? it->close : -1;
+    }
+
+    auto it = std::lower_bound(pairs.byClose.begin(), pairs.byClose.end(), pos,
+        [&pairs](int i, int v) { return pairs.byOpen[i].close < v; });
+    return (it != pairs.byClose.end() && pairs.byOpen[*it].close == pos) ? pairs.byOpen[*it].open : -1;
+}
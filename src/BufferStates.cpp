@@ -0,0 +1,91 @@
+#include "../include/BufferStates.h"
+#include "../include/MarkTracker.h"
+
+BufferStates& BufferStates::getInstance() {
+    static BufferStates instance;
+    return instance;
+}
+
+void BufferStates::release(BufferState& buffer) {
+    for (auto& mark : buffer.localMarks) MarkTracker::getInstance().forget(mark.second.handle);
+    buffer.localMarks.clear();
+    buffer.changeList.clear();
+}
+
+BufferState BufferStates::fresh() const {
+    BufferState buffer;
+    buffer.changeList.setCapacity(changeListCapacity);
+    return buffer;
+}
+
+bool BufferStates::unpark(UINT_PTR bufferId, BufferState& into) {
+    auto it = parked.find(bufferId);
+    if (it == parked.end()) return false;
+    into = std::move(it->second.state);
+    recent.erase(it->second.order);
+    parked.erase(it);
+    return true;
+}
+
+void BufferStates::activate(UINT_PTR bufferId, VimState& state) {
+    BufferState& current = state;
+
+    // The first buffer simply adopts whatever was gathered before it. After
+    // the active buffer was closed the next one brings back its own state.
+    if (!hasActive) {
+        unpark(bufferId, current);
+        active = bufferId;
+        hasActive = true;
+        state.resetPending();
+        return;
+    }
+    if (bufferId == active) return;
+
+    // Anything still parked for the active buffer is older than what it has now
+    auto stale = parked.find(active);
+    if (stale != parked.end()) {
+        release(stale->second.state);
+        recent.erase(stale->second.order);
+        parked.erase(stale);
+    }
+
+    if (parked.size() >= MAX_BUFFERS) {
+        auto oldest = parked.find(recent.back());
+        release(oldest->second.state);
+        parked.erase(oldest);
+        recent.pop_back();
+    }
+    recent.push_front(active);
+    Entry& entry = parked[active];
+    entry.state = std::move(current);
+    entry.order = recent.begin();
+
+    if (!unpark(bufferId, current)) current = fresh();
+
+    active = bufferId;
+    state.resetPending();
+}
+
+void BufferStates::close(UINT_PTR bufferId, VimState& state) {
+    // Notepad++ may report the active buffer closed before activating the
+    // next one; that buffer's parked state is picked up by activate().
+    if (hasActive && bufferId == active) {
+        BufferState& current = state;
+        release(current);
+        current = fresh();
+        hasActive = false;
+        return;
+    }
+
+    auto it = parked.find(bufferId);
+    if (it == parked.end()) return;
+    release(it->second.state);
+    recent.erase(it->second.order);
+    parked.erase(it);
+}
+
+void BufferStates::setChangeListCapacity(size_t capacity, VimState& state) {
+    changeListCapacity = capacity;
+    state.changeList.setCapacity(capacity);
+    for (auto& entry : parked) entry.second.state.changeList.setCapacity(capacity);
+}
@@ -0,0 +1,320 @@
+#include "../include/CharClass.h"
+#include "../include/OptionRegistry.h"
+#include "../include/Utf8.h"
+#include "../plugin/Scintilla.h"
+#include <algorithm>
+#include <cstring>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__SSE2__)
+#include <emmintrin.h>
+#define NPPVIM_SSE2 1
+#endif
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+static int lowestBit(uint64_t v) {
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_ARM64))
+    unsigned long i;
+    _BitScanForward64(&i, v);
+    return (int)i;
+#elif defined(_MSC_VER)
+    unsigned long i;
+    if (_BitScanForward(&i, (unsigned long)v)) return (int)i;
+    _BitScanForward(&i, (unsigned long)(v >> 32));
+    return (int)i + 32;
+#else
+    return __builtin_ctzll(v);
+#endif
+}
+
+static int highestBit(uint64_t v) {
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_ARM64))
+    unsigned long i;
+    _BitScanReverse64(&i, v);
+    return (int)i;
+#elif defined(_MSC_VER)
+    unsigned long i;
+    if (_BitScanReverse(&i, (unsigned long)(v >> 32))) return (int)i + 32;
+    _BitScanReverse(&i, (unsigned long)v);
+    return (int)i;
+#else
+    return 63 - __builtin_clzll(v);
+#endif
+}
+
+static uint64_t lowBits(size_t n) {
+    return n >= 64 ? ~0ULL : (1ULL << n) - 1;
+}
+
+CharClasses::CharClasses(HWND hwnd) {
+    for (int c = 0; c < 256; c++) {
+        if (c == '\r' || c == '\n') table[c] = CC_NEWLINE;
+        else if (c <= ' ' || c == 0x7f) table[c] = CC_SPACE;
+        else table[c] = CC_PUNCT;
+    }
+
+    const std::string& spec = Options::iskeyword.get();
+    bool word[256];
+    if (!spec.empty() && parseKeywordSpec(spec, word)) {
+        for (int c = 0; c < 256; c++) {
+            if (word[c]) table[c] = CC_WORD;
+        }
+    } else {
+        int len = (int)::SendMessage(hwnd, SCI_GETWORDCHARS, 0, 0);
+        std::string chars(len, '\0');
+        if (len > 0) ::SendMessage(hwnd, SCI_GETWORDCHARS, 0, (LPARAM)&chars[0]);
+        for (unsigned char c : chars) table[c] = CC_WORD;
+    }
+
+    utf8 = ::SendMessage(hwnd, SCI_GETCODEPAGE, 0, 0) == SC_CP_UTF8;
+    buildRanges();
+}
+
+void CharClasses::buildRanges() {
+    rangeCount = 0;
+    int c = 0;
+    while (c < 256) {
+        int end = c;
+        while (end + 1 < 256 && table[end + 1] == table[c]) end++;
+        if (table[c] != CC_PUNCT) {
+            if (rangeCount == MAX_RANGES) {
+                rangeCount = 0;
+                break;
+            }
+            ranges[rangeCount++] = { (unsigned char)c, (unsigned char)(end - c), table[c] };
+        }
+        c = end + 1;
+    }
+#ifdef NPPVIM_SSE2
+    vectorized = rangeCount > 0;
+#endif
+}
+
+uint64_t CharClasses::classifyScalar(const char* text, size_t n, uint64_t masks[CC_COUNT]) const {
+    for (int k = 0; k < CC_COUNT; k++) masks[k] = 0;
+    uint64_t high = 0;
+    for (size_t i = 0; i < n; i++) {
+        unsigned char c = (unsigned char)text[i];
+        masks[table[c]] |= 1ULL << i;
+        if (c >= 0x80) high |= 1ULL << i;
+    }
+    return high;
+}
+
+uint64_t CharClasses::classify(const char* text, size_t n, uint64_t masks[CC_COUNT]) const {
+    if (!vectorized) return classifyScalar(text, n, masks);
+
+    uint64_t high = 0;
+#ifdef NPPVIM_SSE2
+    for (int k = 0; k < CC_COUNT; k++) masks[k] = 0;
+
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m128i bytes = _mm_loadu_si128((const __m128i*)(text + i));
+        __m128i hits[CC_PUNCT] = { _mm_setzero_si128(), _mm_setzero_si128(), _mm_setzero_si128() };
+        for (int r = 0; r < rangeCount; r++) {
+            // b is in [low, low + span] exactly when (unsigned)(b - low) <= span
+            __m128i offset = _mm_sub_epi8(bytes, _mm_set1_epi8((char)ranges[r].low));
+            __m128i clamped = _mm_min_epu8(offset, _mm_set1_epi8((char)ranges[r].span));
+            hits[ranges[r].cls] = _mm_or_si128(hits[ranges[r].cls], _mm_cmpeq_epi8(clamped, offset));
+        }
+        for (int k = 0; k < CC_PUNCT; k++) {
+            masks[k] |= (uint64_t)(unsigned)_mm_movemask_epi8(hits[k]) << i;
+        }
+        high |= (uint64_t)(unsigned)_mm_movemask_epi8(bytes) << i;
+    }
+    for (; i < n; i++) {
+        unsigned char c = (unsigned char)text[i];
+        masks[table[c]] |= 1ULL << i;
+        if (c >= 0x80) high |= 1ULL << i;
+    }
+
+    masks[CC_PUNCT] = ~(masks[CC_SPACE] | masks[CC_NEWLINE] | masks[CC_WORD]) & lowBits(n);
+#endif
+    return high;
+}
+
+static bool parseBound(const std::string& part, size_t& i, int& value) {
+    if (i >= part.size()) return false;
+    if (part[i] >= '0' && part[i] <= '9') {
+        value = 0;
+        while (i < part.size() && part[i] >= '0' && part[i] <= '9') {
+            value = value * 10 + (part[i++] - '0');
+            if (value > 255) return false;
+        }
+        return true;
+    }
+    value = (unsigned char)part[i++];
+    return true;
+}
+
+bool CharClasses::parseKeywordSpec(const std::string& spec, bool word[256]) {
+    for (int c = 0; c < 256; c++) word[c] = c >= 0x80;
+
+    size_t pos = 0;
+    while (pos < spec.size()) {
+        size_t comma = spec.find(',', pos);
+        if (comma == std::string::npos) comma = spec.size();
+        std::string part = spec.substr(pos, comma - pos);
+        pos = comma + 1;
+        if (part.empty()) continue;
+
+        bool include = true;
+        if (part.size() > 1 && part[0] == '^') {
+            include = false;
+            part.erase(0, 1);
+        }
+
+        if (part == "@") {
+            for (int c = 'a'; c <= 'z'; c++) word[c] = word[c - 'a' + 'A'] = include;
+            continue;
+        }
+
+        int low, high;
+        if (part == "@-@") {
+            low = high = '@';
+        } else {
+            size_t i = 0;
+            if (!parseBound(part, i, low)) return false;
+            high = low;
+            if (i < part.size()) {
+                if (part[i] != '-') return false;
+                i++;
+                if (!parseBound(part, i, high)) return false;
+            }
+            if (i != part.size() || high < low) return false;
+        }
+        for (int c = low; c <= high; c++) word[c] = include;
+    }
+    return true;
+}
+
+ClassScanner::ClassScanner(HWND hwnd, const CharClasses& classes)
+    : hwnd(hwnd),
+      classes(classes),
+      docLength((int)::SendMessage(hwnd, SCI_GETLENGTH, 0, 0)),
+      gap((int)::SendMessage(hwnd, SCI_GETGAPPOSITION, 0, 0)) {}
+
+void ClassScanner::loadWindow(int pos) {
+    int start = pos - pos % WINDOW;
+    int end = (std::min)(start + WINDOW, docLength);
+    // A range across the gap would make Scintilla move the gap to it
+    if (start < gap && gap < end) {
+        if (pos < gap) end = gap;
+        else start = gap;
+    }
+    windowText = (const char*)::SendMessage(hwnd, SCI_GETRANGEPOINTER, start, end - start);
+    windowStart = start;
+    windowEnd = windowText ? end : start;
+}
+
+void ClassScanner::loadBlock(int pos) {
+    int start = pos - pos % BLOCK;
+    if (start == blockStart) return;
+
+    int n = (std::min)(BLOCK, docLength - start);
+    if (start < windowStart || start >= windowEnd) loadWindow(start);
+    if (start + n <= windowEnd) {
+        blockText = windowText + (start - windowStart);
+    } else {
+        // The block runs past the window, at the gap or a window edge
+        std::memset(copy, 0, sizeof(copy));
+        for (int p = start; p < start + n;) {
+            if (p < windowStart || p >= windowEnd) loadWindow(p);
+            if (windowEnd <= p) break;
+            int k = (std::min)(start + n, windowEnd) - p;
+            std::memcpy(copy + (p - start), windowText + (p - windowStart), k);
+            p += k;
+        }
+        blockText = copy;
+    }
+    blockStart = start;
+    uint64_t high = classes.classify(blockText, n, masks);
+    if (high && classes.isUtf8()) classifyMultiByte(high, n);
+}
+
+// Gives each byte of a multi-byte character the class of the character,
+// including the bytes of one that starts or ends in a neighbouring block.
+// Malformed bytes keep their byte class.
+void ClassScanner::classifyMultiByte(uint64_t high, int n) {
+    auto byteAt = [&](int pos) -> unsigned char {
+        if (pos >= blockStart && pos < blockStart + n) return (unsigned char)blockText[pos - blockStart];
+        if (pos < 0 || pos >= docLength) return 0;
+        if (pos >= windowStart && pos < windowEnd) return (unsigned char)windowText[pos - windowStart];
+        return (unsigned char)::SendMessage(hwnd, SCI_GETCHARAT, pos, 0);
+    };
+
+    while (high) {
+        int i = lowestBit(high);
+        int lead = blockStart + i;
+        size_t used = 1;
+        char32_t cp;
+        if (i + 4 <= n && !Utf8::isContinuation((unsigned char)blockText[i])) {
+            cp = Utf8::decode(blockText + i, 4, used);
+        } else {
+            while (lead > blockStart + i - 3 && Utf8::isContinuation(byteAt(lead))) lead--;
+            char bytes[4];
+            int avail = 0;
+            while (avail < 4 && lead + avail < docLength) {
+                bytes[avail] = (char)byteAt(lead + avail);
+                avail++;
+            }
+            cp = Utf8::decode(bytes, (size_t)avail, used);
+        }
+
+        int end = (std::min)(lead + (int)used, blockStart + n) - blockStart;
+        if (used > 1 && end > i) {
+            uint64_t bits = lowBits((size_t)end) & ~lowBits((size_t)i);
+            for (int k = 0; k < CC_COUNT; k++) masks[k] &= ~bits;
+            masks[Utf8::classOf(cp)] |= bits;
+        } else {
+            end = i + 1;
+        }
+        high &= ~lowBits((size_t)end);
+    }
+}
+
+uint64_t ClassScanner::select(unsigned classSet) const {
+    uint64_t bits = 0;
+    for (int k = 0; k < CC_COUNT; k++) {
+        if (classSet & (1u << k)) bits |= masks[k];
+    }
+    return bits;
+}
+
+CharClass ClassScanner::at(int pos) {
+    if (pos < 0 || pos >= docLength) return CC_NEWLINE;
+    loadBlock(pos);
+    uint64_t bit = 1ULL << (pos - blockStart);
+    for (int k = 0; k < CC_COUNT; k++) {
+        if (masks[k] & bit) return (CharClass)k;
+    }
+    return CC_PUNCT;
+}
+
+int ClassScanner::skipForward(int pos, unsigned classSet, int limit) {
+    limit = (std::min)(limit, docLength);
+    while (pos < limit) {
+        loadBlock(pos);
+        // Bits past the document end are clear in every mask, so a run
+        // always stops there.
+        uint64_t stop = ~select(classSet) >> (pos - blockStart);
+        if (stop) return (std::min)(pos + lowestBit(stop), limit);
+        pos = blockStart + BLOCK;
+    }
+    return (std::min)(pos, limit);
+}
+
+int ClassScanner::skipBackward(int pos, unsigned classSet, int limit) {
+    limit = (std::max)(limit, 0);
+    pos = (std::min)(pos, docLength);
+    while (pos > limit) {
+        loadBlock(pos - 1);
+        uint64_t stop = ~select(classSet) & lowBits((size_t)(pos - blockStart));
+        if (stop) return (std::max)(blockStart + highestBit(stop) + 1, limit);
+        pos = blockStart;
+    }
+    return (std::max)(pos, limit);
+}
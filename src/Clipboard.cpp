@@ -0,0 +1,172 @@
+#include "../include/Clipboard.h"
+#include <cstring>
+
+#ifdef _WIN32
+class Win32ClipboardBackend : public ClipboardBackend {
+public:
+    explicit Win32ClipboardBackend(HWND owner) : owner(owner) {}
+
+    bool claim() override {
+        // Delayed rendering needs an owner window to receive WM_RENDERFORMAT
+        if (!owner || !OpenClipboard(owner)) return false;
+        EmptyClipboard();
+        SetClipboardData(CF_TEXT, nullptr);
+        CloseClipboard();
+        return true;
+    }
+
+    void render(const std::string& text) override {
+        HGLOBAL h = alloc(text);
+        if (h && !SetClipboardData(CF_TEXT, h)) GlobalFree(h);
+    }
+
+    void write(const std::string& text) override {
+        if (!OpenClipboard(owner)) return;
+        EmptyClipboard();
+        HGLOBAL h = alloc(text);
+        if (h && !SetClipboardData(CF_TEXT, h)) GlobalFree(h);
+        CloseClipboard();
+    }
+
+    std::string read() override {
+        std::string text;
+        if (!OpenClipboard(owner)) return text;
+        HANDLE hData = GetClipboardData(CF_TEXT);
+        if (hData) {
+            char* pszText = (char*)GlobalLock(hData);
+            if (pszText) {
+                text = pszText;
+                GlobalUnlock(hData);
+            }
+        }
+        CloseClipboard();
+        return text;
+    }
+
+private:
+    static HGLOBAL alloc(const std::string& text) {
+        HGLOBAL h = GlobalAlloc(GMEM_MOVEABLE, text.size() + 1);
+        if (!h) return nullptr;
+        char* p = (char*)GlobalLock(h);
+        memcpy(p, text.c_str(), text.size() + 1);
+        GlobalUnlock(h);
+        return h;
+    }
+
+    HWND owner;
+};
+#endif
+
+Clipboard& Clipboard::getInstance() {
+    static Clipboard instance;
+    return instance;
+}
+
+Clipboard::Clipboard() {
+#ifdef _WIN32
+    backend = std::make_unique<Win32ClipboardBackend>(nullptr);
+#else
+    backend = std::make_unique<MemoryClipboardBackend>();
+#endif
+}
+
+void Clipboard::setOwner(HWND hwnd) {
+    flush();
+    owner = hwnd;
+#ifdef _WIN32
+    backend = std::make_unique<Win32ClipboardBackend>(hwnd);
+#endif
+    current = nullptr;
+}
+
+void Clipboard::setBackend(std::unique_ptr<ClipboardBackend> newBackend) {
+    flush();
+    backend = std::move(newBackend);
+    claimed = false;
+    current = nullptr;
+}
+
+void Clipboard::setDeferred(const RegisterText& text) {
+    if (!text) return;
+    if (!claimed) {
+        // Claiming empties the clipboard, which notifies us as the previous owner
+        publishing = true;
+        claimed = backend->claim();
+        publishing = false;
+    }
+    pending = text;
+    current = text;
+}
+
+void Clipboard::setText(const std::string& text) {
+    write(std::make_shared<const std::string>(text));
+}
+
+void Clipboard::write(const RegisterText& text) {
+    pending = nullptr;
+    claimed = false;
+    publishing = true;
+    backend->write(*text);
+    publishing = false;
+#ifdef _WIN32
+    // Without an owner window nothing tells us when another application
+    // replaces the text
+    current = owner ? text : nullptr;
+#else
+    current = text;
+#endif
+}
+
+std::string Clipboard::getText() {
+    // Text we put there, handed out or not, is still the clipboard contents
+    if (current) return *current;
+    return backend->read();
+}
+
+RegisterText Clipboard::getShared() {
+    if (current) return current;
+    std::string text = backend->read();
+    if (text.empty()) return nullptr;
+    return std::make_shared<const std::string>(std::move(text));
+}
+
+void Clipboard::flush() {
+    if (!pending) return;
+    RegisterText text = pending;
+    write(text);
+}
+
+bool Clipboard::handleMessage(HWND hwnd, UINT msg, WPARAM wParam) {
+#ifdef _WIN32
+    if (hwnd != owner) return false;
+
+    switch (msg) {
+    case WM_RENDERFORMAT:
+        if (wParam != CF_TEXT || !pending) return false;
+        backend->render(*pending);
+        pending = nullptr;
+        claimed = false;
+        return true;
+    case WM_RENDERALLFORMATS:
+        if (!pending) return false;
+        if (OpenClipboard(owner)) {
+            if (GetClipboardOwner() == owner) backend->render(*pending);
+            CloseClipboard();
+        }
+        pending = nullptr;
+        claimed = false;
+        return true;
+    case WM_DESTROYCLIPBOARD:
+        if (publishing) return false;
+        // Another application took the clipboard; our text is stale
+        pending = nullptr;
+        current = nullptr;
+        claimed = false;
+        return false;
+    case WM_ACTIVATEAPP:
+        if (!wParam) flush();
+        return false;
+    }
+#endif
+    return false;
+}
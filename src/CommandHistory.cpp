@@ -0,0 +1,118 @@
+#include "../include/CommandHistory.h"
+#include <algorithm>
+
+HistoryRing::HistoryRing(size_t capacity)
+    : capacity((std::max)(capacity, (size_t)1)),
+      trie(1) {}
+
+void HistoryRing::setCapacity(size_t lines) {
+    capacity = (std::max)(lines, (size_t)1);
+    while (live.size() > capacity) retire(live.find(*bySeq.begin()->second));
+    rebuild();
+}
+
+const std::string* HistoryRing::find(unsigned long long seq) const {
+    auto it = bySeq.find(seq);
+    return it == bySeq.end() ? nullptr : it->second;
+}
+
+int HistoryRing::descend(std::string_view prefix) const {
+    int node = 0;
+    size_t depth = (std::min)(prefix.size(), MAX_DEPTH);
+    for (size_t i = 0; i < depth; i++) {
+        const auto& children = trie[node].children;
+        auto it = std::lower_bound(children.begin(), children.end(), prefix[i],
+            [](const std::pair<char, int>& child, char key) { return child.first < key; });
+        if (it == children.end() || it->first != prefix[i]) return -1;
+        node = it->second;
+    }
+    return node;
+}
+
+void HistoryRing::index(const std::string& line, unsigned long long seq) {
+    int node = 0;
+    trie[0].seqs.push_back(seq);
+    size_t depth = (std::min)(line.size(), MAX_DEPTH);
+    for (size_t i = 0; i < depth; i++) {
+        auto& children = trie[node].children;
+        auto it = std::lower_bound(children.begin(), children.end(), line[i],
+            [](const std::pair<char, int>& child, char key) { return child.first < key; });
+        if (it == children.end() || it->first != line[i]) {
+            int child = (int)trie.size();
+            children.insert(it, { line[i], child });
+            trie.emplace_back();
+            node = child;
+        } else {
+            node = it->second;
+        }
+        trie[node].seqs.push_back(seq);
+    }
+    liveRefs += depth + 1;
+}
+
+void HistoryRing::retire(std::unordered_map<std::string, unsigned long long>::iterator entry) {
+    size_t refs = (std::min)(entry->first.size(), MAX_DEPTH) + 1;
+    liveRefs -= refs;
+    staleRefs += refs;
+    bySeq.erase(entry->second);
+    live.erase(entry);
+}
+
+void HistoryRing::rebuild() {
+    trie.assign(1, Node());
+    staleRefs = 0;
+    liveRefs = 0;
+    for (const auto& entry : bySeq) index(*entry.second, entry.first);
+}
+
+void HistoryRing::add(const std::string& line) {
+    if (line.empty()) return;
+
+    auto existing = live.find(line);
+    if (existing != live.end()) retire(existing);
+    else if (live.size() >= capacity) retire(live.find(*bySeq.begin()->second));
+
+    unsigned long long seq = nextSeq++;
+    auto entry = live.emplace(line, seq).first;
+    bySeq.emplace(seq, &entry->first);
+    index(line, seq);
+
+    // Retired numbers are skipped while searching; drop them once they
+    // outnumber the live ones.
+    if (staleRefs > liveRefs + 1024) rebuild();
+}
+
+bool HistoryRing::older(std::string_view prefix, unsigned long long& cursor, std::string& out) const {
+    int node = descend(prefix);
+    if (node < 0) return false;
+
+    const auto& seqs = trie[node].seqs;
+    auto it = std::lower_bound(seqs.begin(), seqs.end(), cursor);
+    while (it != seqs.begin()) {
+        --it;
+        const std::string* line = find(*it);
+        if (!line) continue;
+        if (prefix.size() > MAX_DEPTH && line->compare(0, prefix.size(), prefix) != 0) continue;
+        cursor = *it;
+        out = *line;
+        return true;
+    }
+    return false;
+}
+
+bool HistoryRing::newer(std::string_view prefix, unsigned long long& cursor, std::string& out) const {
+    int node = descend(prefix);
+    if (node >= 0) {
+        const auto& seqs = trie[node].seqs;
+        for (auto it = std::upper_bound(seqs.begin(), seqs.end(), cursor); it != seqs.end(); ++it) {
+            const std::string* line = find(*it);
+            if (!line) continue;
+            if (prefix.size() > MAX_DEPTH && line->compare(0, prefix.size(), prefix) != 0) continue;
+            cursor = *it;
+            out = *line;
+            return true;
+        }
+    }
+    cursor = end();
+    return false;
+}
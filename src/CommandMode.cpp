@@ -6,6 +6,12 @@
 #include "../include/Keymap.h"
 #include "../include/NppVim.h"
 #include "../include/Marks.h"
+#include "../include/MarkTracker.h"
+#include "../include/CommandRegistry.h"
+#include "../include/Process.h"
+#include "../include/UiUpdates.h"
+#include "../include/Utf8.h"
+#include "../include/OptionRegistry.h"
 #include "../plugin/Scintilla.h"
 #include "../plugin/Notepad_plus_msgs.h"
 #include "../plugin/PluginInterface.h"
@@ -20,25 +26,20 @@ extern NormalMode *g_normalMode;
 extern NppData nppData;
 extern HINSTANCE g_hInstance;
 
-static std::unordered_map<std::string, std::string> g_userCommands;
-
 void CommandMode::addUserCommand(const std::string& alias, const std::string& target) {
-    g_userCommands[alias] = target;
+    CommandRegistry::getInstance().addUser(alias, target);
 }
 
-void CommandMode::clearUserCommands() {
-    g_userCommands.clear();
+void CommandMode::removeUserCommand(const std::string& alias) {
+    CommandRegistry::getInstance().removeUser(alias);
 }
 
-std::string CommandMode::resolveUserCommand(const std::string& alias) {
-    auto it = g_userCommands.find(alias);
-    if (it != g_userCommands.end()) {
-        return it->second;
-    }
-    return alias;
+void CommandMode::clearUserCommands() {
+    CommandRegistry::getInstance().clearUser();
 }
 
 static void appendNonKeymapHelp(std::string& help);
+static std::string currentFileDirectory();
 
 auto toggleSplit = [](HWND, int) {
     HWND npp = nppData._nppHandle;
@@ -54,10 +55,11 @@ auto toggleSplit = [](HWND, int) {
     }
 };
 
-void CommandMode::enter(char prompt) {
+void CommandMode::enter(char prompt, const std::string& text) {
   state.commandMode = true;
   state.commandBuffer.clear();
   state.commandBuffer.push_back(prompt);
+  state.commandBuffer += text;
 
   if (g_config.enableKeyboardLayoutSwitching) {
     HWND focusWnd = ::GetFocus();
@@ -79,6 +81,12 @@ void CommandMode::enter(char prompt) {
       initSubstitutionIndicators(h);
   }
 
+  endLineEditing();
+  if (prompt == ':') {
+    // Most file names typed here are next to the current file
+    DirectoryCache::getInstance().prefetch(currentFileDirectory());
+  }
+
   updateStatus();
 }
 
@@ -123,9 +131,194 @@ void CommandMode::updateStatus() {
     display += matchInfo;
   }
 
+  if (completing) {
+    display += L"  (" + std::to_wstring(completionIndex + 1) + L" of " + std::to_wstring(completionCount) + L")";
+  }
+
   Utils::setStatus(display.c_str());
 }
 
+void CommandMode::endLineEditing() {
+  recalling = false;
+  completing = false;
+  completions.clear();
+  completionListing.reset();
+}
+
+// Status, incremental search highlight and substitution preview follow the
+// command line after every edit.
+void CommandMode::bufferChanged(HWND hwndEdit) {
+  updateStatus();
+
+  if (state.commandBuffer[0] == '/' && state.commandBuffer.size() > 1) {
+    std::string currentSearch = state.commandBuffer.substr(1);
+    Utils::updateSearchHighlight(hwndEdit, currentSearch, false);
+  } else if (state.commandBuffer[0] == '?' && state.commandBuffer.size() > 1) {
+    std::string currentPattern = state.commandBuffer.substr(1);
+    Utils::updateSearchHighlight(hwndEdit, currentPattern, true);
+  } else if (state.commandBuffer.size() == 1) {
+    Utils::clearSearchHighlights(hwndEdit);
+    state.lastSearchMatchCount = -1;
+  }
+
+  previewSubstitutionFromBuffer(hwndEdit);
+}
+
+void CommandMode::setHistoryCapacity(int lines) {
+  size_t capacity = (size_t)(std::min)((std::max)(lines, 1), 10000);
+  colonHistory.setCapacity(capacity);
+  searchHistory.setCapacity(capacity);
+}
+
+void CommandMode::recallHistory(HWND hwndEdit, bool older) {
+  if (!hwndEdit || state.commandBuffer.empty()) return;
+
+  completing = false;
+  HistoryRing& history = historyFor(state.commandBuffer[0]);
+  if (!recalling) {
+    recalling = true;
+    recallPrefix = state.commandBuffer.substr(1);
+    recallCursor = history.end();
+  }
+
+  std::string line;
+  if (older) {
+    // Past the oldest match the line stays as it is
+    if (!history.older(recallPrefix, recallCursor, line)) return;
+  } else if (!history.newer(recallPrefix, recallCursor, line)) {
+    line = recallPrefix;
+  }
+
+  state.commandBuffer.resize(1);
+  state.commandBuffer += line;
+  bufferChanged(hwndEdit);
+}
+
+static std::string currentFileDirectory() {
+  wchar_t currentDir[MAX_PATH] = {0};
+  ::SendMessageW(nppData._nppHandle, NPPM_GETFULLCURRENTPATH, MAX_PATH, (LPARAM)currentDir);
+  if (!PathRemoveFileSpecW(currentDir) || currentDir[0] == 0) {
+    // An unsaved buffer has no directory of its own
+    ::GetCurrentDirectoryW(MAX_PATH, currentDir);
+  }
+  return Utils::toUtf8(std::wstring(currentDir));
+}
+
+std::string CommandMode::completionAt(size_t index) const {
+  if (completionListing) return completionDir + completionListing->names[completionFirst + index];
+  return completions[index];
+}
+
+bool CommandMode::gatherCompletions() {
+  std::string_view line(state.commandBuffer);
+  line.remove_prefix(1);
+
+  completions.clear();
+  completionListing.reset();
+  completionCount = 0;
+
+  CommandCall call;
+  bool named = CommandRegistry::parse(line, call);
+  size_t nameStart = named ? (size_t)(call.name.data() - line.data()) : line.size();
+  size_t nameEnd = nameStart + call.name.size();
+
+  if (!named || (nameEnd == line.size() && std::isalpha((unsigned char)call.name[0]))) {
+    std::vector<const ColonCommand*> commands;
+    CommandRegistry::getInstance().complete(call.name, commands);
+    for (const ColonCommand* command : commands) completions.push_back(command->name);
+    completionBase = ":" + std::string(line.substr(0, nameStart));
+    completionCount = completions.size();
+    return completionCount > 0;
+  }
+
+  const ColonCommand* command = CommandRegistry::getInstance().find(call.name);
+  if (!command || command->completion == CommandCompletion::None) return false;
+
+  // The word being completed starts after the last blank in the arguments
+  size_t argsStart = nameEnd + (call.bang ? 1 : 0);
+  size_t blank = line.find_last_of(" \t");
+  size_t wordStart = (blank == std::string_view::npos || blank < argsStart) ? argsStart : blank + 1;
+  std::string_view word = line.substr(wordStart);
+  completionBase = ":" + std::string(line.substr(0, wordStart));
+  if (word.empty() && wordStart == argsStart) completionBase += ' ';
+
+  switch (command->completion) {
+  case CommandCompletion::Option: {
+    if (word.find('=') != std::string_view::npos) return false;
+    bool negated = word.size() >= 2 && word.compare(0, 2, "no") == 0;
+    for (const OptionInfo& option : OptionRegistry::getInstance().getAllOptions()) {
+      if (option.name.compare(0, word.size(), word) == 0) {
+        completions.push_back(option.name);
+      } else if (negated && option.type == OptionType::Bool &&
+                 option.name.compare(0, word.size() - 2, word.substr(2)) == 0) {
+        completions.push_back("no" + option.name);
+      }
+    }
+    std::sort(completions.begin(), completions.end());
+    break;
+  }
+  case CommandCompletion::Register: {
+    // Arguments are a run of register names; offer each one with contents
+    // that is not listed yet.
+    std::string listed(word);
+    auto offer = [&](char reg) {
+      if (listed.find(reg) == std::string::npos) completions.push_back(listed + reg);
+    };
+    for (char reg = 'a'; reg <= 'z'; reg++) if (Utils::getRegisterText(reg)) offer(reg);
+    for (char reg = '0'; reg <= '9'; reg++) if (Utils::getRegisterText(reg)) offer(reg);
+    offer('+');
+    offer('*');
+    break;
+  }
+  case CommandCompletion::File: {
+    size_t slash = word.find_last_of("\\/");
+    completionDir = slash == std::string_view::npos ? std::string() : std::string(word.substr(0, slash + 1));
+    std::string_view namePrefix = word.substr(completionDir.size());
+
+    std::string dir = completionDir;
+    bool absolute = (!dir.empty() && (dir[0] == '\\' || dir[0] == '/')) || (dir.size() > 1 && dir[1] == ':');
+    if (!absolute) dir = currentFileDirectory() + "\\" + dir;
+
+    auto listing = DirectoryCache::getInstance().lookup(dir);
+    if (!listing) {
+      Utils::setStatus(TEXT("Reading directory..."));
+      return false;
+    }
+    auto range = DirectoryCache::matching(*listing, namePrefix);
+    completionListing = listing;
+    completionFirst = range.first;
+    completionCount = range.second - range.first;
+    return completionCount > 0;
+  }
+  default:
+    return false;
+  }
+
+  completionCount = completions.size();
+  return completionCount > 0;
+}
+
+void CommandMode::completeCommandLine(HWND hwndEdit, bool forward) {
+  if (!hwndEdit || state.commandBuffer.empty() || state.commandBuffer[0] != ':') return;
+
+  recalling = false;
+  if (!completing) {
+    if (!gatherCompletions()) {
+      completionListing.reset();
+      return;
+    }
+    completing = true;
+    completionIndex = forward ? 0 : completionCount - 1;
+  } else if (forward) {
+    completionIndex = (completionIndex + 1) % completionCount;
+  } else {
+    completionIndex = (completionIndex + completionCount - 1) % completionCount;
+  }
+
+  state.commandBuffer = completionBase + completionAt(completionIndex);
+  bufferChanged(hwndEdit);
+}
+
 void CommandMode::handleKey(HWND hwndEdit, wchar_t wChar) {
   if (!hwndEdit) return;
 
@@ -140,22 +333,10 @@ void CommandMode::handleKey(HWND hwndEdit, wchar_t wChar) {
   }
 
   if (wChar >= 32) {
+    endLineEditing();
     std::string utf8 = Utils::toUtf8(wChar);
     state.commandBuffer += utf8;
-    updateStatus();
-
-    if (state.commandBuffer[0] == '/' && state.commandBuffer.size() > 1) {
-      std::string currentSearch = state.commandBuffer.substr(1);
-      Utils::updateSearchHighlight(hwndEdit, currentSearch, false);
-    } else if (state.commandBuffer[0] == '?' && state.commandBuffer.size() > 1) {
-      std::string currentPattern = state.commandBuffer.substr(1);
-      Utils::updateSearchHighlight(hwndEdit, currentPattern, true);
-    } else if (state.commandBuffer.size() == 1) {
-      Utils::clearSearchHighlights(hwndEdit);
-      state.lastSearchMatchCount = -1;
-    }
-
-    previewSubstitutionFromBuffer(hwndEdit);
+    bufferChanged(hwndEdit);
   }
 }
 
@@ -163,6 +344,7 @@ void CommandMode::handleBackspace(HWND hwndEdit) {
   if (!hwndEdit) return;
 
   if (state.commandBuffer.size() > 1) {
+    endLineEditing();
     // Correctly handle UTF-8 backspace by removing the last multi-byte character
     if (!state.commandBuffer.empty()) {
         size_t last = state.commandBuffer.size() - 1;
@@ -171,18 +353,8 @@ void CommandMode::handleBackspace(HWND hwndEdit) {
         }
         state.commandBuffer.erase(last);
     }
-    
-    updateStatus();
-
-    if (state.commandBuffer[0] == '/' && state.commandBuffer.size() > 1) {
-      std::string currentSearch = state.commandBuffer.substr(1);
-      Utils::updateSearchHighlight(hwndEdit, currentSearch, false);
-    } else if (state.commandBuffer.size() == 1) {
-      Utils::clearSearchHighlights(hwndEdit);
-      state.lastSearchMatchCount = -1;
-    }
 
-    previewSubstitutionFromBuffer(hwndEdit);
+    bufferChanged(hwndEdit);
   }
   else {
     this->exit();
@@ -203,6 +375,9 @@ void CommandMode::handleCommand(HWND hwndEdit) {
   const std::string &buf = state.commandBuffer;
   char firstChar = buf[0];
 
+  endLineEditing();
+  if (buf.size() > 1) historyFor(firstChar).add(buf.substr(1));
+
   try {
     if (firstChar == '/') {
       if (buf.size() > 1) {
@@ -250,234 +425,477 @@ void CommandMode::handleSearchCommand(HWND hwndEdit, const std::string &searchTe
 void CommandMode::handleColonCommand(HWND hwndEdit, const std::string &cmd) {
   if (cmd.empty()) return;
 
-  std::string fullCmd = cmd;
-  std::stringstream ss(fullCmd);
-  std::string baseCmd;
-  ss >> baseCmd;
-
-  // Resolve user-defined alias first
-  baseCmd = resolveUserCommand(baseCmd);
-
-  if (baseCmd == "set") {
-      std::string args;
-      std::getline(ss, args);
-      args = Utils::trim(args);
-      if (args.empty()) {
-          // Display all options
-          std::string help = "Options:\n========\n";
-          auto options = OptionRegistry::getInstance().getAllOptions();
-          for (const auto& opt : options) {
-              help += opt.name + " = ";
-              if (opt.type == OptionType::Bool) help += (std::get<bool>(opt.value) ? "on" : "off");
-              else if (opt.type == OptionType::Number) help += std::to_string(std::get<int>(opt.value));
-              else help += std::get<std::string>(opt.value);
-              help += "\n";
-          }
-          // Show in a new buffer or status
-          Utils::setStatus(TEXT("Options listed in Help (use :h for now)")); // Temporary
-      } else {
-          if (!OptionRegistry::getInstance().setOptionFromString(args)) {
-              Utils::setStatus(TEXT("E518: Unknown option"));
-          }
-      }
-      return;
+  CommandCall call;
+  if (!CommandRegistry::parse(cmd, call)) {
+    if (call.range.empty()) return;
+    goToLine(hwndEdit, call.range);
+    return;
   }
 
-  if (baseCmd == "map" || baseCmd == "nmap" || baseCmd == "imap" || baseCmd == "vmap" ||
-      baseCmd == "noremap" || baseCmd == "nnoremap" || baseCmd == "inoremap" || baseCmd == "vnoremap") {
-      std::string args;
-      std::getline(ss, args);
-      args = Utils::trim(args);
-      if (args.empty()) {
-          // List mappings
-          Utils::setStatus(TEXT("Use :map with args for now"));
-      } else {
-          RcParser::getInstance().executeLine(fullCmd, hwndEdit);
-      }
-      return;
+  const ColonCommand* command = CommandRegistry::getInstance().find(call.name);
+  if (!command) {
+    Utils::setStatus(TEXT("E492: Not an editor command"));
+    return;
   }
 
-  if (baseCmd == "source" || baseCmd == "so") {
-      std::string path;
-      ss >> path;
-      if (!RcParser::getInstance().parseFile(path, hwndEdit)) {
-          Utils::setStatus(TEXT("E484: Cannot open file"));
-      } else {
-          Utils::setStatus(TEXT("Configuration sourced"));
-      }
+  if (command->user) {
+    // User commands stand for a command line; arguments are appended to it.
+    static int depth = 0;
+    if (depth > 10) {
+      Utils::setStatus(TEXT("E169: Command too recursive"));
       return;
+    }
+    std::string expanded = std::string(call.range) + command->replacement;
+    if (!call.args.empty()) expanded += " " + std::string(call.args);
+    depth++;
+    handleColonCommand(hwndEdit, expanded);
+    depth--;
+    return;
   }
 
-  if (baseCmd == "NppVimReload") {
-      loadConfig();
-      Utils::setStatus(TEXT("NppVim reloaded"));
-      return;
+  if (!call.range.empty() && !command->range) {
+    Utils::setStatus(TEXT("E481: No range allowed"));
+    return;
   }
-
-  if (baseCmd == "version" || baseCmd == "ver") {
-      WCHAR path[MAX_PATH];
-      GetModuleFileNameW((HMODULE)g_hInstance, path, MAX_PATH);
-      DWORD handle = 0;
-      DWORD size = GetFileVersionInfoSizeW(path, &handle);
-      if (size) {
-          std::vector<BYTE> data(size);
-          if (GetFileVersionInfoW(path, 0, size, data.data())) {
-              VS_FIXEDFILEINFO* info = nullptr;
-              UINT len = 0;
-              if (VerQueryValueW(data.data(), L"\\", (LPVOID*)&info, &len)) {
-                  WCHAR version[64];
-                  wsprintfW(version, L"NppVim Version: %d.%d.%d.%d",
-                      HIWORD(info->dwFileVersionMS), LOWORD(info->dwFileVersionMS),
-                      HIWORD(info->dwFileVersionLS), LOWORD(info->dwFileVersionLS));
-                  Utils::setStatus(version);
-              }
-          }
-      }
-      return;
+  if (call.bang && !command->bang) {
+    Utils::setStatus(TEXT("E477: No ! allowed"));
+    return;
+  }
+  if (command->args == CommandArgs::None && !call.args.empty()) {
+    Utils::setStatus(TEXT("E488: Trailing characters"));
+    return;
+  }
+  if (command->args == CommandArgs::Required && call.args.empty()) {
+    Utils::setStatus(TEXT("E471: Argument required"));
+    return;
   }
 
-  if (baseCmd == "edit" || baseCmd == "e") {
-      std::string path;
-      std::getline(ss, path);
-      path = Utils::trim(path);
-      if (path.empty()) {
-          // Preserve current behavior: reload current file
-          ::SendMessage(nppData._nppHandle, IDM_FILE_RELOAD, 0, 0);
-          Utils::setStatus(TEXT("File reloaded"));
-      } else {
-          // Support :edit <filename>
-          int wideLen = MultiByteToWideChar(CP_UTF8, 0, path.c_str(), -1, NULL, 0);
-          if (wideLen > 0) {
-              std::vector<wchar_t> pathWide(wideLen);
-              MultiByteToWideChar(CP_UTF8, 0, path.c_str(), -1, pathWide.data(), wideLen);
-
-              wchar_t currentFile[MAX_PATH] = {0};
-              ::SendMessageW(nppData._nppHandle, NPPM_GETFULLCURRENTPATH, MAX_PATH, (LPARAM)currentFile);
-
-              wchar_t currentDir[MAX_PATH] = {0};
-              wcscpy_s(currentDir, currentFile);
-              PathRemoveFileSpecW(currentDir);
-
-              wchar_t fullPath[MAX_PATH] = {0};
-              if (PathIsRelativeW(pathWide.data())) {
-                  PathCombineW(fullPath, currentDir, pathWide.data());
-              } else {
-                  wcscpy_s(fullPath, pathWide.data());
-              }
+  // The handler may register commands itself, which can move the entry.
+  CommandHandler handler = command->handler;
+  if (handler) handler(hwndEdit, call);
+}
 
-              if (!PathFileExistsW(fullPath)) {
-                  // Create the file
-                  HANDLE hFile = CreateFileW(fullPath, GENERIC_WRITE, 0, NULL, CREATE_NEW, FILE_ATTRIBUTE_NORMAL, NULL);
-                  if (hFile != INVALID_HANDLE_VALUE) {
-                      CloseHandle(hFile);
-                  }
-              }
-              ::SendMessageW(nppData._nppHandle, NPPM_DOOPEN, 0, (LPARAM)fullPath);
-          }
-      }
-      return;
+// $ is the last line with text: a final line end does not start another.
+static int lastLine(HWND hwndEdit) {
+  int lineCount = Utils::lineCount(hwndEdit);
+  if (lineCount > 1 && Utils::lineStart(hwndEdit, lineCount - 1) == Utils::lineEnd(hwndEdit, lineCount - 1)) lineCount--;
+  return lineCount;
+}
+
+bool CommandMode::resolveAddress(HWND hwndEdit, std::string_view& text, int current, int& line) {
+  auto number = [&text]() {
+    int value = 0;
+    while (!text.empty() && std::isdigit(static_cast<unsigned char>(text[0]))) {
+      value = (std::min)(value * 10 + (text[0] - '0'), INT_MAX / 10);
+      text.remove_prefix(1);
+    }
+    return value;
+  };
+  auto skipBlanks = [&text]() {
+    while (!text.empty() && (text[0] == ' ' || text[0] == '\t')) text.remove_prefix(1);
+  };
+
+  skipBlanks();
+  if (text.empty()) return false;
+
+  bool based = true;
+  if (std::isdigit(static_cast<unsigned char>(text[0]))) {
+    line = number();
+  } else if (text[0] == '.') {
+    line = current;
+    text.remove_prefix(1);
+  } else if (text[0] == '$') {
+    line = lastLine(hwndEdit);
+    text.remove_prefix(1);
+  } else if (text[0] == '\'') {
+    if (text.size() < 2) return false;
+    int pos = Marks::position(hwndEdit, text[1]);
+    if (pos < 0) {
+      Utils::setStatus(TEXT("E20: Mark not set"));
+      return false;
+    }
+    line = Utils::lineFromPosition(hwndEdit, pos) + 1;
+    text.remove_prefix(2);
+  } else {
+    // "+2" alone is relative to the current line
+    line = current;
+    based = false;
   }
 
-  if (baseCmd == "editrc" || baseCmd == "erc") {
-      ConfigManager::getInstance().editRc();
-      return;
+  bool offset = false;
+  for (skipBlanks(); !text.empty() && (text[0] == '+' || text[0] == '-'); skipBlanks()) {
+    int sign = text[0] == '+' ? 1 : -1;
+    text.remove_prefix(1);
+    int amount = (!text.empty() && std::isdigit(static_cast<unsigned char>(text[0]))) ? number() : 1;
+    line += sign * amount;
+    offset = true;
   }
+  return based || offset;
+}
 
-  if (baseCmd == "editini" || baseCmd == "eini") {
-      ConfigManager::getInstance().editIni();
-      return;
+bool CommandMode::resolveRange(HWND hwndEdit, std::string_view range, int& first, int& last) {
+  int current = Utils::lineFromPosition(hwndEdit, Utils::caretPos(hwndEdit)) + 1;
+  int lineCount = Utils::lineCount(hwndEdit);
+
+  if (range.empty()) {
+    first = last = current;
+    return true;
+  }
+  if (range == "%") {
+    first = 1;
+    last = lastLine(hwndEdit);
+    return true;
   }
 
-  bool isNumber = true;
-  for (char ch : cmd) {
-    if (!std::isdigit(static_cast<unsigned char>(ch))) {
-      isNumber = false;
-      break;
+  if (!resolveAddress(hwndEdit, range, current, first)) {
+    Utils::setStatus(TEXT("E14: Invalid address"));
+    return false;
+  }
+  last = first;
+  if (!range.empty() && (range[0] == ',' || range[0] == ';')) {
+    // With ; the second address counts from the first
+    if (range[0] == ';') current = first;
+    range.remove_prefix(1);
+    if (!resolveAddress(hwndEdit, range, current, last)) {
+      Utils::setStatus(TEXT("E14: Invalid address"));
+      return false;
     }
   }
+  if (!range.empty()) {
+    Utils::setStatus(TEXT("E16: Invalid range"));
+    return false;
+  }
+  if (first > last) std::swap(first, last);
+  if (first < 1 || last > lineCount) {
+    Utils::setStatus(TEXT("E16: Invalid range"));
+    return false;
+  }
+  return true;
+}
 
-  if (isNumber) {
-    int lineNum = std::stoi(cmd);
-    if (lineNum > 0) {
-      int lineCount = (int)::SendMessage(hwndEdit, SCI_GETLINECOUNT, 0, 0);
-      if (lineNum <= lineCount) {
-        ::SendMessage(hwndEdit, SCI_GOTOLINE, lineNum - 1, 0);
-        ::SendMessage(hwndEdit, SCI_SCROLLCARET, 0, 0);
-        std::wstring msg = L"Jumped to line " + std::to_wstring(lineNum);
-        Utils::setStatus(msg.c_str());
-      } else {
-        Utils::setStatus(TEXT("Line number out of range"));
-      }
-    }
+void CommandMode::goToLine(HWND hwndEdit, std::string_view range) {
+  int first = 0, lineNum = 0;
+  if (!resolveRange(hwndEdit, range, first, lineNum)) return;
+
+  ::SendMessage(hwndEdit, SCI_GOTOLINE, lineNum - 1, 0);
+  ::SendMessage(hwndEdit, SCI_SCROLLCARET, 0, 0);
+  std::wstring msg = L"Jumped to line " + std::to_wstring(lineNum);
+  Utils::setStatus(msg.c_str());
+}
+
+// :[range]m {address} and :[range]t {address} as one deletion and one
+// insertion, so the cost follows the size of the block, not how far it
+// travels. Marks inside a moved block travel with it.
+void CommandMode::transferLines(HWND hwndEdit, const CommandCall& call, bool copy) {
+  int first = 0, last = 0;
+  if (!resolveRange(hwndEdit, call.range, first, last)) return;
+
+  std::string_view rest = call.args;
+  int current = Utils::lineFromPosition(hwndEdit, Utils::caretPos(hwndEdit)) + 1;
+  int target = 0;
+  if (!resolveAddress(hwndEdit, rest, current, target) || rest.find_first_not_of(" \t") != std::string_view::npos) {
+    Utils::setStatus(TEXT("E14: Invalid address"));
     return;
   }
 
-   if (cmd.find("sort") == 0) {
-        if (cmd == "sort") {
-            ::SendMessage(nppData._nppHandle, WM_COMMAND, IDM_EDIT_SORTLINES_LEXICOGRAPHIC_ASCENDING, 0);
-            Utils::setStatus(TEXT("Lines sorted"));
-        } else if (cmd == "sort!") {
-            ::SendMessage(nppData._nppHandle, WM_COMMAND, IDM_EDIT_SORTLINES_LEXICOGRAPHIC_DESCENDING, 0);
-            Utils::setStatus(TEXT("Lines sorted (descending)"));
-        } else if (cmd == "sort n") {
-            ::SendMessage(nppData._nppHandle, WM_COMMAND, IDM_EDIT_SORTLINES_INTEGER_ASCENDING, 0);
-            Utils::setStatus(TEXT("Lines sorted (numeric)"));
-        } else if (cmd == "sort n!") {
-            ::SendMessage(nppData._nppHandle, WM_COMMAND, IDM_EDIT_SORTLINES_INTEGER_DESCENDING, 0);
-            Utils::setStatus(TEXT("Lines sorted (numeric descending)"));
-        } else {
-            Utils::setStatus(TEXT("Use: sort, sort!, sort n, sort n!"));
-        }
-        return;
-    }
-
-  if ((cmd.size() >= 2 && cmd[0] == 's' && !std::isalnum(cmd[1])) || 
-      (cmd.size() >= 3 && cmd[0] == '%' && cmd[1] == 's' && !std::isalnum(cmd[2])) )
-  {
-    handleSubstitutionCommand(hwndEdit, cmd);
+  int lineCount = Utils::lineCount(hwndEdit);
+  if (target < 0 || target > lineCount) {
+    Utils::setStatus(TEXT("E16: Invalid range"));
+    return;
+  }
+  if (!copy && target >= first && target < last) {
+    Utils::setStatus(TEXT("E134: Cannot move a range of lines into itself"));
     return;
   }
 
-  if (cmd == "wrap" || cmd == "wrapmode" || cmd == "wrap on") {
-    ::SendMessage(hwndEdit, SCI_SETWRAPMODE, SC_WRAP_WORD, 0);
-    Utils::setStatus(TEXT("Word wrap enabled"));
+  int count = last - first + 1;
+  int newFirst = copy ? target + 1 : (target > last ? target - count + 1 : target + 1);
+  if (!copy && (target == last || target == first - 1)) {
+    ::SendMessage(hwndEdit, SCI_GOTOLINE, last - 1, 0);
     return;
   }
-  if (cmd == "nowrap" || cmd == "wrap off") {
-      ::SendMessage(hwndEdit, SCI_SETWRAPMODE, SC_WRAP_NONE, 0);
-      Utils::setStatus(TEXT("Word wrap disabled"));
-      return;
+
+  // Scintilla's last line has no line end of its own, so text that lands
+  // after it, or leaves from it, takes the line end with it.
+  std::string eol = Utils::eolString(hwndEdit);
+  int bodyStart = Utils::lineStart(hwndEdit, first - 1);
+  int bodyEnd = Utils::lineEnd(hwndEdit, last - 1);
+  std::string body = Utils::getTextRange(hwndEdit, bodyStart, bodyEnd);
+
+  int insertPos;
+  std::string inserted;
+  if (target < lineCount) {
+    insertPos = Utils::lineStart(hwndEdit, target);
+    inserted = body + eol;
+  } else {
+    insertPos = Utils::lineEnd(hwndEdit, lineCount - 1);
+    inserted = eol + body;
   }
-  if (cmd == "wrap char") {
-      ::SendMessage(hwndEdit, SCI_SETWRAPMODE, SC_WRAP_CHAR, 0);
-      Utils::setStatus(TEXT("Character wrap enabled"));
-      return;
+
+  int deleteStart = bodyStart, deleteEnd = 0;
+  if (last < lineCount) {
+    deleteEnd = Utils::lineStart(hwndEdit, last);
+  } else {
+    deleteStart = Utils::lineEnd(hwndEdit, first - 2);
+    deleteEnd = bodyEnd;
   }
-  if (cmd == "wrap whitespace") {
-      ::SendMessage(hwndEdit, SCI_SETWRAPMODE, SC_WRAP_WHITESPACE, 0);
-      Utils::setStatus(TEXT("Whitespace wrap enabled"));
-      return;
+
+  std::vector<std::pair<int, int>> carried;
+  if (!copy) MarkTracker::getInstance().collect(hwndEdit, bodyStart, bodyEnd + 1, carried);
+
+  ::SendMessage(hwndEdit, SCI_BEGINUNDOACTION, 0, 0);
+  // The later edit goes first so the earlier position stays valid
+  if (copy || insertPos >= deleteEnd) {
+    Utils::replaceTarget(hwndEdit, insertPos, insertPos, inserted);
+    if (!copy) Utils::replaceTarget(hwndEdit, deleteStart, deleteEnd, "");
+  } else {
+    Utils::replaceTarget(hwndEdit, deleteStart, deleteEnd, "");
+    Utils::replaceTarget(hwndEdit, insertPos, insertPos, inserted);
   }
 
-  if (cmd.rfind("set tw=", 0) == 0) {
-    try {
-        int width = std::stoi(cmd.substr(7));
-        ::SendMessage(hwndEdit, SCI_SETEDGECOLUMN, width, 0);
-        ::SendMessage(hwndEdit, SCI_SETEDGEMODE, EDGE_LINE, 0);
-        Utils::setStatus(TEXT("Text width set"));
-    } catch (...) {
-        Utils::setStatus(TEXT("Invalid text width"));
+  int movedStart = (int)::SendMessage(hwndEdit, SCI_POSITIONFROMLINE, newFirst - 1, 0);
+  for (const auto& mark : carried) {
+    MarkTracker::getInstance().move(hwndEdit, mark.first, movedStart + (mark.second - bodyStart));
+  }
+
+  ::SendMessage(hwndEdit, SCI_GOTOLINE, newFirst + count - 2, 0);
+  ::SendMessage(hwndEdit, SCI_ENDUNDOACTION, 0, 0);
+  Marks::syncMarkers(hwndEdit);
+
+  if (count > 2) {
+    std::wstring msg = std::to_wstring(count) + (copy ? L" lines copied" : L" lines moved");
+    Utils::setStatus(msg.c_str());
+  }
+}
+
+// Output of Windows tools ends lines with CR LF whatever the document uses.
+static void convertLineEnds(std::string& text, const std::string& eol) {
+  bool uniform = true;
+  for (size_t i = 0; i < text.size() && uniform; i++) {
+    if (text[i] == '\r') {
+      bool crlf = i + 1 < text.size() && text[i + 1] == '\n';
+      uniform = crlf ? eol == "\r\n" : eol == "\r";
+      if (crlf) i++;
+    } else if (text[i] == '\n') {
+      uniform = eol == "\n";
+    }
+  }
+  if (uniform) return;
+
+  std::string converted;
+  converted.reserve(text.size());
+  for (size_t i = 0; i < text.size(); i++) {
+    if (text[i] == '\r' || text[i] == '\n') {
+      if (text[i] == '\r' && i + 1 < text.size() && text[i + 1] == '\n') i++;
+      converted += eol;
+    } else {
+      converted += text[i];
     }
+  }
+  text.swap(converted);
+}
+
+static std::wstring widen(const std::string& text, int codePage = CP_UTF8) {
+  int len = MultiByteToWideChar(codePage, 0, text.c_str(), (int)text.size(), NULL, 0);
+  if (len <= 0) return std::wstring();
+  std::wstring wide(len, L'\0');
+  MultiByteToWideChar(codePage, 0, text.c_str(), (int)text.size(), &wide[0], len);
+  return wide;
+}
+
+static bool isUtf8(const std::string& text) {
+  size_t i = Utf8::asciiPrefix(text.data(), text.size());
+  while (i < text.size()) {
+    size_t used;
+    Utf8::decode(text.data() + i, text.size() - i, used);
+    if (used == 1 && (unsigned char)text[i] >= 0x80) return false;
+    i += used;
+  }
+  return true;
+}
+
+// Console tools write in the OEM code page unless told otherwise, but many
+// ported ones write UTF-8, so output that is valid UTF-8 is taken as that.
+static void fromConsole(std::string& text, int codePage) {
+  if (Utf8::isAscii(text.data(), text.size())) return;
+  int from = isUtf8(text) ? CP_UTF8 : (int)GetOEMCP();
+  int to = codePage ? codePage : (int)GetACP();
+  if (from == to) return;
+
+  std::wstring wide = widen(text, from);
+  int len = WideCharToMultiByte(to, 0, wide.c_str(), (int)wide.size(), NULL, 0, NULL, NULL);
+  if (len <= 0) return;
+  text.assign(len, '\0');
+  WideCharToMultiByte(to, 0, wide.c_str(), (int)wide.size(), &text[0], len, NULL, NULL);
+}
+
+bool CommandMode::runShell(const std::string& command, std::string_view input, std::string& output, int codePage) {
+  // The status bar is all the feedback there is while we wait, so it is
+  // drawn now rather than when the input event ends.
+  auto showProgress = [](const std::wstring& msg) {
+    Utils::setStatus(msg.c_str());
+    UiUpdates::getInstance().flushNow();
+    MSG paint;
+    while (::PeekMessage(&paint, NULL, WM_PAINT, WM_PAINT, PM_REMOVE)) ::DispatchMessage(&paint);
+  };
+  auto progress = [&showProgress](size_t written, size_t read) {
+    if (::GetAsyncKeyState(VK_ESCAPE) & 0x8000) return false;
+    showProgress(L"Running: " + std::to_wstring(written >> 10) + L" KB in, " +
+                 std::to_wstring(read >> 10) + L" KB out (Esc to cancel)");
+    return true;
+  };
+
+  showProgress(L"Running: " + widen(command));
+
+  int exitCode = 0;
+  switch (Process::filter(Options::shell.get(), command, input, output, exitCode, progress)) {
+  case ProcessResult::Failed:
+    Utils::setStatus(TEXT("E282: Cannot start the shell"));
+    return false;
+  case ProcessResult::Cancelled:
+    Utils::setStatus(TEXT("Interrupted"));
+    return false;
+  default:
+    break;
+  }
+  fromConsole(output, codePage);
+
+  Utils::setStatus(TEXT(""));
+  if (exitCode != 0) {
+    std::wstring msg = L"shell returned " + std::to_wstring(exitCode);
+    Utils::setStatus(msg.c_str());
+  }
+  return true;
+}
+
+// :{range}!cmd replaces the lines with the command's output in one edit;
+// :!cmd alone shows the output.
+void CommandMode::shellCommand(HWND hwndEdit, const CommandCall& call) {
+  std::string command(call.args);
+  if (call.bang) {
+    // :!! repeats the previous command
+    if (lastShellCommand.empty()) {
+      Utils::setStatus(TEXT("E34: No previous command"));
+      return;
+    }
+    command = command.empty() ? lastShellCommand : lastShellCommand + " " + command;
+  }
+  if (command.empty()) {
+    Utils::setStatus(TEXT("E471: Argument required"));
     return;
   }
+  lastShellCommand = command;
+
+  std::string output;
+  if (call.range.empty()) {
+    if (!runShell(command, std::string_view(), output)) return;
+    while (!output.empty() && (output.back() == '\n' || output.back() == '\r')) output.pop_back();
+    if (output.empty()) return;
+    if (output.find('\n') == std::string::npos) {
+      Utils::setStatus(widen(output).c_str());
+      return;
+    }
+    ::SendMessage(nppData._nppHandle, NPPM_MENUCOMMAND, 0, IDM_FILE_NEW);
+    HWND h = Utils::getCurrentScintillaHandle();
+    if (!h) return;
+    ::SendMessage(h, SCI_SETTEXT, 0, (LPARAM)output.c_str());
+    ::SendMessage(h, SCI_SETSAVEPOINT, 0, 0);
+    return;
+  }
+
+  int first = 0, last = 0;
+  if (!resolveRange(hwndEdit, call.range, first, last)) return;
+
+  // The command reads straight from the document; nothing can edit it
+  // while the command runs.
+  bool toEnd = last >= Utils::lineCount(hwndEdit);
+  int start = Utils::lineStart(hwndEdit, first - 1);
+  int end = toEnd ? (int)::SendMessage(hwndEdit, SCI_GETLENGTH, 0, 0) : Utils::lineStart(hwndEdit, last);
+  const char* text = (const char*)::SendMessage(hwndEdit, SCI_GETRANGEPOINTER, start, end - start);
+  if (!text && end > start) return;
+
+  int codePage = (int)::SendMessage(hwndEdit, SCI_GETCODEPAGE, 0, 0);
+  if (!runShell(command, std::string_view(text ? text : "", (size_t)(end - start)), output, codePage)) return;
 
-  for (char c : cmd) {
-    if (!g_commandKeymap->handleKey(hwndEdit, c)) {
-        break;
+  std::string eol = Utils::eolString(hwndEdit);
+  convertLineEnds(output, eol);
+  if (toEnd && output.size() >= eol.size() && output.compare(output.size() - eol.size(), eol.size(), eol) == 0) {
+    output.resize(output.size() - eol.size());
+  }
+
+  ::SendMessage(hwndEdit, SCI_BEGINUNDOACTION, 0, 0);
+  Utils::replaceTarget(hwndEdit, start, end, output);
+  ::SendMessage(hwndEdit, SCI_GOTOLINE, first - 1, 0);
+  ::SendMessage(hwndEdit, SCI_ENDUNDOACTION, 0, 0);
+
+  int count = last - first + 1;
+  if (count > 2) {
+    std::wstring msg = std::to_wstring(count) + L" lines filtered";
+    Utils::setStatus(msg.c_str());
+  }
+}
+
+// Puts text on new lines below line (0 for above the first one).
+void CommandMode::insertBelow(HWND hwndEdit, int line, std::string text) {
+  std::string eol = Utils::eolString(hwndEdit);
+  convertLineEnds(text, eol);
+  if (text.size() >= eol.size() && text.compare(text.size() - eol.size(), eol.size(), eol) == 0) {
+    text.resize(text.size() - eol.size());
+  }
+
+  int lineCount = Utils::lineCount(hwndEdit);
+  int pos;
+  if (line < lineCount) {
+    pos = Utils::lineStart(hwndEdit, line);
+    text += eol;
+  } else {
+    pos = Utils::lineEnd(hwndEdit, lineCount - 1);
+    text.insert(0, eol);
+  }
+
+  ::SendMessage(hwndEdit, SCI_BEGINUNDOACTION, 0, 0);
+  Utils::replaceTarget(hwndEdit, pos, pos, text);
+  ::SendMessage(hwndEdit, SCI_GOTOLINE, line, 0);
+  ::SendMessage(hwndEdit, SCI_ENDUNDOACTION, 0, 0);
+}
+
+// :[line]r !cmd and :[line]r file
+void CommandMode::readCommand(HWND hwndEdit, const CommandCall& call) {
+  int line = Utils::lineFromPosition(hwndEdit, Utils::caretPos(hwndEdit)) + 1;
+  if (call.range == "0") {
+    line = 0;
+  } else if (!call.range.empty()) {
+    int first = 0;
+    if (!resolveRange(hwndEdit, call.range, first, line)) return;
+  }
+
+  std::string text;
+  if (call.bang || (!call.args.empty() && call.args[0] == '!')) {
+    std::string command(call.bang ? call.args : call.args.substr(1));
+    if (command.empty()) command = lastShellCommand;
+    if (command.empty()) {
+      Utils::setStatus(TEXT("E34: No previous command"));
+      return;
+    }
+    lastShellCommand = command;
+    if (!runShell(command, std::string_view(), text, (int)::SendMessage(hwndEdit, SCI_GETCODEPAGE, 0, 0))) return;
+  } else {
+    std::string path(call.args);
+    if (path.empty()) {
+      Utils::setStatus(TEXT("E32: No file name"));
+      return;
     }
+    bool absolute = path[0] == '\\' || path[0] == '/' || (path.size() > 1 && path[1] == ':');
+    if (!absolute) path = currentFileDirectory() + "\\" + path;
+    std::ifstream file(path, std::ios::binary);
+    if (!file) {
+      Utils::setStatus(TEXT("E484: Can't open file"));
+      return;
+    }
+    text.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
   }
-  return;
 
+  if (!text.empty()) insertBelow(hwndEdit, line, std::move(text));
 }
 
 auto tutorHandler = [](HWND, int) {
@@ -507,18 +925,17 @@ auto helpHandler = [](HWND, int) {
                "=========================\n\n";
     }
 
-    auto appendKeymap = [&](const char* title, const Keymap* km, bool isCommandMode = false) {
-        if (!km) return;
+    auto appendBindings = [&](const char* title, const std::vector<KeyBinding>& bindings, bool isCommandMode = false) {
         help += "\n";
         help += title;
         help += "\n";
         help += std::string(strlen(title), '-') + "\n";
 
         size_t pad = 0;
-        for (const auto& b : km->getBindings())
+        for (const auto& b : bindings)
             pad = (std::max)(pad, b.keys.size());
 
-        for (const auto& b : km->getBindings()) {
+        for (const auto& b : bindings) {
             help += "  ";
             if (isCommandMode) help += ":";
             help += b.keys;
@@ -529,9 +946,9 @@ auto helpHandler = [](HWND, int) {
         }
     };
 
-    appendKeymap("Normal Mode Mappings", g_normalKeymap.get());
-    appendKeymap("Visual Mode Mappings", g_visualKeymap.get());
-    appendKeymap("Command Mode Commands", g_commandKeymap.get(), true);
+    if (g_normalKeymap) appendBindings("Normal Mode Mappings", g_normalKeymap->getBindings());
+    if (g_visualKeymap) appendBindings("Visual Mode Mappings", g_visualKeymap->getBindings());
+    appendBindings("Command Mode Commands", CommandRegistry::getInstance().listing(), true);
 
     appendNonKeymapHelp(help);
 
@@ -543,139 +960,350 @@ auto helpHandler = [](HWND, int) {
     Utils::setStatus(TEXT("-- HELP --"));
 };
 
-CommandMode::CommandMode(VimState &state) : state(state)
+enum CommandFlags : unsigned {
+  CMD_RANGE = 1,
+  CMD_BANG = 2,
+  CMD_FILES = 4,        // arguments complete as file names
+  CMD_OPTIONS = 8,      // ... as option names
+  CMD_REGISTERS = 16    // ... as register names
+};
+
+static void defineCommand(const char* name, size_t abbreviation, CommandArgs args, unsigned flags,
+                          const char* description, CommandHandler handler) {
+  ColonCommand command;
+  command.name = name;
+  command.abbreviation = abbreviation;
+  command.args = args;
+  command.range = (flags & CMD_RANGE) != 0;
+  command.bang = (flags & CMD_BANG) != 0;
+  if (flags & CMD_FILES) command.completion = CommandCompletion::File;
+  else if (flags & CMD_OPTIONS) command.completion = CommandCompletion::Option;
+  else if (flags & CMD_REGISTERS) command.completion = CommandCompletion::Register;
+  command.description = description;
+  command.handler = handler;
+  CommandRegistry::getInstance().add(command);
+}
+
+static void showMessage(const std::string& text, const TCHAR* title) {
+#ifdef UNICODE
+  int len = MultiByteToWideChar(CP_UTF8, 0, text.c_str(), -1, NULL, 0);
+  if (len > 0) {
+    std::wstring wide(len, L'\0');
+    MultiByteToWideChar(CP_UTF8, 0, text.c_str(), -1, &wide[0], len);
+    ::MessageBox(nppData._nppHandle, wide.c_str(), title, MB_OK | MB_ICONINFORMATION);
+  }
+#else
+  ::MessageBox(nppData._nppHandle, text.c_str(), title, MB_OK | MB_ICONINFORMATION);
+#endif
+}
+
+// :w! writes the file even when Notepad++ has it as unchanged. Untitled
+// documents have no path to write to and take the normal save.
+static void saveCurrentFile(bool force) {
+  wchar_t path[MAX_PATH] = {0};
+  if (force) ::SendMessageW(nppData._nppHandle, NPPM_GETFULLCURRENTPATH, MAX_PATH, (LPARAM)path);
+  if (path[0] && !PathIsRelativeW(path)) {
+    ::SendMessageW(nppData._nppHandle, NPPM_SAVECURRENTFILEAS, FALSE, (LPARAM)path);
+  } else {
+    ::SendMessage(nppData._nppHandle, NPPM_SAVECURRENTFILE, 0, 0);
+  }
+}
+
+// :qa! leaves every document at its save point, so closing them asks nothing.
+static void discardAllChanges() {
+  const int views[][2] = { { MAIN_VIEW, PRIMARY_VIEW }, { SUB_VIEW, SECOND_VIEW } };
+  for (const auto& view : views) {
+    HWND hwnd = (view[0] == MAIN_VIEW) ? nppData._scintillaMainHandle : nppData._scintillaSecondHandle;
+    int count = (int)::SendMessage(nppData._nppHandle, NPPM_GETNBOPENFILES, 0, view[1]);
+    for (int i = 0; i < count; i++) {
+      ::SendMessage(nppData._nppHandle, NPPM_ACTIVATEDOC, view[0], i);
+      ::SendMessage(hwnd, SCI_SETSAVEPOINT, 0, 0);
+    }
+  }
+}
+
+CommandMode::CommandMode(VimState &state)
+    : state(state), colonHistory(1), searchHistory(1)
 {
-  g_commandKeymap = std::make_unique<Keymap>(state);
-  g_commandKeymap->setAllowCount(false);
-
-  g_commandKeymap
-    ->set("w", "Save current file", [](HWND, int) {
-        ::SendMessage(nppData._nppHandle, NPPM_SAVECURRENTFILE, 0, 0);
-        Utils::setStatus(TEXT("File saved"));
-    })
-    .set("e", "Reload current file", [](HWND, int) {
-        ::SendMessage(nppData._nppHandle, IDM_FILE_RELOAD, 0, 0);
-    })
-    .set("q", "Close current file", [](HWND, int) {
-        ::SendMessage(nppData._nppHandle, WM_COMMAND, IDM_FILE_CLOSE, 0);
-    })
-    .set("qa", "Close all files", [](HWND, int) {
-        ::SendMessage(nppData._nppHandle, WM_COMMAND, IDM_FILE_CLOSEALL, 0);
-    })
-    .set("wq", "Save and close file", [](HWND, int) {
-        ::SendMessage(nppData._nppHandle, NPPM_SAVECURRENTFILE, 0, 0);
-        ::SendMessage(nppData._nppHandle, IDM_FILE_CLOSE, 0, 0);
-    })
-    .set("wqa", "Save all and close all files", [](HWND, int) {
-        ::SendMessage(nppData._nppHandle, NPPM_SAVEALLFILES, 0, 0);
-        ::SendMessage(nppData._nppHandle, IDM_FILE_CLOSEALL, 0, 0);
-    })
-    .set("bn", "Next tab", [](HWND, int) {
-        ::SendMessage(nppData._nppHandle, IDM_VIEW_TAB_NEXT, 0, 0);
-    })
-    .set("bp", "Previous tab", [](HWND, int) {
-        ::SendMessage(nppData._nppHandle, IDM_VIEW_TAB_PREV, 0, 0);
-    })
-    .set("bd", "Close current tab", [](HWND, int) {
-        ::SendMessage(nppData._nppHandle, WM_COMMAND, IDM_FILE_CLOSE, 0);
-    })
-    .set("vsplit", "Toggle split", toggleSplit)
-    .set("vs", "Toggle split", toggleSplit)
-    .set("split", "Toggle split", toggleSplit)
-    .set("sp", "Toggle split", toggleSplit)
-    .set("gh", "Open GitHub", [](HWND, int) {
-        ShellExecuteW(NULL, L"open", L"https://github.com/h-jangra/nppvim", NULL, NULL, SW_SHOWNORMAL);
-    })
-    .set("paypal", "Donate via PayPal", [](HWND, int) {
-        ShellExecuteW(NULL, L"open", L"https://paypal.me/h8imansh8u", NULL, NULL, SW_SHOWNORMAL);
-    })
-    .set("donate", "Donate via PayPal", [](HWND, int) {
-        ShellExecuteW(NULL, L"open", L"https://paypal.me/h8imansh8u", NULL, NULL, SW_SHOWNORMAL);
-    })
-    .set("about", "About NppVim", [](HWND, int) {
-        about();
-    })
-    .set("config", "NppVim Configuration", [](HWND, int) {
-        showConfigDialog();
-    })
-    .set("noh", "Clear search highlight", [](HWND hwnd, int) {
-      Utils::clearSearchHighlights(hwnd);
-      Utils::setStatus(TEXT("Search highlight cleared"));
-    })
-    .set("nohl", "Clear search highlight", [](HWND hwnd, int) {
-        Utils::clearSearchHighlights(hwnd);
-        Utils::setStatus(TEXT("Search highlight cleared"));
-    })
-    .set("nohlsearch", "Clear search highlight", [](HWND hwnd, int) {
-        Utils::clearSearchHighlights(hwnd);
-        Utils::setStatus(TEXT("Search highlight cleared"));
-    })
-    .set("set nu", "Enable line numbers", [](HWND hwnd, int) {
-        OptionRegistry::getInstance().setOption("number", true);
-        Utils::setStatus(TEXT("Line numbers enabled"));
-    })
-    .set("set number", "Enable line numbers", [](HWND hwnd, int) {
-        OptionRegistry::getInstance().setOption("number", true);
-        Utils::setStatus(TEXT("Line numbers enabled"));
-    })
-    .set("set nonu", "Disable line numbers", [](HWND hwnd, int) {
-        OptionRegistry::getInstance().setOption("number", false);
-        Utils::setStatus(TEXT("Line numbers disabled"));
-    })
-    .set("set nonumber", "Disable line numbers", [](HWND hwnd, int) {
-        OptionRegistry::getInstance().setOption("number", false);
-        Utils::setStatus(TEXT("Line numbers disabled"));
-    })
-    .set("set rnu", "Enable relative numbers", [](HWND hwnd, int) {
-        OptionRegistry::getInstance().setOption("relativenumber", true);
-        Utils::setStatus(TEXT("Relative numbers enabled"));
-    })
-    .set("set relativenumber", "Enable relative numbers", [](HWND hwnd, int) {
-        OptionRegistry::getInstance().setOption("relativenumber", true);
-        Utils::setStatus(TEXT("Relative numbers enabled"));
-    })
-    .set("set nornu", "Disable relative numbers", [](HWND hwnd, int) {
-        OptionRegistry::getInstance().setOption("relativenumber", false);
-        Utils::setStatus(TEXT("Relative numbers disabled"));
-    })
-    .set("set norelativenumber", "Disable relative numbers", [](HWND hwnd, int) {
-        OptionRegistry::getInstance().setOption("relativenumber", false);
-        Utils::setStatus(TEXT("Relative numbers disabled"));
-    })
-    .set("m", "Move line to specific line number", [](HWND h, int c) {
-        int currentLine = ::SendMessage(h, SCI_LINEFROMPOSITION, Utils::caretPos(h), 0);
-        int targetLine = c > 0 ? c - 1 : 0;
-        if (targetLine >= 0 && targetLine != currentLine) {
-            ::SendMessage(h, SCI_MOVESELECTEDLINESUP, currentLine < targetLine ? 0 : 1, 0);
-            if (currentLine < targetLine) {
-                for (int i = currentLine; i < targetLine; ++i) {
-                    ::SendMessage(h, SCI_MOVESELECTEDLINESDOWN, 0, 0);
-                }
-            } else {
-                for (int i = currentLine; i > targetLine; --i) {
-                    ::SendMessage(h, SCI_MOVESELECTEDLINESUP, 0, 0);
-                }
-            }
-            ::SendMessage(h, SCI_GOTOLINE, targetLine, 0);
+  setHistoryCapacity(Options::history.get());
+
+  using A = CommandArgs;
+
+  auto clearHighlight = [](HWND hwnd, const CommandCall&) {
+    Utils::clearSearchHighlights(hwnd);
+    Utils::setStatus(TEXT("Search highlight cleared"));
+  };
+  auto registers = [this](HWND, const CommandCall& call) { showRegisters(std::string(call.args)); };
+  auto split = [](HWND h, const CommandCall&) { toggleSplit(h, 1); };
+  auto help = [](HWND h, const CommandCall&) { helpHandler(h, 1); };
+  auto tutor = [](HWND h, const CommandCall&) { tutorHandler(h, 1); };
+  auto donate = [](HWND, const CommandCall&) {
+    ShellExecuteW(NULL, L"open", L"https://paypal.me/h8imansh8u", NULL, NULL, SW_SHOWNORMAL);
+  };
+  auto closeAll = [](HWND, const CommandCall& call) {
+    if (call.bang) discardAllChanges();
+    ::SendMessage(nppData._nppHandle, WM_COMMAND, IDM_FILE_CLOSEALL, 0);
+  };
+  auto saveAndClose = [](HWND, const CommandCall& call) {
+    saveCurrentFile(call.bang);
+    ::SendMessage(nppData._nppHandle, WM_COMMAND, IDM_FILE_CLOSE, 0);
+  };
+  auto wrap = [](HWND hwndEdit, const CommandCall& call) {
+    if (call.args.empty() || call.args == "on") {
+      ::SendMessage(hwndEdit, SCI_SETWRAPMODE, SC_WRAP_WORD, 0);
+      Utils::setStatus(TEXT("Word wrap enabled"));
+    } else if (call.args == "off") {
+      ::SendMessage(hwndEdit, SCI_SETWRAPMODE, SC_WRAP_NONE, 0);
+      Utils::setStatus(TEXT("Word wrap disabled"));
+    } else if (call.args == "char") {
+      ::SendMessage(hwndEdit, SCI_SETWRAPMODE, SC_WRAP_CHAR, 0);
+      Utils::setStatus(TEXT("Character wrap enabled"));
+    } else if (call.args == "whitespace") {
+      ::SendMessage(hwndEdit, SCI_SETWRAPMODE, SC_WRAP_WHITESPACE, 0);
+      Utils::setStatus(TEXT("Whitespace wrap enabled"));
+    } else {
+      Utils::setStatus(TEXT("Use: wrap, wrap off, wrap char, wrap whitespace"));
+    }
+  };
+
+  defineCommand("substitute", 1, A::Optional, CMD_RANGE | CMD_BANG, "Replace pattern matches",
+    [this](HWND hwndEdit, const CommandCall& call) {
+      // Everything after the name is pattern and flags, delimiter included
+      const char* rest = call.name.data() + call.name.size();
+      std::string command = std::string(call.range) + "s" + std::string(rest, call.line.data() + call.line.size() - rest);
+      handleSubstitutionCommand(hwndEdit, command);
+    });
+
+  defineCommand("set", 2, A::Optional, CMD_OPTIONS, "Show or change options", [](HWND, const CommandCall& call) {
+    if (call.args.empty()) {
+      std::string help;
+      auto options = OptionRegistry::getInstance().getAllOptions();
+      for (const auto& opt : options) {
+        help += opt.name + " = ";
+        if (opt.type == OptionType::Bool) help += (std::get<bool>(opt.value) ? "on" : "off");
+        else if (opt.type == OptionType::Number) help += std::to_string(std::get<int>(opt.value));
+        else help += std::get<std::string>(opt.value);
+        help += "\n";
+      }
+      showMessage(help, TEXT("Options"));
+    } else if (!OptionRegistry::getInstance().setOptionFromString(std::string(call.args))) {
+      Utils::setStatus(TEXT("E518: Unknown option"));
+    }
+  });
+
+  static const std::pair<const char*, size_t> mapCommands[] = {
+    { "map", 3 }, { "nmap", 2 }, { "vmap", 2 }, { "imap", 2 },
+    { "noremap", 2 }, { "nnoremap", 2 }, { "vnoremap", 2 }, { "inoremap", 3 },
+  };
+  for (const auto& [name, abbreviation] : mapCommands) {
+    std::string full = name;
+    defineCommand(name, abbreviation, A::Optional, 0, "Define a key mapping", [full](HWND hwndEdit, const CommandCall& call) {
+      if (call.args.empty()) {
+        // List mappings
+        Utils::setStatus(TEXT("Use :map with args for now"));
+      } else {
+        RcParser::getInstance().executeLine(full + " " + std::string(call.args), hwndEdit);
+      }
+    });
+  }
+  static const std::pair<const char*, size_t> unmapCommands[] = {
+    { "unmap", 3 }, { "nunmap", 3 }, { "vunmap", 2 }, { "iunmap", 2 },
+  };
+  for (const auto& [name, abbreviation] : unmapCommands) {
+    std::string full = name;
+    defineCommand(name, abbreviation, A::Required, 0, "Remove a key mapping", [full](HWND hwndEdit, const CommandCall& call) {
+      RcParser::getInstance().executeLine(full + " " + std::string(call.args), hwndEdit);
+    });
+  }
+
+  defineCommand("command", 3, A::Optional, CMD_BANG, "Define or list user commands", [](HWND hwndEdit, const CommandCall& call) {
+    if (!call.args.empty()) {
+      RcParser::getInstance().executeLine("command " + std::string(call.args), hwndEdit);
+      return;
+    }
+    auto commands = CommandRegistry::getInstance().listing(true);
+    if (commands.empty()) {
+      Utils::setStatus(TEXT("No user-defined commands found"));
+      return;
+    }
+    std::string list;
+    for (const auto& c : commands) list += c.keys + "\t" + c.desc + "\n";
+    showMessage(list, TEXT("User Commands"));
+  });
+  defineCommand("delcommand", 4, A::Required, 0, "Delete a user command", [](HWND, const CommandCall& call) {
+    if (!CommandRegistry::getInstance().removeUser(std::string(call.args))) {
+      Utils::setStatus(TEXT("E184: No such user-defined command"));
+    }
+  });
+
+  defineCommand("source", 2, A::Required, CMD_FILES, "Run commands from a file", [](HWND hwndEdit, const CommandCall& call) {
+    if (!RcParser::getInstance().parseFile(std::string(call.args), hwndEdit)) {
+      Utils::setStatus(TEXT("E484: Cannot open file"));
+    } else {
+      Utils::setStatus(TEXT("Configuration sourced"));
+    }
+  });
+  defineCommand("NppVimReload", 0, A::None, 0, "Reload nppvim.rc", [](HWND, const CommandCall&) {
+    loadConfig();
+    Utils::setStatus(TEXT("NppVim reloaded"));
+  });
+
+  defineCommand("version", 2, A::None, 0, "Show the NppVim version", [](HWND, const CommandCall&) {
+    WCHAR path[MAX_PATH];
+    GetModuleFileNameW((HMODULE)g_hInstance, path, MAX_PATH);
+    DWORD handle = 0;
+    DWORD size = GetFileVersionInfoSizeW(path, &handle);
+    if (size) {
+      std::vector<BYTE> data(size);
+      if (GetFileVersionInfoW(path, 0, size, data.data())) {
+        VS_FIXEDFILEINFO* info = nullptr;
+        UINT len = 0;
+        if (VerQueryValueW(data.data(), L"\\", (LPVOID*)&info, &len)) {
+          WCHAR version[64];
+          wsprintfW(version, L"NppVim Version: %d.%d.%d.%d",
+            HIWORD(info->dwFileVersionMS), LOWORD(info->dwFileVersionMS),
+            HIWORD(info->dwFileVersionLS), LOWORD(info->dwFileVersionLS));
+          Utils::setStatus(version);
         }
-    })
-    .set("reg", "Show registers", [this](HWND, int) {
-        showRegisters();
-    })
-    .set("registers", "Show registers", [this](HWND, int) {
-        showRegisters();
-    })
-    .set("di", "Show registers", [this](HWND, int) {
-        showRegisters();
-    })
-    .set("display", "Show registers", [this](HWND, int) {
-        showRegisters();
-    })
-    .set("h",    "Open command help", helpHandler)
-    .set("help", "Open command help", helpHandler)
-    .set("tutor", "Open tutor", tutorHandler)
-    .set("tut",   "Open tutor", tutorHandler)
-    .set("t",     "Open tutor", tutorHandler);
+      }
+    }
+  });
+
+  defineCommand("edit", 1, A::Optional, CMD_FILES, "Reload the file or open another", [](HWND, const CommandCall& call) {
+    std::string path(call.args);
+    if (path.empty()) {
+      // Preserve current behavior: reload current file
+      ::SendMessage(nppData._nppHandle, IDM_FILE_RELOAD, 0, 0);
+      Utils::setStatus(TEXT("File reloaded"));
+      return;
+    }
+    // Support :edit <filename>
+    int wideLen = MultiByteToWideChar(CP_UTF8, 0, path.c_str(), -1, NULL, 0);
+    if (wideLen > 0) {
+      std::vector<wchar_t> pathWide(wideLen);
+      MultiByteToWideChar(CP_UTF8, 0, path.c_str(), -1, pathWide.data(), wideLen);
+
+      wchar_t currentFile[MAX_PATH] = {0};
+      ::SendMessageW(nppData._nppHandle, NPPM_GETFULLCURRENTPATH, MAX_PATH, (LPARAM)currentFile);
+
+      wchar_t currentDir[MAX_PATH] = {0};
+      wcscpy_s(currentDir, currentFile);
+      PathRemoveFileSpecW(currentDir);
+
+      wchar_t fullPath[MAX_PATH] = {0};
+      if (PathIsRelativeW(pathWide.data())) {
+        PathCombineW(fullPath, currentDir, pathWide.data());
+      } else {
+        wcscpy_s(fullPath, pathWide.data());
+      }
+
+      if (!PathFileExistsW(fullPath)) {
+        // Create the file
+        HANDLE hFile = CreateFileW(fullPath, GENERIC_WRITE, 0, NULL, CREATE_NEW, FILE_ATTRIBUTE_NORMAL, NULL);
+        if (hFile != INVALID_HANDLE_VALUE) {
+          CloseHandle(hFile);
+        }
+      }
+      ::SendMessageW(nppData._nppHandle, NPPM_DOOPEN, 0, (LPARAM)fullPath);
+    }
+  });
+  defineCommand("editrc", 0, A::None, 0, "Edit nppvim.rc", [](HWND, const CommandCall&) { ConfigManager::getInstance().editRc(); });
+  defineCommand("erc", 0, A::None, 0, "Edit nppvim.rc", [](HWND, const CommandCall&) { ConfigManager::getInstance().editRc(); });
+  defineCommand("editini", 0, A::None, 0, "Edit config.ini", [](HWND, const CommandCall&) { ConfigManager::getInstance().editIni(); });
+  defineCommand("eini", 0, A::None, 0, "Edit config.ini", [](HWND, const CommandCall&) { ConfigManager::getInstance().editIni(); });
+
+  defineCommand("sort", 3, A::Optional, CMD_BANG, "Sort lines (n: numeric, !: descending)", [](HWND, const CommandCall& call) {
+    bool descending = call.bang;
+    std::string_view how = call.args;
+    if (how == "n!") {
+      descending = true;
+      how = "n";
+    }
+    if (how.empty()) {
+      ::SendMessage(nppData._nppHandle, WM_COMMAND, descending ? IDM_EDIT_SORTLINES_LEXICOGRAPHIC_DESCENDING : IDM_EDIT_SORTLINES_LEXICOGRAPHIC_ASCENDING, 0);
+      Utils::setStatus(descending ? TEXT("Lines sorted (descending)") : TEXT("Lines sorted"));
+    } else if (how == "n") {
+      ::SendMessage(nppData._nppHandle, WM_COMMAND, descending ? IDM_EDIT_SORTLINES_INTEGER_DESCENDING : IDM_EDIT_SORTLINES_INTEGER_ASCENDING, 0);
+      Utils::setStatus(descending ? TEXT("Lines sorted (numeric descending)") : TEXT("Lines sorted (numeric)"));
+    } else {
+      Utils::setStatus(TEXT("Use: sort, sort!, sort n, sort n!"));
+    }
+  });
+
+  defineCommand("wrap", 0, A::Optional, 0, "Set wrap mode (off, char, whitespace)", wrap);
+  defineCommand("wrapmode", 0, A::Optional, 0, "Set wrap mode (off, char, whitespace)", wrap);
+  defineCommand("nowrap", 0, A::None, 0, "Disable wrapping", [](HWND hwndEdit, const CommandCall&) {
+    ::SendMessage(hwndEdit, SCI_SETWRAPMODE, SC_WRAP_NONE, 0);
+    Utils::setStatus(TEXT("Word wrap disabled"));
+  });
+
+  defineCommand("write", 1, A::None, CMD_BANG, "Save current file (! even if unchanged)", [](HWND, const CommandCall& call) {
+    saveCurrentFile(call.bang);
+    Utils::setStatus(TEXT("File saved"));
+  });
+  defineCommand("quit", 1, A::None, CMD_BANG, "Close current file (! discards changes)", [](HWND hwndEdit, const CommandCall& call) {
+    if (call.bang) ::SendMessage(hwndEdit, SCI_SETSAVEPOINT, 0, 0);
+    ::SendMessage(nppData._nppHandle, WM_COMMAND, IDM_FILE_CLOSE, 0);
+  });
+  defineCommand("qall", 2, A::None, CMD_BANG, "Close all files (! discards changes)", closeAll);
+  defineCommand("quitall", 5, A::None, CMD_BANG, "Close all files (! discards changes)", closeAll);
+  defineCommand("wq", 0, A::None, CMD_BANG, "Save and close file", saveAndClose);
+  defineCommand("xit", 1, A::None, CMD_BANG, "Save and close file", saveAndClose);
+  defineCommand("wqall", 3, A::None, CMD_BANG, "Save all and close all files", [](HWND, const CommandCall&) {
+    ::SendMessage(nppData._nppHandle, NPPM_SAVEALLFILES, 0, 0);
+    ::SendMessage(nppData._nppHandle, WM_COMMAND, IDM_FILE_CLOSEALL, 0);
+  });
+
+  defineCommand("bnext", 2, A::None, 0, "Next tab", [](HWND, const CommandCall&) {
+    ::SendMessage(nppData._nppHandle, IDM_VIEW_TAB_NEXT, 0, 0);
+  });
+  defineCommand("bprevious", 2, A::None, 0, "Previous tab", [](HWND, const CommandCall&) {
+    ::SendMessage(nppData._nppHandle, IDM_VIEW_TAB_PREV, 0, 0);
+  });
+  defineCommand("bdelete", 2, A::None, 0, "Close current tab", [](HWND, const CommandCall&) {
+    ::SendMessage(nppData._nppHandle, WM_COMMAND, IDM_FILE_CLOSE, 0);
+  });
+  defineCommand("vsplit", 2, A::None, 0, "Toggle split", split);
+  defineCommand("split", 2, A::None, 0, "Toggle split", split);
+
+  defineCommand("gh", 0, A::None, 0, "Open GitHub", [](HWND, const CommandCall&) {
+    ShellExecuteW(NULL, L"open", L"https://github.com/h-jangra/nppvim", NULL, NULL, SW_SHOWNORMAL);
+  });
+  defineCommand("paypal", 0, A::None, 0, "Donate via PayPal", donate);
+  defineCommand("donate", 0, A::None, 0, "Donate via PayPal", donate);
+  defineCommand("about", 0, A::None, 0, "About NppVim", [](HWND, const CommandCall&) { about(); });
+  defineCommand("config", 0, A::None, 0, "NppVim Configuration", [](HWND, const CommandCall&) { showConfigDialog(); });
+
+  defineCommand("nohlsearch", 3, A::None, 0, "Clear search highlight", clearHighlight);
+
+  defineCommand("move", 1, A::Required, CMD_RANGE, "Move lines below an address", [this](HWND h, const CommandCall& call) {
+    transferLines(h, call, false);
+  });
+  defineCommand("copy", 2, A::Required, CMD_RANGE, "Copy lines below an address", [this](HWND h, const CommandCall& call) {
+    transferLines(h, call, true);
+  });
+  defineCommand("t", 0, A::Required, CMD_RANGE, "Copy lines below an address", [this](HWND h, const CommandCall& call) {
+    transferLines(h, call, true);
+  });
+
+  defineCommand("!", 0, A::Optional, CMD_RANGE | CMD_BANG, "Filter lines or run a shell command", [this](HWND h, const CommandCall& call) {
+    shellCommand(h, call);
+  });
+  defineCommand("read", 1, A::Optional, CMD_RANGE | CMD_BANG | CMD_FILES, "Insert a file or command output below", [this](HWND h, const CommandCall& call) {
+    readCommand(h, call);
+  });
+
+  defineCommand("marks", 0, A::None, 0, "List marks", [this](HWND hwndEdit, const CommandCall&) {
+    handleMarksCommand(hwndEdit, "marks");
+  });
+  defineCommand("delmarks", 4, A::Optional, CMD_BANG, "Delete marks (! for all)", [this](HWND hwndEdit, const CommandCall& call) {
+    handleMarksCommand(hwndEdit, call.bang ? "delm!" : "delm " + std::string(call.args));
+  });
+
+  defineCommand("registers", 3, A::Optional, CMD_REGISTERS, "Show registers", registers);
+  defineCommand("display", 2, A::Optional, CMD_REGISTERS, "Show registers", registers);
+  defineCommand("help", 1, A::Optional, 0, "Open command help", help);
+  defineCommand("tutor", 3, A::None, 0, "Open tutor", tutor);
 }
 
 static void appendNonKeymapHelp(std::string& help) {
@@ -1463,7 +2091,7 @@ void CommandMode::previewSubstitutionFromBuffer(HWND h) {
     previewSubstitution(h, pat, rep, regex, global);
 }
 
-void CommandMode::showRegisters() {
+void CommandMode::showRegisters(const std::string& only) {
     HWND h = Utils::getCurrentScintillaHandle();
     if (!h) return;
     
@@ -1540,11 +2168,14 @@ void CommandMode::showRegisters() {
     registersText += "Type Name  Preview                              Lines\n";
     registersText += "──── ───── ──────────────────────────────────── ─────\n";
     
+    auto wanted = [&only](char reg) { return only.empty() || only.find(reg) != std::string::npos; };
+
     for (char reg = 'a'; reg <= 'z'; reg++) {
-        std::string content = Utils::getRegisterContent(reg);
-        if (!content.empty()) {
-            std::string preview = getPreview(content, 35);
-            int lines = countLines(content);
+        if (!wanted(reg)) continue;
+        RegisterText content = Utils::getRegisterText(reg);
+        if (content) {
+            std::string preview = getPreview(*content, 35);
+            int lines = countLines(*content);
             
             char line[80];
             sprintf_s(line, "char  \"%c   %-35s %4d\n", 
@@ -1561,10 +2192,11 @@ void CommandMode::showRegisters() {
     registersText += "──── ───── ──────────────────────────────────── ─────\n";
     
     for (char reg = '0'; reg <= '9'; reg++) {
-        std::string content = Utils::getRegisterContent(reg);
-        if (!content.empty()) {
-            std::string preview = getPreview(content, 35);
-            int lines = countLines(content);
+        if (!wanted(reg)) continue;
+        RegisterText content = Utils::getRegisterText(reg);
+        if (content) {
+            std::string preview = getPreview(*content, 35);
+            int lines = countLines(*content);
             
             char line[80];
             sprintf_s(line, "char  \"%c   %-35s %4d\n", 
@@ -1581,20 +2213,7 @@ void CommandMode::showRegisters() {
     registersText += "──── ───── ─────────────────────────────────── ───────\n";
     
     // System clipboard
-    std::string clipboardPreview;
-    if (IsClipboardFormatAvailable(CF_TEXT)) {
-        if (OpenClipboard(NULL)) {
-            HANDLE hData = GetClipboardData(CF_TEXT);
-            if (hData) {
-                char* pszText = (char*)GlobalLock(hData);
-                if (pszText) {
-                    clipboardPreview = getPreview(pszText, 30);
-                    GlobalUnlock(hData);
-                }
-            }
-            CloseClipboard();
-        }
-    }
+    std::string clipboardPreview = getPreview(Utils::getClipboardText(), 30);
     
     char line[80];
     sprintf_s(line, "sys   \"+   System clipboard               %s\n", 
@@ -1615,10 +2234,10 @@ void CommandMode::showRegisters() {
     }
     
     // Black hole
-    std::string blackhole = Utils::getRegisterContent('_');
-    if (!blackhole.empty()) {
+    RegisterText blackhole = Utils::getRegisterText('_');
+    if (blackhole) {
         sprintf_s(line, "spec  \"_   Black hole register           %s\n", 
-                 getPreview(blackhole, 30).c_str());
+                 getPreview(*blackhole, 30).c_str());
         registersText += line;
     } else {
         registersText += "spec  \"_   Black hole register           (empty)\n";
@@ -0,0 +1,307 @@
+#include "../include/CommandRegistry.h"
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+
+CommandRegistry& CommandRegistry::getInstance() {
+    static CommandRegistry instance;
+    return instance;
+}
+
+static unsigned long long hashName(std::string_view name) {
+    // FNV-1a
+    unsigned long long h = 14695981039346656037ULL;
+    for (unsigned char c : name) {
+        h ^= c;
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+static unsigned long long mix(unsigned long long x) {
+    x ^= x >> 30;
+    x *= 0xBF58476D1CE4E5B9ULL;
+    x ^= x >> 27;
+    x *= 0x94D049BB133111EBULL;
+    x ^= x >> 31;
+    return x;
+}
+
+static size_t slotOf(unsigned long long h, unsigned int displacement, size_t slotCount) {
+    return (size_t)(mix(h ^ ((displacement + 1ULL) * 0x9E3779B97F4A7C15ULL)) % slotCount);
+}
+
+void CommandRegistry::add(const ColonCommand& command) {
+    for (auto& existing : commands) {
+        if (!existing.user && existing.name == command.name) {
+            existing = command;
+            existing.user = false;
+            dirty = true;
+            return;
+        }
+    }
+    commands.push_back(command);
+    commands.back().user = false;
+    dirty = true;
+}
+
+void CommandRegistry::addUser(const std::string& name, const std::string& replacement) {
+    for (auto& existing : commands) {
+        if (existing.user && existing.name == name) {
+            existing.replacement = replacement;
+            return;
+        }
+    }
+    ColonCommand command;
+    command.name = name;
+    command.args = CommandArgs::Optional;
+    command.range = true;
+    command.replacement = replacement;
+    command.user = true;
+    commands.push_back(command);
+    dirty = true;
+}
+
+bool CommandRegistry::removeUser(const std::string& name) {
+    auto it = std::find_if(commands.begin(), commands.end(),
+        [&](const ColonCommand& c) { return c.user && c.name == name; });
+    if (it == commands.end()) return false;
+    commands.erase(it);
+    dirty = true;
+    return true;
+}
+
+void CommandRegistry::clearUser() {
+    auto end = std::remove_if(commands.begin(), commands.end(), [](const ColonCommand& c) { return c.user; });
+    if (end == commands.end()) return;
+    commands.erase(end, commands.end());
+    dirty = true;
+}
+
+int CommandRegistry::childOf(int node, char key) const {
+    const auto& children = trie[node].children;
+    auto it = std::lower_bound(children.begin(), children.end(), key,
+        [](const std::pair<char, int>& child, char k) { return child.first < k; });
+    return (it != children.end() && it->first == key) ? it->second : -1;
+}
+
+void CommandRegistry::buildTrie() const {
+    trie.assign(1, TrieNode());
+    for (size_t i = 0; i < commands.size(); i++) {
+        int node = 0;
+        trie[0].count++;
+        for (char key : commands[i].name) {
+            int child = childOf(node, key);
+            if (child < 0) {
+                child = (int)trie.size();
+                trie.emplace_back();
+                auto& children = trie[node].children;
+                auto at = std::lower_bound(children.begin(), children.end(), key,
+                    [](const std::pair<char, int>& c, char k) { return c.first < k; });
+                children.insert(at, { key, child });
+            }
+            node = child;
+            trie[node].count++;
+        }
+        // A user command named like a built-in owns the name
+        if (trie[node].command < 0 || commands[i].user) trie[node].command = (int)i;
+    }
+}
+
+size_t CommandRegistry::uniquePrefix(const std::string& name) const {
+    int node = 0;
+    for (size_t i = 0; i < name.size(); i++) {
+        node = childOf(node, name[i]);
+        if (node < 0) break;
+        if (trie[node].count == 1) return i + 1;
+    }
+    return name.size();
+}
+
+void CommandRegistry::buildHash(const std::unordered_map<std::string, int>& spellings) const {
+    slots.clear();
+    displacement.clear();
+    spellingPool.clear();
+    if (spellings.empty()) return;
+
+    struct Key {
+        const std::string* text;
+        int command;
+        unsigned long long hash;
+    };
+
+    size_t keyCount = spellings.size();
+    size_t slotCount = keyCount + keyCount / 4 + 1;
+    size_t bucketCount = keyCount / 2 + 1;
+
+    for (;;) {
+        std::vector<std::vector<Key>> buckets(bucketCount);
+        for (const auto& [text, command] : spellings) {
+            unsigned long long h = hashName(text);
+            buckets[mix(h) % bucketCount].push_back({ &text, command, h });
+        }
+        std::vector<size_t> order(bucketCount);
+        for (size_t i = 0; i < bucketCount; i++) order[i] = i;
+        std::stable_sort(order.begin(), order.end(),
+            [&](size_t a, size_t b) { return buckets[a].size() > buckets[b].size(); });
+
+        slots.assign(slotCount, Slot());
+        displacement.assign(bucketCount, 0);
+        std::vector<size_t> taken;
+        bool placedAll = true;
+
+        // Largest buckets first, each with the first displacement that puts
+        // all of its keys in free, distinct slots.
+        for (size_t b : order) {
+            const auto& bucket = buckets[b];
+            if (bucket.empty()) break;
+            bool placed = false;
+            for (unsigned int d = 0; d < (1u << 16) && !placed; d++) {
+                taken.clear();
+                placed = true;
+                for (const Key& key : bucket) {
+                    size_t slot = slotOf(key.hash, d, slotCount);
+                    if (slots[slot].command >= 0 || std::find(taken.begin(), taken.end(), slot) != taken.end()) {
+                        placed = false;
+                        break;
+                    }
+                    taken.push_back(slot);
+                }
+                if (!placed) continue;
+                displacement[b] = d;
+                for (size_t k = 0; k < bucket.size(); k++) {
+                    Slot& slot = slots[taken[k]];
+                    slot.offset = (unsigned int)spellingPool.size();
+                    slot.length = (unsigned int)bucket[k].text->size();
+                    slot.command = bucket[k].command;
+                    spellingPool += *bucket[k].text;
+                }
+            }
+            if (!placed) {
+                placedAll = false;
+                break;
+            }
+        }
+        if (placedAll) return;
+
+        spellingPool.clear();
+        slotCount *= 2;
+    }
+}
+
+void CommandRegistry::index() const {
+    buildTrie();
+
+    // Earlier registrations win a shared abbreviation, and no abbreviation
+    // takes a name another command has in full.
+    std::unordered_map<std::string, int> spellings;
+    for (size_t i = 0; i < commands.size(); i++) {
+        if (!commands[i].user) spellings.emplace(commands[i].name, (int)i);
+    }
+    for (size_t i = 0; i < commands.size(); i++) {
+        const ColonCommand& command = commands[i];
+        if (command.user) continue;
+        size_t shortest = command.abbreviation ? command.abbreviation : uniquePrefix(command.name);
+        for (size_t length = shortest; length < command.name.size(); length++) {
+            spellings.emplace(command.name.substr(0, length), (int)i);
+        }
+    }
+    for (size_t i = 0; i < commands.size(); i++) {
+        if (commands[i].user) spellings[commands[i].name] = (int)i;
+    }
+    for (size_t i = 0; i < commands.size(); i++) {
+        const ColonCommand& command = commands[i];
+        if (!command.user) continue;
+        for (size_t length = uniquePrefix(command.name); length < command.name.size(); length++) {
+            spellings.emplace(command.name.substr(0, length), (int)i);
+        }
+    }
+
+    buildHash(spellings);
+    dirty = false;
+}
+
+const ColonCommand* CommandRegistry::find(std::string_view name) const {
+    if (dirty) index();
+    if (slots.empty() || name.empty()) return nullptr;
+
+    unsigned long long h = hashName(name);
+    const Slot& slot = slots[slotOf(h, displacement[mix(h) % displacement.size()], slots.size())];
+    if (slot.command < 0 || std::string_view(spellingPool.data() + slot.offset, slot.length) != name) return nullptr;
+    return &commands[slot.command];
+}
+
+static bool isBlank(char c) {
+    return c == ' ' || c == '\t';
+}
+
+static std::string_view trimBlanks(std::string_view s) {
+    while (!s.empty() && isBlank(s.front())) s.remove_prefix(1);
+    while (!s.empty() && isBlank(s.back())) s.remove_suffix(1);
+    return s;
+}
+
+bool CommandRegistry::parse(std::string_view line, CommandCall& call) {
+    call = CommandCall();
+    call.line = line;
+
+    size_t i = 0;
+    size_t n = line.size();
+    while (i < n && isBlank(line[i])) i++;
+
+    size_t rangeStart = i;
+    while (i < n) {
+        char c = line[i];
+        if (std::isdigit((unsigned char)c) || isBlank(c) || (c && strchr(".,;$%+-", c))) i++;
+        else if (c == '\'' && i + 1 < n) i += 2;
+        else break;
+    }
+    call.range = trimBlanks(line.substr(rangeStart, i - rangeStart));
+
+    if (i < n && std::isalpha((unsigned char)line[i])) {
+        // User commands start upper case and may contain digits
+        bool user = std::isupper((unsigned char)line[i]) != 0;
+        size_t nameStart = i;
+        while (i < n && (std::isalpha((unsigned char)line[i]) || (user && std::isdigit((unsigned char)line[i])))) i++;
+        call.name = line.substr(nameStart, i - nameStart);
+    } else if (i < n) {
+        // One-character commands such as :! or :&
+        call.name = line.substr(i, 1);
+        i++;
+    }
+
+    if (i < n && line[i] == '!') {
+        call.bang = true;
+        i++;
+    }
+    call.args = trimBlanks(line.substr(i));
+    return !call.name.empty();
+}
+
+void CommandRegistry::collect(int node, std::vector<const ColonCommand*>& out) const {
+    if (trie[node].command >= 0) out.push_back(&commands[trie[node].command]);
+    for (const auto& child : trie[node].children) collect(child.second, out);
+}
+
+void CommandRegistry::complete(std::string_view prefix, std::vector<const ColonCommand*>& out) const {
+    if (dirty) index();
+    int node = 0;
+    for (char key : prefix) {
+        node = childOf(node, key);
+        if (node < 0) return;
+    }
+    collect(node, out);
+}
+
+std::vector<KeyBinding> CommandRegistry::listing(bool userOnly) const {
+    std::vector<KeyBinding> result;
+    for (const ColonCommand& command : commands) {
+        if (userOnly && !command.user) continue;
+        std::string keys = command.name;
+        if (command.abbreviation > 0 && command.abbreviation < command.name.size()) {
+            keys = command.name.substr(0, command.abbreviation) + "[" + command.name.substr(command.abbreviation) + "]";
+        }
+        result.push_back({ keys, command.user ? ":" + command.replacement : command.description });
+    }
+    return result;
+}
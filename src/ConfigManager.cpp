@@ -132,6 +132,10 @@ void ConfigManager::saveConfig() {
     }
 }
 
+std::string ConfigManager::getRcCachePath() {
+    return getPluginsConfigDir() + "\\NppVim\\nppvim.rc.cache";
+}
+
 std::string ConfigManager::getRcPath() {
     if (!rcFilePath.empty()) return rcFilePath;
 
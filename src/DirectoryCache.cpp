@@ -0,0 +1,121 @@
+#include "../include/DirectoryCache.h"
+#include "../include/Utils.h"
+#include <algorithm>
+#include <map>
+#include <mutex>
+#include <numeric>
+#include <thread>
+
+struct DirectoryCache::Shared {
+    struct Entry {
+        std::shared_ptr<const DirectoryListing> listing;
+        ULONGLONG readAt = 0;
+        ULONGLONG lastUse = 0;
+        bool reading = false;
+    };
+
+    std::mutex mutex;
+    std::map<std::string, Entry> entries;    // keyed by folded path
+};
+
+DirectoryCache& DirectoryCache::getInstance() {
+    static DirectoryCache instance;
+    return instance;
+}
+
+DirectoryCache::DirectoryCache() : shared(std::make_shared<Shared>()) {}
+
+std::string DirectoryCache::fold(std::string_view name) {
+    std::string folded(name);
+    for (char& c : folded) {
+        if (c >= 'A' && c <= 'Z') c = (char)(c - 'A' + 'a');
+        else if (c == '/') c = '\\';
+    }
+    return folded;
+}
+
+std::pair<size_t, size_t> DirectoryCache::matching(const DirectoryListing& listing, std::string_view prefix) {
+    std::string key = fold(prefix);
+    auto begin = listing.folded.begin();
+    auto end = listing.folded.end();
+    auto first = std::lower_bound(begin, end, key);
+    auto last = end;
+    if (!key.empty() && (unsigned char)key.back() != 0xFF) {
+        // Everything before the prefix with its last byte bumped starts with it
+        key.back() = (char)(key.back() + 1);
+        last = std::lower_bound(first, end, key);
+    } else if (!key.empty()) {
+        last = first;
+        while (last != end && last->compare(0, key.size(), key) == 0) ++last;
+    }
+    return { (size_t)(first - begin), (size_t)(last - begin) };
+}
+
+void DirectoryCache::read(std::shared_ptr<Shared> shared, std::string dir) {
+    std::wstring pattern;
+    int len = MultiByteToWideChar(CP_UTF8, 0, dir.c_str(), -1, NULL, 0);
+    if (len > 0) {
+        pattern.resize(len);
+        MultiByteToWideChar(CP_UTF8, 0, dir.c_str(), -1, &pattern[0], len);
+        pattern.pop_back();
+    }
+    if (!pattern.empty() && pattern.back() != L'\\' && pattern.back() != L'/') pattern += L'\\';
+    pattern += L'*';
+
+    std::vector<std::string> names;
+    WIN32_FIND_DATAW data;
+    HANDLE find = FindFirstFileW(pattern.c_str(), &data);
+    if (find != INVALID_HANDLE_VALUE) {
+        do {
+            if (wcscmp(data.cFileName, L".") == 0 || wcscmp(data.cFileName, L"..") == 0) continue;
+            std::string name = Utils::toUtf8(std::wstring(data.cFileName));
+            if (data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) name += '\\';
+            names.push_back(std::move(name));
+        } while (FindNextFileW(find, &data));
+        FindClose(find);
+    }
+
+    auto listing = std::make_shared<DirectoryListing>();
+    std::vector<std::string> folded(names.size());
+    for (size_t i = 0; i < names.size(); i++) folded[i] = fold(names[i]);
+    std::vector<size_t> order(names.size());
+    std::iota(order.begin(), order.end(), (size_t)0);
+    std::sort(order.begin(), order.end(), [&](size_t a, size_t b) { return folded[a] < folded[b]; });
+    listing->names.reserve(names.size());
+    listing->folded.reserve(names.size());
+    for (size_t i : order) {
+        listing->names.push_back(std::move(names[i]));
+        listing->folded.push_back(std::move(folded[i]));
+    }
+
+    std::lock_guard<std::mutex> lock(shared->mutex);
+    auto it = shared->entries.find(fold(dir));
+    if (it == shared->entries.end()) return;
+    it->second.listing = listing;
+    it->second.readAt = GetTickCount64();
+    it->second.reading = false;
+}
+
+std::shared_ptr<const DirectoryListing> DirectoryCache::lookup(const std::string& dir) {
+    std::string key = fold(dir);
+    ULONGLONG now = GetTickCount64();
+
+    std::lock_guard<std::mutex> lock(shared->mutex);
+    auto it = shared->entries.find(key);
+    if (it == shared->entries.end()) {
+        if (shared->entries.size() >= MAX_DIRECTORIES) {
+            auto oldest = std::min_element(shared->entries.begin(), shared->entries.end(),
+                [](const auto& a, const auto& b) { return a.second.lastUse < b.second.lastUse; });
+            if (!oldest->second.reading) shared->entries.erase(oldest);
+        }
+        it = shared->entries.emplace(key, Shared::Entry()).first;
+    }
+
+    Shared::Entry& entry = it->second;
+    entry.lastUse = now;
+    if (!entry.reading && (!entry.listing || now - entry.readAt > REFRESH_MS)) {
+        entry.reading = true;
+        std::thread(read, shared, dir).detach();
+    }
+    return entry.listing;
+}
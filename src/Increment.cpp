@@ -0,0 +1,282 @@
+#include "../include/Increment.h"
+#include "../include/OptionRegistry.h"
+#include "../include/Utils.h"
+#include "../plugin/Scintilla.h"
+#include <algorithm>
+
+namespace {
+
+enum NumberKind { NUM_DECIMAL, NUM_HEX, NUM_OCTAL, NUM_BIN, NUM_ALPHA };
+
+struct Number {
+    NumberKind kind;
+    size_t start;       // the sign or prefix
+    size_t digits;
+    size_t end;
+    bool negative;
+};
+
+bool isDigit(char c) { return c >= '0' && c <= '9'; }
+bool isBinDigit(char c) { return c == '0' || c == '1'; }
+bool isHexDigit(char c) { return isDigit(c) || ((c | 0x20) >= 'a' && (c | 0x20) <= 'f'); }
+bool isLetter(char c) { return (c | 0x20) >= 'a' && (c | 0x20) <= 'z'; }
+bool isBlank(char c) { return c == ' ' || c == '\t'; }
+
+size_t runEnd(std::string_view s, size_t i, bool (*accept)(char)) {
+    while (i < s.size() && accept(s[i])) i++;
+    return i;
+}
+
+// The numbers are read left to right, so the caret inside one, on its sign
+// or on the "x" of "0x" finds the whole of it.
+bool findNumber(std::string_view line, size_t from, unsigned formats, Number& n) {
+    for (size_t i = 0; i < line.size();) {
+        char c = line[i];
+        if (!isDigit(c)) {
+            if ((formats & Increment::FORMAT_ALPHA) && isLetter(c) && i >= from) {
+                n = { NUM_ALPHA, i, i, i + 1, false };
+                return true;
+            }
+            i++;
+            continue;
+        }
+
+        char x = i + 2 < line.size() ? (char)(line[i + 1] | 0x20) : '\0';
+        n.start = i;
+        n.negative = false;
+        if (c == '0' && x == 'x' && (formats & Increment::FORMAT_HEX) && isHexDigit(line[i + 2])) {
+            n.kind = NUM_HEX;
+            n.digits = i + 2;
+            n.end = runEnd(line, n.digits, isHexDigit);
+        } else if (c == '0' && x == 'b' && (formats & Increment::FORMAT_BIN) && isBinDigit(line[i + 2])) {
+            n.kind = NUM_BIN;
+            n.digits = i + 2;
+            n.end = runEnd(line, n.digits, isBinDigit);
+        } else {
+            n.kind = NUM_DECIMAL;
+            n.digits = i;
+            n.end = runEnd(line, i, isDigit);
+            if ((formats & Increment::FORMAT_OCTAL) && c == '0' && n.end - i > 1 &&
+                std::all_of(line.begin() + i, line.begin() + n.end, [](char d) { return d <= '7'; })) {
+                n.kind = NUM_OCTAL;
+                n.digits = i + 1;
+            } else if (!(formats & Increment::FORMAT_UNSIGNED) && i > 0 && line[i - 1] == '-' &&
+                       (!(formats & Increment::FORMAT_BLANK) || i == 1 || isBlank(line[i - 2]))) {
+                n.start = i - 1;
+                n.negative = true;
+            }
+        }
+        if (n.end > from) return true;
+        i = n.end;
+    }
+    return false;
+}
+
+// Digits are kept as values, most significant first.
+void addTo(std::string& d, int base, unsigned long long amount) {
+    for (size_t i = d.size(); i-- > 0 && amount;) {
+        unsigned long long v = (unsigned long long)d[i] + amount % base;
+        amount = amount / base + v / base;
+        d[i] = (char)(v % base);
+    }
+    for (; amount; amount /= base) d.insert(d.begin(), (char)(amount % base));
+}
+
+// False when amount is the larger; d then holds the difference modulo
+// base to the power of its length.
+bool subtractFrom(std::string& d, int base, unsigned long long amount) {
+    for (size_t i = d.size(); i-- > 0 && amount;) {
+        int b = (int)(amount % base);
+        amount /= base;
+        if (d[i] >= b) {
+            d[i] = (char)(d[i] - b);
+        } else {
+            d[i] = (char)(d[i] + base - b);
+            amount++;
+        }
+    }
+    return amount == 0;
+}
+
+unsigned long long valueOf(const std::string& d, int base) {
+    unsigned long long v = 0;
+    for (char digit : d) v = v * base + digit;
+    return v;
+}
+
+std::string digitsOf(unsigned long long v, int base) {
+    std::string d;
+    do {
+        d.insert(d.begin(), (char)(v % base));
+        v /= base;
+    } while (v);
+    return d;
+}
+
+unsigned currentFormats() {
+    unsigned formats;
+    if (!Increment::parseFormats(Options::nrformats.get(), formats))
+        formats = Increment::FORMAT_BIN | Increment::FORMAT_HEX;
+    return formats;
+}
+
+// Changes the first number in text[a, b) and copies up to it into out.
+bool adjustSpan(const std::string& text, size_t a, size_t b, long long delta, unsigned formats,
+                std::string& out, size_t& copied) {
+    Increment::Edit edit;
+    if (!Increment::adjust(std::string_view(text).substr(a, b - a), 0, delta, formats, edit)) return false;
+    out.append(text, copied, a + edit.start - copied);
+    out += edit.text;
+    copied = a + edit.end;
+    return true;
+}
+
+}
+
+bool Increment::parseFormats(const std::string& spec, unsigned& formats) {
+    formats = 0;
+    size_t pos = 0;
+    while (pos < spec.size()) {
+        size_t comma = spec.find(',', pos);
+        if (comma == std::string::npos) comma = spec.size();
+        std::string name = spec.substr(pos, comma - pos);
+        pos = comma + 1;
+
+        if (name.empty()) continue;
+        else if (name == "bin") formats |= FORMAT_BIN;
+        else if (name == "hex") formats |= FORMAT_HEX;
+        else if (name == "octal") formats |= FORMAT_OCTAL;
+        else if (name == "alpha") formats |= FORMAT_ALPHA;
+        else if (name == "unsigned") formats |= FORMAT_UNSIGNED;
+        else if (name == "blank") formats |= FORMAT_BLANK;
+        else return false;
+    }
+    return true;
+}
+
+// Hex, octal and binary keep their width and wrap around within it, so
+// 0x00 - 1 is 0xff. Decimal keeps leading zeros and crosses zero to the
+// other sign, or stops at zero when unsigned.
+bool Increment::adjust(std::string_view line, size_t from, long long delta, unsigned formats, Edit& edit) {
+    Number n;
+    if (delta == 0 || !findNumber(line, from, formats, n)) return false;
+
+    bool up = delta > 0;
+    unsigned long long amount = up ? (unsigned long long)delta : 0ULL - (unsigned long long)delta;
+    edit.start = n.start;
+    edit.end = n.end;
+
+    if (n.kind == NUM_ALPHA) {
+        char c = line[n.start];
+        char first = c >= 'a' ? 'a' : 'A';
+        unsigned long long at = (unsigned long long)(c - first);
+        if (up) at = amount >= 25 - at ? 25 : at + amount;
+        else at = amount >= at ? 0 : at - amount;
+        edit.text.assign(1, (char)(first + at));
+        return true;
+    }
+
+    int base = n.kind == NUM_HEX ? 16 : n.kind == NUM_OCTAL ? 8 : n.kind == NUM_BIN ? 2 : 10;
+    std::string d(line.substr(n.digits, n.end - n.digits));
+    bool upper = false;
+    for (char& c : d) {
+        if (isLetter(c)) upper = c < 'a';
+        c = (char)(isDigit(c) ? c - '0' : (c | 0x20) - 'a' + 10);
+    }
+    size_t width = d.size();
+    bool negative = n.negative;
+
+    if (base != 10) {
+        if (up) addTo(d, base, amount);
+        else subtractFrom(d, base, amount);
+        if (d.size() > width) d.erase(0, d.size() - width);
+    } else if (up != negative) {
+        addTo(d, base, amount);
+    } else {
+        std::string before = d;
+        if (!subtractFrom(d, base, amount)) {
+            if (formats & FORMAT_UNSIGNED) {
+                d.assign(1, 0);
+            } else {
+                d = digitsOf(amount - valueOf(before, base), base);
+                negative = !negative;
+            }
+        }
+    }
+
+    if (base == 10) {
+        size_t zeros = 0;
+        while (zeros + 1 < d.size() && d[zeros] == 0) zeros++;
+        d.erase(0, zeros);
+        if (width > 1 && line[n.digits] == '0' && d.size() < width) d.insert(0, width - d.size(), 0);
+        if (std::all_of(d.begin(), d.end(), [](char v) { return v == 0; })) negative = false;
+        edit.text = negative ? "-" : "";
+    } else {
+        edit.text.assign(line.substr(n.start, n.digits - n.start));
+    }
+
+    const char* chars = upper ? "0123456789ABCDEF" : "0123456789abcdef";
+    for (char v : d) edit.text += chars[(int)v];
+    return true;
+}
+
+void Increment::atCaret(HWND hwnd, long long delta) {
+    int line = Utils::caretLine(hwnd);
+    int start = Utils::lineStart(hwnd, line);
+    std::string text = Utils::getTextRange(hwnd, start, Utils::lineEnd(hwnd, line));
+
+    Edit edit;
+    if (!adjust(text, Utils::caretPos(hwnd) - start, delta, currentFormats(), edit)) return;
+    Utils::replaceTarget(hwnd, start + (int)edit.start, start + (int)edit.end, edit.text);
+    ::SendMessage(hwnd, SCI_SETEMPTYSELECTION, start + edit.start + edit.text.size() - 1, 0);
+}
+
+// The selected text is fetched once and written back with one replace,
+// which Scintilla trims to the changed bytes, however many lines it spans.
+void Increment::inRange(HWND hwnd, int start, int end, long long delta, bool progressive) {
+    if (start >= end) return;
+    std::string text = Utils::getTextRange(hwnd, start, end);
+    unsigned formats = currentFormats();
+
+    std::string out;
+    out.reserve(text.size() + 64);
+    size_t copied = 0;
+    long long changed = 0;
+    for (size_t a = 0; a < text.size();) {
+        size_t b = text.find_first_of("\r\n", a);
+        if (b == std::string::npos) b = text.size();
+        if (adjustSpan(text, a, b, progressive ? delta * (changed + 1) : delta, formats, out, copied))
+            changed++;
+        if (b + 1 < text.size() && text[b] == '\r' && text[b + 1] == '\n') b++;
+        a = b + 1;
+    }
+    if (!changed) return;
+    out.append(text, copied, std::string::npos);
+    ::SendMessage(hwnd, SCI_SETTARGETRANGE, start, end);
+    ::SendMessage(hwnd, SCI_REPLACETARGETMINIMAL, out.size(), (LPARAM)out.data());
+}
+
+void Increment::inBlock(HWND hwnd, const BlockSelection& blk, long long delta, bool progressive) {
+    int first = Utils::lineStart(hwnd, blk.startLine);
+    int last = Utils::lineEnd(hwnd, blk.endLine);
+    if (first >= last) return;
+    std::string text = Utils::getTextRange(hwnd, first, last);
+    unsigned formats = currentFormats();
+
+    std::string out;
+    out.reserve(text.size() + 64);
+    size_t copied = 0;
+    long long changed = 0;
+    for (int line = blk.startLine; line <= blk.endLine; line++) {
+        int end = Utils::lineEnd(hwnd, line);
+        int a = (std::min)((int)::SendMessage(hwnd, SCI_FINDCOLUMN, line, blk.startCol), end);
+        int b = (std::min)((int)::SendMessage(hwnd, SCI_FINDCOLUMN, line, blk.endCol), end);
+        if (a >= b) continue;
+        if (adjustSpan(text, a - first, b - first, progressive ? delta * (changed + 1) : delta, formats, out, copied))
+            changed++;
+    }
+    if (!changed) return;
+    out.append(text, copied, std::string::npos);
+    ::SendMessage(hwnd, SCI_SETTARGETRANGE, first, last);
+    ::SendMessage(hwnd, SCI_REPLACETARGETMINIMAL, out.size(), (LPARAM)out.data());
+}
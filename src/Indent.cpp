@@ -0,0 +1,530 @@
+#include "../include/Indent.h"
+#include "../include/Utils.h"
+#include "../plugin/Scintilla.h"
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <memory>
+#include <string_view>
+#include <vector>
+
+namespace {
+
+bool isBlank(char c) { return c == ' ' || c == '\t'; }
+bool isWordChar(char c) { return std::isalnum((unsigned char)c) || c == '_'; }
+
+bool startsWith(std::string_view s, std::string_view prefix) {
+    return s.substr(0, prefix.size()) == prefix;
+}
+
+bool startsWithWord(std::string_view s, std::string_view word) {
+    return startsWith(s, word) && (s.size() == word.size() || !isWordChar(s[word.size()]));
+}
+
+size_t skipBlanks(std::string_view s, size_t i) {
+    while (i < s.size() && isBlank(s[i])) i++;
+    return i;
+}
+
+bool closes(char open, char close) {
+    return (open == '(' && close == ')') || (open == '[' && close == ']') || (open == '{' && close == '}');
+}
+
+// A line's rules see each line once, in order, as the text after its
+// leading blanks and the indent it has now.
+class Rules {
+public:
+    explicit Rules(const Indent::Settings& s) : sw(s.shiftWidth), tabWidth(s.tabWidth) {}
+    virtual ~Rules() = default;
+
+    // The indent line should get, or -1 to leave it as it is.
+    virtual int next(std::string_view line, int indent) = 0;
+
+protected:
+    int sw;
+    int tabWidth;
+
+    // The column of line[n] when line starts at column col.
+    int columnOf(std::string_view line, size_t n, int col) const {
+        for (size_t i = 0; i < n; i++) {
+            if (line[i] == '\t') col = (col / tabWidth + 1) * tabWidth;
+            else if (((unsigned char)line[i] & 0xC0) != 0x80) col++;
+        }
+        return col;
+    }
+};
+
+// Braces indent by a shiftwidth, a line inside unclosed ( or [ lines up
+// after it and an unfinished statement continues one shiftwidth in. Case
+// labels sit at the block's indent with their statements one in, access
+// labels at the indent of the class, and preprocessor lines at column 0.
+class CRules : public Rules {
+public:
+    using Rules::Rules;
+
+    int next(std::string_view line, int indent) override {
+        if (inComment) {
+            int target = !line.empty() && line[0] == '*' ? commentIndent + 1 : -1;
+            size_t end = line.find("*/");
+            if (end != std::string_view::npos) {
+                inComment = false;
+                scan(line, end + 2, target < 0 ? indent : target, false);
+            }
+            return target;
+        }
+        if (line.empty()) return 0;
+        if (inMacro) {
+            inMacro = line.back() == '\\';
+            return -1;
+        }
+        if (line[0] == '#') {
+            inMacro = line.back() == '\\';
+            return 0;
+        }
+
+        Frame* top = frames.empty() ? nullptr : &frames.back();
+        bool label = false;
+        int target;
+        if (top && closes(top->open, line[0])) {
+            target = top->closeIndent;
+        } else if (!top || top->open == '{') {
+            target = top ? top->indent : 0;
+            label = isCaseLabel(line);
+            if (isAccessLabel(line)) {
+                label = true;
+                if (top) target = top->closeIndent;
+            } else if (label) {
+                if (top) top->label = true;
+            } else {
+                if (top && top->label) target += sw;
+                if (continued && line[0] != '{') target += sw;
+            }
+        } else {
+            target = top->indent;
+        }
+        if (!continued && (!top || top->open == '{')) statement = target;
+
+        scan(line, 0, target, label);
+        return target;
+    }
+
+private:
+    struct Frame {
+        char open;
+        int indent;         // of the lines inside
+        int closeIndent;    // of a line starting with the closing bracket
+        bool label;         // a case or access label has been seen
+    };
+
+    std::vector<Frame> frames;
+    bool inComment = false;
+    int commentIndent = 0;
+    bool inMacro = false;
+    bool continued = false;
+    int statement = 0;
+
+    static bool isLabel(std::string_view line, std::string_view word) {
+        if (!startsWithWord(line, word)) return false;
+        size_t i = skipBlanks(line, word.size());
+        return i < line.size() && line[i] == ':' && (i + 1 == line.size() || line[i + 1] != ':');
+    }
+
+    static bool isCaseLabel(std::string_view line) {
+        return startsWithWord(line, "case") || isLabel(line, "default");
+    }
+
+    static bool isAccessLabel(std::string_view line) {
+        return isLabel(line, "public") || isLabel(line, "private") || isLabel(line, "protected");
+    }
+
+    void scan(std::string_view line, size_t i, int target, bool label) {
+        char last = 0;
+        for (; i < line.size(); i++) {
+            char c = line[i];
+            char d = i + 1 < line.size() ? line[i + 1] : '\0';
+            if (c == '/' && d == '/') break;
+            if (c == '/' && d == '*') {
+                size_t end = line.find("*/", i + 2);
+                if (end == std::string_view::npos) {
+                    inComment = true;
+                    commentIndent = columnOf(line, i, target);
+                    break;
+                }
+                i = end + 1;
+                continue;
+            }
+            if (c == '\'' && i > 0 && std::isxdigit((unsigned char)line[i - 1]) && std::isxdigit((unsigned char)d)) {
+                continue;   // 1'000
+            }
+            if (c == '"' || c == '\'') {
+                for (i++; i < line.size() && line[i] != c; i++)
+                    if (line[i] == '\\') i++;
+                last = c;
+                continue;
+            }
+            if (c == '(' || c == '[' || c == '{') {
+                Frame f = { c, 0, target, false };
+                if (c == '{') {
+                    f.closeIndent = statement;
+                    f.indent = statement + sw;
+                } else {
+                    size_t k = skipBlanks(line, i + 1);
+                    bool text = k < line.size() && !startsWith(line.substr(k), "//") && !startsWith(line.substr(k), "/*");
+                    f.indent = text ? columnOf(line, k, target) : target + sw;
+                }
+                frames.push_back(f);
+            } else if (c == ')' || c == ']' || c == '}') {
+                if (!frames.empty() && closes(frames.back().open, c)) frames.pop_back();
+            }
+            if (!isBlank(c)) last = c;
+        }
+
+        if (!frames.empty() && frames.back().open != '{') return;
+        if (label || startsWith(line, "@") || startsWith(line, "[[") || startsWithWord(line, "template")) {
+            continued = false;
+        } else if (last) {
+            // A comma ends a line of a list, unless the statement was
+            // already running on, as in a constructor's initializers.
+            continued = !strchr(";{}:", last) && (last != ',' || continued);
+        }
+    }
+};
+
+// Python's blocks are its indentation, so the levels already there are kept
+// and renumbered in shiftwidths. Lines inside brackets line up after the
+// bracket, and a line after a backslash continues one shiftwidth in.
+// Triple-quoted strings are left alone.
+class PythonRules : public Rules {
+public:
+    using Rules::Rules;
+
+    int next(std::string_view line, int indent) override {
+        if (quote) {
+            size_t end = findTriple(line, 0);
+            if (end != std::string_view::npos) {
+                quote = 0;
+                scan(line, end + 3, indent);
+            }
+            return -1;
+        }
+        if (line.empty()) return 0;
+
+        int target;
+        if (!frames.empty()) {
+            const Frame& top = frames.back();
+            target = closes(top.open, line[0]) ? top.closeIndent : top.indent;
+        } else if (joined) {
+            target = statement + sw;
+        } else if (line[0] == '#') {
+            // Comments do not open or close blocks.
+            auto level = std::find_if(levels.rbegin(), levels.rend(), [&](const Level& l) { return l.from <= indent; });
+            target = level->to;
+            if (colon && indent > levels.back().from) target = levels.back().to + sw;
+            return target;
+        } else {
+            while (levels.size() > 1 && levels.back().from > indent) levels.pop_back();
+            if (levels.back().from < indent) levels.push_back({ indent, levels.back().to + sw });
+            target = levels.back().to;
+            statement = target;
+        }
+
+        scan(line, 0, target);
+        return target;
+    }
+
+private:
+    struct Level {
+        int from;
+        int to;
+    };
+
+    struct Frame {
+        char open;
+        int indent;
+        int closeIndent;
+    };
+
+    std::vector<Level> levels{ { 0, 0 } };
+    std::vector<Frame> frames;
+    char quote = 0;         // inside a triple-quoted string
+    bool joined = false;    // the last line ended with a backslash
+    bool colon = false;     // the last statement ended with ':'
+    int statement = 0;
+
+    size_t findTriple(std::string_view line, size_t i) const {
+        for (; i + 2 < line.size(); i++) {
+            if (line[i] == '\\') i++;
+            else if (line[i] == quote && line[i + 1] == quote && line[i + 2] == quote) return i;
+        }
+        return std::string_view::npos;
+    }
+
+    void scan(std::string_view line, size_t i, int target) {
+        char last = 0;
+        bool backslash = false;
+        for (; i < line.size(); i++) {
+            char c = line[i];
+            if (c == '#') break;
+            if (c == '"' || c == '\'') {
+                last = c;
+                if (i + 2 < line.size() && line[i + 1] == c && line[i + 2] == c) {
+                    quote = c;
+                    size_t end = findTriple(line, i + 3);
+                    if (end == std::string_view::npos) return;
+                    quote = 0;
+                    i = end + 2;
+                    continue;
+                }
+                for (i++; i < line.size() && line[i] != c; i++)
+                    if (line[i] == '\\') i++;
+                continue;
+            }
+            if (c == '(' || c == '[' || c == '{') {
+                size_t k = skipBlanks(line, i + 1);
+                bool text = k < line.size() && line[k] != '#';
+                frames.push_back({ c, text ? columnOf(line, k, target) : target + sw, target });
+            } else if (c == ')' || c == ']' || c == '}') {
+                if (!frames.empty() && closes(frames.back().open, c)) frames.pop_back();
+            }
+            backslash = c == '\\' && i + 1 == line.size();
+            if (!isBlank(c)) last = c;
+        }
+
+        if (!frames.empty()) return;
+        joined = backslash;
+        if (last && !backslash) colon = last == ':';
+    }
+};
+
+// Each element's content is one shiftwidth in from its tags. A line
+// starting with a closing tag goes back out, and the attribute lines of a
+// tag split over lines go one shiftwidth in from it. HTML knows its void
+// elements and leaves the content of <pre>, <script>, <style> and
+// <textarea> alone, like comments.
+class MarkupRules : public Rules {
+public:
+    MarkupRules(const Indent::Settings& s, bool html) : Rules(s), html(html) {}
+
+    int next(std::string_view line, int) override {
+        if (inComment) {
+            size_t end = line.find("-->");
+            if (end == std::string_view::npos) return -1;
+            inComment = false;
+            scan(line, end + 3);
+            return -1;
+        }
+        if (!raw.empty()) {
+            size_t end = findClose(line, 0);
+            if (end == std::string_view::npos) return -1;
+            if (end > 0) {
+                raw.clear();
+                scan(line, end);
+                return -1;
+            }
+            raw.clear();
+        }
+        if (line.empty()) return 0;
+
+        int target;
+        if (inTag) {
+            target = tagIndent + sw;
+        } else {
+            target = (std::max)(depth - (startsWith(line, "</") ? 1 : 0), 0) * sw;
+            tagIndent = target;
+        }
+        scan(line, 0);
+        return target;
+    }
+
+private:
+    bool html;
+    int depth = 0;
+    bool inComment = false;
+    bool inTag = false;         // between a tag's name and its '>'
+    bool closing = false;       // that tag is </name>
+    char quote = 0;             // inside a quoted attribute
+    int tagIndent = 0;
+    std::string name;           // of that tag; empty for <! and <?
+    std::string raw;            // the element whose content is left alone
+
+    static bool isNameChar(char c) {
+        return isWordChar(c) || c == ':' || c == '-' || c == '.';
+    }
+
+    size_t findClose(std::string_view line, size_t i) const {
+        for (i = line.find("</", i); i != std::string_view::npos; i = line.find("</", i + 2)) {
+            std::string_view rest = line.substr(i + 2);
+            if (rest.size() >= raw.size() &&
+                std::equal(raw.begin(), raw.end(), rest.begin(),
+                           [](char a, char b) { return a == std::tolower((unsigned char)b); }))
+                return i;
+        }
+        return std::string_view::npos;
+    }
+
+    bool isVoid() const {
+        for (const char* v : { "area", "base", "br", "col", "embed", "hr", "img", "input", "link",
+                               "meta", "param", "source", "track", "wbr" })
+            if (name == v) return true;
+        return false;
+    }
+
+    void endTag(bool selfClosing) {
+        inTag = false;
+        if (name.empty()) return;
+        if (closing) {
+            depth = (std::max)(depth - 1, 0);
+        } else if (!selfClosing && !(html && isVoid())) {
+            depth++;
+            if (html && (name == "pre" || name == "script" || name == "style" || name == "textarea")) raw = name;
+        }
+    }
+
+    void scan(std::string_view line, size_t i) {
+        while (i < line.size()) {
+            if (inTag) {
+                char c = line[i];
+                if (quote) {
+                    if (c == quote) quote = 0;
+                } else if (c == '"' || c == '\'') {
+                    quote = c;
+                } else if (c == '>') {
+                    endTag(i > 0 && line[i - 1] == '/');
+                }
+                i++;
+                continue;
+            }
+            if (!raw.empty()) {
+                i = findClose(line, i);
+                if (i == std::string_view::npos) return;
+                raw.clear();
+            }
+
+            size_t open = line.find('<', i);
+            if (open == std::string_view::npos) return;
+            std::string_view rest = line.substr(open);
+            if (startsWith(rest, "<!--")) {
+                size_t end = line.find("-->", open + 4);
+                if (end == std::string_view::npos) {
+                    inComment = true;
+                    return;
+                }
+                i = end + 3;
+                continue;
+            }
+
+            i = open + 1;
+            closing = i < line.size() && line[i] == '/';
+            if (closing) i++;
+            name.clear();
+            if (i < line.size() && (line[i] == '!' || line[i] == '?')) {
+                inTag = true;
+                continue;
+            }
+            if (i >= line.size() || !std::isalpha((unsigned char)line[i])) continue;
+            for (; i < line.size() && isNameChar(line[i]); i++)
+                name += html ? (char)std::tolower((unsigned char)line[i]) : line[i];
+            inTag = true;
+        }
+    }
+};
+
+std::unique_ptr<Rules> makeRules(const Indent::Settings& s) {
+    switch (s.language) {
+    case Indent::LANG_PYTHON: return std::make_unique<PythonRules>(s);
+    case Indent::LANG_XML: return std::make_unique<MarkupRules>(s, false);
+    case Indent::LANG_HTML: return std::make_unique<MarkupRules>(s, true);
+    default: return std::make_unique<CRules>(s);
+    }
+}
+
+// Where the pass can start: a line above the range whose first column
+// holds code at the outermost level of the file.
+bool startsAtTopLevel(char c, Indent::Language language) {
+    if (language == Indent::LANG_XML || language == Indent::LANG_HTML) return c == '<';
+    if (c == '\0' || isBlank(c) || c == '\r' || c == '\n' || c == '#' || c == '/' || c == '*') return false;
+    return language != Indent::LANG_PYTHON || (c != ')' && c != ']' && c != '}');
+}
+
+}
+
+Indent::Language Indent::languageOf(HWND hwnd) {
+    int length = (int)::SendMessage(hwnd, SCI_GETLEXERLANGUAGE, 0, 0);
+    if (length <= 0) return LANG_C;
+    std::string name(length + 1, '\0');
+    ::SendMessage(hwnd, SCI_GETLEXERLANGUAGE, 0, (LPARAM)&name[0]);
+    name.resize(strlen(name.c_str()));
+
+    if (name == "python") return LANG_PYTHON;
+    if (name == "xml") return LANG_XML;
+    if (name == "hypertext" || name == "html" || name == "asp" || name == "php") return LANG_HTML;
+    return LANG_C;
+}
+
+std::string Indent::format(const std::string& text, size_t from, const Settings& settings) {
+    std::unique_ptr<Rules> rules = makeRules(settings);
+    std::string out;
+    out.reserve(text.size() - from + text.size() / 8);
+
+    for (size_t pos = 0;;) {
+        size_t end = pos;
+        while (end < text.size() && text[end] != '\n' && text[end] != '\r') end++;
+        size_t next = end;
+        if (next < text.size() && text[next] == '\r') next++;
+        if (next < text.size() && text[next] == '\n') next++;
+
+        size_t body = pos;
+        int indent = 0;
+        for (; body < end && isBlank(text[body]); body++)
+            indent = text[body] == '\t' ? (indent / settings.tabWidth + 1) * settings.tabWidth : indent + 1;
+
+        std::string_view line(text.data() + body, end - body);
+        int target = rules->next(line, indent);
+        if (pos >= from) {
+            if (target < 0) {
+                out.append(text, pos, end - pos);
+            } else if (!line.empty()) {
+                Utils::appendIndent(out, target, settings.useTabs, settings.tabWidth);
+                out.append(line);
+            }
+            out.append(text, end, next - end);
+        }
+
+        if (end == text.size()) break;
+        pos = next;
+    }
+    return out;
+}
+
+void Indent::apply(HWND hwnd, int firstLine, int lastLine) {
+    if (firstLine > lastLine) std::swap(firstLine, lastLine);
+    firstLine = (std::max)(firstLine, 0);
+    lastLine = (std::min)(lastLine, Utils::lineCount(hwnd) - 1);
+
+    Settings settings;
+    settings.tabWidth = (int)::SendMessage(hwnd, SCI_GETTABWIDTH, 0, 0);
+    settings.shiftWidth = (int)::SendMessage(hwnd, SCI_GETINDENT, 0, 0);
+    if (settings.tabWidth <= 0) settings.tabWidth = 8;
+    if (settings.shiftWidth <= 0) settings.shiftWidth = settings.tabWidth;
+    settings.useTabs = ::SendMessage(hwnd, SCI_GETUSETABS, 0, 0) != 0;
+    settings.language = languageOf(hwnd);
+
+    int anchor = firstLine - 1;
+    while (anchor > 0 &&
+           !startsAtTopLevel((char)::SendMessage(hwnd, SCI_GETCHARAT, Utils::lineStart(hwnd, anchor), 0), settings.language))
+        anchor--;
+    anchor = (std::max)(anchor, 0);
+
+    int begin = Utils::lineStart(hwnd, anchor);
+    int start = Utils::lineStart(hwnd, firstLine);
+    int end = Utils::lineEnd(hwnd, lastLine);
+    std::string text = Utils::getTextRange(hwnd, begin, end);
+    std::string out = format(text, start - begin, settings);
+
+    if (text.compare(start - begin, std::string::npos, out) != 0) {
+        ::SendMessage(hwnd, SCI_SETTARGETRANGE, start, end);
+        ::SendMessage(hwnd, SCI_REPLACETARGETMINIMAL, out.size(), (LPARAM)out.data());
+    }
+    int target = (int)::SendMessage(hwnd, SCI_GETLINEINDENTPOSITION, firstLine, 0);
+    ::SendMessage(hwnd, SCI_SETEMPTYSELECTION, target, 0);
+}
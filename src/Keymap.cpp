@@ -4,7 +4,6 @@
 
 std::unique_ptr<Keymap> g_normalKeymap;
 std::unique_ptr<Keymap> g_visualKeymap;
-std::unique_ptr<Keymap> g_commandKeymap;
 std::unique_ptr<Keymap> g_insertKeymap;
 
 Keymap::Keymap(VimState& state) 
@@ -127,7 +126,29 @@ void Keymap::reset() {
     state.repeatCount = 0;
 }
 
+std::shared_ptr<KeymapNode> Keymap::findNode(const std::string& keys) const {
+    auto node = root;
+    for (char key : keys) {
+        auto it = node->children.find(key);
+        if (it == node->children.end()) return nullptr;
+        node = it->second;
+    }
+    return node;
+}
+
+void Keymap::shadow(const std::string& from, const std::shared_ptr<KeymapNode>& node) {
+    if (shadowed.count(from)) return;
+    Shadowed& saved = shadowed[from];
+    if (node) {
+        saved.handler = node->handler;
+        saved.motionChar = node->motionChar;
+        saved.isLeaf = node->isLeaf;
+    }
+}
+
 void Keymap::addMapping(const std::string& from, const std::string& to, bool recursive) {
+    shadow(from, findNode(from));
+
     auto handler = [this, to, recursive](HWND hwnd, int count) {
         static int depth = 0;
         if (depth > 10) return;
@@ -157,15 +178,46 @@ void Keymap::addMapping(const std::string& from, const std::string& to, bool rec
 }
 
 void Keymap::removeMapping(const std::string& from) {
-    // Basic implementation: find the node and clear handler
-    auto node = root;
-    for (char key : from) {
-        if (node->children.find(key) == node->children.end()) return;
-        node = node->children[key];
-    }
+    auto node = findNode(from);
+    if (!node) return;
+    shadow(from, node);
     node->handler = nullptr;
     node->isLeaf = false;
 }
 
+void Keymap::restoreMapping(const std::string& from) {
+    auto saved = shadowed.find(from);
+    if (saved == shadowed.end()) return;
+    auto node = findNode(from);
+    if (node) {
+        node->handler = saved->second.handler;
+        node->motionChar = saved->second.motionChar;
+        node->isLeaf = saved->second.isLeaf;
+    }
+    shadowed.erase(saved);
+    if (node && !node->isLeaf && node->children.empty()) prune(from);
+}
+
+// Drops the trailing nodes of keys that lead nowhere, so a removed mapping
+// does not leave a prefix waiting for more keys.
+void Keymap::prune(const std::string& keys) {
+    std::vector<std::shared_ptr<KeymapNode>> path{ root };
+    for (char key : keys) {
+        auto it = path.back()->children.find(key);
+        if (it == path.back()->children.end()) return;
+        path.push_back(it->second);
+    }
+    for (size_t i = keys.size(); i > 0; i--) {
+        const auto& node = path[i];
+        if (node->isLeaf || !node->children.empty()) break;
+        path[i - 1]->children.erase(keys[i - 1]);
+    }
+    currentNode = root;
+    pendingKeys.clear();
+}
+
 void Keymap::clearDynamicMappings() {
+    while (!shadowed.empty()) {
+        restoreMapping(shadowed.begin()->first);
+    }
 }
\ No newline at end of file
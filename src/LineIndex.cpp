@@ -0,0 +1,267 @@
+#include "../include/LineIndex.h"
+#include "../plugin/Scintilla.h"
+#include "../include/Utils.h"
+#include <algorithm>
+#include <cstdio>
+
+extern NppData nppData;
+
+LineIndex& LineIndex::getInstance() {
+    static LineIndex instance;
+    return instance;
+}
+
+int LineIndex::Lines::position(int partition) const {
+    int pos = starts[partition];
+    if (partition > stepPartition) pos += stepLength;
+    return pos;
+}
+
+int LineIndex::Lines::partitionFromPosition(int pos) const {
+    int lines = count();
+    if (lines <= 1 || pos <= 0) return 0;
+    if (pos >= position(lines)) return lines - 1;
+
+    int lower = 0;
+    int upper = lines;
+    while (lower < upper) {
+        int middle = (upper + lower + 1) / 2;
+        if (pos < position(middle)) upper = middle - 1;
+        else lower = middle;
+    }
+    return lower;
+}
+
+void LineIndex::Lines::applyStep(int partitionUpTo) {
+    if (stepLength != 0) {
+        for (int i = stepPartition + 1; i <= partitionUpTo; i++) starts[i] += stepLength;
+    }
+    stepPartition = partitionUpTo;
+    if (stepPartition >= count()) {
+        stepPartition = count();
+        stepLength = 0;
+    }
+}
+
+void LineIndex::Lines::backStep(int partitionDownTo) {
+    if (stepLength != 0) {
+        for (int i = partitionDownTo + 1; i <= stepPartition; i++) starts[i] -= stepLength;
+    }
+    stepPartition = partitionDownTo;
+}
+
+void LineIndex::Lines::insertText(int partition, int delta) {
+    if (stepLength != 0) {
+        if (partition >= stepPartition) {
+            applyStep(partition);
+            stepLength += delta;
+        } else if (partition >= stepPartition - count() / 10) {
+            backStep(partition);
+            stepLength += delta;
+        } else {
+            applyStep(count());
+            stepPartition = partition;
+            stepLength = delta;
+        }
+    } else {
+        stepPartition = partition;
+        stepLength = delta;
+    }
+}
+
+void LineIndex::Lines::insertPartition(int partition, int pos) {
+    if (stepPartition < partition) applyStep(partition);
+    starts.insert(starts.begin() + partition, pos);
+    stepPartition++;
+}
+
+void LineIndex::Lines::removePartition(int partition) {
+    if (partition > stepPartition) applyStep(partition);
+    stepPartition--;
+    starts.erase(starts.begin() + partition);
+}
+
+enum EolKind : unsigned char { EOL_NONE, EOL_CR, EOL_LF, EOL_CRLF };
+
+static int eolLength(unsigned char kind) {
+    return (kind == EOL_CRLF) ? 2 : (kind == EOL_NONE ? 0 : 1);
+}
+
+// Line ends in text as (offset after the end, kind), CRLF counting once.
+static void scanLineEnds(const char* text, int length, std::vector<int>& offsets, std::vector<unsigned char>& eols) {
+    for (int i = 0; i < length; i++) {
+        if (text[i] == '\r') {
+            if (i + 1 < length && text[i + 1] == '\n') {
+                eols.push_back(EOL_CRLF);
+                i++;
+            } else {
+                eols.push_back(EOL_CR);
+            }
+            offsets.push_back(i + 1);
+        } else if (text[i] == '\n') {
+            eols.push_back(EOL_LF);
+            offsets.push_back(i + 1);
+        }
+    }
+}
+
+bool LineIndex::Lines::endsWith(int pos, unsigned char kind, int fromEnd) const {
+    int line = partitionFromPosition(pos);
+    return eolKind[line] == kind && pos == position(line + 1) - fromEnd;
+}
+
+bool LineIndex::Lines::afterLoneCR(int pos) const {
+    int line = partitionFromPosition(pos);
+    return line > 0 && pos == position(line) && eolKind[line - 1] == EOL_CR;
+}
+
+void LineIndex::rebuild(HWND hwnd, Lines& lines) {
+    int length = Utils::sci(hwnd, SCI_GETLENGTH);
+    const char* text = (const char*)::SendMessage(hwnd, SCI_GETCHARACTERPOINTER, 0, 0);
+
+    lines.starts.assign(1, 0);
+    lines.eolKind.clear();
+    if (text) scanLineEnds(text, length, lines.starts, lines.eolKind);
+    lines.starts.push_back(length);
+    lines.eolKind.push_back(EOL_NONE);
+
+    lines.stepPartition = 0;
+    lines.stepLength = 0;
+    lines.dirty = false;
+}
+
+LineIndex::Lines* LineIndex::lookup(HWND hwnd) {
+    // Only the two editor views report their edits to beNotified.
+    if (!hwnd || (hwnd != nppData._scintillaMainHandle && hwnd != nppData._scintillaSecondHandle)) return nullptr;
+
+    auto view = viewDocs.find(hwnd);
+    if (view == viewDocs.end()) {
+        void* doc = (void*)::SendMessage(hwnd, SCI_GETDOCPOINTER, 0, 0);
+        view = viewDocs.emplace(hwnd, doc).first;
+    }
+
+    Lines& lines = docs[view->second];
+    if (lines.dirty) rebuild(hwnd, lines);
+    return &lines;
+}
+
+void LineIndex::viewsChanged() {
+    reset();
+}
+
+void LineIndex::forget(void* doc) {
+    docs.erase(doc);
+    for (auto it = viewDocs.begin(); it != viewDocs.end();) {
+        if (it->second == doc) it = viewDocs.erase(it);
+        else ++it;
+    }
+}
+
+void LineIndex::reset() {
+    viewDocs.clear();
+    docs.clear();
+}
+
+void LineIndex::notifyModified(HWND hwnd, bool inserted, int pos, int length, int linesAdded, const char* text) {
+    if (docs.empty()) return;
+    auto view = viewDocs.find(hwnd);
+    void* doc = (view != viewDocs.end()) ? view->second : (void*)::SendMessage(hwnd, SCI_GETDOCPOINTER, 0, 0);
+    auto it = docs.find(doc);
+    if (it == docs.end() || it->second.dirty) return;
+
+    Lines& lines = it->second;
+    if (length <= 0) return;
+    if (!text) {
+        lines.dirty = true;
+        return;
+    }
+
+    // Edits that join or split a CR LF pair change line ends outside the
+    // edited text; rescan rather than patch those.
+    int end = inserted ? pos : pos + length;
+    bool crlfSeam = lines.endsWith(pos, EOL_CRLF, 1) || lines.endsWith(end, EOL_CRLF, 1);
+    if (inserted) {
+        crlfSeam = crlfSeam
+            || (text[0] == '\n' && lines.afterLoneCR(pos))
+            || (text[length - 1] == '\r' && lines.endsWith(pos, EOL_LF, 1));
+    } else {
+        crlfSeam = crlfSeam
+            || (lines.afterLoneCR(pos) && (lines.endsWith(end, EOL_LF, 1)));
+    }
+
+    std::vector<int> offsets;
+    std::vector<unsigned char> eols;
+    scanLineEnds(text, length, offsets, eols);
+
+    if (crlfSeam || (int)offsets.size() != (inserted ? linesAdded : -linesAdded)) {
+        lines.dirty = true;
+        return;
+    }
+
+    int line = lines.partitionFromPosition(pos);
+    int added = (int)offsets.size();
+
+    if (inserted) {
+        lines.insertText(line, length);
+        for (int k = 0; k < added; k++) {
+            lines.insertPartition(line + 1 + k, pos + offsets[k]);
+        }
+        lines.eolKind.insert(lines.eolKind.begin() + line, eols.begin(), eols.end());
+    } else {
+        if (line + added >= lines.count()) {
+            lines.dirty = true;
+            return;
+        }
+        for (int k = 0; k < added; k++) {
+            lines.removePartition(line + 1);
+        }
+        lines.insertText(line, -length);
+        lines.eolKind[line] = lines.eolKind[line + added];
+        lines.eolKind.erase(lines.eolKind.begin() + line + 1, lines.eolKind.begin() + line + 1 + added);
+    }
+}
+
+#ifdef NPPVIM_VERIFY_LINE_INDEX
+static int verify(HWND hwnd, const char* what, int arg, int cached, int msg, WPARAM wParam) {
+    int actual = (int)::SendMessage(hwnd, msg, wParam, 0);
+    if (actual != cached) {
+        char buf[160];
+        snprintf(buf, sizeof(buf), "NppVim: LineIndex %s(%d) = %d, Scintilla says %d\n", what, arg, cached, actual);
+        OutputDebugStringA(buf);
+        LineIndex::getInstance().reset();
+    }
+    return actual;
+}
+#define VERIFIED(what, arg, cached, msg, wParam) verify(hwnd, what, arg, cached, msg, wParam)
+#else
+#define VERIFIED(what, arg, cached, msg, wParam) (cached)
+#endif
+
+int LineIndex::lineCount(HWND hwnd) {
+    Lines* lines = lookup(hwnd);
+    if (!lines) return (int)::SendMessage(hwnd, SCI_GETLINECOUNT, 0, 0);
+    return VERIFIED("lineCount", 0, lines->count(), SCI_GETLINECOUNT, 0);
+}
+
+int LineIndex::lineStart(HWND hwnd, int line) {
+    Lines* lines = lookup(hwnd);
+    if (!lines || line < 0) return (int)::SendMessage(hwnd, SCI_POSITIONFROMLINE, line, 0);
+    int pos = (line > lines->count()) ? -1 : lines->position(line);
+    return VERIFIED("lineStart", line, pos, SCI_POSITIONFROMLINE, line);
+}
+
+int LineIndex::lineEnd(HWND hwnd, int line) {
+    Lines* lines = lookup(hwnd);
+    if (!lines || line < 0) return (int)::SendMessage(hwnd, SCI_GETLINEENDPOSITION, line, 0);
+    int last = lines->count() - 1;
+    int pos = (line >= last)
+        ? lines->position(lines->count())
+        : lines->position(line + 1) - eolLength(lines->eolKind[line]);
+    return VERIFIED("lineEnd", line, pos, SCI_GETLINEENDPOSITION, line);
+}
+
+int LineIndex::lineFromPosition(HWND hwnd, int pos) {
+    Lines* lines = lookup(hwnd);
+    if (!lines) return (int)::SendMessage(hwnd, SCI_LINEFROMPOSITION, pos, 0);
+    return VERIFIED("lineFromPosition", pos, lines->partitionFromPosition(pos), SCI_LINEFROMPOSITION, pos);
+}
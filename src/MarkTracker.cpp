@@ -0,0 +1,160 @@
+#include "../include/MarkTracker.h"
+#include "../plugin/Scintilla.h"
+
+MarkTracker& MarkTracker::getInstance() {
+    static MarkTracker instance;
+    return instance;
+}
+
+size_t MarkTracker::Positions::lowerBound(int pos) const {
+    size_t lower = 0;
+    size_t upper = raw.size();
+    while (lower < upper) {
+        size_t middle = (lower + upper) / 2;
+        if (value(middle) < pos) lower = middle + 1;
+        else upper = middle;
+    }
+    return lower;
+}
+
+size_t MarkTracker::Positions::find(int handle) const {
+    auto it = slots.find(handle);
+    return (it == slots.end()) ? handles.size() : it->second;
+}
+
+void MarkTracker::Positions::reindexFrom(size_t first) {
+    for (size_t i = first; i < handles.size(); i++) slots[handles[i]] = i;
+}
+
+void MarkTracker::Positions::shiftFrom(size_t first, int delta) {
+    size_t count = raw.size();
+    if (stepDelta == 0 || first == stepStart) {
+        stepStart = first;
+        stepDelta += delta;
+        return;
+    }
+    if (first > stepStart) {
+        for (size_t i = stepStart; i < first; i++) raw[i] += stepDelta;
+    } else if (stepStart - first <= count / 10 + 1) {
+        for (size_t i = first; i < stepStart; i++) raw[i] -= stepDelta;
+    } else {
+        for (size_t i = stepStart; i < count; i++) raw[i] += stepDelta;
+        stepDelta = 0;
+    }
+    stepStart = first;
+    stepDelta += delta;
+}
+
+void MarkTracker::Positions::insert(int handle, int pos) {
+    size_t i = lowerBound(pos);
+    if (i < stepStart) {
+        raw.insert(raw.begin() + i, pos);
+        stepStart++;
+    } else {
+        raw.insert(raw.begin() + i, pos - stepDelta);
+    }
+    handles.insert(handles.begin() + i, handle);
+    reindexFrom(i);
+}
+
+void MarkTracker::Positions::erase(size_t i) {
+    if (i < stepStart) stepStart--;
+    slots.erase(handles[i]);
+    raw.erase(raw.begin() + i);
+    handles.erase(handles.begin() + i);
+    reindexFrom(i);
+}
+
+void MarkTracker::Positions::assign(size_t i, int pos) {
+    raw[i] = pos - (i >= stepStart ? stepDelta : 0);
+}
+
+bool MarkTracker::Positions::fits(size_t i, int pos) const {
+    return (i == 0 || value(i - 1) <= pos) && (i + 1 >= raw.size() || pos <= value(i + 1));
+}
+
+void* MarkTracker::documentOf(HWND hwnd) {
+    return hwnd ? (void*)::SendMessage(hwnd, SCI_GETDOCPOINTER, 0, 0) : nullptr;
+}
+
+MarkTracker::Positions* MarkTracker::lookup(HWND hwnd) {
+    if (!hwnd) return nullptr;
+    auto it = docs.find(documentOf(hwnd));
+    return (it != docs.end()) ? &it->second : nullptr;
+}
+
+int MarkTracker::track(HWND hwnd, int pos) {
+    if (!hwnd) return -1;
+    void* doc = documentOf(hwnd);
+    int handle = nextHandle++;
+    docs[doc].insert(handle, pos);
+    owners[handle] = doc;
+    return handle;
+}
+
+void MarkTracker::move(HWND hwnd, int handle, int pos) {
+    Positions* positions = lookup(hwnd);
+    if (!positions) return;
+    size_t i = positions->find(handle);
+    if (i == positions->handles.size()) return;
+    // '. moves on every edit, nearly always without passing a neighbour
+    if (positions->fits(i, pos)) {
+        positions->assign(i, pos);
+        return;
+    }
+    positions->erase(i);
+    positions->insert(handle, pos);
+}
+
+void MarkTracker::forget(int handle) {
+    auto owner = owners.find(handle);
+    if (owner == owners.end()) return;
+    auto it = docs.find(owner->second);
+    if (it != docs.end()) {
+        size_t i = it->second.find(handle);
+        if (i != it->second.handles.size()) it->second.erase(i);
+    }
+    owners.erase(owner);
+}
+
+void MarkTracker::forgetDocument(void* doc) {
+    auto it = docs.find(doc);
+    if (it == docs.end()) return;
+    for (int handle : it->second.handles) owners.erase(handle);
+    docs.erase(it);
+}
+
+int MarkTracker::position(HWND hwnd, int handle) {
+    if (handle <= 0) return -1;
+    Positions* positions = lookup(hwnd);
+    if (!positions) return -1;
+    size_t i = positions->find(handle);
+    return (i == positions->handles.size()) ? -1 : positions->value(i);
+}
+
+void MarkTracker::collect(HWND hwnd, int start, int end, std::vector<std::pair<int, int>>& out) {
+    Positions* positions = lookup(hwnd);
+    if (!positions) return;
+    for (size_t i = positions->lowerBound(start); i < positions->raw.size(); i++) {
+        int pos = positions->value(i);
+        if (pos >= end) break;
+        out.emplace_back(positions->handles[i], pos);
+    }
+}
+
+void MarkTracker::notifyModified(HWND hwnd, bool inserted, int pos, int length) {
+    if (docs.empty() || length <= 0) return;
+    Positions* positions = lookup(hwnd);
+    if (!positions || positions->raw.empty()) return;
+
+    size_t first = positions->lowerBound(pos);
+    if (inserted) {
+        positions->shiftFrom(first, length);
+        return;
+    }
+
+    // Positions inside the deleted text collapse onto its start
+    size_t last = positions->lowerBound(pos + length);
+    for (size_t i = first; i < last; i++) positions->assign(i, pos);
+    positions->shiftFrom(last, -length);
+}
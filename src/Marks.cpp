@@ -1,17 +1,19 @@
 #include "../include/Marks.h"
 #include "../include/Utils.h"
+#include "../include/MarkTracker.h"
+#include "../include/NppVim.h"
 #include "../plugin/Scintilla.h"
 #include "../plugin/Notepad_plus_msgs.h"
 #include <sstream>
 #include <cctype>
 #include <algorithm>
+#include <vector>
 
 extern NppData nppData;
 
-std::map<char, MarkInfo> Marks::localMarks;
 std::map<char, MarkInfo> Marks::globalMarks;
-MarkInfo Marks::lastJumpMark;
-MarkInfo Marks::lastChangeMark;
+std::map<void*, int> Marks::changeHandles;
+std::map<void*, std::pair<int, int>> Marks::visualHandles;
 
 void Marks::initializeMarkers(HWND hwndEdit) {
     if (!hwndEdit) return;
@@ -39,7 +41,8 @@ void Marks::initializeMarkers(HWND hwndEdit) {
 bool Marks::isValidMark(char mark) {
     return (mark >= 'a' && mark <= 'z') ||  // Local marks
         (mark >= 'A' && mark <= 'Z') ||  // Global marks
-        mark == '.';                      // Last change position
+        mark == '.' ||                    // Last change position
+        mark == '<' || mark == '>';       // Last visual selection
 }
 
 int Marks::getMarkerNumber(char mark) {
@@ -70,97 +73,179 @@ std::string Marks::getCurrentFilename() {
     return result;
 }
 
+int Marks::markPosition(HWND hwndEdit, const MarkInfo& info) {
+    int pos = MarkTracker::getInstance().position(hwndEdit, info.handle);
+    if (pos >= 0) return pos;
+    if (info.line < 0 || info.line >= Utils::lineCount(hwndEdit)) return -1;
+    return (std::min)(Utils::lineStart(hwndEdit, info.line) + info.column, Utils::lineEnd(hwndEdit, info.line));
+}
+
+void Marks::trackMark(HWND hwndEdit, MarkInfo& info, int pos) {
+    MarkTracker& tracker = MarkTracker::getInstance();
+    if (tracker.position(hwndEdit, info.handle) >= 0) {
+        tracker.move(hwndEdit, info.handle, pos);
+    } else {
+        tracker.forget(info.handle);
+        info.handle = tracker.track(hwndEdit, pos);
+    }
+}
+
 void Marks::setMark(HWND hwndEdit, char mark) {
     if (!hwndEdit || !isValidMark(mark)) return;
 
-    int pos = (int)::SendMessage(hwndEdit, SCI_GETCURRENTPOS, 0, 0);
-    int line = (int)::SendMessage(hwndEdit, SCI_LINEFROMPOSITION, pos, 0);
-    int lineStart = (int)::SendMessage(hwndEdit, SCI_POSITIONFROMLINE, line, 0);
-    int column = pos - lineStart;
+    int pos = (int)Utils::caretPos(hwndEdit);
+
+    if (mark == '.') {
+        noteChange(hwndEdit, pos);
+        Utils::setStatus(TEXT("Last change mark set"));
+        return;
+    }
+    if (mark == '<' || mark == '>') {
+        int anchor = pos, caret = pos;
+        getVisualMarks(hwndEdit, anchor, caret);
+        int start = (std::min)(anchor, caret), end = (std::max)(anchor, caret);
+        if (mark == '<') start = pos; else end = pos;
+        setVisualMarks(hwndEdit, start, end);
+        return;
+    }
 
-    MarkInfo markInfo;
+    int line = Utils::lineFromPosition(hwndEdit, pos);
+    bool isGlobal = (mark >= 'A' && mark <= 'Z');
+    MarkInfo& markInfo = isGlobal ? globalMarks[mark] : state.localMarks[mark];
     markInfo.line = line;
-    markInfo.column = column;
+    markInfo.column = pos - Utils::lineStart(hwndEdit, line);
     markInfo.filename = getCurrentFilename();
-    markInfo.isGlobal = (mark >= 'A' && mark <= 'Z');
+    markInfo.isGlobal = isGlobal;
+    trackMark(hwndEdit, markInfo, pos);
+    syncMarkers(hwndEdit);
 
-    if (mark >= 'a' && mark <= 'z') {
-        localMarks[mark] = markInfo;
-        updateMarkerDisplay(hwndEdit, mark);
+    char statusMsg[64];
+    sprintf_s(statusMsg, "%s mark '%c' set at line %d", isGlobal ? "Global" : "Local", mark, line + 1);
+    Utils::setStatus(std::wstring(statusMsg, statusMsg + strlen(statusMsg)).c_str());
+}
 
-        char statusMsg[64];
-        sprintf_s(statusMsg, "Local mark '%c' set at line %d", mark, line + 1);
-        Utils::setStatus(std::wstring(statusMsg, statusMsg + strlen(statusMsg)).c_str());
+void Marks::noteChange(HWND hwndEdit, int pos) {
+    if (!hwndEdit) return;
+    void* doc = MarkTracker::documentOf(hwndEdit);
+    MarkTracker& tracker = MarkTracker::getInstance();
+    auto it = changeHandles.find(doc);
+    if (it != changeHandles.end() && tracker.position(hwndEdit, it->second) >= 0) {
+        tracker.move(hwndEdit, it->second, pos);
+    } else {
+        changeHandles[doc] = tracker.track(hwndEdit, pos);
     }
-    else if (mark >= 'A' && mark <= 'Z') {
-        globalMarks[mark] = markInfo;
-        updateMarkerDisplay(hwndEdit, mark);
+}
 
-        char statusMsg[64];
-        sprintf_s(statusMsg, "Global mark '%c' set at line %d", mark, line + 1);
-        Utils::setStatus(std::wstring(statusMsg, statusMsg + strlen(statusMsg)).c_str());
-    }
-    else if (mark == '.') {
-        lastChangeMark = markInfo;
-        Utils::setStatus(TEXT("Last change mark set"));
+void Marks::setVisualMarks(HWND hwndEdit, int anchor, int caret) {
+    if (!hwndEdit) return;
+    void* doc = MarkTracker::documentOf(hwndEdit);
+    MarkTracker& tracker = MarkTracker::getInstance();
+    auto it = visualHandles.find(doc);
+    if (it != visualHandles.end()
+        && tracker.position(hwndEdit, it->second.first) >= 0
+        && tracker.position(hwndEdit, it->second.second) >= 0) {
+        tracker.move(hwndEdit, it->second.first, anchor);
+        tracker.move(hwndEdit, it->second.second, caret);
+    } else {
+        visualHandles[doc] = { tracker.track(hwndEdit, anchor), tracker.track(hwndEdit, caret) };
     }
 }
 
-void Marks::updateMarkerDisplay(HWND hwndEdit, char mark) {
-    if (!hwndEdit) return;
+void Marks::forgetDocument(void* doc) {
+    changeHandles.erase(doc);
+    visualHandles.erase(doc);
+}
 
-    int markerNum = getMarkerNumber(mark);
-    if (markerNum == -1) return;
+bool Marks::getVisualMarks(HWND hwndEdit, int& anchor, int& caret) {
+    auto it = visualHandles.find(MarkTracker::documentOf(hwndEdit));
+    if (it == visualHandles.end()) return false;
+    MarkTracker& tracker = MarkTracker::getInstance();
+    int a = tracker.position(hwndEdit, it->second.first);
+    int c = tracker.position(hwndEdit, it->second.second);
+    if (a < 0 || c < 0) return false;
+    anchor = a;
+    caret = c;
+    return true;
+}
 
-    auto it = (mark >= 'a' && mark <= 'z') ? localMarks.find(mark) : globalMarks.find(mark);
-    if (it == ((mark >= 'a' && mark <= 'z') ? localMarks.end() : globalMarks.end())) return;
+void Marks::syncMarkers(HWND hwndEdit) {
+    if (!hwndEdit) return;
 
-    // For local marks, only show if in current file
-    if (mark >= 'a' && mark <= 'z') {
-        if (it->second.filename != getCurrentFilename()) {
-            ::SendMessage(hwndEdit, SCI_MARKERDELETE, it->second.line, markerNum);
-            return;
+    // Only the lines on screen carry margin markers; scrolling calls back
+    // here, so the number of marks never turns into per-line Scintilla calls.
+    static HWND shownWindow = nullptr;
+    static void* shownDoc = nullptr;
+    static std::vector<std::pair<int, int>> shown;
+    if (state.localMarks.empty() && globalMarks.empty() && shown.empty()) return;
+
+    int firstVisible = (int)::SendMessage(hwndEdit, SCI_GETFIRSTVISIBLELINE, 0, 0);
+    int onScreen = (int)::SendMessage(hwndEdit, SCI_LINESONSCREEN, 0, 0);
+    int firstLine = (int)::SendMessage(hwndEdit, SCI_DOCLINEFROMVISIBLE, firstVisible, 0);
+    int lastLine = (int)::SendMessage(hwndEdit, SCI_DOCLINEFROMVISIBLE, firstVisible + onScreen, 0);
+
+    std::vector<std::pair<int, int>> wanted;
+    auto collect = [&](const std::map<char, MarkInfo>& marks, int markerNum) {
+        for (auto& entry : marks) {
+            int pos = MarkTracker::getInstance().position(hwndEdit, entry.second.handle);
+            if (pos < 0) continue;
+            int line = Utils::lineFromPosition(hwndEdit, pos);
+            if (line >= firstLine && line <= lastLine) wanted.push_back({ line, markerNum });
         }
+    };
+    collect(state.localMarks, 20);
+    collect(globalMarks, 21);
+    std::sort(wanted.begin(), wanted.end());
+
+    void* doc = MarkTracker::documentOf(hwndEdit);
+    if (hwndEdit == shownWindow && doc == shownDoc && wanted == shown) return;
+
+    ::SendMessage(hwndEdit, SCI_MARKERDELETEALL, 20, 0);
+    ::SendMessage(hwndEdit, SCI_MARKERDELETEALL, 21, 0);
+    for (auto& marker : wanted) {
+        ::SendMessage(hwndEdit, SCI_MARKERADD, marker.first, marker.second);
     }
-
-    // Remove any existing marker at this line
-    ::SendMessage(hwndEdit, SCI_MARKERDELETE, it->second.line, markerNum);
-
-    // Add marker at the marked line
-    ::SendMessage(hwndEdit, SCI_MARKERADD, it->second.line, markerNum);
+    shownWindow = hwndEdit;
+    shownDoc = doc;
+    shown.swap(wanted);
 }
 
-void Marks::removeMarkerDisplay(HWND hwndEdit, char mark) {
-    if (!hwndEdit) return;
-
-    int markerNum = getMarkerNumber(mark);
-    if (markerNum == -1) return;
+int Marks::position(HWND hwndEdit, char mark) {
+    if (!hwndEdit || !isValidMark(mark)) return -1;
 
-    auto it = (mark >= 'a' && mark <= 'z') ? localMarks.find(mark) : globalMarks.find(mark);
-    if (it != ((mark >= 'a' && mark <= 'z') ? localMarks.end() : globalMarks.end())) {
-        ::SendMessage(hwndEdit, SCI_MARKERDELETE, it->second.line, markerNum);
+    if (mark >= 'a' && mark <= 'z') {
+        auto it = state.localMarks.find(mark);
+        return it == state.localMarks.end() ? -1 : markPosition(hwndEdit, it->second);
+    }
+    if (mark >= 'A' && mark <= 'Z') {
+        auto it = globalMarks.find(mark);
+        if (it == globalMarks.end() || it->second.filename != getCurrentFilename()) return -1;
+        return markPosition(hwndEdit, it->second);
     }
+    if (mark == '.') {
+        auto it = changeHandles.find(MarkTracker::documentOf(hwndEdit));
+        return it == changeHandles.end() ? -1 : MarkTracker::getInstance().position(hwndEdit, it->second);
+    }
+    int anchor, caret;
+    if (!getVisualMarks(hwndEdit, anchor, caret)) return -1;
+    return (mark == '<') ? (std::min)(anchor, caret) : (std::max)(anchor, caret);
 }
+
 bool Marks::jumpToMark(HWND hwndEdit, char mark, bool isBacktick) {
     if (!hwndEdit || !isValidMark(mark)) {
         Utils::setStatus(TEXT("Invalid mark or no editor"));
         return false;
     }
 
-    MarkInfo* markInfo = nullptr;
+    int markPos = -1;
     bool fileSwitched = false;
 
     if (mark >= 'a' && mark <= 'z') {
-        auto it = localMarks.find(mark);
-        if (it == localMarks.end()) {
+        auto it = state.localMarks.find(mark);
+        if (it == state.localMarks.end()) {
             Utils::setStatus(TEXT("Local mark not set"));
             return false;
         }
-        if (it->second.filename != getCurrentFilename()) {
-            Utils::setStatus(TEXT("Local mark in different file"));
-            return false;
-        }
-        markInfo = &it->second;
+        markPos = markPosition(hwndEdit, it->second);
     }
     else if (mark >= 'A' && mark <= 'Z') {
         auto it = globalMarks.find(mark);
@@ -191,41 +276,36 @@ bool Marks::jumpToMark(HWND hwndEdit, char mark, bool isBacktick) {
             }
             fileSwitched = true;
         }
-        markInfo = &it->second;
+        markPos = markPosition(hwndEdit, it->second);
     }
     else if (mark == '.') {
-        if (lastChangeMark.line == -1) {
+        auto it = changeHandles.find(MarkTracker::documentOf(hwndEdit));
+        if (it != changeHandles.end()) markPos = MarkTracker::getInstance().position(hwndEdit, it->second);
+        if (markPos < 0) {
             Utils::setStatus(TEXT("Last change mark not set"));
             return false;
         }
-        markInfo = &lastChangeMark;
     }
-
-    if (!markInfo || markInfo->line == -1) {
-        Utils::setStatus(TEXT("Mark position invalid"));
-        return false;
+    else {
+        int anchor, caret;
+        if (!getVisualMarks(hwndEdit, anchor, caret)) {
+            Utils::setStatus(TEXT("Visual marks not set"));
+            return false;
+        }
+        markPos = (mark == '<') ? (std::min)(anchor, caret) : (std::max)(anchor, caret);
     }
 
-    // Jump to the mark
-    int lineCount = (int)::SendMessage(hwndEdit, SCI_GETLINECOUNT, 0, 0);
-    if (markInfo->line >= lineCount) {
+    if (markPos < 0) {
         Utils::setStatus(TEXT("Mark line out of range"));
         return false;
     }
 
-    int targetPos;
-    if (isBacktick) {
-        // ` jumps to exact position
-        int linePos = (int)::SendMessage(hwndEdit, SCI_POSITIONFROMLINE, markInfo->line, 0);
-        int lineEnd = (int)::SendMessage(hwndEdit, SCI_GETLINEENDPOSITION, markInfo->line, 0);
-        targetPos = linePos + markInfo->column;
-        if (targetPos > lineEnd) targetPos = lineEnd;
-    }
-    else {
+    int line = Utils::lineFromPosition(hwndEdit, markPos);
+    int targetPos = markPos;
+    if (!isBacktick) {
         // ' jumps to first non-blank character of line
-        targetPos = (int)::SendMessage(hwndEdit, SCI_POSITIONFROMLINE, markInfo->line, 0);
-        int lineEnd = (int)::SendMessage(hwndEdit, SCI_GETLINEENDPOSITION, markInfo->line, 0);
-
+        targetPos = Utils::lineStart(hwndEdit, line);
+        int lineEnd = Utils::lineEnd(hwndEdit, line);
         while (targetPos < lineEnd) {
             char c = (char)::SendMessage(hwndEdit, SCI_GETCHARAT, targetPos, 0);
             if (!std::isspace(static_cast<unsigned char>(c))) break;
@@ -237,7 +317,7 @@ bool Marks::jumpToMark(HWND hwndEdit, char mark, bool isBacktick) {
     ::SendMessage(hwndEdit, SCI_SCROLLCARET, 0, 0);
 
     if (fileSwitched) {
-        ::SendMessage(hwndEdit, SCI_SETCARETSTYLE, CARETSTYLE_BLOCK, 0);
+        Utils::setCaretStyle(hwndEdit, CARETSTYLE_BLOCK);
 
         int caret = (int)::SendMessage(hwndEdit, SCI_GETCURRENTPOS, 0, 0);
         ::SendMessage(hwndEdit, SCI_SETSEL, caret, caret);
@@ -246,7 +326,7 @@ bool Marks::jumpToMark(HWND hwndEdit, char mark, bool isBacktick) {
     }
 
     char statusMsg[64];
-    sprintf_s(statusMsg, "Jumped to mark '%c' at line %d", mark, markInfo->line + 1);
+    sprintf_s(statusMsg, "Jumped to mark '%c' at line %d", mark, line + 1);
     Utils::setStatus(std::wstring(statusMsg, statusMsg + strlen(statusMsg)).c_str());
 
     return true;
@@ -256,27 +336,35 @@ void Marks::deleteMark(HWND hwndEdit, char mark) {
     if (!isValidMark(mark)) return;
 
     if (mark >= 'a' && mark <= 'z') {
-        removeMarkerDisplay(hwndEdit, mark);
-        localMarks.erase(mark);
+        auto it = state.localMarks.find(mark);
+        if (it != state.localMarks.end()) {
+            MarkTracker::getInstance().forget(it->second.handle);
+            state.localMarks.erase(it);
+        }
+        syncMarkers(hwndEdit);
         Utils::setStatus(TEXT("Local mark deleted"));
     }
     else if (mark >= 'A' && mark <= 'Z') {
-        removeMarkerDisplay(hwndEdit, mark);
-        globalMarks.erase(mark);
+        auto it = globalMarks.find(mark);
+        if (it != globalMarks.end()) {
+            MarkTracker::getInstance().forget(it->second.handle);
+            globalMarks.erase(it);
+        }
+        syncMarkers(hwndEdit);
         Utils::setStatus(TEXT("Global mark deleted"));
     }
 }
 
 void Marks::clearAllMarks(HWND hwndEdit) {
-    if (hwndEdit) {
-        // Clear all markers from the editor
-        ::SendMessage(hwndEdit, SCI_MARKERDELETEALL, 20, 0);
-        ::SendMessage(hwndEdit, SCI_MARKERDELETEALL, 21, 0);
-    }
+    MarkTracker& tracker = MarkTracker::getInstance();
+    for (auto& entry : state.localMarks) tracker.forget(entry.second.handle);
+    for (auto& entry : globalMarks) tracker.forget(entry.second.handle);
+    for (auto& entry : changeHandles) tracker.forget(entry.second);
 
-    localMarks.clear();
+    state.localMarks.clear();
     globalMarks.clear();
-    lastChangeMark = MarkInfo(-1, -1, "", false);
+    changeHandles.clear();
+    syncMarkers(hwndEdit);
 
     Utils::setStatus(TEXT("All marks cleared"));
 }
@@ -286,30 +374,49 @@ std::string Marks::listMarks(HWND hwndEdit) {
     oss << "Marks:\n";
     oss << "-----\n";
 
-    if (!localMarks.empty()) {
+    // Marks in the current document report where their text is now.
+    auto where = [&](const MarkInfo& info, int& line, int& column) {
+        int pos = MarkTracker::getInstance().position(hwndEdit, info.handle);
+        if (pos < 0) {
+            line = info.line;
+            column = info.column;
+            return;
+        }
+        line = Utils::lineFromPosition(hwndEdit, pos);
+        column = pos - Utils::lineStart(hwndEdit, line);
+    };
+    int line, column;
+
+    if (!state.localMarks.empty()) {
         oss << "Local marks (a-z):\n";
-        for (auto& pair : localMarks) {
-            oss << "  " << pair.first << " : line " << (pair.second.line + 1)
-                << ", col " << pair.second.column << "\n";
+        for (auto& pair : state.localMarks) {
+            where(pair.second, line, column);
+            oss << "  " << pair.first << " : line " << (line + 1)
+                << ", col " << column << "\n";
         }
     }
 
     if (!globalMarks.empty()) {
         oss << "\nGlobal marks (A-Z):\n";
         for (auto& pair : globalMarks) {
-            oss << "  " << pair.first << " : line " << (pair.second.line + 1)
-                << ", col " << pair.second.column
+            where(pair.second, line, column);
+            oss << "  " << pair.first << " : line " << (line + 1)
+                << ", col " << column
                 << " [" << pair.second.filename << "]\n";
         }
     }
 
-    if (lastChangeMark.line != -1) {
+    int changePos = -1;
+    auto change = changeHandles.find(MarkTracker::documentOf(hwndEdit));
+    if (change != changeHandles.end()) changePos = MarkTracker::getInstance().position(hwndEdit, change->second);
+    if (changePos >= 0) {
+        line = Utils::lineFromPosition(hwndEdit, changePos);
         oss << "\nLast change position:\n";
-        oss << "  . : line " << (lastChangeMark.line + 1)
-            << ", col " << lastChangeMark.column << "\n";
+        oss << "  . : line " << (line + 1)
+            << ", col " << (changePos - Utils::lineStart(hwndEdit, line)) << "\n";
     }
 
-    if (localMarks.empty() && globalMarks.empty() && lastChangeMark.line == -1) {
+    if (state.localMarks.empty() && globalMarks.empty() && changePos < 0) {
         oss << "No marks set\n";
     }
 
@@ -3,158 +3,143 @@
 #include "../plugin/Scintilla.h"
 #include "../include/NppVim.h"
 #include "../include/Utils.h"
+#include "../include/BracketIndex.h"
+#include "../include/CharClass.h"
+#include <algorithm>
+#include <string>
 
 Motion motion;
 
-static inline void doMotion(HWND h,int normalCmd,int extendCmd,int count){
-    int cmd = (state.mode==VISUAL) ? extendCmd : normalCmd;
-    for(int i=0;i<count;i++){
-        Utils::sci(h, cmd, 0);
-    }
+// Single-step Scintilla commands (document/page motions) that have no count.
+static inline void doMotion(HWND h,int normalCmd,int extendCmd){
+    Utils::sci(h, (state.mode==VISUAL) ? extendCmd : normalCmd, 0);
+}
+
+// Apply a computed target with one selection update.
+static void moveTo(HWND h, int pos) {
+    if (state.mode == VISUAL)
+        Utils::sci(h, SCI_SETSEL, state.visualAnchor, pos);
+    else
+        Utils::sci(h, SCI_GOTOPOS, pos);
 }
 
 void Motion::charLeft(HWND hwndEdit, int count) {
-    doMotion(hwndEdit, SCI_CHARLEFT, SCI_CHARLEFTEXTEND, count);
+    int pos = Utils::caretPos(hwndEdit);
+    int target = Utils::sci(hwndEdit, SCI_POSITIONRELATIVE, pos, -count);
+    moveTo(hwndEdit, target);
 }
 
 void Motion::charRight(HWND hwndEdit, int count) {
-    doMotion(hwndEdit, SCI_CHARRIGHT, SCI_CHARRIGHTEXTEND, count);
+    int pos = Utils::caretPos(hwndEdit);
+    int target = Utils::sci(hwndEdit, SCI_POSITIONRELATIVE, pos, count);
+    // POSITIONRELATIVE reports 0 when the count runs past the document end
+    if (target <= pos) target = Utils::sci(hwndEdit, SCI_GETLENGTH);
+    moveTo(hwndEdit, target);
 }
 
-void Motion::lineUp(HWND hwndEdit, int count) {
-    if(state.mode!=VISUAL){
-        for(int i=0;i<count;i++)
-            Utils::sci(hwndEdit, SCI_LINEUP, 0);
-        return;
-    }
-
-    int anchor=state.visualAnchor;
+// Column j/k aim for in normal mode; kept while the caret stays where the last
+// vertical motion left it, the way SCI_LINEDOWN remembers its x position.
+static int stickyColumn = -1;
+static int stickyPos = -1;
 
-    for(int i=0;i<count;i++){
-        int pos=Utils::sci(hwndEdit, SCI_GETCURRENTPOS, 0, 0);
-        int line=Utils::sci(hwndEdit, SCI_LINEFROMPOSITION, pos, 0);
-        int newLine=(line>0)?line-1:0;
+static void verticalMove(HWND h, int delta) {
+    int pos = Utils::caretPos(h);
+    int line = Utils::lineFromPosition(h, pos);
+    int maxLine = Utils::lineCount(h) - 1;
+    int newLine = (std::max)(0, (std::min)(line + delta, maxLine));
 
-        int newPos=Utils::sci(hwndEdit, SCI_FINDCOLUMN, newLine, state.visualPreferredColumn);
-        Utils::sci(hwndEdit, SCI_SETSEL, anchor, newPos);
+    int column;
+    if (state.mode == VISUAL) {
+        column = state.visualPreferredColumn;
+    } else {
+        column = (pos == stickyPos && stickyColumn >= 0)
+            ? stickyColumn : Utils::sci(h, SCI_GETCOLUMN, pos);
     }
-}
 
-void Motion::lineDown(HWND hwndEdit, int count) {
-    if(state.mode!=VISUAL){
-        for(int i=0;i<count;i++)
-            Utils::sci(hwndEdit, SCI_LINEDOWN, 0);
-        return;
-    }
+    int newPos = Utils::sci(h, SCI_FINDCOLUMN, newLine, column);
+    moveTo(h, newPos);
 
-    int anchor=state.visualAnchor;
-    int maxLine=Utils::sci(hwndEdit, SCI_GETLINECOUNT, 0, 0) - 1;
+    if (state.mode != VISUAL) {
+        stickyColumn = column;
+        stickyPos = newPos;
+    }
+}
 
-    for(int i=0;i<count;i++){
-        int pos=Utils::sci(hwndEdit, SCI_GETCURRENTPOS, 0, 0);
-        int line=Utils::sci(hwndEdit, SCI_LINEFROMPOSITION, pos, 0);
-        int newLine=(line<maxLine)?line+1:maxLine;
+void Motion::lineUp(HWND hwndEdit, int count) {
+    verticalMove(hwndEdit, -count);
+}
 
-        int newPos=Utils::sci(hwndEdit, SCI_FINDCOLUMN, newLine, state.visualPreferredColumn);
-        Utils::sci(hwndEdit, SCI_SETSEL, anchor, newPos);
-    }
+void Motion::lineDown(HWND hwndEdit, int count) {
+    verticalMove(hwndEdit, count);
 }
 
 void Motion::wordRight(HWND hwndEdit, int count) {
-    doMotion(hwndEdit, SCI_WORDRIGHT, SCI_WORDRIGHTEXTEND, count);
+    CharClasses classes(hwndEdit);
+    ClassScanner scan(hwndEdit, classes);
+    int len = scan.length();
+    int pos = Utils::caretPos(hwndEdit);
+    for (int i = 0; i < count && pos < len; i++) {
+        pos = scan.skipForward(pos, classBit(scan.at(pos)));
+        pos = scan.skipForward(pos, classBit(CC_SPACE));
+    }
+    moveTo(hwndEdit, pos);
 }
 
 void Motion::wordRightBig(HWND hwndEdit, int count) {
-    int docLen = (int)::SendMessage(hwndEdit, SCI_GETLENGTH, 0, 0);
-    int pos = (int)::SendMessage(hwndEdit, SCI_GETCURRENTPOS, 0, 0);
-    for (int i = 0; i < count; i++) {
-        while (pos < docLen) {
-            char ch = (char)::SendMessage(hwndEdit, SCI_GETCHARAT, pos, 0);
-            if (ch == ' ' || ch == '\t' || ch == '\r' || ch == '\n') {
-                break;
-            }
-            pos++;
-        }
-        while (pos < docLen) {
-            char ch = (char)::SendMessage(hwndEdit, SCI_GETCHARAT, pos, 0);
-            if (!(ch == ' ' || ch == '\t' || ch == '\r' || ch == '\n')) {
-                break;
-            }
-            pos++;
-        }
-    }
-    if (state.mode == VISUAL) {
-        int anchor = state.visualAnchor;
-        ::SendMessage(hwndEdit, SCI_SETSEL, anchor, pos);
-    }
-    else {
-        ::SendMessage(hwndEdit, SCI_SETCURRENTPOS, pos, 0);
-        ::SendMessage(hwndEdit, SCI_SETSEL, pos, pos);
+    CharClasses classes(hwndEdit);
+    ClassScanner scan(hwndEdit, classes);
+    int len = scan.length();
+    int pos = Utils::caretPos(hwndEdit);
+    for (int i = 0; i < count && pos < len; i++) {
+        pos = scan.skipForward(pos, CLASS_NONBLANK);
+        pos = scan.skipForward(pos, CLASS_BLANK);
     }
+    moveTo(hwndEdit, pos);
 }
 
 void Motion::wordLeft(HWND hwndEdit, int count) {
-    doMotion(hwndEdit, SCI_WORDLEFT, SCI_WORDLEFTEXTEND, count);
+    CharClasses classes(hwndEdit);
+    ClassScanner scan(hwndEdit, classes);
+    int pos = Utils::caretPos(hwndEdit);
+    for (int i = 0; i < count && pos > 0; i++) {
+        pos = scan.skipBackward(pos, classBit(CC_SPACE));
+        if (pos > 0) pos = scan.skipBackward(pos, classBit(scan.at(pos - 1)));
+    }
+    moveTo(hwndEdit, pos);
 }
 
 void Motion::wordLeftBig(HWND hwndEdit, int count) {
-    int pos = (int)::SendMessage(hwndEdit, SCI_GETCURRENTPOS, 0, 0);
-    for (int i = 0; i < count; i++) {
-        if (pos <= 0) break;
-        pos--;
-        while (pos > 0) {
-            char ch = (char)::SendMessage(hwndEdit, SCI_GETCHARAT, pos, 0);
-            if (!(ch == ' ' || ch == '\t' || ch == '\r' || ch == '\n')) {
-                break;
-            }
-            pos--;
-        }
-        while (pos > 0) {
-            char prevCh = (char)::SendMessage(hwndEdit, SCI_GETCHARAT, pos - 1, 0);
-            if (prevCh == ' ' || prevCh == '\t' || prevCh == '\r' || prevCh == '\n') {
-                break;
-            }
-            pos--;
-        }
-    }
-    if (state.mode == VISUAL) {
-        int anchor = state.visualAnchor;
-        ::SendMessage(hwndEdit, SCI_SETSEL, anchor, pos);
-    }
-    else {
-        ::SendMessage(hwndEdit, SCI_SETCURRENTPOS, pos, 0);
-        ::SendMessage(hwndEdit, SCI_SETSEL, pos, pos);
+    CharClasses classes(hwndEdit);
+    ClassScanner scan(hwndEdit, classes);
+    int pos = Utils::caretPos(hwndEdit);
+    for (int i = 0; i < count && pos > 0; i++) {
+        pos = scan.skipBackward(pos, CLASS_BLANK);
+        pos = scan.skipBackward(pos, CLASS_NONBLANK);
     }
+    moveTo(hwndEdit, pos);
 }
 
 void Motion::wordEnd(HWND hwndEdit, int count) {
-    doMotion(hwndEdit, SCI_WORDRIGHTEND, SCI_WORDRIGHTENDEXTEND, count);
+    CharClasses classes(hwndEdit);
+    ClassScanner scan(hwndEdit, classes);
+    int len = scan.length();
+    int pos = Utils::caretPos(hwndEdit);
+    for (int i = 0; i < count && pos < len; i++) {
+        pos = scan.skipForward(pos, classBit(CC_SPACE));
+        if (pos < len) pos = scan.skipForward(pos, classBit(scan.at(pos)));
+    }
+    moveTo(hwndEdit, pos);
 }
 
 void Motion::wordEndBig(HWND hwndEdit, int count) {
-    int docLen = (int)::SendMessage(hwndEdit, SCI_GETLENGTH, 0, 0);
-    int pos = (int)::SendMessage(hwndEdit, SCI_GETCURRENTPOS, 0, 0);
-    for (int i = 0; i < count; i++) {
-        if (pos < docLen) pos++;
-
-        while (pos < docLen) {
-            char ch = (char)::SendMessage(hwndEdit, SCI_GETCHARAT, pos, 0);
-            if (!(ch == ' ' || ch == '\t' || ch == '\r' || ch == '\n')) {
-                break;
-            }
-            pos++;
-        }
-        while (pos < docLen) {
-            char ch = (char)::SendMessage(hwndEdit, SCI_GETCHARAT, pos, 0);
-            if (ch == ' ' || ch == '\t' || ch == '\r' || ch == '\n') {
-                pos--;
-                break;
-            }
-            pos++;
-        }
-        if (pos >= docLen) {
-            pos = docLen - 1;
-        }
+    CharClasses classes(hwndEdit);
+    ClassScanner scan(hwndEdit, classes);
+    int len = scan.length();
+    int pos = Utils::caretPos(hwndEdit);
+    for (int i = 0; i < count && len > 0; i++) {
+        int end = scan.skipForward((std::min)(pos + 1, len), CLASS_BLANK);
+        end = scan.skipForward(end, CLASS_NONBLANK);
+        pos = (int)::SendMessage(hwndEdit, SCI_POSITIONBEFORE, end, 0);
     }
     if (state.mode == VISUAL) {
         int anchor = state.visualAnchor;
@@ -165,147 +150,196 @@ void Motion::wordEndBig(HWND hwndEdit, int count) {
     }
 }
 
+// Vim's ge: back over the rest of the current word, then over blanks to
+// the last character of the word before. An empty line counts as a word.
+int Motion::wordEndPrevTarget(HWND hwndEdit, int pos, int count, bool bigWord) {
+    CharClasses classes(hwndEdit);
+    ClassScanner scan(hwndEdit, classes);
+    auto runOf = [&](CharClass c) {
+        return bigWord ? CLASS_NONBLANK : classBit(c);
+    };
+
+    for (int i = 0; i < count && pos > 0; i++) {
+        CharClass start = scan.at(pos);
+        pos--;
+        if (start != CC_SPACE && start != CC_NEWLINE) {
+            int first = scan.skipBackward(pos + 1, runOf(start));
+            if (first == 0) {
+                pos = 0;
+                break;
+            }
+            pos = first - 1;
+        }
+
+        while (pos > 0) {
+            pos = scan.skipBackward(pos + 1, classBit(CC_SPACE)) - 1;
+            if (pos < 0) pos = 0;
+            if (scan.at(pos) != CC_NEWLINE) break;
+            int line = Utils::lineFromPosition(hwndEdit, pos);
+            int lineStart = Utils::lineStart(hwndEdit, line);
+            int lineEnd = Utils::lineEnd(hwndEdit, line);
+            if (lineStart == lineEnd) {
+                pos = lineStart;
+                break;
+            }
+            pos = lineEnd - 1;
+        }
+    }
+
+    // Land on the first byte of a multi-byte character
+    if (pos < scan.length())
+        pos = (int)::SendMessage(hwndEdit, SCI_POSITIONBEFORE, pos + 1, 0);
+    return pos;
+}
+
 void Motion::wordEndPrev(HWND hwndEdit, int count) {
-    doMotion(hwndEdit, SCI_WORDLEFTEND, SCI_WORDLEFTENDEXTEND, count);
+    moveTo(hwndEdit, wordEndPrevTarget(hwndEdit, Utils::caretPos(hwndEdit), count, false));
+}
+
+void Motion::wordEndPrevBig(HWND hwndEdit, int count) {
+    moveTo(hwndEdit, wordEndPrevTarget(hwndEdit, Utils::caretPos(hwndEdit), count, true));
 }
 
 void Motion::lineEnd(HWND hwndEdit, int count) {
-    doMotion(hwndEdit, SCI_LINEEND, SCI_LINEENDEXTEND, count);
+    int line = Utils::caretLine(hwndEdit) + (std::max)(count, 1) - 1;
+    line = (std::min)(line, Utils::lineCount(hwndEdit) - 1);
+    moveTo(hwndEdit, Utils::lineEnd(hwndEdit, line));
 }
 
+// Each step works like SCI_VCHOME, alternating between the indentation and
+// column 0, so the count keeps its old meaning without a message per step.
 void Motion::lineStart(HWND hwndEdit, int count) {
-    doMotion(hwndEdit, SCI_VCHOME, SCI_VCHOMEEXTEND, count);
+    int pos = Utils::caretPos(hwndEdit);
+    int line = Utils::lineFromPosition(hwndEdit, pos);
+    int start = Utils::lineStart(hwndEdit, line);
+    int indent = Utils::sci(hwndEdit, SCI_GETLINEINDENTPOSITION, line);
+    int target = (pos == indent) ? start : indent;
+    if (count > 1 && count % 2 == 0)
+        target = (target == indent) ? start : indent;
+    moveTo(hwndEdit, target);
 }
 
-void Motion::nextChar(HWND hwndEdit, int count, char target) {
-
+// f, t, F and T search the line for the target as the document encodes it,
+// so a multi-byte character is found whole and the caret lands on its
+// first byte.
+void Motion::nextChar(HWND hwndEdit, int count, char32_t target) {
+    std::string needle=Utils::documentChar(hwndEdit,target);
     int pos=Utils::sci(hwndEdit,SCI_GETCURRENTPOS);
-    int line=Utils::sci(hwndEdit,SCI_LINEFROMPOSITION,pos);
-    int end=Utils::sci(hwndEdit,SCI_GETLINEENDPOSITION,line);
-
-    int found=0;
-
-    for(int i=pos+1;i<=end;i++){
-        if((char)Utils::sci(hwndEdit,SCI_GETCHARAT,i)==target){
-            if(++found==count){
-                Utils::sci(hwndEdit,SCI_SETEMPTYSELECTION,i);
-                return;
-            }
-        }
+    int line=Utils::lineFromPosition(hwndEdit,pos);
+    int end=Utils::lineEnd(hwndEdit,line);
+    if(pos>=end||needle.empty()) return;
+
+    int from=Utils::sci(hwndEdit,SCI_POSITIONAFTER,pos);
+    std::string text=Utils::getTextRange(hwndEdit,from,end);
+    size_t at=std::string::npos;
+    for(int found=0;found<count;found++){
+        at=text.find(needle,at==std::string::npos?0:at+needle.size());
+        if(at==std::string::npos) return;
     }
+    Utils::sci(hwndEdit,SCI_SETEMPTYSELECTION,from+(int)at);
+}
 
-    // int pos = (int)::SendMessage(hwndEdit, SCI_GETCURRENTPOS, 0, 0);
-    // int line = (int)::SendMessage(hwndEdit, SCI_LINEFROMPOSITION, pos, 0);
-    // int lineEnd = (int)::SendMessage(hwndEdit, SCI_GETLINEENDPOSITION, line, 0);
-
-    // int foundPos = -1;
-    // int searchPos = pos + 1;
-    // int found = 0;
-    // while (searchPos <= lineEnd) {
-    //     char c = (char)::SendMessage(hwndEdit, SCI_GETCHARAT, searchPos, 0);
-    //     if (c == target) {
-    //         found++;
-    //         if (found == count) { foundPos = searchPos; break; }
-    //     }
-    //     searchPos++;
-    // }
-    // if (foundPos == -1) return;
-    
-    // ::SendMessage(hwndEdit, SCI_SETCURRENTPOS, foundPos, 0);
-    // ::SendMessage(hwndEdit, SCI_SETSEL, foundPos, foundPos);
-}
-
-void Motion::prevChar(HWND hwndEdit, int count, char target) {
+void Motion::prevChar(HWND hwndEdit, int count, char32_t target) {
+    std::string needle = Utils::documentChar(hwndEdit, target);
     int pos = (int)::SendMessage(hwndEdit, SCI_GETCURRENTPOS, 0, 0);
-    int line = (int)::SendMessage(hwndEdit, SCI_LINEFROMPOSITION, pos, 0);
-    int lineStart = (int)::SendMessage(hwndEdit, SCI_POSITIONFROMLINE, line, 0);
-
-    int foundPos = -1;
-    int searchPos = pos - 1;
-    int found = 0;
-    while (searchPos >= lineStart) {
-        char c = (char)::SendMessage(hwndEdit, SCI_GETCHARAT, searchPos, 0);
-        if (c == target) {
-            found++;
-            if (found == count) { foundPos = searchPos; break; }
-        }
-        searchPos--;
+    int line = Utils::lineFromPosition(hwndEdit, pos);
+    int lineStart = Utils::lineStart(hwndEdit, line);
+    if (pos <= lineStart || needle.empty()) return;
+
+    std::string text = Utils::getTextRange(hwndEdit, lineStart, pos);
+    size_t at = text.size();
+    for (int found = 0; found < count; found++) {
+        if (at == 0) return;
+        at = text.rfind(needle, at - 1);
+        if (at == std::string::npos) return;
     }
-    if (foundPos == -1) return;
-    
-    Utils::sci(hwndEdit,SCI_SETEMPTYSELECTION,foundPos);
+
+    Utils::sci(hwndEdit,SCI_SETEMPTYSELECTION,lineStart + (int)at);
 }
 
-void Motion::tillChar(HWND hwndEdit, int count, char target) {
+void Motion::tillChar(HWND hwndEdit, int count, char32_t target) {
+    std::string needle = Utils::documentChar(hwndEdit, target);
     int pos = (int)::SendMessage(hwndEdit, SCI_GETCURRENTPOS, 0, 0);
-    int line = (int)::SendMessage(hwndEdit, SCI_LINEFROMPOSITION, pos, 0);
-    int lineEnd = (int)::SendMessage(hwndEdit, SCI_GETLINEENDPOSITION, line, 0);
+    int line = Utils::lineFromPosition(hwndEdit, pos);
+    int lineEnd = Utils::lineEnd(hwndEdit, line);
+    if (pos >= lineEnd || needle.empty()) return;
 
-    int searchStart = pos;
+    int from = Utils::sci(hwndEdit, SCI_POSITIONAFTER, pos);
+    std::string text = Utils::getTextRange(hwndEdit, from, lineEnd);
+    size_t at = std::string::npos;
     for (int i = 0; i < count; ++i) {
-        int searchPos = searchStart + 1;
-        bool found = false;
-        while (searchPos <= lineEnd) {
-            char c = (char)::SendMessage(hwndEdit, SCI_GETCHARAT, searchPos, 0);
-            if (c == target) { searchStart = searchPos; found = true; break; }
-            searchPos++;
-        }
-        if (!found) return;
+        at = text.find(needle, at == std::string::npos ? 0 : at + needle.size());
+        if (at == std::string::npos) return;
     }
-    int finalPos = searchStart - 1;
-    if (finalPos < Utils::lineStart(hwndEdit, line)) finalPos = Utils::lineStart(hwndEdit, line);
-    
+    int finalPos = Utils::sci(hwndEdit, SCI_POSITIONBEFORE, from + (int)at);
+    if (finalPos < pos) finalPos = pos;
+
     Utils::sci(hwndEdit,SCI_SETEMPTYSELECTION,finalPos);
 }
 
-void Motion::tillCharBack(HWND hwndEdit, int count, char target) {
+void Motion::tillCharBack(HWND hwndEdit, int count, char32_t target) {
+    std::string needle = Utils::documentChar(hwndEdit, target);
     int pos = (int)::SendMessage(hwndEdit, SCI_GETCURRENTPOS, 0, 0);
-    int line = (int)::SendMessage(hwndEdit, SCI_LINEFROMPOSITION, pos, 0);
-    int lineStart = (int)::SendMessage(hwndEdit, SCI_POSITIONFROMLINE, line, 0);
+    int line = Utils::lineFromPosition(hwndEdit, pos);
+    int lineStart = Utils::lineStart(hwndEdit, line);
+    if (pos <= lineStart || needle.empty()) return;
 
-    int searchStart = pos;
+    std::string text = Utils::getTextRange(hwndEdit, lineStart, pos);
+    size_t at = text.size();
     for (int i = 0; i < count; ++i) {
-        int searchPos = searchStart - 1;
-        bool found = false;
-        while (searchPos >= lineStart) {
-            char c = (char)::SendMessage(hwndEdit, SCI_GETCHARAT, searchPos, 0);
-            if (c == target) { searchStart = searchPos; found = true; break; }
-            searchPos--;
-        }
-        if (!found) return;
+        if (at == 0) return;
+        at = text.rfind(needle, at - 1);
+        if (at == std::string::npos) return;
     }
-    int finalPos = searchStart + 1;
-    int lineEnd = Utils::lineEnd(hwndEdit, line);
-    if (finalPos > lineEnd) finalPos = lineEnd;
+    int finalPos = lineStart + (int)at + (int)needle.size();
+    if (finalPos > pos) finalPos = pos;
     Utils::sci(hwndEdit,SCI_SETEMPTYSELECTION,finalPos);
 }
 
+static bool isWhiteLine(HWND h, int line) {
+    return Utils::sci(h, SCI_GETLINEINDENTPOSITION, line) == Utils::lineEnd(h, line);
+}
+
+// Same stops as SCI_PARAUP/SCI_PARADOWN, repeated on line numbers only.
 void Motion::paragraphUp(HWND hwndEdit, int count) {
-    doMotion(hwndEdit, SCI_PARAUP, SCI_PARAUPEXTEND, count);
+    int pos = Utils::caretPos(hwndEdit);
+    for (int i = 0; i < count && pos > 0; i++) {
+        int line = Utils::lineFromPosition(hwndEdit, pos);
+        if (pos == Utils::lineStart(hwndEdit, line)) line--;
+        while (line >= 0 && isWhiteLine(hwndEdit, line)) line--;
+        while (line >= 0 && !isWhiteLine(hwndEdit, line)) line--;
+        pos = Utils::lineStart(hwndEdit, line + 1);
+    }
+    moveTo(hwndEdit, pos);
 }
 
 void Motion::paragraphDown(HWND hwndEdit, int count) {
-    doMotion(hwndEdit, SCI_PARADOWN, SCI_PARADOWNEXTEND, count);
+    int total = Utils::lineCount(hwndEdit);
+    int pos = Utils::caretPos(hwndEdit);
+    for (int i = 0; i < count; i++) {
+        int line = Utils::lineFromPosition(hwndEdit, pos);
+        while (line < total && !isWhiteLine(hwndEdit, line)) line++;
+        while (line < total && isWhiteLine(hwndEdit, line)) line++;
+        if (line >= total) {
+            pos = Utils::lineEnd(hwndEdit, total - 1);
+            break;
+        }
+        pos = Utils::lineStart(hwndEdit, line);
+    }
+    moveTo(hwndEdit, pos);
 }
 
 void Motion::gotoLine(HWND hwndEdit, int lineNum) {
-    if (state.mode == VISUAL) {
-        int anchor = state.visualAnchor;
-        ::SendMessage(hwndEdit, SCI_GOTOLINE, lineNum - 1, 0);
-        int newPos = (int)::SendMessage(hwndEdit, SCI_GETCURRENTPOS, 0, 0);
-        ::SendMessage(hwndEdit, SCI_SETSEL, anchor, newPos);
-    }
-    else {
-        ::SendMessage(hwndEdit, SCI_GOTOLINE, lineNum - 1, 0);
-    }
+    int line = (std::max)(0, (std::min)(lineNum - 1, Utils::lineCount(hwndEdit) - 1));
+    moveTo(hwndEdit, Utils::lineStart(hwndEdit, line));
 }
 
 void Motion::documentStart(HWND hwndEdit) {
-    doMotion(hwndEdit, SCI_DOCUMENTSTART, SCI_DOCUMENTSTARTEXTEND, 1);
+    doMotion(hwndEdit, SCI_DOCUMENTSTART, SCI_DOCUMENTSTARTEXTEND);
 }
 
 void Motion::documentEnd(HWND hwndEdit) {
-    doMotion(hwndEdit, SCI_DOCUMENTEND, SCI_DOCUMENTENDEXTEND, 1);
+    doMotion(hwndEdit, SCI_DOCUMENTEND, SCI_DOCUMENTENDEXTEND);
 }
 
 void Motion::pageUp(HWND hwndEdit) {
@@ -314,7 +348,7 @@ void Motion::pageUp(HWND hwndEdit) {
     if (now - lastTime < 100) return;
     lastTime = now;
 
-    doMotion(hwndEdit, SCI_PAGEUP, SCI_PAGEUPEXTEND, 1);
+    doMotion(hwndEdit, SCI_PAGEUP, SCI_PAGEUPEXTEND);
 }
 
 void Motion::pageDown(HWND hwndEdit) {
@@ -323,15 +357,15 @@ void Motion::pageDown(HWND hwndEdit) {
     if (now - lastTime < 100) return;
     lastTime = now;
 
-    doMotion(hwndEdit, SCI_PAGEDOWN, SCI_PAGEDOWNEXTEND, 1);
+    doMotion(hwndEdit, SCI_PAGEDOWN, SCI_PAGEDOWNEXTEND);
 }
 
 void Motion::matchPair(HWND hwndEdit) {
     int pos=Utils::sci(hwndEdit,SCI_GETCURRENTPOS);
-    int match=Utils::sci(hwndEdit,SCI_BRACEMATCH,pos);
+    int match=BracketIndex::getInstance().match(hwndEdit,pos);
 
-    if(match==-1)
-        match=Utils::sci(hwndEdit,SCI_BRACEMATCH,pos-1);
+    if(match==-1&&pos>0)
+        match=BracketIndex::getInstance().match(hwndEdit,pos-1);
 
     if(match==-1) return;
 
@@ -351,19 +385,13 @@ void Motion::toggleCase(HWND hwndEdit, int count) {
         end=Utils::sci(hwndEdit,SCI_GETSELECTIONEND);
     }else{
         start=Utils::sci(hwndEdit,SCI_GETCURRENTPOS);
-        end=start+count;
+        int line=Utils::lineFromPosition(hwndEdit,start);
+        int lineEnd=Utils::lineEnd(hwndEdit,line);
+        end=Utils::sci(hwndEdit,SCI_POSITIONRELATIVE,start,count);
+        if(end==0||end>lineEnd) end=lineEnd;
     }
 
-    for(int i=start;i<end;i++){
-        char c=(char)Utils::sci(hwndEdit,SCI_GETCHARAT,i);
-
-        if(std::islower(c)) c=std::toupper(c);
-        else if(std::isupper(c)) c=std::tolower(c);
-        else continue;
-
-        Utils::sci(hwndEdit,SCI_SETTARGETRANGE,i,i+1);
-        Utils::sci(hwndEdit,SCI_REPLACETARGET,1,(LPARAM)&c);
-    }
+    Utils::toggleCase(hwndEdit,start,end);
 
     if(state.mode==NORMAL)
         Utils::sci(hwndEdit,SCI_SETEMPTYSELECTION,end);
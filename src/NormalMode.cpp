@@ -10,7 +10,14 @@
 #include "../include/Keymap.h"
 #include "../include/NppVim.h"
 #include "../include/Marks.h"
+#include "../include/Registers.h"
+#include "../include/BracketIndex.h"
 #include "../include/TextObject.h"
+#include "../include/Increment.h"
+#include "../include/BlockEdit.h"
+#include "../include/Reflow.h"
+#include "../include/Indent.h"
+#include "../include/Paste.h"
 #include "../include/Utils.h"
 #include "../plugin/menuCmdID.h"
 #include "../plugin/Notepad_plus_msgs.h"
@@ -26,77 +33,11 @@ int g_macroDepth = 0;
 
 extern VimConfig g_config;
 
-static std::vector<std::string> splitLines(const std::string& str) {
-    std::vector<std::string> lines;
-    std::string current;
-    for (char c : str) {
-        if (c == '\r') continue;
-        if (c == '\n') {
-            lines.push_back(current);
-            current.clear();
-        } else {
-            current.push_back(c);
-        }
-    }
-    if (!current.empty() || str.empty()) {
-        lines.push_back(current);
-    }
-    if (!lines.empty() && lines.back().empty() && !str.empty() && str.back() == '\n') {
-        lines.pop_back();
-    }
-    return lines;
-}
-
-static void pasteBlock(HWND h, const std::string& content, bool pasteAfter) {
-    std::vector<std::string> lines = splitLines(content);
-    if (lines.empty()) return;
-
-    int caretPos = Utils::caretPos(h);
-    int startLine = ::SendMessage(h, SCI_LINEFROMPOSITION, caretPos, 0);
-    int startCol = ::SendMessage(h, SCI_GETCOLUMN, caretPos, 0);
-
-    int targetCol = pasteAfter ? (startCol + 1) : startCol;
-    if (pasteAfter) {
-        int lineStart = ::SendMessage(h, SCI_POSITIONFROMLINE, startLine, 0);
-        int lineEnd = Utils::lineEnd(h, startLine);
-        if (lineStart == lineEnd) {
-            targetCol = 0;
-        }
-    }
-
-    int totalLines = ::SendMessage(h, SCI_GETLINECOUNT, 0, 0);
-
-    Utils::beginUndo(h);
-
-    for (size_t i = 0; i < lines.size(); i++) {
-        int curLine = startLine + (int)i;
-        
-        if (curLine >= totalLines) {
-            int docLen = ::SendMessage(h, SCI_GETLENGTH, 0, 0);
-            ::SendMessage(h, SCI_SETCURRENTPOS, docLen, 0);
-            ::SendMessage(h, SCI_REPLACESEL, 0, (LPARAM)"\r\n");
-            totalLines = ::SendMessage(h, SCI_GETLINECOUNT, 0, 0);
-        }
-
-        int lineStart = ::SendMessage(h, SCI_POSITIONFROMLINE, curLine, 0);
-        int lineEnd = Utils::lineEnd(h, curLine);
-        int colPos = ::SendMessage(h, SCI_FINDCOLUMN, curLine, targetCol);
-
-        int curLineEndCol = ::SendMessage(h, SCI_GETCOLUMN, lineEnd, 0);
-        if (curLineEndCol < targetCol) {
-            int padCount = targetCol - curLineEndCol;
-            std::string padding(padCount, ' ');
-            ::SendMessage(h, SCI_INSERTTEXT, lineEnd, (LPARAM)padding.c_str());
-            colPos = lineEnd + padCount;
-        }
-
-        ::SendMessage(h, SCI_INSERTTEXT, colPos, (LPARAM)lines[i].c_str());
-    }
-
-    int finalCaret = ::SendMessage(h, SCI_FINDCOLUMN, startLine, targetCol);
-    Utils::select(h, finalCaret, finalCaret);
-
-    Utils::endUndo(h);
+// Registers keep no shape of their own; p and P go by the last yank, in
+// whichever buffer it was made.
+static Paste::Shape pasteShape(const VimState& state) {
+    if (state.lastYankBlockwise) return Paste::BLOCKWISE;
+    return state.lastYankLinewise ? Paste::LINEWISE : Paste::CHARWISE;
 }
 
 NormalMode::NormalMode(VimState& state) : state(state) {
@@ -148,7 +89,7 @@ void NormalMode::setupKeyMaps() {
         long pos = Utils::caretPos(h);
         int line = Utils::caretLine(h);
         state.recordJump(pos, line);
-        int match = ::SendMessage(h, SCI_BRACEMATCH, pos, 0);
+        int match = BracketIndex::getInstance().match(h, pos);
         if (match != -1) ::SendMessage(h, SCI_GOTOPOS, match, 0);
      })
      .motion("H", 'H', "Page up", [this](HWND h, int c) {
@@ -199,72 +140,8 @@ void NormalMode::setupKeyMaps() {
          Utils::select(h, pos, pos);
          state.recordLastOp(OP_MOTION, c, 'g');
      })
-     .set("ge", "Previous word end",  [](HWND h, int c) {
-        for (int i = 0; i < c; i++) {
-            int pos = Utils::caretPos(h);
-
-            if (pos > 0)
-                pos = ::SendMessage(h, SCI_POSITIONBEFORE, pos, 0);
-
-            while (pos > 0) {
-                char ch = ::SendMessage(h, SCI_GETCHARAT, pos, 0);
-                if (!isspace(ch)) break;
-                pos = ::SendMessage(h, SCI_POSITIONBEFORE, pos, 0);
-            }
-
-            while (pos > 0) {
-                char ch = ::SendMessage(h, SCI_GETCHARAT, pos - 1, 0);
-                if (isspace(ch)) break;
-                pos = ::SendMessage(h, SCI_POSITIONBEFORE, pos, 0);
-            }
-
-            while (true) {
-                char ch = ::SendMessage(h, SCI_GETCHARAT, pos, 0);
-                if (isspace(ch)) break;
-
-                int next = ::SendMessage(h, SCI_POSITIONAFTER, pos, 0);
-                if (next == pos) break;
-                pos = next;
-            }
-
-            pos = ::SendMessage(h, SCI_POSITIONBEFORE, pos, 0);
-
-            ::SendMessage(h, SCI_GOTOPOS, pos, 0);
-        }
-    })
-    .motion("gE", 'E', "Previous WORD end", [](HWND h, int c) {
-        for (int i = 0; i < c; i++) {
-            int pos = Utils::caretPos(h);
-
-            if (pos > 0)
-                pos = ::SendMessage(h, SCI_POSITIONBEFORE, pos, 0);
-
-            while (pos > 0) {
-                char ch = ::SendMessage(h, SCI_GETCHARAT, pos, 0);
-                if (ch != ' ' && ch != '\t' && ch != '\n') break;
-                pos = ::SendMessage(h, SCI_POSITIONBEFORE, pos, 0);
-            }
-
-            while (pos > 0) {
-                char ch = ::SendMessage(h, SCI_GETCHARAT, pos - 1, 0);
-                if (ch == ' ' || ch == '\t' || ch == '\n') break;
-                pos = ::SendMessage(h, SCI_POSITIONBEFORE, pos, 0);
-            }
-
-            while (true) {
-                char ch = ::SendMessage(h, SCI_GETCHARAT, pos, 0);
-                if (ch == ' ' || ch == '\t' || ch == '\n') break;
-
-                int next = ::SendMessage(h, SCI_POSITIONAFTER, pos, 0);
-                if (next == pos) break;
-                pos = next;
-            }
-
-            pos = ::SendMessage(h, SCI_POSITIONBEFORE, pos, 0);
-
-            ::SendMessage(h, SCI_GOTOPOS, pos, 0);
-        }
-    })
+     .set("ge", "Previous word end",  [](HWND h, int c) { Motion::wordEndPrev(h, c); })
+    .motion("gE", 'E', "Previous WORD end", [](HWND h, int c) { Motion::wordEndPrevBig(h, c); })
     .set("gf", "Goto file", [](HWND h, int c) {
         int pos = Utils::caretPos(h);
         int line = Utils::caretLine(h);
@@ -390,11 +267,23 @@ void NormalMode::setupKeyMaps() {
         int mid = first + lines / 2;
         ::SendMessage(h, SCI_GOTOLINE, mid, 0);
     })
-    .set("g;", "Last edit position", [this](HWND h, int c) {
-        if (state.lastInsertPos != -1)
-            ::SendMessage(h, SCI_GOTOPOS, state.lastInsertPos, 0);
+    .set("g;", "Older change position", [this](HWND h, int c) {
+        long target;
+        if (!state.changeList.back(h, Utils::caretPos(h), Utils::caretLine(h), c, target)) {
+            Utils::setStatus(TEXT("At start of changelist"));
+            return;
+        }
+        ::SendMessage(h, SCI_GOTOPOS, target, 0);
+        ::SendMessage(h, SCI_SCROLLCARET, 0, 0);
     })
-    .set("g,", "Previous edit (stub)", [this](HWND h, int c) {
+    .set("g,", "Newer change position", [this](HWND h, int c) {
+        long target;
+        if (!state.changeList.forward(h, c, target)) {
+            Utils::setStatus(TEXT("At end of changelist"));
+            return;
+        }
+        ::SendMessage(h, SCI_GOTOPOS, target, 0);
+        ::SendMessage(h, SCI_SCROLLCARET, 0, 0);
     })
     .set("gJ", "Join lines (no space)", [this](HWND h, int c) {
         Utils::beginUndo(h);
@@ -413,9 +302,13 @@ void NormalMode::setupKeyMaps() {
         state.opPending = 'U';
         Utils::setStatus(TEXT("-- UPPERCASE --"));
     })
-    .set("gq", "Format text (stub)", [this](HWND h, int c) {
+    .set("gq", "Format text (operator)", [this](HWND h, int c) {
+        state.opPending = 'q';
+        Utils::setStatus(TEXT("-- FORMAT --"));
     })
-    .set("gw", "Format keep cursor (stub)", [this](HWND h, int c) {
+    .set("gw", "Format keep cursor (operator)", [this](HWND h, int c) {
+        state.opPending = 'w';
+        Utils::setStatus(TEXT("-- FORMAT --"));
     })
     .set("g*", "Search word (no boundary)", [this](HWND h, int c) {
         int pos = Utils::caretPos(h);
@@ -477,37 +370,25 @@ void NormalMode::setupKeyMaps() {
     k.set("d", "Delete line", [this](HWND h, int c) {
          state.resetPending();
          state.lastYankLinewise = true;
+         state.lastYankBlockwise = false;
          Utils::beginUndo(h);
 
-         char reg = Utils::getCurrentRegister();
-
-         for (int i = 0; i < c; ++i) deleteLineOnce(h);
+         deleteLines(h, c);
          Utils::endUndo(h);
          state.recordLastOp(OP_DELETE_LINE, c);
      })
      .set("y", "Yank line", [this](HWND h, int c) {
          state.resetPending();
          state.lastYankLinewise = true;
-         Utils::beginUndo(h);
-
-        char reg = Utils::getCurrentRegister();
-        if (state.opPending == 'y' && state.repeatCount == 0) {
-            // Handle "ayy" - yank to register a
-        }
-
-         for (int i = 0; i < c; ++i) yankLineOnce(h);
-         Utils::endUndo(h);
-         state.recordLastOp(OP_YANK_LINE, c);
+         state.lastYankBlockwise = false;
+         yankLines(h, c);
      })
      .set("c", "Change line", [this](HWND h, int c) {
          state.resetPending();
+         state.lastYankLinewise = true;
+         state.lastYankBlockwise = false;
          Utils::beginUndo(h);
-         for (int i = 0; i < c; ++i) {
-            deleteLineOnce(h);
-            ::SendMessage(h, SCI_HOME, 0, 0);
-            ::SendMessage(h, SCI_NEWLINE, 0, 0);
-            Motion::lineUp(h, 1);
-         }
+         changeLines(h, c);
          Utils::endUndo(h);
          enterInsertMode();
          state.recordLastOp(OP_MOTION, c, 'c');
@@ -736,7 +617,7 @@ void NormalMode::setupKeyMaps() {
          state.mode = INSERT;
          Utils::setStatus(TEXT("-- REPLACE --"));
          Utils::sci(h, SCI_SETOVERTYPE, true, 0);
-         Utils::sci(h, SCI_SETCARETSTYLE, CARETSTYLE_BLOCK, 0);
+         Utils::setCaretStyle(h, CARETSTYLE_BLOCK);
          state.recordLastOp(OP_MOTION, c, 'R');
      })
      .motion("~", '~', "Toggle case", [this](HWND h, int c) { motion.toggleCase(h, c); });
@@ -749,186 +630,12 @@ void NormalMode::setupKeyMaps() {
      });
 
    k.set("p", "Paste after", [this](HWND h, int c) {
-        char reg = Utils::getCurrentRegister();
-
-        std::string content;
-
-        if (reg == '+' || reg == '*') {
-            if (OpenClipboard(h)) {
-                HANDLE hData = GetClipboardData(CF_TEXT);
-
-                if (hData) {
-                    char* pszText = (char*)GlobalLock(hData);
-
-                    if (pszText) {
-                        content = pszText;
-                        GlobalUnlock(hData);
-                    }
-                }
-
-                CloseClipboard();
-            }
-        } else {
-            content = Utils::getRegisterContent(reg);
-        }
-
-        if (content.empty())
-            return;
-
-        Utils::beginUndo(h);
-
-        if (state.lastVisualWasBlock) {
-            for (int i = 0; i < c; i++) {
-                pasteBlock(h, content, true);
-            }
-        } else {
-            bool linewise = state.lastYankLinewise;
-
-            for (int i = 0; i < c; i++) {
-
-                if (linewise) {
-
-                int line = Utils::caretLine(h);
-
-                int insertPos =
-                    Utils::lineRange(h, line, true).second;
-
-                ::SendMessage(
-                    h,
-                    SCI_INSERTTEXT,
-                    insertPos,
-                    (LPARAM)content.c_str()
-                );
-
-                ::SendMessage(
-                    h,
-                    SCI_GOTOPOS,
-                    insertPos,
-                    0
-                );
-
-            } else {
-
-                int pos = Utils::caretPos(h);
-
-                int insertPos =
-                    ::SendMessage(
-                        h,
-                        SCI_POSITIONAFTER,
-                        pos,
-                        0
-                    );
-
-                ::SendMessage(
-                    h,
-                    SCI_INSERTTEXT,
-                    insertPos,
-                    (LPARAM)content.c_str()
-                );
-
-                ::SendMessage(
-                    h,
-                    SCI_GOTOPOS,
-                    insertPos + (int)content.size() - 1,
-                    0
-                );
-            }
-        }
-        } // end else for !state.lastVisualWasBlock
-
-        Utils::endUndo(h);
-
-        state.recordLastOp(OP_PASTE, c);
+        if (Paste::put(h, Utils::getCurrentRegister(), c, pasteShape(state), true))
+            state.recordLastOp(OP_PASTE, c);
     })
     .set("P", "Paste before", [this](HWND h, int c) {
-
-        char reg = Utils::getCurrentRegister();
-
-        std::string content;
-
-        if (reg == '+' || reg == '*') {
-
-            if (OpenClipboard(h)) {
-
-                HANDLE hData = GetClipboardData(CF_TEXT);
-
-                if (hData) {
-
-                    char* pszText =
-                        (char*)GlobalLock(hData);
-
-                    if (pszText) {
-                        content = pszText;
-                        GlobalUnlock(hData);
-                    }
-                }
-
-                CloseClipboard();
-            }
-
-        } else {
-            content = Utils::getRegisterContent(reg);
-        }
-
-        if (content.empty())
-            return;
-
-        Utils::beginUndo(h);
-
-        if (state.lastVisualWasBlock) {
-            for (int i = 0; i < c; i++) {
-                pasteBlock(h, content, false);
-            }
-        } else {
-            bool linewise = state.lastYankLinewise;
-
-            for (int i = 0; i < c; i++) {
-
-                if (linewise) {
-
-                int line = Utils::caretLine(h);
-
-                int insertPos =
-                    Utils::lineStart(h, line);
-
-                ::SendMessage(
-                    h,
-                    SCI_INSERTTEXT,
-                    insertPos,
-                    (LPARAM)content.c_str()
-                );
-
-                ::SendMessage(
-                    h,
-                    SCI_GOTOPOS,
-                    insertPos,
-                    0
-                );
-
-            } else {
-
-                int pos = Utils::caretPos(h);
-
-                ::SendMessage(
-                    h,
-                    SCI_INSERTTEXT,
-                    pos,
-                    (LPARAM)content.c_str()
-                );
-
-                ::SendMessage(
-                    h,
-                    SCI_GOTOPOS,
-                    pos,
-                    0
-                );
-            }
-        }
-        } // end else for !state.lastVisualWasBlock
-
-        Utils::endUndo(h);
-
-        state.recordLastOp(OP_PASTE, c);
+        if (Paste::put(h, Utils::getCurrentRegister(), c, pasteShape(state), false))
+            state.recordLastOp(OP_PASTE, c);
     });
 
     k.set("\"", "Select register", [this](HWND h, int c) {
@@ -1036,10 +743,10 @@ void NormalMode::setupKeyMaps() {
         if (state.lastSearchChar == 0) return;
         bool fwd = state.lastSearchForward;
         bool till = state.lastSearchTill;
-        char ch = state.lastSearchChar;
+        char32_t ch = state.lastSearchChar;
         int before = Utils::caretPos(h);
         if (till) {
-            int nudge = fwd ? before + 1 : before - 1;
+            int nudge = (int)::SendMessage(h, fwd ? SCI_POSITIONAFTER : SCI_POSITIONBEFORE, before, 0);
             ::SendMessage(h, SCI_SETCURRENTPOS, nudge, 0);
             ::SendMessage(h, SCI_SETSEL, nudge, nudge);
             if (fwd) Motion::tillChar(h, c, ch);
@@ -1055,7 +762,7 @@ void NormalMode::setupKeyMaps() {
         if (state.lastSearchChar == 0) return;
         bool fwd = !state.lastSearchForward;
         bool till = state.lastSearchTill;
-        char ch = state.lastSearchChar;
+        char32_t ch = state.lastSearchChar;
         int before = Utils::caretPos(h);
         if (till) {
             if (fwd) Motion::tillChar(h, c, ch);
@@ -1083,13 +790,13 @@ void NormalMode::setupKeyMaps() {
          int rc = (state.repeatCount > 0) ? state.repeatCount : state.lastOp.count;
          switch (state.lastOp.type) {
          case OP_DELETE_LINE:
-             for (int i = 0; i < rc; ++i) deleteLineOnce(h);
+             deleteLines(h, rc);
              break;
          case OP_YANK_LINE:
-             for (int i = 0; i < rc; ++i) yankLineOnce(h);
+             yankLines(h, rc);
              break;
          case OP_PASTE_LINE:
-             for (int i = 0; i < rc; ++i) Utils::pasteAfter(h, 1, state.lastYankLinewise);
+             Utils::pasteAfter(h, rc, state.lastYankLinewise);
              break;
          case OP_MOTION:
              if (state.lastOp.textModifier && state.lastOp.textObject) {
@@ -1122,6 +829,7 @@ void NormalMode::setupKeyMaps() {
              state.replacePending = true;
              break;
         case OP_INDENT:
+            Marks::getVisualMarks(h, state.lastVisualAnchor, state.lastVisualCaret);
             if (state.lastVisualAnchor >= 0 && state.lastVisualCaret >= 0) {
                 Utils::select(h, state.lastVisualAnchor, state.lastVisualCaret);
             }
@@ -1177,7 +885,7 @@ void NormalMode::setupKeyMaps() {
             if (!state.macroBuffer.empty() && state.macroBuffer.back() == 'q') {
                 state.macroBuffer.pop_back();
             }
-            state.registers[state.macroRegister] = std::string(state.macroBuffer.begin(), state.macroBuffer.end());
+            Utils::setRegisterContent(state.macroRegister, std::string(state.macroBuffer.begin(), state.macroBuffer.end()));
             state.recordingMacro = false;
             state.recordingInsertMacro = false;
             state.macroRegister = '\0';
@@ -1195,11 +903,12 @@ void NormalMode::setupKeyMaps() {
 
         char reg = Utils::getCurrentRegister();
 
-        if (state.registers.find(reg) == state.registers.end() || state.registers[reg].empty()) {
+        // Hold a reference so the macro can overwrite its own register safely
+        RegisterText macroContent = Utils::getRegisterText(reg);
+        if (!macroContent) {
             Utils::setStatus(TEXT("Register is empty"));
             return;
         }
-        std::string macroContent = state.registers[reg];
 
         // Iteration limit to prevent infinite loops
         const int MAX_MACRO_ITERATIONS = 1000;
@@ -1208,7 +917,7 @@ void NormalMode::setupKeyMaps() {
         g_macroDepth++;
 
         for (int iteration = 0; iteration < c; ++iteration) {
-            for (char key : macroContent) {
+            for (char key : *macroContent) {
                 if (++iterations > MAX_MACRO_ITERATIONS) {
                     Utils::setStatus(TEXT("Macro iteration limit reached"));
                     g_macroDepth--;
@@ -1236,34 +945,17 @@ void NormalMode::setupKeyMaps() {
          Utils::setStatus(TEXT("-- Set mark --"));
      })
     .set("``", "Jump back", [this](HWND h, int c) {
-        if (state.jumpList.size() < 2) return;
-        int last = state.jumpList.size() - 1;
-        std::swap(state.jumpList[last], state.jumpList[last - 1]);
-        auto jump = state.jumpList[last];
-        if (jump.position != -1) {
-            long pos = Utils::caretPos(h);
-            int line = Utils::caretLine(h);
-            state.recordJump(pos, line);
-            ::SendMessage(h, SCI_GOTOPOS, jump.position, 0);
-            ::SendMessage(h, SCI_SETSEL, jump.position, jump.position);
-            ::SendMessage(h, SCI_SCROLLCARET, 0, 0);
-        }
+        const JumpPosition* jump = state.jumpList.newest(h);
+        if (!jump) return;
+        long target = state.jumpList.target(h, *jump);
+        state.recordJump(Utils::caretPos(h), Utils::caretLine(h));
+        ::SendMessage(h, SCI_GOTOPOS, target, 0);
+        ::SendMessage(h, SCI_SETSEL, target, target);
+        ::SendMessage(h, SCI_SCROLLCARET, 0, 0);
     })
      .set("'", "Jump to mark", [this](HWND h, int c) {
          if (c > 1) {
-             if (state.jumpList.size() >= 2) {
-                 int last = state.jumpList.size() - 1;
-                 std::swap(state.jumpList[last], state.jumpList[last - 1]);
-                 auto jump = state.jumpList[last];
-                 if (jump.lineNumber != -1) {
-                     int target = ::SendMessage(h, SCI_GETLINEINDENTPOSITION, jump.lineNumber, 0);
-
-                     ::SendMessage(h, SCI_GOTOPOS, target, 0);
-                     ::SendMessage(h, SCI_SETSEL, target, target);
-                     ::SendMessage(h, SCI_SCROLLCARET, 0, 0);
-                     Utils::setStatus(TEXT("-- Jumped to last line --"));
-                 }
-             }
+             jumpToLastLine(h);
              return;
          }
          state.awaitingMarkJump = true;
@@ -1272,16 +964,7 @@ void NormalMode::setupKeyMaps() {
          Utils::setStatus(TEXT("-- Jump to mark (line start) --"));
      })
      .set("''", "Jump to last line", [this](HWND h, int c) {
-         if (state.jumpList.size() < 2) return;
-         int last = state.jumpList.size() - 1;
-         std::swap(state.jumpList[last], state.jumpList[last - 1]);
-         auto jump = state.jumpList[last];
-         if (jump.lineNumber != -1) {
-             int target = ::SendMessage(h, SCI_GETLINEINDENTPOSITION, jump.lineNumber, 0);
-             ::SendMessage(h, SCI_GOTOPOS, target, 0);
-             ::SendMessage(h, SCI_SETSEL, target, target);
-             ::SendMessage(h, SCI_SCROLLCARET, 0, 0);
-         }
+         jumpToLastLine(h);
      });
 
     k.set(">", "Indent", [this](HWND h, int c) {
@@ -1292,7 +975,15 @@ void NormalMode::setupKeyMaps() {
          Utils::handleUnindent(h, c);
          state.recordLastOp(OP_INDENT, c, '<');
      })
-     .set("=", "Autoindent", [](HWND h, int c) { Utils::handleAutoIndent(h, c); });
+     .set("=", "Reindent lines", [this](HWND h, int c) {
+         state.resetPending();
+         int line = Utils::caretLine(h);
+         Indent::apply(h, line, line + c - 1);
+     })
+     .set("!", "Filter lines", [this](HWND h, int c) {
+         state.resetPending();
+         if (g_commandMode) g_commandMode->enter(':', c > 1 ? ".,.+" + std::to_string(c - 1) + "!" : ".!");
+     });
 
     k.set("gcc", "Toggle Comment", [this](HWND h, int c) {
          ::SendMessage(nppData._nppHandle, WM_COMMAND, IDM_EDIT_BLOCK_COMMENT, 0);
@@ -1309,6 +1000,7 @@ void NormalMode::setupKeyMaps() {
          state.recordLastOp(OP_MOTION, c, 'T');
      })
     .set("gv", "Restore previous visual selection", [this](HWND h, int c) {
+        Marks::getVisualMarks(h, state.lastVisualAnchor, state.lastVisualCaret);
         if (state.lastVisualAnchor == -1 || state.lastVisualCaret == -1) return;
 
         state.mode = VISUAL;
@@ -1354,40 +1046,28 @@ void NormalMode::setupKeyMaps() {
      });
 
     k.set("gUU", "Uppercase Whole Line", [this](HWND h, int c) {
-        Utils::beginUndo(h);
         int line = Utils::caretLine(h);
-        int last = Utils::lineCount(h) - 1;
-        for (int i = 0; i < c && line + i <= last; i++) {
-            int start = Utils::lineStart(h, line + i);
-            int end = Utils::lineEnd(h, line + i);
-            Utils::toUpper(h, start, end);
-        }
-        Utils::endUndo(h);
+        int last = (std::min)(line + (std::max)(c, 1) - 1, Utils::lineCount(h) - 1);
+        Utils::toUpper(h, Utils::lineStart(h, line), Utils::lineEnd(h, last));
     })
     .set("guu", "Lowercase Whole Line", [this](HWND h, int c) {
-        Utils::beginUndo(h);
         int line = Utils::caretLine(h);
-        int last = Utils::lineCount(h) - 1;
-        for (int i = 0; i < c && line + i <= last; i++) {
-            int start = Utils::lineStart(h, line + i);
-            int end = Utils::lineEnd(h, line + i);
-            Utils::toLower(h, start, end);
-        }
-        Utils::endUndo(h);
+        int last = (std::min)(line + (std::max)(c, 1) - 1, Utils::lineCount(h) - 1);
+        Utils::toLower(h, Utils::lineStart(h, line), Utils::lineEnd(h, last));
     });
 
     k.set("\x01", "Ctrl+A Increment number", [this](HWND h, int c) {
-        incrementNumber(h, c);
+        Increment::atCaret(h, c);
     })
     .set("\x18", "Ctrl+X Decrement number", [this](HWND h, int c) {
-        decrementNumber(h, c);
+        Increment::atCaret(h, -(long long)c);
     });
 
     k.set("\x0F", "Ctrl+O - Jump backward", [this](HWND h, int c) {
-        for (int i = 0; i < c; i++) jumpBackward(h);
+        jumpBackward(h, c);
     })
     .set("\x09", "Ctrl+I - Jump forward", [this](HWND h, int c) {
-        for (int i = 0; i < c; i++) jumpForward(h);
+        jumpForward(h, c);
     });
 
     k.set("\x12", "Ctrl+R - Redo", [this](HWND h, int c) {
@@ -1405,15 +1085,11 @@ void NormalMode::setupKeyMaps() {
     })
     .set("\x04", "Ctrl+D - half page down", [](HWND h, int c) {
         int lines = ::SendMessage(h, SCI_LINESONSCREEN, 0, 0) / 2;
-        for (int i = 0; i < c; i++) {
-            Motion::lineDown(h, lines);
-        }
+        Motion::lineDown(h, lines * c);
     })
     .set("\x15", "Ctrl+U - half page up", [](HWND h, int c) {
         int lines = ::SendMessage(h, SCI_LINESONSCREEN, 0, 0) / 2;
-        for (int i = 0; i < c; i++) {
-            Motion::lineUp(h, lines);
-        }
+        Motion::lineUp(h, lines * c);
     })
     .set("\x06", "Ctrl+F - page forward", [](HWND h, int c) {
         for (int i = 0; i < c; i++) {
@@ -1470,6 +1146,8 @@ void NormalMode::enter() {
     HWND hwnd = Utils::getCurrentScintillaHandle();
     int caret = Utils::caretPos(hwnd);
 
+    if (state.blockInsert.op) BlockEdit::finishInsert(hwnd, state.blockInsert);
+
     if (state.mode == VISUAL && !state.restoringVisual) {
         if (state.isBlockVisual) {
             state.lastVisualAnchor = ::SendMessage(hwnd, SCI_GETRECTANGULARSELECTIONANCHOR, 0, 0);
@@ -1478,6 +1156,7 @@ void NormalMode::enter() {
             state.lastVisualAnchor = ::SendMessage(hwnd, SCI_GETANCHOR, 0, 0);
             state.lastVisualCaret  = ::SendMessage(hwnd, SCI_GETCURRENTPOS, 0, 0);
         }
+        Marks::setVisualMarks(hwnd, state.lastVisualAnchor, state.lastVisualCaret);
         state.lastVisualWasLine  = state.isLineVisual;
         state.lastVisualWasBlock = state.isBlockVisual;
     }
@@ -1506,7 +1185,7 @@ void NormalMode::enter() {
     if (g_normalKeymap) g_normalKeymap->reset();
 
     Utils::setStatus(TEXT("-- NORMAL --"));
-    ::SendMessage(hwnd, SCI_SETCARETSTYLE, CARETSTYLE_BLOCK, 0);
+    Utils::setCaretStyle(hwnd, CARETSTYLE_BLOCK);
 
     ::SendMessage(hwnd, SCI_SETSELECTIONMODE, SC_SEL_STREAM, 0);
     ::SendMessage(hwnd, SCI_CLEARSELECTIONS, 0, 0);
@@ -1549,7 +1228,7 @@ void NormalMode::enterInsertMode() {
     }
 
     Utils::setStatus(TEXT("-- INSERT --"));
-    ::SendMessage(hwnd, SCI_SETCARETSTYLE, CARETSTYLE_LINE, 0);
+    Utils::setCaretStyle(hwnd, CARETSTYLE_LINE);
 }
 
 void handleInsertModeChar(HWND hwnd, char c, VimState& state) {
@@ -1598,6 +1277,7 @@ void NormalMode::handleKey(HWND hwnd, char c) {
 
     if (!state.opPending && !g_normalKeymap->hasPending() && (c == 'd' || c == 'c' || c == 'y')) {
         state.lastYankLinewise = false;
+        state.lastYankBlockwise = false;
         state.opPending = c;
         Utils::setStatus(
             c == 'd' ? TEXT("-- DELETE --") :
@@ -1607,6 +1287,18 @@ void NormalMode::handleKey(HWND hwnd, char c) {
         return;
     }
 
+    if (!state.opPending && !g_normalKeymap->hasPending() && c == '!') {
+        state.opPending = c;
+        Utils::setStatus(TEXT("-- FILTER --"));
+        return;
+    }
+
+    if (!state.opPending && !g_normalKeymap->hasPending() && c == '=') {
+        state.opPending = c;
+        Utils::setStatus(TEXT("-- INDENT --"));
+        return;
+    }
+
     if (state.replacePending) {
         handleReplaceInput(hwnd, c);
         return;
@@ -1656,6 +1348,7 @@ void NormalMode::handleKey(HWND hwnd, char c) {
     }
 
     if ((state.opPending == 'd' || state.opPending == 'c' || state.opPending == 'y' ||
+         state.opPending == 'q' || state.opPending == 'w' || state.opPending == '=' ||
          (state.mode == VISUAL && state.opPending == 'v')) &&
         (c == 'i' || c == 'a')) {
         state.textObjectPending = c;
@@ -1667,6 +1360,12 @@ void NormalMode::handleKey(HWND hwnd, char c) {
 
         int count = (state.repeatCount > 0) ? state.repeatCount : 1;
 
+        // gqgq and gwgw
+        if ((state.opPending == 'q' || state.opPending == 'w') && c == state.opPending) {
+            formatLines(hwnd, state.opPending, count);
+            return;
+        }
+
         if (g_normalKeymap) {
             g_normalKeymap->handleKey(hwnd, 'g');
             g_normalKeymap->handleKey(hwnd, c);
@@ -1678,6 +1377,12 @@ void NormalMode::handleKey(HWND hwnd, char c) {
     }
 
     if (state.opPending && !state.textObjectPending) {
+        // gqq and gww
+        if ((state.opPending == 'q' || state.opPending == 'w') && c == state.opPending) {
+            formatLines(hwnd, state.opPending, (state.repeatCount > 0) ? state.repeatCount : 1);
+            return;
+        }
+
         if (c == 'g') {
             state.textObjectPending = 'g';
             return;
@@ -1726,6 +1431,7 @@ void NormalMode::handleKey(HWND hwnd, char c) {
             int caret = (int)Utils::caretPos(hwnd);
             state.lastVisualAnchor = anchor;
             state.lastVisualCaret = caret;
+            Marks::setVisualMarks(hwnd, anchor, caret);
             state.lastVisualWasBlock = false;
             state.lastVisualWasLine = false;
 
@@ -1738,7 +1444,17 @@ void NormalMode::handleKey(HWND hwnd, char c) {
     }
 }
 
-void NormalMode::handleCharSearchInput(HWND hwnd, char searchChar, char searchType, int count) {
+// Non-ASCII input reaches normal mode only as the character for f, t or r.
+void NormalMode::handleCharArgument(HWND hwnd, char32_t c) {
+    if (state.replacePending) {
+        handleReplaceInput(hwnd, c);
+    } else if (state.textObjectPending == 'f' || state.textObjectPending == 't') {
+        int count = (state.repeatCount > 0) ? state.repeatCount : 1;
+        handleCharSearchInput(hwnd, c, state.opPending, count);
+    }
+}
+
+void NormalMode::handleCharSearchInput(HWND hwnd, char32_t searchChar, char searchType, int count) {
     bool isTill = (searchType == 't' || searchType == 'T');
     bool isForward = (searchType == 'f' || searchType == 't');
 
@@ -1785,9 +1501,6 @@ void NormalMode::handleMarkJumpInput(HWND hwnd, char mark, bool exactPosition) {
         state.recordJump(pos, line);
 
         if (Marks::jumpToMark(hwnd, mark, exactPosition)) {
-            long newPos = Utils::caretPos(hwnd);
-            int newLine = ::SendMessage(hwnd, SCI_LINEFROMPOSITION, newPos, 0);
-            state.recordJump(newPos, newLine);
             Utils::setStatus(TEXT("-- Jumped to mark --"));
         } else {
             Utils::setStatus(TEXT("-- Mark not set --"));
@@ -1800,7 +1513,7 @@ void NormalMode::handleMarkJumpInput(HWND hwnd, char mark, bool exactPosition) {
     state.pendingJumpCount = 0;
 }
 
-void NormalMode::handleReplaceInput(HWND hwnd, char replaceChar) {
+void NormalMode::handleReplaceInput(HWND hwnd, char32_t replaceChar) {
     int pos = Utils::caretPos(hwnd);
     int len = ::SendMessage(hwnd, SCI_GETLENGTH, 0, 0);
 
@@ -1817,50 +1530,80 @@ void NormalMode::handleReplaceInput(HWND hwnd, char replaceChar) {
     Utils::setStatus(TEXT("-- NORMAL --"));
 }
 
-void NormalMode::deleteLineOnce(HWND hwnd) {
-    int pos = Utils::caretPos(hwnd);
-    int line = Utils::caretLine(hwnd);
-    auto range = Utils::lineRange(hwnd, line, true);
+// Range covering count whole lines from the caret, including the final line break.
+static std::pair<int, int> countedLineRange(HWND hwnd, int count, int& firstLine, int& lastLine) {
+    firstLine = Utils::caretLine(hwnd);
+    int total = Utils::lineCount(hwnd);
+    lastLine = (std::min)(firstLine + (std::max)(count, 1) - 1, total - 1);
+    int start = Utils::lineStart(hwnd, firstLine);
+    int end = (lastLine < total - 1)
+        ? Utils::lineStart(hwnd, lastLine + 1)
+        : (int)::SendMessage(hwnd, SCI_GETLENGTH, 0, 0);
+    return {start, end};
+}
 
-    // Get the text before deleting
-    std::string text = Utils::getTextRange(hwnd, range.first, range.second);
+static std::string linewiseText(HWND hwnd, int start, int end) {
+    std::string text = Utils::getTextRange(hwnd, start, end);
+    if (text.empty() || (text.back() != '\n' && text.back() != '\r')) {
+        text += Utils::eolString(hwnd);
+    }
+    return text;
+}
 
-    // Store in register if not blackhole
-    if (!state.deleteToBlackhole && g_config.dStoreClipboard) {
-        char reg = Utils::getCurrentRegister();
-        if (reg != '_') {  // Skip blackhole register
-            Utils::storeRegister(reg, text.c_str(), g_config.dStoreClipboard);
-            Utils::setClipboardText(text.c_str());
-        }
+void NormalMode::storeDeletedLines(const std::string& text, bool shouldStore) {
+    if (state.deleteToBlackhole || !shouldStore) return;
+    char reg = Utils::getCurrentRegister();
+    if (reg == '_') return;  // Skip blackhole register
+    Utils::storeRegister(reg, text, shouldStore);
+    if (reg == '"') {
+        RegisterStore::getInstance().shiftNumbered(Utils::getRegisterText(reg));
     }
+}
 
-    Utils::select(hwnd, range.first, range.second);
-    ::SendMessage(hwnd, SCI_CUT, 0, 0);
+void NormalMode::deleteLines(HWND hwnd, int count) {
+    int firstLine, lastLine;
+    auto range = countedLineRange(hwnd, count, firstLine, lastLine);
 
-    int newPos = Utils::lineStart(hwnd, line);
-    if (newPos == -1) {
-        newPos = (int)::SendMessage(hwnd, SCI_GETLENGTH, 0, 0);
+    storeDeletedLines(linewiseText(hwnd, range.first, range.second), g_config.dStoreClipboard);
+
+    // Deleting through the last line also removes the line break before it
+    int start = range.first;
+    if (lastLine == Utils::lineCount(hwnd) - 1 && firstLine > 0) {
+        start = Utils::lineEnd(hwnd, firstLine - 1);
     }
-    ::SendMessage(hwnd, SCI_GOTOPOS, newPos, 0);
+    ::SendMessage(hwnd, SCI_DELETERANGE, start, range.second - start);
+
+    int line = (std::min)(firstLine, Utils::lineCount(hwnd) - 1);
+    ::SendMessage(hwnd, SCI_GOTOPOS, Utils::lineStart(hwnd, line), 0);
 }
 
-void NormalMode::yankLineOnce(HWND hwnd) {
-    int pos = Utils::caretPos(hwnd);
-    int line = Utils::caretLine(hwnd);
-    auto range = Utils::lineRange(hwnd, line, true);
+void NormalMode::changeLines(HWND hwnd, int count) {
+    int firstLine, lastLine;
+    countedLineRange(hwnd, count, firstLine, lastLine);
+    int start = Utils::lineStart(hwnd, firstLine);
+    int end = Utils::lineEnd(hwnd, lastLine);
 
-    // Get the text
-    std::string text = Utils::getTextRange(hwnd, range.first, range.second);
+    storeDeletedLines(linewiseText(hwnd, start, end), g_config.cStoreClipboard);
 
-    // Store in register
-    char reg = Utils::getCurrentRegister();
-    Utils::storeRegister(reg, text.c_str(), true);
+    ::SendMessage(hwnd, SCI_DELETERANGE, start, end - start);
+    ::SendMessage(hwnd, SCI_GOTOPOS, start, 0);
+}
+
+void NormalMode::yankLines(HWND hwnd, int count) {
+    int firstLine, lastLine;
+    auto range = countedLineRange(hwnd, count, firstLine, lastLine);
 
-    Utils::select(hwnd, range.first, range.second);
-    ::SendMessage(hwnd, SCI_COPY, 0, 0);
-    Utils::select(hwnd, pos, pos);
+    Utils::storeRegister(Utils::getCurrentRegister(), linewiseText(hwnd, range.first, range.second), true);
 
-    state.recordLastOp(OP_YANK_LINE, 1);
+    state.recordLastOp(OP_YANK_LINE, count);
+}
+
+// gqq and gww: count lines from the caret's.
+void NormalMode::formatLines(HWND hwnd, char op, int count) {
+    int line = Utils::caretLine(hwnd);
+    Reflow::apply(hwnd, line, line + count - 1, op == 'w' ? Utils::caretPos(hwnd) : -1);
+    state.opPending = 0;
+    state.repeatCount = 0;
 }
 
 void NormalMode::applyOperatorToMotion(HWND hwnd, char op, char motion, int count) {
@@ -1909,7 +1652,7 @@ void NormalMode::applyOperatorToMotion(HWND hwnd, char op, char motion, int coun
     case '{': Motion::paragraphUp(hwnd, count); break;
     case '}': Motion::paragraphDown(hwnd, count); break;
     case '%': {
-        int match = ::SendMessage(hwnd, SCI_BRACEMATCH, start, 0);
+        int match = BracketIndex::getInstance().match(hwnd, start);
         if (match != -1) ::SendMessage(hwnd, SCI_GOTOPOS, match, 0);
         break;
     }
@@ -1924,39 +1667,26 @@ void NormalMode::applyOperatorToMotion(HWND hwnd, char op, char motion, int coun
         return;
     }
 
-    // Get selected text before operation
-    std::string selectedText;
-    if (start != end) {
-        int selStart = (std::min)(start, end);
-        int selEnd = (std::max)(start, end);
-        if (isLineMotion && op == 'd') {
-            // For line motions, we already captured in deleteLineOnce
-        } else {
-            std::string text = Utils::getTextRange(hwnd, selStart, selEnd);
-            selectedText = text;
-        }
+    if (op == '!') {
+        // Filters take whole lines; the command line starts with their range
+        int first = (std::min)(startLine, endLine);
+        int lines = (std::max)(startLine, endLine) - first;
+        ::SendMessage(hwnd, SCI_GOTOLINE, first, 0);
+        state.opPending = 0;
+        if (g_commandMode) g_commandMode->enter(':', lines > 0 ? ".,.+" + std::to_string(lines) + "!" : ".!");
+        return;
     }
 
-    // Store in register before deletion
-    if (op == 'd' || op == 'c') {
-        bool shouldStore = (op == 'd') ? g_config.dStoreClipboard : g_config.cStoreClipboard;
-        if (shouldStore && !state.deleteToBlackhole && !selectedText.empty()) {
-            char reg = Utils::getCurrentRegister();
-            if (reg != '_') {  // Skip blackhole register
-                if (reg == '+' || reg == '*') {
-                    Utils::setClipboardText(selectedText);
-                } else {
-                    Utils::setRegisterContent(reg, selectedText);
-                }
-            }
-        }
-    } else if (op == 'y' && !selectedText.empty()) {
-        char reg = Utils::getCurrentRegister();
-        if (reg == '+' || reg == '*') {
-            Utils::setClipboardText(selectedText);
-        } else {
-            Utils::setRegisterContent(reg, selectedText);
-        }
+    if (op == 'q' || op == 'w') {
+        Reflow::apply(hwnd, startLine, endLine, op == 'w' ? start : -1);
+        state.opPending = 0;
+        return;
+    }
+
+    if (op == '=') {
+        Indent::apply(hwnd, startLine, endLine);
+        state.opPending = 0;
+        return;
     }
 
     if (isLineMotion) {
@@ -1966,6 +1696,7 @@ void NormalMode::applyOperatorToMotion(HWND hwnd, char op, char motion, int coun
         start = Utils::lineStart(hwnd, startLine);
         end = Utils::lineStart(hwnd, endLine + 1);
         state.lastYankLinewise = true;
+        state.lastYankBlockwise = false;
     } else {
         if (start > end) std::swap(start, end);
 
@@ -1975,12 +1706,31 @@ void NormalMode::applyOperatorToMotion(HWND hwnd, char op, char motion, int coun
             if (end < docLen) end = ::SendMessage(hwnd, SCI_POSITIONAFTER, end, 0);
         }
         state.lastYankLinewise = false;
+        state.lastYankBlockwise = false;
+    }
+
+    std::string selectedText;
+    if (op == 'd' || op == 'c' || op == 'y') {
+        selectedText = Utils::getTextRange(hwnd, start, end);
+    }
+
+    // Store in register before deletion; the clipboard is synced lazily
+    if (op == 'd' || op == 'c') {
+        bool shouldStore = (op == 'd') ? g_config.dStoreClipboard : g_config.cStoreClipboard;
+        if (shouldStore && !state.deleteToBlackhole && !selectedText.empty()) {
+            char reg = Utils::getCurrentRegister();
+            if (reg != '_') {  // Skip blackhole register
+                Utils::storeRegister(reg, selectedText, true);
+            }
+        }
+    } else if (op == 'y' && !selectedText.empty()) {
+        Utils::storeRegister(Utils::getCurrentRegister(), selectedText, true);
     }
 
     Utils::select(hwnd, start, end);
     switch (op) {
     case 'd':
-        ::SendMessage(hwnd, SCI_CUT, 0, 0);
+        ::SendMessage(hwnd, SCI_CLEAR, 0, 0);
         if (isLineMotion) {
             int newPos = Utils::lineStart(hwnd, startLine);
             ::SendMessage(hwnd, SCI_SETCURRENTPOS, newPos, 0);
@@ -1990,12 +1740,11 @@ void NormalMode::applyOperatorToMotion(HWND hwnd, char op, char motion, int coun
         state.recordLastOp(OP_MOTION, count, motion);
         break;
     case 'y':
-        ::SendMessage(hwnd, SCI_COPY, 0, 0);
         Utils::select(hwnd, start, start);
         state.recordLastOp(OP_MOTION, count, motion);
         break;
     case 'c':
-        ::SendMessage(hwnd, SCI_CUT, 0, 0);
+        ::SendMessage(hwnd, SCI_CLEAR, 0, 0);
         if (isLineMotion) {
             ::SendMessage(hwnd, SCI_HOME, 0, 0);
             ::SendMessage(hwnd, SCI_NEWLINE, 0, 0);
@@ -2018,7 +1767,7 @@ void NormalMode::applyOperatorToMotion(HWND hwnd, char op, char motion, int coun
         break;
 
     case '~': // g~
-        Motion::toggleCase(hwnd, count);
+        Utils::toggleCase(hwnd, start, end);
         Utils::select(hwnd, start, start);
         break;
     case '?': Utils::rot13(hwnd, start, end); break;
@@ -2029,37 +1778,7 @@ void NormalMode::applyOperatorToMotion(HWND hwnd, char op, char motion, int coun
 }
 
 void NormalMode::handlePasteFromRegister(HWND hwnd, char pasteCmd, char reg) {
-    std::string content;
-
-    if (reg == '+' || reg == '*') {
-        // Get from system clipboard
-        if (OpenClipboard(hwnd)) {
-            HANDLE hData = GetClipboardData(CF_TEXT);
-            if (hData) {
-                char* pszText = (char*)GlobalLock(hData);
-                if (pszText) {
-                    content = pszText;
-                    GlobalUnlock(hData);
-                }
-            }
-            CloseClipboard();
-        }
-    } else {
-        content = Utils::getRegisterContent(reg);
-    }
-
-    if (!content.empty()) {
-        Utils::beginUndo(hwnd);
-
-        if (pasteCmd == 'p') {
-            // Paste after cursor
-            Utils::pasteAfter(hwnd, 1, false);
-        } else if (pasteCmd == 'P') {
-            // Paste before cursor
-            Utils::pasteBefore(hwnd, 1, false);
-        }
-
-        Utils::endUndo(hwnd);
+    if (Paste::put(hwnd, reg, 1, pasteShape(state), pasteCmd == 'p')) {
         state.recordLastOp(OP_PASTE, 1);
     } else {
         Utils::setStatus(TEXT("-- Register empty --"));
@@ -2149,138 +1868,52 @@ void NormalMode::gotoDefinition(HWND h, VimState& state, bool applyOp) {
     int start = found;
     int end = found + len;
 
+    Utils::storeRegister(Utils::getCurrentRegister(), Utils::getTextRange(h, start, end));
     Utils::select(h, start, end);
 
     switch (state.opPending) {
-        case 'd': ::SendMessage(h, SCI_CUT, 0, 0); break;
-        case 'y': ::SendMessage(h, SCI_COPY, 0, 0); break;
+        case 'd': ::SendMessage(h, SCI_CLEAR, 0, 0); break;
+        case 'y': Utils::select(h, start, start); break;
         case 'c':
-            ::SendMessage(h, SCI_CUT, 0, 0);
+            ::SendMessage(h, SCI_CLEAR, 0, 0);
             NormalMode::enterInsertMode();
             break;
     }
 }
 
-void NormalMode::incrementNumber(HWND h, int c) {
+void NormalMode::jumpBackward(HWND hwnd, int count) {
     static DWORD lastTime = 0;
     DWORD now = GetTickCount();
     if (now - lastTime < 100) return;
     lastTime = now;
 
-    int pos = Utils::caretPos(h);
-    int line = Utils::caretLine(h);
-    int start = Utils::lineStart(h, line);
-    int end = Utils::lineEnd(h, line);
-
-    int s = pos;
-    int e = pos;
-
-    if (pos < end && std::isdigit(::SendMessage(h, SCI_GETCHARAT, pos, 0))) {
-        s = pos;
-    } else {
-        while (s < end && !std::isdigit(::SendMessage(h, SCI_GETCHARAT, s, 0))) s++;
-        if (s == end) {
-            s = pos;
-            while (s > start && !std::isdigit(::SendMessage(h, SCI_GETCHARAT, s - 1, 0))) s--;
-            if (s == start) return;
-            s--;
-        }
-    }
-
-    while (s > start && std::isdigit(::SendMessage(h, SCI_GETCHARAT, s - 1, 0))) s--;
-    if (s > start && ::SendMessage(h, SCI_GETCHARAT, s - 1, 0) == '-') s--;
-
-    e = s;
-    if (e < end && ::SendMessage(h, SCI_GETCHARAT, e, 0) == '-') e++;
-    while (e < end && std::isdigit(::SendMessage(h, SCI_GETCHARAT, e, 0))) e++;
-
-    std::vector<char> buf(e - s + 1);
-    Sci_TextRangeFull tr{ { s, e }, buf.data() };
-    ::SendMessage(h, SCI_GETTEXTRANGEFULL, 0, (LPARAM)&tr);
-
-    try {
-        int n = std::stoi(buf.data()) + (c > 0 ? c : 1);
-        std::string r = std::to_string(n);
-
-        ::SendMessage(h, SCI_SETTARGETRANGE, s, e);
-        ::SendMessage(h, SCI_REPLACETARGET, r.size(), (LPARAM)r.c_str());
-        ::SendMessage(h, SCI_SETEMPTYSELECTION, s + (int)r.size() - 1, 0);
-    } catch (...) {}
-}
-
-void NormalMode::decrementNumber(HWND h, int c) {
-    static DWORD lastTime = 0;
-    DWORD now = GetTickCount();
-    if (now - lastTime < 100) return;
-    lastTime = now;
-
-    int pos = Utils::caretPos(h);
-    int line = Utils::caretLine(h);
-    int start = Utils::lineStart(h, line);
-    int end = Utils::lineEnd(h, line);
-
-    int s = pos;
-    int e = pos;
-
-    if (pos < end && std::isdigit(::SendMessage(h, SCI_GETCHARAT, pos, 0))) {
-        s = pos;
-    } else {
-        while (s < end && !std::isdigit(::SendMessage(h, SCI_GETCHARAT, s, 0))) s++;
-        if (s == end) {
-            s = pos;
-            while (s > start && !std::isdigit(::SendMessage(h, SCI_GETCHARAT, s - 1, 0))) s--;
-            if (s == start) return;
-            s--;
-        }
-    }
-
-    while (s > start && std::isdigit(::SendMessage(h, SCI_GETCHARAT, s - 1, 0))) s--;
-    if (s > start && ::SendMessage(h, SCI_GETCHARAT, s - 1, 0) == '-') s--;
-
-    e = s;
-    if (e < end && ::SendMessage(h, SCI_GETCHARAT, e, 0) == '-') e++;
-    while (e < end && std::isdigit(::SendMessage(h, SCI_GETCHARAT, e, 0))) e++;
-
-    std::vector<char> buf(e - s + 1);
-    Sci_TextRangeFull tr{ { s, e }, buf.data() };
-    ::SendMessage(h, SCI_GETTEXTRANGEFULL, 0, (LPARAM)&tr);
-
-    try {
-        int n = std::stoi(buf.data()) - (c > 0 ? c : 1);
-        std::string r = std::to_string(n);
-
-        ::SendMessage(h, SCI_SETTARGETRANGE, s, e);
-        ::SendMessage(h, SCI_REPLACETARGET, r.size(), (LPARAM)r.c_str());
-        ::SendMessage(h, SCI_SETEMPTYSELECTION, s + (int)r.size() - 1, 0);
-    } catch (...) {}
+    long target;
+    if (!state.jumpList.back(hwnd, Utils::caretPos(hwnd), Utils::caretLine(hwnd), count, target)) return;
+    ::SendMessage(hwnd, SCI_GOTOPOS, target, 0);
+    ::SendMessage(hwnd, SCI_SETSEL, target, target);
+    ::SendMessage(hwnd, SCI_SCROLLCARET, 0, 0);
 }
 
-void NormalMode::jumpBackward(HWND hwnd) {
+void NormalMode::jumpForward(HWND hwnd, int count) {
     static DWORD lastTime = 0;
     DWORD now = GetTickCount();
     if (now - lastTime < 100) return;
     lastTime = now;
 
-    if (state.jumpList.empty() || state.jumpIndex <= 0) return;
-    
-    state.jumpIndex--;
-    auto& jump = state.jumpList[state.jumpIndex];
-    ::SendMessage(hwnd, SCI_GOTOPOS, jump.position, 0);
-    ::SendMessage(hwnd, SCI_SETSEL, jump.position, jump.position);
+    long target;
+    if (!state.jumpList.forward(hwnd, count, target)) return;
+    ::SendMessage(hwnd, SCI_GOTOPOS, target, 0);
+    ::SendMessage(hwnd, SCI_SETSEL, target, target);
     ::SendMessage(hwnd, SCI_SCROLLCARET, 0, 0);
 }
 
-void NormalMode::jumpForward(HWND hwnd) {
-    static DWORD lastTime = 0;
-    DWORD now = GetTickCount();
-    if (now - lastTime < 100) return;
-    lastTime = now;
-
-    if (state.jumpList.empty() || state.jumpIndex >= (int)state.jumpList.size() - 1) return;
-    
-    state.jumpIndex++;
-    auto& jump = state.jumpList[state.jumpIndex];
-    ::SendMessage(hwnd, SCI_GOTOPOS, jump.position, 0);
-    ::SendMessage(hwnd, SCI_SETSEL, jump.position, jump.position);
+void NormalMode::jumpToLastLine(HWND hwnd) {
+    const JumpPosition* jump = state.jumpList.newest(hwnd);
+    if (!jump) return;
+    int line = Utils::lineFromPosition(hwnd, (int)state.jumpList.target(hwnd, *jump));
+    int target = ::SendMessage(hwnd, SCI_GETLINEINDENTPOSITION, line, 0);
+    state.recordJump(Utils::caretPos(hwnd), Utils::caretLine(hwnd));
+    ::SendMessage(hwnd, SCI_GOTOPOS, target, 0);
+    ::SendMessage(hwnd, SCI_SETSEL, target, target);
     ::SendMessage(hwnd, SCI_SCROLLCARET, 0, 0);
-}
\ No newline at end of file
+}
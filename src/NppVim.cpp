@@ -7,6 +7,7 @@
 #include <commctrl.h>
 #include <vector>
 #include <algorithm>
+#include <unordered_map>
 #pragma comment(lib, "Version.lib")
 
 #include "../plugin/PluginInterface.h"
@@ -25,6 +26,15 @@
 #include "../include/OptionRegistry.h"
 #include "../include/MappingManager.h"
 #include "../include/RcParser.h"
+#include "../include/Clipboard.h"
+#include "../include/BracketIndex.h"
+#include "../include/LineIndex.h"
+#include "../include/MarkTracker.h"
+#include "../include/Marks.h"
+#include "../include/BufferStates.h"
+#include "../include/UiUpdates.h"
+#include "../include/CharClass.h"
+#include "../include/Increment.h"
 #include <algorithm>
 
 HINSTANCE g_hInstance = nullptr;
@@ -61,6 +71,7 @@ HKL g_englishLayout = NULL;
 // Forward declarations
 LRESULT CALLBACK ScintillaHookProc(HWND, UINT, WPARAM, LPARAM);
 LRESULT CALLBACK NppHostHookProc(HWND, UINT, WPARAM, LPARAM);
+static LRESULT handleScintillaMessage(HWND, WNDPROC, UINT, WPARAM, LPARAM);
 void installScintillaHookFor(HWND hwnd);
 void installNppHook();
 void removeAllScintillaHooks();
@@ -72,6 +83,7 @@ void loadConfig();
 void saveConfig();
 void initializeOptions();
 void updateRelativeLineNumbers(HWND hwnd, bool force = false);
+void invalidateRelativeLineNumbers();
 
 void installNppHook() {
     if (nppData._nppHandle && !g_origNppProc) {
@@ -86,8 +98,21 @@ void removeNppHook() {
     }
 }
 
+// CTRL-A and CTRL-X run as keys of the current mode, so a count, "g" and
+// the visual selection apply. After a key press the WM_CHAR made from it is
+// dropped; an accelerator makes none.
+static char g_swallowChar = 0;
+
+static void sendModeKey(HWND hwnd, char key) {
+    if (state.mode == NORMAL && g_normalMode) g_normalMode->handleKey(hwnd, key);
+    else if (state.mode == VISUAL && g_visualMode) g_visualMode->handleKey(hwnd, key);
+}
+
 LRESULT CALLBACK NppHostHookProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam) {
+    if (Clipboard::getInstance().handleMessage(hwnd, msg, wParam)) return 0;
+
     if (msg == WM_COMMAND) {
+        UiBatch batch;
         int cmd = LOWORD(wParam);
         if (state.vimEnabled && (state.mode == NORMAL || state.mode == VISUAL)) {
             HWND hwndEdit = Utils::getCurrentScintillaHandle();
@@ -126,11 +151,11 @@ LRESULT CALLBACK NppHostHookProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lPar
                 return 0;
             }
             if (cmd == IDM_EDIT_SELECTALL && g_config.overrideCtrlA) {
-                if (g_normalMode) g_normalMode->incrementNumber(hwndEdit, 1);
+                sendModeKey(hwndEdit, '\x01');
                 return 0;
             }
             if (cmd == IDM_EDIT_CUT && g_config.overrideCtrlX) {
-                if (g_normalMode) g_normalMode->decrementNumber(hwndEdit, 1);
+                sendModeKey(hwndEdit, '\x18');
                 return 0;
             }
         }
@@ -153,23 +178,45 @@ bool isNativeLineNumberEnabled() {
     return (state != (UINT)-1) && (state & MF_CHECKED);
 }
 
+// Margin labels are drawn from this table instead of formatting each row.
+static const std::string& lineNumberLabel(int n) {
+    static std::vector<std::string> labels;
+    static std::string scratch;
+    if (n >= 4096) {
+        scratch = std::to_string(n);
+        return scratch;
+    }
+    while ((int)labels.size() <= n) labels.push_back(std::to_string(labels.size()));
+    return labels[n];
+}
+
+struct MarginState {
+    int currentLine = -1;
+    int firstVisibleLine = -1;
+    COLORREF lastBg = 0xFFFFFFFF;
+    int lastWidth = -1;
+    int charWidth = 0;
+    int digits = 0;
+    bool lastRelNum = false;
+    bool lastAbsNum = false;
+    // Number last written into each document line's margin text
+    std::unordered_map<int, int> shown;
+};
+static std::map<HWND, MarginState> marginStates;
+static HWND lastMarginView = nullptr;
+
+// Margin text lives on document lines, so anything that moves lines (or a
+// clone in the other view writing the same document) voids what we know.
+void invalidateRelativeLineNumbers() {
+    for (auto& entry : marginStates) entry.second.shown.clear();
+}
+
 void updateRelativeLineNumbers(HWND hwnd, bool force) {
     if (!hwnd || !state.vimEnabled) return;
-    
-    auto& reg = OptionRegistry::getInstance();
-    bool relNum = std::get<bool>(reg.getOption("relativenumber"));
-    bool absNum = std::get<bool>(reg.getOption("number"));
-    
-    struct MarginState {
-        int currentLine = -1;
-        int firstVisibleLine = -1;
-        COLORREF lastBg = 0xFFFFFFFF;
-        int lastWidth = -1;
-        bool lastRelNum = false;
-        bool lastAbsNum = false;
-    };
-    static std::map<HWND, MarginState> states;
-    auto& s = states[hwnd];
+
+    bool relNum = Options::relativenumber.get();
+    bool absNum = Options::number.get();
+    auto& s = marginStates[hwnd];
 
     // Case 1: Everything Disabled (set nonu nornu)
     if (!relNum && !absNum) {
@@ -188,6 +235,7 @@ void updateRelativeLineNumbers(HWND hwnd, bool force) {
             s.lastAbsNum = false;
             s.lastWidth = 0;
             s.currentLine = -1;
+            s.shown.clear();
         }
         return;
     }
@@ -208,19 +256,25 @@ void updateRelativeLineNumbers(HWND hwnd, bool force) {
             s.lastAbsNum = true;
             s.lastWidth = 50;
             s.currentLine = -1;
+            s.shown.clear();
         }
         return;
     }
 
     // Case 3: Relative numbering active (pure or hybrid)
-    int currentLine = (int)::SendMessage(hwnd, SCI_LINEFROMPOSITION, ::SendMessage(hwnd, SCI_GETCURRENTPOS, 0, 0), 0);
+    int currentLine = Utils::caretLine(hwnd);
     int firstVisibleLine = (int)::SendMessage(hwnd, SCI_GETFIRSTVISIBLELINE, 0, 0);
-    
-    // Sync theme colors to our margin
-    COLORREF bg = (COLORREF)::SendMessage(hwnd, SCI_STYLEGETBACK, STYLE_LINENUMBER, 0);
-    
-    // Check if we even need to update margin configuration type/offset
-    if (::SendMessage(hwnd, SCI_GETMARGINTYPEN, 0, 0) != SC_MARGIN_RTEXT || force) {
+
+    if (hwnd != lastMarginView) {
+        s.shown.clear();
+        s.currentLine = -1;
+        lastMarginView = hwnd;
+    }
+
+    // Margin setup, theme colour and digit width only change on a forced
+    // update (option toggle, buffer switch, style change).
+    if (force || s.charWidth == 0 || ::SendMessage(hwnd, SCI_GETMARGINTYPEN, 0, 0) != SC_MARGIN_RTEXT) {
+        COLORREF bg = (COLORREF)::SendMessage(hwnd, SCI_STYLEGETBACK, STYLE_LINENUMBER, 0);
         ::SendMessage(hwnd, SCI_SETMARGINTYPEN, 0, SC_MARGIN_RTEXT);
         ::SendMessage(hwnd, SCI_SETMARGINBACKN, 0, bg);
         ::SendMessage(hwnd, SCI_MARGINSETSTYLEOFFSET, STYLE_LINENUMBER, 0);
@@ -229,23 +283,22 @@ void updateRelativeLineNumbers(HWND hwnd, bool force) {
         ::SendMessage(nppData._nppHandle, NPPM_SETLINENUMBERWIDTHMODE, 0, LINENUMWIDTH_CONSTANT);
         
         s.lastBg = bg;
+        s.charWidth = (int)::SendMessage(hwnd, SCI_TEXTWIDTH, STYLE_LINENUMBER, (LPARAM)"9");
+        s.digits = 0;
         s.currentLine = -1; // Force text update
-    }
-
-    // Only update background if it changed
-    if (s.lastBg != bg) {
-        ::SendMessage(hwnd, SCI_SETMARGINBACKN, 0, bg);
-        s.lastBg = bg;
+        s.shown.clear();
     }
 
     // Dynamic width calculation - only update if it changed
-    int lineCount = (int)::SendMessage(hwnd, SCI_GETLINECOUNT, 0, 0);
-    int charWidth = (int)::SendMessage(hwnd, SCI_TEXTWIDTH, STYLE_LINENUMBER, (LPARAM)"9");
+    int lineCount = Utils::lineCount(hwnd);
     int digits = (int)log10(max(1, lineCount)) + 1;
-    int targetWidth = (digits + 1) * charWidth;
-    if (s.lastWidth != targetWidth) {
-        ::SendMessage(hwnd, SCI_SETMARGINWIDTHN, 0, targetWidth);
-        s.lastWidth = targetWidth;
+    if (digits != s.digits) {
+        int targetWidth = (digits + 1) * s.charWidth;
+        if (s.lastWidth != targetWidth) {
+            ::SendMessage(hwnd, SCI_SETMARGINWIDTHN, 0, targetWidth);
+            s.lastWidth = targetWidth;
+        }
+        s.digits = digits;
     }
 
     // Only update text if cursor moved or scrolled, unless forced
@@ -256,81 +309,84 @@ void updateRelativeLineNumbers(HWND hwnd, bool force) {
     s.lastAbsNum = absNum;
 
     int displayLines = (int)::SendMessage(hwnd, SCI_LINESONSCREEN, 0, 0);
+
+    // Without folds or wrapping in view, rows map to consecutive document
+    // lines and don't need asking one by one.
+    int firstDocLine = (int)::SendMessage(hwnd, SCI_DOCLINEFROMVISIBLE, firstVisibleLine, 0);
+    int lastDocLine = (int)::SendMessage(hwnd, SCI_DOCLINEFROMVISIBLE, firstVisibleLine + displayLines, 0);
+    bool contiguous = (lastDocLine - firstDocLine == displayLines)
+        || (::SendMessage(hwnd, SCI_GETWRAPMODE, 0, 0) == SC_WRAP_NONE && ::SendMessage(hwnd, SCI_GETALLLINESVISIBLE, 0, 0));
+
+    if (s.shown.size() > (size_t)(displayLines + 1) * 4) s.shown.clear();
+
     for (int i = 0; i <= displayLines; i++) {
-        int displayLine = firstVisibleLine + i;
-        int docLine = (int)::SendMessage(hwnd, SCI_DOCLINEFROMVISIBLE, displayLine, 0);
-        if (docLine < 0 || docLine >= lineCount) continue;
+        int docLine = contiguous ? firstDocLine + i
+            : (int)::SendMessage(hwnd, SCI_DOCLINEFROMVISIBLE, firstVisibleLine + i, 0);
+        if (docLine < 0 || docLine >= lineCount) break;
 
+        // Proper Vim behavior: Hybrid only if 'number' is also on
         int rel = abs(docLine - currentLine);
-        char buf[32];
-        
-        if (rel == 0) {
-            // Proper Vim behavior: Hybrid only if 'number' is also on
-            if (absNum) sprintf(buf, "%d", docLine + 1);
-            else sprintf(buf, "0");
-        } else {
-            sprintf(buf, "%d", rel);
-        }
-        
-        ::SendMessage(hwnd, SCI_MARGINSETTEXT, docLine, (LPARAM)buf);
-        ::SendMessage(hwnd, SCI_MARGINSETSTYLE, docLine, 0); // Offset 33 makes this STYLE_LINENUMBER
+        int number = (rel == 0 && absNum) ? docLine + 1 : rel;
+
+        auto it = s.shown.find(docLine);
+        if (it != s.shown.end() && it->second == number) continue;
+        s.shown[docLine] = number;
+        ::SendMessage(hwnd, SCI_MARGINSETTEXT, docLine, (LPARAM)lineNumberLabel(number).c_str());
     }
 }
 
 void initializeOptions() {
     auto& reg = OptionRegistry::getInstance();
     
-    reg.registerOption("number", OptionType::Bool, false, [](const OptionValue& v) {
+    reg.registerOption(OptionId::Number, "number", OptionType::Bool, false, [](const OptionValue& v) {
         HWND hwnd = Utils::getCurrentScintillaHandle();
-        if (hwnd) {
-            updateRelativeLineNumbers(hwnd, true);
-        }
+        if (hwnd) UiUpdates::getInstance().requestMargin(hwnd, true);
     }, "Show line numbers");
 
-    reg.registerOption("relativenumber", OptionType::Bool, false, [](const OptionValue& v) {
+    reg.registerOption(OptionId::RelativeNumber, "relativenumber", OptionType::Bool, false, [](const OptionValue& v) {
         HWND hwnd = Utils::getCurrentScintillaHandle();
-        if (hwnd) updateRelativeLineNumbers(hwnd, true);
+        if (hwnd) UiUpdates::getInstance().requestMargin(hwnd, true);
     }, "Show relative line numbers");
 
-    reg.registerOption("hlsearch", OptionType::Bool, true, nullptr, "Highlight search matches");
-    reg.registerOption("ignorecase", OptionType::Bool, false, nullptr, "Ignore case in search");
-    reg.registerOption("smartcase", OptionType::Bool, false, nullptr, "Override ignorecase if pattern contains uppercase");
-    reg.registerOption("clipboard", OptionType::String, std::string("unnamed"), nullptr, "Clipboard settings");
+    reg.registerOption(OptionId::HlSearch, "hlsearch", OptionType::Bool, true, nullptr, "Highlight search matches");
+    reg.registerOption(OptionId::IgnoreCase, "ignorecase", OptionType::Bool, false, nullptr, "Ignore case in search");
+    reg.registerOption(OptionId::SmartCase, "smartcase", OptionType::Bool, false, nullptr, "Override ignorecase if pattern contains uppercase");
+    reg.registerOption(OptionId::Clipboard, "clipboard", OptionType::String, std::string("unnamed"), nullptr, "Clipboard settings");
 
     // Vim-specific Options
-    reg.registerOption("expandtab", OptionType::Bool, false, [](const OptionValue& v) {
+    reg.registerOption(OptionId::ExpandTab, "expandtab", OptionType::Bool, false, [](const OptionValue& v) {
         HWND hwnd = Utils::getCurrentScintillaHandle();
         if (hwnd) ::SendMessage(hwnd, SCI_SETUSETABS, std::get<bool>(v) ? 0 : 1, 0);
     }, "Use spaces instead of tabs");
 
-    reg.registerOption("tabstop", OptionType::Number, 4, [](const OptionValue& v) {
+    reg.registerOption(OptionId::TabStop, "tabstop", OptionType::Number, 4, [](const OptionValue& v) {
         HWND hwnd = Utils::getCurrentScintillaHandle();
         if (hwnd) ::SendMessage(hwnd, SCI_SETTABWIDTH, std::get<int>(v), 0);
     }, "Number of spaces that a <Tab> in the file counts for");
 
-    reg.registerOption("shiftwidth", OptionType::Number, 4, [](const OptionValue& v) {
+    reg.registerOption(OptionId::ShiftWidth, "shiftwidth", OptionType::Number, 4, [](const OptionValue& v) {
         HWND hwnd = Utils::getCurrentScintillaHandle();
         if (hwnd) ::SendMessage(hwnd, SCI_SETINDENT, std::get<int>(v), 0);
     }, "Number of spaces to use for each step of (auto)indent");
 
-    reg.registerOption("wrap", OptionType::Bool, false, [](const OptionValue& v) {
+    reg.registerOption(OptionId::Wrap, "wrap", OptionType::Bool, false, [](const OptionValue& v) {
         HWND hwnd = Utils::getCurrentScintillaHandle();
         if (hwnd) ::SendMessage(hwnd, SCI_SETWRAPMODE, std::get<bool>(v) ? SC_WRAP_WORD : SC_WRAP_NONE, 0);
     }, "Wrap long lines");
 
-    reg.registerOption("cursorline", OptionType::Bool, false, [](const OptionValue& v) {
+    reg.registerOption(OptionId::CursorLine, "cursorline", OptionType::Bool, false, [](const OptionValue& v) {
         HWND hwnd = Utils::getCurrentScintillaHandle();
         if (hwnd) ::SendMessage(hwnd, SCI_SETCARETSTICKY, std::get<bool>(v) ? 1 : 0, 0);
         // Note: CaretLine is typically configured in N++ settings directly, but we can try to toggle Scintilla's background caret line.
         if (hwnd) ::SendMessage(hwnd, SCI_SETCARETLINEVISIBLE, std::get<bool>(v) ? 1 : 0, 0);
     }, "Highlight the text line of the cursor");
 
-    reg.registerOption("list", OptionType::Bool, false, [](const OptionValue& v) {
+    reg.registerOption(OptionId::List, "list", OptionType::Bool, false, [](const OptionValue& v) {
         HWND hwnd = Utils::getCurrentScintillaHandle();
         if (hwnd) ::SendMessage(hwnd, SCI_SETVIEWWS, std::get<bool>(v) ? SCWS_VISIBLEALWAYS : SCWS_INVISIBLE, 0);
     }, "Show whitespace characters");
 
-    reg.registerOption("scrolloff", OptionType::Number, 0, [](const OptionValue& v) {
+    reg.registerOption(OptionId::ScrollOff, "scrolloff", OptionType::Number, 0, [](const OptionValue& v) {
         HWND hwnd = Utils::getCurrentScintillaHandle();
         if (hwnd) {
             int lines = std::get<int>(v);
@@ -338,35 +394,32 @@ void initializeOptions() {
         }
     }, "Minimal number of screen lines to keep above and below the cursor");
 
-    reg.registerOption("keylayout", OptionType::Bool, false, [](const OptionValue& v) {
+    reg.registerOption(OptionId::JumpListSize, "jumplistsize", OptionType::Number, 100, [](const OptionValue& v) {
+        state.jumpList.setCapacity((size_t)(std::max)(std::get<int>(v), 1));
+    }, "Number of entries kept in the jumplist");
+
+    reg.registerOption(OptionId::ChangeListSize, "changelistsize", OptionType::Number, 100, [](const OptionValue& v) {
+        BufferStates::getInstance().setChangeListCapacity((size_t)(std::max)(std::get<int>(v), 1), state);
+    }, "Number of entries kept in the changelist");
+
+    reg.registerOption(OptionId::KeyLayout, "keylayout", OptionType::Bool, false, [](const OptionValue& v) {
         g_config.enableKeyboardLayoutSwitching = std::get<bool>(v);
     }, "Automatically switch keyboard layout between English (Normal) and last used (Insert)");
 
-    reg.registerOption("normallayout", OptionType::String, std::string("en-US"), [](const OptionValue& v) {
+    reg.registerOption(OptionId::NormalLayout, "normallayout", OptionType::String, std::string("en-US"), [](const OptionValue& v) {
         g_config.normallayout = std::get<std::string>(v);
     }, "Keyboard layout for Normal mode");
 
-    reg.registerOption("insertlayout", OptionType::String, std::string("system"), [](const OptionValue& v) {
+    reg.registerOption(OptionId::InsertLayout, "insertlayout", OptionType::String, std::string("system"), [](const OptionValue& v) {
         g_config.insertlayout = std::get<std::string>(v);
     }, "Keyboard layout for Insert mode");
 
-    reg.registerOption("langmap", OptionType::String, std::string(""), [](const OptionValue& v) {
+    reg.registerOption(OptionId::Langmap, "langmap", OptionType::String, std::string(""), [](const OptionValue& v) {
         Utils::parseLangmap(std::get<std::string>(v));
     }, "Translate characters in Normal/Visual modes");
 
-    reg.registerOption("textwidth", OptionType::Number, 0, [](const OptionValue& v) {
-        int width = 0;
-        if (std::holds_alternative<int>(v)) {
-            width = std::get<int>(v);
-        } else if (std::holds_alternative<std::string>(v)) {
-            try {
-                width = std::stoi(std::get<std::string>(v));
-            } catch (...) {
-                width = 0;
-            }
-        } else if (std::holds_alternative<bool>(v)) {
-            width = std::get<bool>(v) ? 80 : 0;
-        }
+    reg.registerOption(OptionId::TextWidth, "textwidth", OptionType::Number, 0, [](const OptionValue& v) {
+        int width = std::get<int>(v);
 
         HWND mainWnd = nppData._scintillaMainHandle;
         HWND secondWnd = nppData._scintillaSecondHandle;
@@ -385,6 +438,28 @@ void initializeOptions() {
             if (secondWnd) ::SendMessage(secondWnd, SCI_SETEDGEMODE, EDGE_NONE, 0);
         }
     }, "Maximum width of text that is being inserted");
+
+    reg.registerOption(OptionId::History, "history", OptionType::Number, 50, [](const OptionValue& v) {
+        if (g_commandMode) g_commandMode->setHistoryCapacity(std::get<int>(v));
+    }, "Number of command-line and search lines remembered");
+
+    reg.registerOption(OptionId::Shell, "shell", OptionType::String, std::string(""), nullptr,
+        "Shell for ! and :r !; empty uses COMSPEC");
+
+    reg.registerOption(OptionId::IsKeyword, "iskeyword", OptionType::String, std::string(""), [](const OptionValue& v) {
+        bool word[256];
+        if (!CharClasses::parseKeywordSpec(std::get<std::string>(v), word))
+            Utils::setStatus(TEXT("E474: Invalid argument: iskeyword"));
+    }, "Word characters for w, b, e and iw; empty uses Notepad++'s");
+
+    reg.registerOption(OptionId::NrFormats, "nrformats", OptionType::String, std::string("bin,hex"), [](const OptionValue& v) {
+        unsigned formats;
+        if (!Increment::parseFormats(std::get<std::string>(v), formats))
+            Utils::setStatus(TEXT("E474: Invalid argument: nrformats"));
+    }, "Number formats for CTRL-A and CTRL-X besides decimal");
+
+    reg.registerOption(OptionId::OptimalBreak, "optimalbreak", OptionType::Bool, false, nullptr,
+        "gq and gw balance line lengths instead of filling each line");
 }
 
 void loadConfig() {
@@ -396,7 +471,7 @@ void loadConfig() {
     ::SendMessage(nppData._nppHandle, NPPM_HIDESTATUSBAR, 0, ConfigManager::getInstance().isShowStatusBar() ? FALSE : TRUE);
 
     // Load RC file
-    RcParser::getInstance().parseFile(ConfigManager::getInstance().getRcPath());
+    RcParser::getInstance().loadRc(ConfigManager::getInstance().getRcPath());
 }
 
 void saveConfig() {
@@ -689,6 +764,16 @@ LRESULT CALLBACK ScintillaHookProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lP
         return CallWindowProc(orig, hwnd, msg, wParam, lParam);
     }
 
+    // Status, caret and margin changes made while handling a key are applied
+    // once, when the handler returns.
+    bool keyMessage = (msg == WM_KEYDOWN || msg == WM_CHAR || msg == WM_SYSKEYDOWN);
+    if (keyMessage) UiUpdates::getInstance().begin();
+    LRESULT result = handleScintillaMessage(hwnd, orig, msg, wParam, lParam);
+    if (keyMessage) UiUpdates::getInstance().end();
+    return result;
+}
+
+static LRESULT handleScintillaMessage(HWND hwnd, WNDPROC orig, UINT msg, WPARAM wParam, LPARAM lParam) {
     if (msg == WM_INPUTLANGCHANGE && g_config.enableKeyboardLayoutSwitching) {
         g_userLayout = (HKL)lParam;
         if (state.mode == INSERT) state.savedInsertLayout = g_userLayout;
@@ -716,8 +801,8 @@ LRESULT CALLBACK ScintillaHookProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lP
             if (wParam == 'O' && g_config.overrideCtrlO) { if (g_normalMode) g_normalMode->jumpBackward(hwnd); return 0; }
             if (wParam == 'I' && g_config.overrideCtrlI) { if (g_normalMode) g_normalMode->jumpForward(hwnd); return 0; }
             if (wParam == 'V' && g_config.overrideCtrlV) { if (state.mode == VISUAL && state.isBlockVisual) g_normalMode->enter(); else g_visualMode->enterBlock(hwnd); return 0; }
-            if (wParam == 'A' && g_config.overrideCtrlA) { if (g_normalMode) g_normalMode->incrementNumber(hwnd, 1); return 0; }
-            if (wParam == 'X' && g_config.overrideCtrlX) { if (g_normalMode) g_normalMode->decrementNumber(hwnd, 1); return 0; }
+            if (wParam == 'A' && g_config.overrideCtrlA) { sendModeKey(hwnd, '\x01'); g_swallowChar = '\x01'; return 0; }
+            if (wParam == 'X' && g_config.overrideCtrlX) { sendModeKey(hwnd, '\x18'); g_swallowChar = '\x18'; return 0; }
         }
     }
 
@@ -726,6 +811,8 @@ LRESULT CALLBACK ScintillaHookProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lP
             if (wParam == VK_RETURN) { g_commandMode->handleEnter(hwnd); return 0; }
             if (wParam == VK_ESCAPE) { Utils::clearSearchHighlights(hwnd); state.lastSearchMatchCount = -1; g_commandMode->exit(); return 0; }
             if (wParam == VK_BACK) { g_commandMode->handleBackspace(hwnd); return 0; }
+            if (wParam == VK_UP || wParam == VK_DOWN) { g_commandMode->recallHistory(hwnd, wParam == VK_UP); return 0; }
+            if (wParam == VK_TAB) { g_commandMode->completeCommandLine(hwnd, (GetKeyState(VK_SHIFT) & 0x8000) == 0); return 0; }
         }
         if (msg == WM_CHAR) { 
             wchar_t wChar = (wchar_t)wParam;
@@ -783,8 +870,7 @@ LRESULT CALLBACK ScintillaHookProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lP
                 if (wParam == 'T') {
                     int line = Utils::caretLine(hwnd);
                     int indent = (int)::SendMessage(hwnd, SCI_GETLINEINDENTATION, line, 0);
-                    auto val = OptionRegistry::getInstance().getOption("shiftwidth");
-                    int shiftWidth = std::holds_alternative<int>(val) ? std::get<int>(val) : 4;
+                    int shiftWidth = Options::shiftwidth.get();
                     Utils::beginUndo(hwnd);
                     ::SendMessage(hwnd, SCI_SETLINEINDENTATION, line, indent + shiftWidth);
                     Utils::endUndo(hwnd);
@@ -793,8 +879,7 @@ LRESULT CALLBACK ScintillaHookProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lP
                 if (wParam == 'D') {
                     int line = Utils::caretLine(hwnd);
                     int indent = (int)::SendMessage(hwnd, SCI_GETLINEINDENTATION, line, 0);
-                    auto val = OptionRegistry::getInstance().getOption("shiftwidth");
-                    int shiftWidth = std::holds_alternative<int>(val) ? std::get<int>(val) : 4;
+                    int shiftWidth = Options::shiftwidth.get();
                     Utils::beginUndo(hwnd);
                     ::SendMessage(hwnd, SCI_SETLINEINDENTATION, line, (std::max)(0, indent - shiftWidth));
                     Utils::endUndo(hwnd);
@@ -831,8 +916,24 @@ LRESULT CALLBACK ScintillaHookProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lP
 
     if (msg == WM_CHAR) {
         wchar_t wChar = (wchar_t)wParam;
+        char swallow = g_swallowChar;
+        g_swallowChar = 0;
+        if (swallow && wChar == (wchar_t)swallow) return 0;
         char c = Utils::applyLangmap(wChar);
-        if (c == 0) return 0; // Consume unmapped non-ASCII in Normal/Visual mode to prevent text insertion
+        if (c == 0) {
+            // Unmapped non-ASCII is never inserted; it only answers f, t or r
+            static wchar_t highSurrogate = 0;
+            if (wChar >= 0xD800 && wChar < 0xDC00) { highSurrogate = wChar; return 0; }
+            char32_t cp = wChar;
+            if (wChar >= 0xDC00 && wChar < 0xE000) {
+                if (!highSurrogate) return 0;
+                cp = 0x10000 + (((char32_t)highSurrogate - 0xD800) << 10) + (wChar - 0xDC00);
+            }
+            highSurrogate = 0;
+            if (state.mode == NORMAL) g_normalMode->handleCharArgument(hwnd, cp);
+            else if (state.mode == VISUAL) g_visualMode->handleCharArgument(hwnd, cp);
+            return 0;
+        }
 
         if (c == 27) { g_firstKey = 0; g_normalMode->enter(); return 0; }
         if (state.mode == NORMAL) { g_normalMode->handleKey(hwnd, c); return 0; }
@@ -858,9 +959,9 @@ void updateCursorForCurrentMode() {
     HWND hwndEdit = Utils::getCurrentScintillaHandle();
     if (!hwndEdit || !IsWindow(hwndEdit)) return;
     if (state.vimEnabled) {
-        if (state.mode == NORMAL || state.mode == VISUAL) ::SendMessage(hwndEdit, SCI_SETCARETSTYLE, CARETSTYLE_BLOCK, 0);
-        else if (state.mode == INSERT) ::SendMessage(hwndEdit, SCI_SETCARETSTYLE, CARETSTYLE_LINE, 0);
-    } else ::SendMessage(hwndEdit, SCI_SETCARETSTYLE, CARETSTYLE_LINE, 0);
+        if (state.mode == NORMAL || state.mode == VISUAL) Utils::setCaretStyle(hwndEdit, CARETSTYLE_BLOCK);
+        else if (state.mode == INSERT) Utils::setCaretStyle(hwndEdit, CARETSTYLE_LINE);
+    } else Utils::setCaretStyle(hwndEdit, CARETSTYLE_LINE);
 }
 
 void toggleVimMode() {
@@ -886,6 +987,7 @@ BOOL APIENTRY DllMain(HANDLE hModule, DWORD reasonForCall, LPVOID) {
 extern "C" __declspec(dllexport) void setInfo(NppData notpadPlusData) {
     nppData = notpadPlusData; setNppData(notpadPlusData);
     installNppHook();
+    Clipboard::getInstance().setOwner(nppData._nppHandle);
     initializeOptions();
     g_normalMode = new NormalMode(state); g_visualMode = new VisualMode(state); g_commandMode = new CommandMode(state);
     loadConfig();
@@ -896,17 +998,9 @@ extern "C" __declspec(dllexport) void setInfo(NppData notpadPlusData) {
 extern "C" __declspec(dllexport) const TCHAR* getName() { return PLUGIN_NAME; }
 
 void reloadConfiguration() { 
-    if (g_normalMode) delete g_normalMode; 
-    if (g_visualMode) delete g_visualMode; 
-    if (g_commandMode) delete g_commandMode;
-    
-    MappingManager::getInstance().clearMappings();
-    CommandMode::clearUserCommands();
-    OptionRegistry::getInstance().resetToDefaults();
-
-    g_normalMode = new NormalMode(state); 
-    g_visualMode = new VisualMode(state); 
-    g_commandMode = new CommandMode(state);
+    // Only what the rc file changed is applied; option side effects run once, at the end.
+    UiBatch ui;
+    OptionBatch options;
 
     loadConfig(); 
     Utils::setStatus(TEXT("Configuration reloaded")); 
@@ -927,9 +1021,62 @@ extern "C" __declspec(dllexport) FuncItem* getFuncsArray(int* nbF) {
     return funcItem;
 }
 
+void VimState::recordJump(long position, int lineNumber) {
+    jumpList.push(Utils::getCurrentScintillaHandle(), position, lineNumber);
+}
+
+// A document cloned into both views reports each edit from both windows;
+// only take the second view's notification when it shows its own document.
+static bool isPrimaryNotifier(HWND hwnd) {
+    if (hwnd == nppData._scintillaMainHandle) return true;
+    if (hwnd != nppData._scintillaSecondHandle) return false;
+    return ::SendMessage(hwnd, SCI_GETDOCPOINTER, 0, 0)
+        != ::SendMessage(nppData._scintillaMainHandle, SCI_GETDOCPOINTER, 0, 0);
+}
+
+// Scintilla document behind each buffer, noted on activation. Once a buffer
+// closes its document pointer may be handed to a new document, so the caches
+// keyed by it are dropped.
+static std::map<UINT_PTR, void*> bufferDocs;
+
+static void noteBufferDocument(UINT_PTR bufferId) {
+    HWND hwnd = Utils::getCurrentScintillaHandle();
+    if (hwnd) bufferDocs[bufferId] = (void*)::SendMessage(hwnd, SCI_GETDOCPOINTER, 0, 0);
+}
+
+static void forgetBufferDocument(UINT_PTR bufferId) {
+    auto it = bufferDocs.find(bufferId);
+    if (it == bufferDocs.end()) return;
+    // Still open as a clone in the other view
+    if (::SendMessage(nppData._nppHandle, NPPM_GETPOSFROMBUFFERID, bufferId, 0) != -1) return;
+    void* doc = it->second;
+    bufferDocs.erase(it);
+    BracketIndex::getInstance().forget(doc);
+    LineIndex::getInstance().forget(doc);
+    MarkTracker::getInstance().forgetDocument(doc);
+    Marks::forgetDocument(doc);
+}
+
 extern "C" __declspec(dllexport) void beNotified(SCNotification* notifyCode) {
     if (!notifyCode) return;
 
+    // Notepad++ writes the language name into the field our status uses.
+    if (notifyCode->nmhdr.code == NPPN_BUFFERACTIVATED || notifyCode->nmhdr.code == NPPN_LANGCHANGED) {
+        UiUpdates::getInstance().statusOverwritten();
+    }
+
+    if (notifyCode->nmhdr.code == NPPN_BUFFERACTIVATED) {
+        BufferStates::getInstance().activate(notifyCode->nmhdr.idFrom, state);
+        LineIndex::getInstance().viewsChanged();
+        BracketIndex::getInstance().viewsChanged();
+        noteBufferDocument(notifyCode->nmhdr.idFrom);
+    }
+
+    if (notifyCode->nmhdr.code == NPPN_FILECLOSED) {
+        BufferStates::getInstance().close(notifyCode->nmhdr.idFrom, state);
+        forgetBufferDocument(notifyCode->nmhdr.idFrom);
+    }
+
     if ((notifyCode->nmhdr.code == NPPN_BUFFERACTIVATED || notifyCode->nmhdr.code == NPPN_READY) && state.vimEnabled) {
         ensureScintillaHooks(); 
         updateCursorForCurrentMode();
@@ -970,10 +1117,32 @@ extern "C" __declspec(dllexport) void beNotified(SCNotification* notifyCode) {
         }
     }
 
+    if (notifyCode->nmhdr.code == SCN_MODIFIED
+        && (notifyCode->modificationType & (SC_MOD_INSERTTEXT | SC_MOD_DELETETEXT))) {
+        HWND hwnd = (HWND)notifyCode->nmhdr.hwndFrom;
+        bool inserted = (notifyCode->modificationType & SC_MOD_INSERTTEXT) != 0;
+        int position = (int)notifyCode->position;
+        int length = (int)notifyCode->length;
+        if (isPrimaryNotifier(hwnd)) {
+            BracketIndex::getInstance().notifyModified(hwnd, inserted, position, length, notifyCode->text);
+            LineIndex::getInstance().notifyModified(hwnd, inserted, position, length,
+                (int)notifyCode->linesAdded, notifyCode->text);
+            MarkTracker::getInstance().notifyModified(hwnd, inserted, position, length);
+            Marks::noteChange(hwnd, position);
+            state.changeList.note(hwnd, position, Utils::lineFromPosition(hwnd, position));
+            if (notifyCode->linesAdded != 0) invalidateRelativeLineNumbers();
+        }
+    }
+
     if (notifyCode->nmhdr.code == SCN_UPDATEUI) {
+        UiBatch batch;
+        HWND hwnd = (HWND)notifyCode->nmhdr.hwndFrom;
         // Always update on selection/scroll/content change
         if (notifyCode->updated & (SC_UPDATE_SELECTION | SC_UPDATE_V_SCROLL | SC_UPDATE_CONTENT | SC_UPDATE_H_SCROLL)) {
-            updateRelativeLineNumbers((HWND)notifyCode->nmhdr.hwndFrom);
+            UiUpdates::getInstance().requestMargin(hwnd);
+        }
+        if (notifyCode->updated & (SC_UPDATE_V_SCROLL | SC_UPDATE_CONTENT)) {
+            UiUpdates::getInstance().requestMarkers(hwnd);
         }
     }
 }
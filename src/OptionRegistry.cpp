@@ -7,35 +7,99 @@ OptionRegistry& OptionRegistry::getInstance() {
     return instance;
 }
 
-void OptionRegistry::registerOption(const std::string& name, OptionType type, OptionValue defaultValue, OptionSetter setter, const std::string& desc) {
-    options[name] = { name, type, defaultValue, defaultValue, setter, desc };
+OptionRegistry::OptionRegistry()
+    : options((size_t)OptionId::Count),
+      registered((size_t)OptionId::Count, false),
+      pending((size_t)OptionId::Count, false) {}
+
+void OptionRegistry::registerOption(OptionId id, const std::string& name, OptionType type, OptionValue defaultValue, OptionSetter setter, const std::string& desc) {
+    size_t index = (size_t)id;
+    options[index] = { name, type, defaultValue, defaultValue, setter, desc };
+    registered[index] = true;
+    byName[name] = index;
     if (setter) {
         setter(defaultValue);
     }
 }
 
-bool OptionRegistry::setOption(const std::string& name, const OptionValue& value) {
-    auto it = options.find(name);
-    if (it != options.end()) {
-        it->second.value = value;
-        if (it->second.setter) {
-            it->second.setter(value);
+bool OptionRegistry::convert(OptionType type, const OptionValue& in, OptionValue& out) const {
+    switch (type) {
+    case OptionType::Bool:
+        if (std::holds_alternative<bool>(in)) out = std::get<bool>(in);
+        else if (std::holds_alternative<int>(in)) out = std::get<int>(in) != 0;
+        else return false;
+        return true;
+    case OptionType::Number:
+        if (std::holds_alternative<int>(in)) {
+            out = std::get<int>(in);
+            return true;
+        }
+        if (std::holds_alternative<std::string>(in)) {
+            try {
+                out = std::stoi(std::get<std::string>(in));
+                return true;
+            } catch (...) {}
         }
+        return false;
+    case OptionType::String:
+        if (std::holds_alternative<std::string>(in)) out = std::get<std::string>(in);
+        else if (std::holds_alternative<int>(in)) out = std::to_string(std::get<int>(in));
+        else return false;
         return true;
     }
     return false;
 }
 
+void OptionRegistry::applySetter(size_t index) {
+    if (!options[index].setter) return;
+    if (batchDepth > 0) {
+        pending[index] = true;
+        return;
+    }
+    options[index].setter(options[index].value);
+}
+
+bool OptionRegistry::setOption(OptionId id, const OptionValue& value) {
+    size_t index = (size_t)id;
+    if (index >= options.size() || !registered[index]) return false;
+
+    OptionValue typed;
+    if (!convert(options[index].type, value, typed)) return false;
+    options[index].value = typed;
+    applySetter(index);
+    return true;
+}
+
+bool OptionRegistry::setOption(const std::string& name, const OptionValue& value) {
+    auto it = byName.find(name);
+    if (it == byName.end()) return false;
+    return setOption((OptionId)it->second, value);
+}
+
 void OptionRegistry::resetToDefaults() {
-    for (auto& pair : options) {
-        pair.second.value = pair.second.defaultValue;
-        if (pair.second.setter) {
-            pair.second.setter(pair.second.defaultValue);
-        }
+    beginBatch();
+    for (size_t i = 0; i < options.size(); i++) {
+        if (!registered[i]) continue;
+        options[i].value = options[i].defaultValue;
+        applySetter(i);
     }
+    endBatch();
 }
 
-bool OptionRegistry::setOptionFromString(const std::string& line) {
+void OptionRegistry::beginBatch() {
+    batchDepth++;
+}
+
+void OptionRegistry::endBatch() {
+    if (batchDepth == 0 || --batchDepth > 0) return;
+    for (size_t i = 0; i < options.size(); i++) {
+        if (!pending[i]) continue;
+        pending[i] = false;
+        applySetter(i);
+    }
+}
+
+bool OptionRegistry::parseAssignments(const std::string& line, std::vector<OptionAssignment>& out) const {
     std::string s = line;
     if (s.find("set ") == 0) s = s.substr(4);
     
@@ -74,9 +138,12 @@ bool OptionRegistry::setOptionFromString(const std::string& line) {
 
             isBool = false;
             
-            // Check if it's a number or string
+            // Check if it's a number or string; "48-57,_" is a string
             try {
-                value = std::stoi(valStr);
+                size_t used = 0;
+                int number = std::stoi(valStr, &used);
+                if (used == valStr.size()) value = number;
+                else value = valStr;
             } catch (...) {
                 value = valStr;
             }
@@ -87,11 +154,13 @@ bool OptionRegistry::setOptionFromString(const std::string& line) {
                 if (potentialName == "nu") potentialName = "number";
                 if (potentialName == "rnu") potentialName = "relativenumber";
                 if (potentialName == "tw") potentialName = "textwidth";
+                if (potentialName == "isk") potentialName = "iskeyword";
+                if (potentialName == "nf") potentialName = "nrformats";
 
-                if (options.count(potentialName)) {
+                if (byName.count(potentialName)) {
                     name = potentialName;
                     boolVal = false;
-                } else if (options.count(name)) {
+                } else if (byName.count(name)) {
                     // it's an option that happens to start with 'no'
                     boolVal = true;
                 }
@@ -103,27 +172,61 @@ bool OptionRegistry::setOptionFromString(const std::string& line) {
         if (name == "nu") name = "number";
         if (name == "rnu") name = "relativenumber";
         if (name == "tw") name = "textwidth";
+        if (name == "isk") name = "iskeyword";
+        if (name == "nf") name = "nrformats";
 
-        if (!setOption(name, value)) {
+        auto it = byName.find(name);
+        OptionValue typed;
+        if (it == byName.end() || !convert(options[it->second].type, value, typed)) {
             allSuccess = false;
+            continue;
         }
+        out.emplace_back((OptionId)it->second, typed);
     }
 
     return allSuccess;
 }
 
+bool OptionRegistry::setOptionFromString(const std::string& line) {
+    std::vector<OptionAssignment> assignments;
+    bool allSuccess = parseAssignments(line, assignments);
+
+    OptionBatch batch;
+    for (const auto& assignment : assignments) {
+        setOption(assignment.first, assignment.second);
+    }
+    return allSuccess;
+}
+
+void OptionRegistry::applyConfiguration(const std::vector<OptionAssignment>& assignments) {
+    std::vector<OptionValue> target((size_t)OptionId::Count);
+    for (size_t i = 0; i < options.size(); i++) {
+        if (registered[i]) target[i] = options[i].defaultValue;
+    }
+    for (const auto& assignment : assignments) {
+        target[(size_t)assignment.first] = assignment.second;
+    }
+
+    beginBatch();
+    for (size_t i = 0; i < options.size(); i++) {
+        if (!registered[i] || options[i].value == target[i]) continue;
+        setOption((OptionId)i, target[i]);
+    }
+    endBatch();
+}
+
 OptionValue OptionRegistry::getOption(const std::string& name) const {
-    auto it = options.find(name);
-    if (it != options.end()) {
-        return it->second.value;
+    auto it = byName.find(name);
+    if (it != byName.end()) {
+        return options[it->second].value;
     }
     return false;
 }
 
 std::vector<OptionInfo> OptionRegistry::getAllOptions() const {
     std::vector<OptionInfo> result;
-    for (auto const& [name, info] : options) {
-        result.push_back(info);
+    for (size_t i = 0; i < options.size(); i++) {
+        if (registered[i]) result.push_back(options[i]);
     }
     return result;
 }
@@ -0,0 +1,128 @@
+#include "../include/Paste.h"
+#include "../include/BlockEdit.h"
+#include "../include/Clipboard.h"
+#include "../include/Utils.h"
+#include "../plugin/Scintilla.h"
+#include <algorithm>
+#include <vector>
+
+RegisterText Paste::source(char reg) {
+    if (reg == '+' || reg == '*') return Clipboard::getInstance().getShared();
+    return Utils::getRegisterText(reg);
+}
+
+std::string Paste::repeat(const std::string& text, int count) {
+    std::string out;
+    out.reserve(text.size() * count);
+    for (int i = 0; i < count; i++) out += text;
+    return out;
+}
+
+bool Paste::put(HWND hwnd, char reg, int count, Shape shape, bool after) {
+    RegisterText text = source(reg);
+    if (!text || text->empty()) return false;
+    put(hwnd, *text, count, shape, after);
+    return true;
+}
+
+static size_t eolLength(const std::string& text) {
+    size_t n = text.size();
+    if (n >= 2 && text[n - 2] == '\r' && text[n - 1] == '\n') return 2;
+    if (n >= 1 && (text[n - 1] == '\n' || text[n - 1] == '\r')) return 1;
+    return 0;
+}
+
+static void putLines(HWND hwnd, const std::string& text, int count, bool after) {
+    std::string eol = Utils::eolString(hwnd);
+    int line = Utils::caretLine(hwnd);
+    bool last = line == Utils::lineCount(hwnd) - 1;
+    int at = !after ? Utils::lineStart(hwnd, line) : last ? Utils::lineEnd(hwnd, line) : Utils::lineStart(hwnd, line + 1);
+
+    // The last line has no EOL, so the copies open a new line instead
+    bool open = after && last;
+    size_t ended = eolLength(text);
+
+    std::string out;
+    out.reserve((text.size() + eol.size()) * count + eol.size());
+    if (open) out += eol;
+    for (int i = 0; i < count; i++) {
+        out += text;
+        if (!ended) out += eol;
+    }
+    if (open) out.resize(out.size() - (ended ? ended : eol.size()));
+
+    Utils::replaceTarget(hwnd, at, at, out);
+    ::SendMessage(hwnd, SCI_GOTOPOS, at + (open ? (int)eol.size() : 0), 0);
+}
+
+static void putChars(HWND hwnd, const std::string& text, int count, bool after) {
+    int pos = Utils::caretPos(hwnd);
+    int at = pos;
+    if (after && pos < Utils::lineEnd(hwnd, Utils::caretLine(hwnd)))
+        at = (int)::SendMessage(hwnd, SCI_POSITIONAFTER, pos, 0);
+
+    std::string repeated;
+    const std::string& out = count > 1 ? (repeated = Paste::repeat(text, count)) : text;
+    Utils::replaceTarget(hwnd, at, at, out);
+    ::SendMessage(hwnd, SCI_GOTOPOS, after ? at + (int)out.size() - 1 : pos, 0);
+}
+
+// Each line of the block is a piece. Repeated pieces are padded to the
+// block's width so the copies line up.
+static void putBlock(HWND hwnd, const std::string& text, int count, bool after) {
+    std::vector<std::string> pieces;
+    size_t start = 0;
+    size_t end = text.size() - eolLength(text);
+    while (true) {
+        size_t stop = start;
+        while (stop < end && text[stop] != '\r' && text[stop] != '\n') stop++;
+        pieces.emplace_back(text, start, stop - start);
+        if (stop >= end) break;
+        start = stop + (text.compare(stop, 2, "\r\n") == 0 ? 2 : 1);
+    }
+
+    if (count > 1) {
+        int codePage = (int)::SendMessage(hwnd, SCI_GETCODEPAGE, 0, 0);
+        std::vector<int> widths;
+        int width = 0;
+        for (const std::string& piece : pieces) {
+            int w = 0;
+            for (size_t i = 0; i < piece.size(); i += Utils::charLength(piece, i, codePage)) w++;
+            widths.push_back(w);
+            width = (std::max)(width, w);
+        }
+        for (size_t i = 0; i < pieces.size(); i++) {
+            int pad = width - widths[i];
+            std::string repeated;
+            repeated.reserve((pieces[i].size() + pad) * count);
+            for (int k = 1; k < count; k++) {
+                repeated += pieces[i];
+                repeated.append(pad, ' ');
+            }
+            repeated += pieces[i];
+            pieces[i].swap(repeated);
+        }
+    }
+
+    int pos = Utils::caretPos(hwnd);
+    int line = Utils::caretLine(hwnd);
+    int at = pos;
+    if (after && pos < Utils::lineEnd(hwnd, line))
+        at = (int)::SendMessage(hwnd, SCI_POSITIONAFTER, pos, 0);
+    int col = (int)::SendMessage(hwnd, SCI_GETCOLUMN, at, 0);
+
+    int lastLine = (std::min)(line + (int)pieces.size() - 1, Utils::lineCount(hwnd) - 1);
+    BlockEdit block(hwnd, line, lastLine, col, col, false);
+    int caret = block.put(pieces, Utils::eolString(hwnd));
+    Utils::select(hwnd, caret, caret);
+}
+
+void Paste::put(HWND hwnd, const std::string& text, int count, Shape shape, bool after) {
+    if (text.empty() || count < 1) return;
+
+    Utils::beginUndo(hwnd);
+    if (shape == BLOCKWISE) putBlock(hwnd, text, count, after);
+    else if (shape == LINEWISE) putLines(hwnd, text, count, after);
+    else putChars(hwnd, text, count, after);
+    Utils::endUndo(hwnd);
+}
@@ -0,0 +1,201 @@
+#include "../include/PositionRing.h"
+#include "../include/MarkTracker.h"
+#include "../include/Utils.h"
+#include <sstream>
+
+PositionRing::PositionRing(size_t capacity, bool currentDocumentOnly)
+    : slots((std::max)(capacity, (size_t)1)), currentDocumentOnly(currentDocumentOnly) {}
+
+size_t PositionRing::size() const {
+    size_t count = 0;
+    for (auto& entry : slots) {
+        if (entry.live) count++;
+    }
+    return count;
+}
+
+void PositionRing::retire(JumpPosition& entry) {
+    MarkTracker::getInstance().forget(entry.handle);
+    entry = JumpPosition();
+}
+
+void PositionRing::clear() {
+    for (auto& entry : slots) {
+        if (entry.live) retire(entry);
+    }
+    lineSeq.clear();
+    nextSeq = 0;
+    cursor = 0;
+}
+
+void PositionRing::setCapacity(size_t capacity) {
+    capacity = (std::max)(capacity, (size_t)1);
+    if (capacity == slots.size()) return;
+
+    std::vector<JumpPosition> kept;
+    for (unsigned long long seq = oldest(); seq < nextSeq; seq++) {
+        if (at(seq).live) kept.push_back(at(seq));
+    }
+    while (kept.size() > capacity) {
+        MarkTracker::getInstance().forget(kept.front().handle);
+        kept.erase(kept.begin());
+    }
+
+    slots.assign(capacity, JumpPosition());
+    lineSeq.clear();
+    for (size_t i = 0; i < kept.size(); i++) {
+        slots[i] = kept[i];
+        lineSeq[{ kept[i].doc, kept[i].lineNumber }] = i;
+    }
+    nextSeq = kept.size();
+    cursor = nextSeq;
+}
+
+long PositionRing::target(HWND hwnd, const JumpPosition& entry) const {
+    int pos = MarkTracker::getInstance().position(hwnd, entry.handle);
+    return (pos >= 0) ? pos : entry.position;
+}
+
+bool PositionRing::visible(HWND hwnd, const JumpPosition& entry) const {
+    if (!entry.live) return false;
+    return !currentDocumentOnly || !entry.doc || entry.doc == MarkTracker::documentOf(hwnd);
+}
+
+// Move every entry newer than gap down one place. Navigation keeps pointing
+// at the same entry.
+void PositionRing::compact(unsigned long long gap) {
+    for (unsigned long long seq = gap + 1; seq < nextSeq; seq++) {
+        JumpPosition& entry = at(seq);
+        at(seq - 1) = entry;
+        if (!entry.live) continue;
+        auto it = lineSeq.find({ entry.doc, entry.lineNumber });
+        if (it != lineSeq.end() && it->second == seq) it->second = seq - 1;
+    }
+    nextSeq--;
+    at(nextSeq) = JumpPosition();
+    if (cursor > gap) cursor--;
+}
+
+void PositionRing::add(HWND hwnd, long position, int line) {
+    void* doc = MarkTracker::documentOf(hwnd);
+
+    auto same = lineSeq.find({ doc, line });
+    if (same != lineSeq.end() && same->second >= oldest() && same->second < nextSeq) {
+        unsigned long long seq = same->second;
+        JumpPosition& entry = at(seq);
+        if (entry.live && entry.doc == doc && Utils::lineFromPosition(hwnd, (int)target(hwnd, entry)) == line) {
+            retire(entry);
+            compact(seq);
+        }
+    }
+
+    JumpPosition& slot = at(nextSeq);
+    if (slot.live) retire(slot);
+    slot.position = position;
+    slot.lineNumber = line;
+    slot.handle = MarkTracker::getInstance().track(hwnd, (int)position);
+    slot.doc = doc;
+    slot.live = true;
+
+    // Stale line keys are skipped by the checks above; just keep the table small.
+    if (lineSeq.size() > slots.size() * 4) {
+        lineSeq.clear();
+        for (unsigned long long seq = oldest(); seq < nextSeq; seq++) {
+            if (at(seq).live) lineSeq[{ at(seq).doc, at(seq).lineNumber }] = seq;
+        }
+    }
+    lineSeq[{ doc, line }] = nextSeq++;
+}
+
+void PositionRing::push(HWND hwnd, long position, int line) {
+    add(hwnd, position, line);
+    cursor = nextSeq;
+}
+
+void PositionRing::note(HWND hwnd, long position, int line) {
+    if (nextSeq > 0) {
+        JumpPosition& last = at(nextSeq - 1);
+        if (last.live && last.doc == MarkTracker::documentOf(hwnd)
+            && Utils::lineFromPosition(hwnd, (int)target(hwnd, last)) == line) {
+            last.position = position;
+            MarkTracker::getInstance().move(hwnd, last.handle, (int)position);
+            cursor = nextSeq;
+            return;
+        }
+    }
+    push(hwnd, position, line);
+}
+
+bool PositionRing::back(HWND hwnd, long currentPos, int currentLine, int count, long& result) {
+    bool atEnd = cursor >= nextSeq;
+    if (cursor < oldest()) cursor = oldest();
+
+    // From the end, entries on the current line are about to be replaced by
+    // the current position and don't count as a step.
+    void* doc = MarkTracker::documentOf(hwnd);
+    unsigned long long seq = cursor;
+    for (int remaining = count; remaining > 0;) {
+        if (seq == oldest()) return false;
+        seq--;
+        const JumpPosition& entry = at(seq);
+        if (!visible(hwnd, entry)) continue;
+        if (atEnd && entry.doc == doc && Utils::lineFromPosition(hwnd, (int)target(hwnd, entry)) == currentLine) continue;
+        remaining--;
+    }
+
+    result = target(hwnd, at(seq));
+    cursor = seq;
+    if (atEnd) add(hwnd, currentPos, currentLine);
+    cursor = (std::max)(cursor, oldest());
+    return true;
+}
+
+bool PositionRing::forward(HWND hwnd, int count, long& result) {
+    if (cursor >= nextSeq) return false;
+    if (cursor < oldest()) cursor = oldest();
+
+    unsigned long long seq = cursor;
+    for (int remaining = count; remaining > 0;) {
+        if (seq + 1 >= nextSeq) return false;
+        seq++;
+        if (visible(hwnd, at(seq))) remaining--;
+    }
+    cursor = seq;
+    result = target(hwnd, at(seq));
+    return true;
+}
+
+const JumpPosition* PositionRing::newest(HWND hwnd) const {
+    for (unsigned long long seq = nextSeq; seq > oldest(); seq--) {
+        if (visible(hwnd, at(seq - 1))) return &at(seq - 1);
+    }
+    return nullptr;
+}
+
+std::string PositionRing::serialize(HWND hwnd) const {
+    std::ostringstream out;
+    for (unsigned long long seq = oldest(); seq < nextSeq; seq++) {
+        const JumpPosition& entry = at(seq);
+        if (!entry.live) continue;
+        long pos = target(hwnd, entry);
+        int line = (pos == entry.position) ? entry.lineNumber : Utils::lineFromPosition(hwnd, (int)pos);
+        out << pos << ' ' << line << '\n';
+    }
+    return out.str();
+}
+
+void PositionRing::deserialize(const std::string& data) {
+    clear();
+    std::istringstream in(data);
+    long position;
+    int line;
+    while (in >> position >> line) {
+        JumpPosition& slot = at(nextSeq);
+        slot = JumpPosition();
+        slot.position = position;
+        slot.lineNumber = line;
+        slot.live = true;
+        lineSeq[{ nullptr, line }] = nextSeq++;
+    }
+    cursor = nextSeq;
+}
@@ -0,0 +1,252 @@
+#include "../include/Process.h"
+#include <algorithm>
+#include <vector>
+
+#ifdef _WIN32
+
+#include <windows.h>
+#include <atomic>
+#include <thread>
+
+static std::wstring widen(const std::string& text) {
+    int len = MultiByteToWideChar(CP_UTF8, 0, text.c_str(), -1, NULL, 0);
+    if (len <= 0) return std::wstring();
+    std::wstring wide(len, L'\0');
+    MultiByteToWideChar(CP_UTF8, 0, text.c_str(), -1, &wide[0], len);
+    wide.pop_back();
+    return wide;
+}
+
+std::string Process::defaultShell() {
+    char comspec[MAX_PATH] = {0};
+    DWORD len = GetEnvironmentVariableA("COMSPEC", comspec, MAX_PATH);
+    return (len > 0 && len < MAX_PATH) ? std::string(comspec, len) : std::string("cmd.exe");
+}
+
+static std::wstring commandLine(const std::string& shell, const std::string& command) {
+    std::string name = shell.substr(shell.find_last_of("\\/") == std::string::npos ? 0 : shell.find_last_of("\\/") + 1);
+    std::transform(name.begin(), name.end(), name.begin(), [](unsigned char c) { return (char)std::tolower(c); });
+
+    std::string line = "\"" + shell + "\" ";
+    if (name == "cmd" || name == "cmd.exe") {
+        // /s keeps cmd from stripping quotes inside the command
+        line += "/s /c \"" + command + "\"";
+    } else {
+        std::string quoted;
+        for (char c : command) {
+            if (c == '"') quoted += '\\';
+            quoted += c;
+        }
+        line += "-c \"" + quoted + "\"";
+    }
+    return widen(line);
+}
+
+ProcessResult Process::filter(const std::string& shell, const std::string& command, std::string_view input,
+    std::string& output, int& exitCode, const Progress& progress) {
+    output.clear();
+    exitCode = -1;
+
+    SECURITY_ATTRIBUTES inherit = { sizeof(SECURITY_ATTRIBUTES), NULL, TRUE };
+    HANDLE inRead = NULL, inWrite = NULL, outRead = NULL, outWrite = NULL;
+    if (!CreatePipe(&inRead, &inWrite, &inherit, 0)) return ProcessResult::Failed;
+    if (!CreatePipe(&outRead, &outWrite, &inherit, 0)) {
+        CloseHandle(inRead);
+        CloseHandle(inWrite);
+        return ProcessResult::Failed;
+    }
+    SetHandleInformation(inWrite, HANDLE_FLAG_INHERIT, 0);
+    SetHandleInformation(outRead, HANDLE_FLAG_INHERIT, 0);
+
+    // Everything the command starts goes into one job, so cancelling also
+    // stops the programs a shell pipeline spawned.
+    HANDLE job = CreateJobObjectW(NULL, NULL);
+    if (job) {
+        JOBOBJECT_EXTENDED_LIMIT_INFORMATION limits = {};
+        limits.BasicLimitInformation.LimitFlags = JOB_OBJECT_LIMIT_KILL_ON_JOB_CLOSE;
+        SetInformationJobObject(job, JobObjectExtendedLimitInformation, &limits, sizeof(limits));
+    }
+
+    std::wstring cmdLine = commandLine(shell.empty() ? defaultShell() : shell, command);
+    STARTUPINFOW startup = {};
+    startup.cb = sizeof(startup);
+    startup.dwFlags = STARTF_USESTDHANDLES;
+    startup.hStdInput = inRead;
+    startup.hStdOutput = outWrite;
+    startup.hStdError = outWrite;
+    PROCESS_INFORMATION process = {};
+    BOOL started = CreateProcessW(NULL, &cmdLine[0], NULL, NULL, TRUE, CREATE_NO_WINDOW | CREATE_SUSPENDED,
+        NULL, NULL, &startup, &process);
+    CloseHandle(inRead);
+    CloseHandle(outWrite);
+    if (!started) {
+        CloseHandle(inWrite);
+        CloseHandle(outRead);
+        if (job) CloseHandle(job);
+        return ProcessResult::Failed;
+    }
+    if (job) AssignProcessToJobObject(job, process.hProcess);
+    ResumeThread(process.hThread);
+    CloseHandle(process.hThread);
+
+    // A blocking write on its own thread; it ends when the input is used up
+    // or the command closes its stdin.
+    std::atomic<size_t> written(0);
+    std::thread writer([&written, input, inWrite]() {
+        size_t offset = 0;
+        while (offset < input.size()) {
+            DWORD chunk = (DWORD)(std::min)(input.size() - offset, CHUNK);
+            DWORD done = 0;
+            if (!WriteFile(inWrite, input.data() + offset, chunk, &done, NULL)) break;
+            offset += done;
+            written = offset;
+        }
+        CloseHandle(inWrite);
+    });
+
+    ProcessResult result = ProcessResult::Finished;
+    std::vector<char> buffer(CHUNK);
+    ULONGLONG lastReport = GetTickCount64();
+    for (;;) {
+        DWORD available = 0;
+        // Fails once every copy of the write end is closed
+        if (!PeekNamedPipe(outRead, NULL, 0, NULL, &available, NULL)) break;
+        if (available > 0) {
+            DWORD got = 0;
+            if (!ReadFile(outRead, buffer.data(), (std::min)(available, (DWORD)CHUNK), &got, NULL)) break;
+            output.append(buffer.data(), got);
+        } else if (WaitForSingleObject(process.hProcess, 5) == WAIT_OBJECT_0) {
+            Sleep(5);
+        }
+
+        ULONGLONG now = GetTickCount64();
+        if (progress && now - lastReport >= PROGRESS_MS) {
+            lastReport = now;
+            if (!progress(written, output.size())) {
+                if (job) TerminateJobObject(job, 1);
+                TerminateProcess(process.hProcess, 1);
+                result = ProcessResult::Cancelled;
+                break;
+            }
+        }
+    }
+
+    CloseHandle(outRead);
+    writer.join();
+    WaitForSingleObject(process.hProcess, INFINITE);
+    DWORD code = 0;
+    if (GetExitCodeProcess(process.hProcess, &code)) exitCode = (int)code;
+    CloseHandle(process.hProcess);
+    if (job) CloseHandle(job);
+    return result;
+}
+
+#else
+
+#include <cerrno>
+#include <chrono>
+#include <csignal>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+std::string Process::defaultShell() {
+    return "/bin/sh";
+}
+
+ProcessResult Process::filter(const std::string& shell, const std::string& command, std::string_view input,
+    std::string& output, int& exitCode, const Progress& progress) {
+    output.clear();
+    exitCode = -1;
+
+    int in[2], out[2];
+    if (pipe(in) != 0) return ProcessResult::Failed;
+    if (pipe(out) != 0) {
+        close(in[0]);
+        close(in[1]);
+        return ProcessResult::Failed;
+    }
+
+    std::string sh = shell.empty() ? defaultShell() : shell;
+    pid_t pid = fork();
+    if (pid < 0) {
+        close(in[0]); close(in[1]); close(out[0]); close(out[1]);
+        return ProcessResult::Failed;
+    }
+    if (pid == 0) {
+        // Own process group, so cancelling reaches the whole pipeline
+        setpgid(0, 0);
+        dup2(in[0], STDIN_FILENO);
+        dup2(out[1], STDOUT_FILENO);
+        dup2(out[1], STDERR_FILENO);
+        close(in[0]); close(in[1]); close(out[0]); close(out[1]);
+        execl(sh.c_str(), sh.c_str(), "-c", command.c_str(), (char*)NULL);
+        _exit(127);
+    }
+    close(in[0]);
+    close(out[1]);
+
+    int inFd = in[1];
+    int outFd = out[0];
+    fcntl(inFd, F_SETFL, fcntl(inFd, F_GETFL) | O_NONBLOCK);
+    fcntl(outFd, F_SETFL, fcntl(outFd, F_GETFL) | O_NONBLOCK);
+    if (input.empty()) {
+        close(inFd);
+        inFd = -1;
+    }
+
+    // A command that stops reading early must not take us down with SIGPIPE
+    void (*previous)(int) = signal(SIGPIPE, SIG_IGN);
+
+    ProcessResult result = ProcessResult::Finished;
+    std::vector<char> buffer(CHUNK);
+    size_t offset = 0;
+    auto lastReport = std::chrono::steady_clock::now();
+    while (outFd >= 0) {
+        pollfd fds[2] = {};
+        nfds_t count = 0;
+        fds[count++] = { outFd, POLLIN, 0 };
+        if (inFd >= 0) fds[count++] = { inFd, POLLOUT, 0 };
+        if (poll(fds, count, (int)PROGRESS_MS) < 0 && errno != EINTR) break;
+
+        if (inFd >= 0 && (fds[1].revents & (POLLOUT | POLLERR | POLLHUP))) {
+            ssize_t done = write(inFd, input.data() + offset, (std::min)(input.size() - offset, CHUNK));
+            if (done > 0) offset += (size_t)done;
+            if ((done < 0 && errno != EAGAIN && errno != EINTR) || offset == input.size()) {
+                close(inFd);
+                inFd = -1;
+            }
+        }
+        if (fds[0].revents & (POLLIN | POLLERR | POLLHUP)) {
+            ssize_t got = read(outFd, buffer.data(), buffer.size());
+            if (got > 0) {
+                output.append(buffer.data(), (size_t)got);
+            } else if (got == 0 || (errno != EAGAIN && errno != EINTR)) {
+                close(outFd);
+                outFd = -1;
+            }
+        }
+
+        auto now = std::chrono::steady_clock::now();
+        if (progress && now - lastReport >= std::chrono::milliseconds(PROGRESS_MS)) {
+            lastReport = now;
+            if (!progress(offset, output.size())) {
+                kill(-pid, SIGKILL);
+                result = ProcessResult::Cancelled;
+                break;
+            }
+        }
+    }
+
+    if (inFd >= 0) close(inFd);
+    if (outFd >= 0) close(outFd);
+    int status = 0;
+    while (waitpid(pid, &status, 0) < 0 && errno == EINTR) {}
+    if (WIFEXITED(status)) exitCode = WEXITSTATUS(status);
+    else if (WIFSIGNALED(status)) exitCode = 128 + WTERMSIG(status);
+    signal(SIGPIPE, previous);
+    return result;
+}
+
+#endif
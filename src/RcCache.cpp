@@ -0,0 +1,227 @@
+#include "../include/RcCache.h"
+#include <windows.h>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+
+// Bump whenever the layout below or the meaning of an entry changes.
+static const unsigned int CACHE_VERSION = 1;
+static const char CACHE_MAGIC[4] = { 'N', 'V', 'R', 'C' };
+
+namespace {
+
+class Writer {
+public:
+    void u8(unsigned char v) { data.push_back((char)v); }
+    void u32(unsigned int v) { data.append((const char*)&v, sizeof(v)); }
+    void u64(unsigned long long v) { data.append((const char*)&v, sizeof(v)); }
+    void str(const std::string& s) {
+        u32((unsigned int)s.size());
+        data += s;
+    }
+
+    std::string data;
+};
+
+class Reader {
+public:
+    explicit Reader(const std::string& data) : data(data) {}
+
+    bool u8(unsigned char& v) { return take(&v, sizeof(v)); }
+    bool u32(unsigned int& v) { return take(&v, sizeof(v)); }
+    bool u64(unsigned long long& v) { return take(&v, sizeof(v)); }
+    bool str(std::string& s) {
+        unsigned int length = 0;
+        if (!u32(length) || length > data.size() - offset) return false;
+        s.assign(data, offset, length);
+        offset += length;
+        return true;
+    }
+    bool done() const { return offset == data.size(); }
+
+private:
+    bool take(void* out, size_t length) {
+        if (data.size() - offset < length) return false;
+        memcpy(out, data.data() + offset, length);
+        offset += length;
+        return true;
+    }
+
+    const std::string& data;
+    size_t offset = 0;
+};
+
+void writeValue(Writer& w, const OptionValue& value) {
+    w.u8((unsigned char)value.index());
+    if (std::holds_alternative<bool>(value)) w.u8(std::get<bool>(value) ? 1 : 0);
+    else if (std::holds_alternative<int>(value)) w.u32((unsigned int)std::get<int>(value));
+    else w.str(std::get<std::string>(value));
+}
+
+bool readValue(Reader& r, OptionValue& value) {
+    unsigned char tag = 0;
+    if (!r.u8(tag)) return false;
+    if (tag == 0) {
+        unsigned char b = 0;
+        if (!r.u8(b)) return false;
+        value = b != 0;
+    } else if (tag == 1) {
+        unsigned int n = 0;
+        if (!r.u32(n)) return false;
+        value = (int)n;
+    } else if (tag == 2) {
+        std::string s;
+        if (!r.str(s)) return false;
+        value = s;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+bool readFile(const std::string& path, std::string& content) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file.is_open()) return false;
+    std::ostringstream ss;
+    ss << file.rdbuf();
+    content = ss.str();
+    return true;
+}
+
+}
+
+unsigned long long RcCache::hash(const std::string& data) {
+    // FNV-1a
+    unsigned long long h = 14695981039346656037ULL;
+    for (unsigned char c : data) {
+        h ^= c;
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+bool RcCache::fileInfo(const std::string& path, unsigned long long& writeTime, unsigned long long& size) {
+    WIN32_FILE_ATTRIBUTE_DATA info;
+    if (!GetFileAttributesExA(path.c_str(), GetFileExInfoStandard, &info)) return false;
+    if (info.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) return false;
+    writeTime = ((unsigned long long)info.ftLastWriteTime.dwHighDateTime << 32) | info.ftLastWriteTime.dwLowDateTime;
+    size = ((unsigned long long)info.nFileSizeHigh << 32) | info.nFileSizeLow;
+    return true;
+}
+
+RcSource RcCache::describe(const std::string& path, const std::string* content) {
+    RcSource source;
+    source.path = path;
+    source.exists = content && fileInfo(path, source.writeTime, source.size);
+    if (source.exists) source.hash = hash(*content);
+    return source;
+}
+
+bool RcCache::fresh(RcSource& source, bool& restamp) {
+    unsigned long long writeTime = 0;
+    unsigned long long size = 0;
+    bool exists = fileInfo(source.path, writeTime, size);
+    if (exists != source.exists) return false;
+    if (!exists) return true;
+    if (size != source.size) return false;
+    if (writeTime == source.writeTime) return true;
+
+    // Saved again without changes (or copied): the content decides.
+    std::string content;
+    if (!readFile(source.path, content) || hash(content) != source.hash) return false;
+    source.writeTime = writeTime;
+    restamp = true;
+    return true;
+}
+
+bool RcCache::read(const std::string& cachePath, const std::string& rcPath, CompiledRc& rc, bool& restamp) {
+    restamp = false;
+    std::string data;
+    if (!readFile(cachePath, data)) return false;
+
+    Reader r(data);
+    char magic[4] = {};
+    unsigned int version = 0;
+    unsigned int optionCount = 0;
+    unsigned int count = 0;
+    for (char& c : magic) {
+        unsigned char b = 0;
+        if (!r.u8(b)) return false;
+        c = (char)b;
+    }
+    if (memcmp(magic, CACHE_MAGIC, sizeof(magic)) != 0) return false;
+    if (!r.u32(version) || version != CACHE_VERSION) return false;
+    if (!r.u32(optionCount) || optionCount != (unsigned int)OptionId::Count) return false;
+
+    if (!r.u32(count) || count == 0) return false;
+    rc.sources.assign(count, RcSource());
+    for (RcSource& source : rc.sources) {
+        unsigned char exists = 0;
+        if (!r.str(source.path) || !r.u64(source.writeTime) || !r.u64(source.size)
+            || !r.u64(source.hash) || !r.u8(exists)) return false;
+        source.exists = exists != 0;
+    }
+    if (rc.sources.front().path != rcPath) return false;
+
+    if (!r.u32(count)) return false;
+    rc.entries.assign(count, RcEntry());
+    for (RcEntry& entry : rc.entries) {
+        unsigned char kind = 0;
+        unsigned char mode = 0;
+        unsigned char recursive = 0;
+        unsigned int option = 0;
+        if (!r.u8(kind) || kind > (unsigned char)RcEntryKind::Colon) return false;
+        if (!r.u8(mode) || !r.u8(recursive) || !r.u32(option) || option > optionCount) return false;
+        if (!readValue(r, entry.value)) return false;
+        if (!r.str(entry.from) || !r.str(entry.to) || !r.str(entry.keysFrom) || !r.str(entry.keysTo)) return false;
+        entry.kind = (RcEntryKind)kind;
+        entry.mode = (char)mode;
+        entry.recursive = recursive != 0;
+        entry.option = (OptionId)option;
+    }
+    if (!r.done()) return false;
+
+    for (RcSource& source : rc.sources) {
+        if (!fresh(source, restamp)) return false;
+    }
+    return true;
+}
+
+bool RcCache::write(const std::string& cachePath, const CompiledRc& rc) {
+    Writer w;
+    for (char c : CACHE_MAGIC) w.u8((unsigned char)c);
+    w.u32(CACHE_VERSION);
+    w.u32((unsigned int)OptionId::Count);
+
+    w.u32((unsigned int)rc.sources.size());
+    for (const RcSource& source : rc.sources) {
+        w.str(source.path);
+        w.u64(source.writeTime);
+        w.u64(source.size);
+        w.u64(source.hash);
+        w.u8(source.exists ? 1 : 0);
+    }
+
+    w.u32((unsigned int)rc.entries.size());
+    for (const RcEntry& entry : rc.entries) {
+        w.u8((unsigned char)entry.kind);
+        w.u8((unsigned char)entry.mode);
+        w.u8(entry.recursive ? 1 : 0);
+        w.u32((unsigned int)entry.option);
+        writeValue(w, entry.value);
+        w.str(entry.from);
+        w.str(entry.to);
+        w.str(entry.keysFrom);
+        w.str(entry.keysTo);
+    }
+
+    // Written aside and moved over, so a reader never sees half a cache.
+    std::string tempPath = cachePath + ".tmp";
+    {
+        std::ofstream file(tempPath, std::ios::binary | std::ios::trunc);
+        if (!file.is_open()) return false;
+        file.write(w.data.data(), (std::streamsize)w.data.size());
+        if (!file) return false;
+    }
+    return MoveFileExA(tempPath.c_str(), cachePath.c_str(), MOVEFILE_REPLACE_EXISTING) != FALSE;
+}
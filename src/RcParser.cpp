@@ -7,6 +7,7 @@
 #include <fstream>
 #include <sstream>
 #include <algorithm>
+#include <map>
 
 RcParser& RcParser::getInstance() {
     static RcParser instance;
@@ -25,23 +26,110 @@ bool RcParser::isComment(const std::string& line) {
     return line[0] == '"' || line[0] == '#';
 }
 
-bool RcParser::parseFile(const std::string& path, HWND hwndEdit) {
-    std::ifstream file(path);
-    if (!file.is_open()) return false;
+// Sourced files may source others; this stops a file that sources itself.
+static const int MAX_SOURCE_DEPTH = 16;
+
+static const char* modesOf(const RcEntry& entry) {
+    switch (entry.mode) {
+    case 'n': return "n";
+    case 'i': return "i";
+    case 'v': return "v";
+    default: return "nvi";
+    }
+}
+
+static Keymap* keymapFor(char mode) {
+    switch (mode) {
+    case 'n': return g_normalKeymap.get();
+    case 'i': return g_insertKeymap.get();
+    case 'v': return g_visualKeymap.get();
+    }
+    return nullptr;
+}
+
+static MappingMode mappingModeOf(const RcEntry& entry) {
+    switch (entry.mode) {
+    case 'n': return MappingMode::Normal;
+    case 'i': return MappingMode::Insert;
+    case 'v': return MappingMode::Visual;
+    default: return MappingMode::All;
+    }
+}
+
+static void applyToKeymap(Keymap* keymap, const RcEntry& entry) {
+    if (!keymap) return;
+    if (entry.kind == RcEntryKind::Map) keymap->addMapping(entry.keysFrom, entry.keysTo, entry.recursive);
+    else keymap->removeMapping(entry.keysFrom);
+}
+
+bool RcParser::compileFile(const std::string& path, CompiledRc& rc, int depth) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file.is_open()) {
+        rc.sources.push_back(RcCache::describe(path, nullptr));
+        return false;
+    }
+    std::ostringstream content;
+    content << file.rdbuf();
+    std::string text = content.str();
+    rc.sources.push_back(RcCache::describe(path, &text));
 
+    std::istringstream lines(text);
     std::string line;
-    while (std::getline(file, line)) {
-        executeLine(line, hwndEdit);
+    while (std::getline(lines, line)) {
+        compileLine(line, rc, depth);
     }
     return true;
 }
 
+bool RcParser::parseFile(const std::string& path, HWND hwndEdit) {
+    CompiledRc rc;
+    if (!compileFile(path, rc, 0)) return false;
+
+    // Each option's side effects run once, after the whole file.
+    OptionBatch batch;
+    for (const RcEntry& entry : rc.entries) {
+        apply(entry, hwndEdit);
+    }
+    return true;
+}
+
+bool RcParser::loadRc(const std::string& path, HWND hwndEdit) {
+    std::string cachePath = ConfigManager::getInstance().getRcCachePath();
+    CompiledRc next;
+    bool restamp = false;
+    bool found = true;
+    if (RcCache::read(cachePath, path, next, restamp)) {
+        if (restamp) RcCache::write(cachePath, next);
+    } else {
+        next = CompiledRc();
+        found = compileFile(path, next, 0);
+        if (found) RcCache::write(cachePath, next);
+    }
+
+    OptionBatch batch;
+    applyChanges(next, hwndEdit);
+    loaded = std::move(next);
+    return found;
+}
+
 #include "../include/CommandMode.h"
 extern CommandMode* g_commandMode;
 
 bool RcParser::executeLine(const std::string& line, HWND hwndEdit) {
+    CompiledRc rc;
+    compileLine(line, rc, 0);
+
+    bool handled = true;
+    OptionBatch batch;
+    for (const RcEntry& entry : rc.entries) {
+        if (!apply(entry, hwndEdit)) handled = false;
+    }
+    return handled;
+}
+
+void RcParser::compileLine(const std::string& line, CompiledRc& rc, int depth) {
     std::string s = trim(line);
-    if (isComment(s)) return true;
+    if (isComment(s)) return;
 
     std::stringstream ss(s);
     std::string cmd;
@@ -52,33 +140,153 @@ bool RcParser::executeLine(const std::string& line, HWND hwndEdit) {
     args = trim(args);
 
     if (cmd == "set") {
-        handleSet(args);
+        handleSet(args, rc);
     } else if (cmd == "map" || cmd == "nmap" || cmd == "imap" || cmd == "vmap" ||
                cmd == "noremap" || cmd == "nnoremap" || cmd == "inoremap" || cmd == "vnoremap") {
-        handleMapping(cmd, args);
+        handleMapping(cmd, args, rc);
     } else if (cmd == "unmap" || cmd == "nunmap" || cmd == "iunmap" || cmd == "vunmap") {
-        handleUnmapping(cmd, args);
+        handleUnmapping(cmd, args, rc);
     } else if (cmd == "source" || cmd == "so") {
-        handleSource(args, hwndEdit);
+        handleSource(args, rc, depth);
     } else if (cmd == "command" || cmd == "com") {
-        handleCommandDefinition(args);
+        handleCommandDefinition(args, rc);
     } else {
-        // Try as a colon command
-        if (g_commandMode) {
-            std::string c = s;
-            if (!c.empty() && c[0] == ':') c = c.substr(1);
-            g_commandMode->handleColonCommand(hwndEdit, c);
-            return true;
-        }
-        return false;
+        // Run as a colon command when applied
+        RcEntry entry;
+        entry.kind = RcEntryKind::Colon;
+        entry.from = s;
+        if (!entry.from.empty() && entry.from[0] == ':') entry.from = entry.from.substr(1);
+        rc.entries.push_back(entry);
     }
+}
 
+bool RcParser::apply(const RcEntry& entry, HWND hwndEdit) {
+    switch (entry.kind) {
+    case RcEntryKind::Option:
+        OptionRegistry::getInstance().setOption(entry.option, entry.value);
+        break;
+    case RcEntryKind::Map:
+        for (const char* mode = modesOf(entry); *mode; mode++) applyToKeymap(keymapFor(*mode), entry);
+        MappingManager::getInstance().addMapping(mappingModeOf(entry), entry.from, entry.to, entry.recursive);
+        break;
+    case RcEntryKind::Unmap:
+        for (const char* mode = modesOf(entry); *mode; mode++) applyToKeymap(keymapFor(*mode), entry);
+        MappingManager::getInstance().removeMapping(mappingModeOf(entry), entry.from);
+        break;
+    case RcEntryKind::Command:
+        CommandMode::addUserCommand(entry.from, entry.to);
+        break;
+    case RcEntryKind::Colon:
+        if (!g_commandMode) return false;
+        g_commandMode->handleColonCommand(hwndEdit, entry.from);
+        break;
+    }
     return true;
 }
 
-#include "../include/CommandMode.h"
+// Where a sequence of entries leaves the options, each keymap and the user
+// commands, as the entry that decides each of them.
+struct RcState {
+    std::map<OptionId, const RcEntry*> options;
+    std::map<std::pair<char, std::string>, const RcEntry*> mappings;
+    std::map<std::string, const RcEntry*> commands;
+    std::vector<std::string> colon;
+};
 
-void RcParser::handleCommandDefinition(const std::string& args) {
+static void finalState(const CompiledRc& rc, RcState& state) {
+    for (const RcEntry& entry : rc.entries) {
+        switch (entry.kind) {
+        case RcEntryKind::Option:
+            state.options[entry.option] = &entry;
+            break;
+        case RcEntryKind::Map:
+        case RcEntryKind::Unmap:
+            for (const char* mode = modesOf(entry); *mode; mode++) state.mappings[{ *mode, entry.keysFrom }] = &entry;
+            break;
+        case RcEntryKind::Command:
+            state.commands[entry.from] = &entry;
+            break;
+        case RcEntryKind::Colon:
+            state.colon.push_back(entry.from);
+            break;
+        }
+    }
+}
+
+static bool sameMapping(const RcEntry* a, const RcEntry* b) {
+    return a->kind == b->kind && a->keysTo == b->keysTo && a->recursive == b->recursive;
+}
+
+void RcParser::applyChanges(const CompiledRc& next, HWND hwndEdit) {
+    RcState before, after;
+    finalState(loaded, before);
+    finalState(next, after);
+
+    // What the file no longer sets goes back first; it has no place in the
+    // order below. Options the file still sets keep their value for now.
+    OptionRegistry& registry = OptionRegistry::getInstance();
+    std::vector<OptionAssignment> kept;
+    for (const auto& [id, entry] : after.options) kept.emplace_back(id, registry.value(id));
+    registry.applyConfiguration(kept);
+
+    bool mappingsChanged = false;
+    for (const auto& [key, entry] : before.mappings) {
+        if (after.mappings.count(key)) continue;
+        if (Keymap* keymap = keymapFor(key.first)) keymap->restoreMapping(key.second);
+        mappingsChanged = true;
+    }
+    for (const auto& [alias, entry] : before.commands) {
+        if (!after.commands.count(alias)) CommandMode::removeUserCommand(alias);
+    }
+
+    // The rest in source order, so a colon command sees what the lines above
+    // it set and the lines below can override what it did. Only the entry
+    // deciding a setting is applied, and only if the setting changed; what a
+    // colon command did cannot be undone, so they only run again when they
+    // changed.
+    bool colonChanged = (after.colon != before.colon);
+    for (const RcEntry& entry : next.entries) {
+        switch (entry.kind) {
+        case RcEntryKind::Option:
+            if (after.options[entry.option] == &entry && registry.value(entry.option) != entry.value) {
+                registry.setOption(entry.option, entry.value);
+            }
+            break;
+        case RcEntryKind::Map:
+        case RcEntryKind::Unmap:
+            for (const char* mode = modesOf(entry); *mode; mode++) {
+                std::pair<char, std::string> key(*mode, entry.keysFrom);
+                if (after.mappings[key] != &entry) continue;
+                auto old = before.mappings.find(key);
+                if (old != before.mappings.end() && sameMapping(old->second, &entry)) continue;
+                applyToKeymap(keymapFor(*mode), entry);
+                mappingsChanged = true;
+            }
+            break;
+        case RcEntryKind::Command: {
+            if (after.commands[entry.from] != &entry) break;
+            auto old = before.commands.find(entry.from);
+            if (old == before.commands.end() || old->second->to != entry.to) CommandMode::addUserCommand(entry.from, entry.to);
+            break;
+        }
+        case RcEntryKind::Colon:
+            if (colonChanged) apply(entry, hwndEdit);
+            break;
+        }
+    }
+
+    if (mappingsChanged) {
+        // The listing is keyed by the text as written; rebuild it whole.
+        MappingManager& manager = MappingManager::getInstance();
+        manager.clearMappings();
+        for (const RcEntry& entry : next.entries) {
+            if (entry.kind == RcEntryKind::Map) manager.addMapping(mappingModeOf(entry), entry.from, entry.to, entry.recursive);
+            else if (entry.kind == RcEntryKind::Unmap) manager.removeMapping(mappingModeOf(entry), entry.from);
+        }
+    }
+}
+
+void RcParser::handleCommandDefinition(const std::string& args, CompiledRc& rc) {
     std::stringstream ss(args);
     std::string alias, target;
     ss >> alias;
@@ -86,17 +294,27 @@ void RcParser::handleCommandDefinition(const std::string& args) {
     target = trim(target);
 
     if (!alias.empty() && !target.empty()) {
-        CommandMode::addUserCommand(alias, target);
+        RcEntry entry;
+        entry.kind = RcEntryKind::Command;
+        entry.from = alias;
+        entry.to = target;
+        rc.entries.push_back(entry);
     }
 }
 
-void RcParser::handleSet(const std::string& args) {
-    OptionRegistry::getInstance().setOptionFromString(args);
+void RcParser::handleSet(const std::string& args, CompiledRc& rc) {
+    std::vector<OptionAssignment> assignments;
+    OptionRegistry::getInstance().parseAssignments(args, assignments);
+    for (const auto& assignment : assignments) {
+        RcEntry entry;
+        entry.kind = RcEntryKind::Option;
+        entry.option = assignment.first;
+        entry.value = assignment.second;
+        rc.entries.push_back(entry);
+    }
 }
 
-void RcParser::handleMapping(const std::string& cmd, const std::string& args) {
-    bool recursive = (cmd.find("nore") == std::string::npos);
-    
+void RcParser::handleMapping(const std::string& cmd, const std::string& args, CompiledRc& rc) {
     std::stringstream ss(args);
     std::string from, to;
     ss >> from;
@@ -105,54 +323,34 @@ void RcParser::handleMapping(const std::string& cmd, const std::string& args) {
 
     if (from.empty() || to.empty()) return;
 
-    std::string transFrom = Utils::translateKeyNotation(from);
-    std::string transTo = Utils::translateKeyNotation(to);
-
-    if (cmd == "map" || cmd == "noremap") {
-        if (g_normalKeymap) g_normalKeymap->addMapping(transFrom, transTo, recursive);
-        if (g_visualKeymap) g_visualKeymap->addMapping(transFrom, transTo, recursive);
-        if (g_insertKeymap) g_insertKeymap->addMapping(transFrom, transTo, recursive);
-    } else if (cmd == "nmap" || cmd == "nnoremap") {
-        if (g_normalKeymap) g_normalKeymap->addMapping(transFrom, transTo, recursive);
-    } else if (cmd == "imap" || cmd == "inoremap") {
-        if (g_insertKeymap) g_insertKeymap->addMapping(transFrom, transTo, recursive);
-    } else if (cmd == "vmap" || cmd == "vnoremap") {
-        if (g_visualKeymap) g_visualKeymap->addMapping(transFrom, transTo, recursive);
-    }
-    
-    // Also store in MappingManager for listing
-    MappingMode mode = MappingMode::All;
-    if (cmd[0] == 'n') mode = MappingMode::Normal;
-    else if (cmd[0] == 'i') mode = MappingMode::Insert;
-    else if (cmd[0] == 'v') mode = MappingMode::Visual;
-    MappingManager::getInstance().addMapping(mode, from, to, recursive);
-}
-
-void RcParser::handleUnmapping(const std::string& cmd, const std::string& args) {
+    RcEntry entry;
+    entry.kind = RcEntryKind::Map;
+    entry.recursive = (cmd.find("nore") == std::string::npos);
+    if (cmd == "nmap" || cmd == "nnoremap") entry.mode = 'n';
+    else if (cmd == "imap" || cmd == "inoremap") entry.mode = 'i';
+    else if (cmd == "vmap" || cmd == "vnoremap") entry.mode = 'v';
+    entry.from = from;
+    entry.to = to;
+    entry.keysFrom = Utils::translateKeyNotation(from);
+    entry.keysTo = Utils::translateKeyNotation(to);
+    rc.entries.push_back(entry);
+}
+
+void RcParser::handleUnmapping(const std::string& cmd, const std::string& args, CompiledRc& rc) {
     std::string from = trim(args);
     if (from.empty()) return;
 
-    std::string transFrom = Utils::translateKeyNotation(from);
-
-    if (cmd == "unmap") {
-        if (g_normalKeymap) g_normalKeymap->removeMapping(transFrom);
-        if (g_visualKeymap) g_visualKeymap->removeMapping(transFrom);
-        if (g_insertKeymap) g_insertKeymap->removeMapping(transFrom);
-    } else if (cmd == "nunmap") {
-        if (g_normalKeymap) g_normalKeymap->removeMapping(transFrom);
-    } else if (cmd == "iunmap") {
-        if (g_insertKeymap) g_insertKeymap->removeMapping(transFrom);
-    } else if (cmd == "vunmap") {
-        if (g_visualKeymap) g_visualKeymap->removeMapping(transFrom);
-    }
-    
-    MappingMode mode = MappingMode::All;
-    if (cmd[0] == 'n') mode = MappingMode::Normal;
-    else if (cmd[0] == 'i') mode = MappingMode::Insert;
-    else if (cmd[0] == 'v') mode = MappingMode::Visual;
-    MappingManager::getInstance().removeMapping(mode, from);
-}
-
-void RcParser::handleSource(const std::string& path, HWND hwndEdit) {
-    parseFile(path, hwndEdit);
+    RcEntry entry;
+    entry.kind = RcEntryKind::Unmap;
+    if (cmd == "nunmap") entry.mode = 'n';
+    else if (cmd == "iunmap") entry.mode = 'i';
+    else if (cmd == "vunmap") entry.mode = 'v';
+    entry.from = from;
+    entry.keysFrom = Utils::translateKeyNotation(from);
+    rc.entries.push_back(entry);
+}
+
+void RcParser::handleSource(const std::string& path, CompiledRc& rc, int depth) {
+    if (depth >= MAX_SOURCE_DEPTH) return;
+    compileFile(path, rc, depth + 1);
 }
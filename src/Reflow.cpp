@@ -0,0 +1,378 @@
+#include "../include/Reflow.h"
+#include "../include/OptionRegistry.h"
+#include "../include/Utils.h"
+#include "../plugin/Scintilla.h"
+#include <algorithm>
+#include <cstring>
+#include <string_view>
+#include <vector>
+
+namespace {
+
+enum LineKind { LINE_TEXT, LINE_EMPTY, LINE_VERBATIM };
+
+struct Line {
+    LineKind kind;
+    size_t begin;
+    size_t end;         // before the EOL
+    size_t leader;      // after the indent
+    size_t leaderEnd;   // == leader when there is no comment leader
+    size_t body;        // after the leader and its blanks
+    size_t marker;      // after a list marker and its blanks; == body if none
+};
+
+bool isBlank(char c) { return c == ' ' || c == '\t'; }
+bool isDigit(char c) { return c >= '0' && c <= '9'; }
+
+class Filler {
+public:
+    Filler(const std::string& text, const Reflow::Settings& s, std::string& out, size_t cursor)
+        : text(text), s(s), out(out), cursor(cursor) {}
+
+    size_t cursorOut = std::string::npos;
+
+    size_t skipBlanks(size_t i, size_t end) const {
+        while (i < end && isBlank(text[i])) i++;
+        return i;
+    }
+
+    bool startsWith(size_t i, size_t end, const char* s) const {
+        size_t n = strlen(s);
+        return end - i >= n && text.compare(i, n, s) == 0;
+    }
+
+    bool contains(size_t i, size_t end, const char* s) const {
+        return std::string_view(text).substr(i, end - i).find(s) != std::string_view::npos;
+    }
+
+    int columns(size_t from, size_t to, int col = 0) const {
+        for (size_t i = from; i < to; i++) {
+            char c = text[i];
+            if (c == '\t') col = (col / s.tabWidth + 1) * s.tabWidth;
+            else if (!s.utf8 || ((unsigned char)c & 0xC0) != 0x80) col++;
+        }
+        return col;
+    }
+
+    // ---, ===, ***, ////// and the like.
+    bool isRule(size_t i, size_t end) const {
+        char c = text[i];
+        if (!strchr("-=_*~#/+", c)) return false;
+        int count = 0;
+        for (; i < end; i++) {
+            if (isBlank(text[i])) continue;
+            if (text[i] != c) return false;
+            count++;
+        }
+        return count >= 3;
+    }
+
+    size_t leaderLength(size_t i, size_t end, bool inBlock) const {
+        if (inBlock && text[i] == '*') return 1;
+        if (text[i] == '>') {
+            size_t j = i;
+            while (j < end && text[j] == '>') {
+                j++;
+                size_t k = skipBlanks(j, end);
+                if (k < end && text[k] == '>') j = k;
+            }
+            return j - i;
+        }
+        for (const char* leader : { "///", "//!", "//" })
+            if (startsWith(i, end, leader)) return strlen(leader);
+
+        size_t n = 0;
+        if (text[i] == '#') {
+            while (i + n < end && text[i + n] == '#') n++;
+        } else {
+            for (const char* leader : { "--", ";;", ";", "%" }) {
+                if (startsWith(i, end, leader)) {
+                    n = strlen(leader);
+                    break;
+                }
+            }
+        }
+        return n && (i + n == end || isBlank(text[i + n])) ? n : 0;
+    }
+
+    size_t listMarker(size_t b, size_t end) const {
+        size_t k = b;
+        if (text[b] == '-' || text[b] == '*' || text[b] == '+') {
+            k = b + 1;
+        } else if (isDigit(text[b])) {
+            while (k < end && isDigit(text[k]) && k - b < 9) k++;
+            if (k == end || (text[k] != '.' && text[k] != ')')) return b;
+            k++;
+        } else {
+            return b;
+        }
+        if (k == end || !isBlank(text[k])) return b;
+        size_t m = skipBlanks(k, end);
+        return m == end ? b : m;
+    }
+
+    Line classify(size_t begin, size_t end) {
+        size_t i = skipBlanks(begin, end);
+        Line l = { LINE_VERBATIM, begin, end, i, i, i, i };
+
+        if (i == end) {
+            l.kind = LINE_EMPTY;
+            return l;
+        }
+        if (fence) {
+            if (startsWith(i, end, fence)) fence = nullptr;
+            return l;
+        }
+        if (startsWith(i, end, "```") || startsWith(i, end, "~~~")) {
+            fence = text[i] == '`' ? "```" : "~~~";
+            return l;
+        }
+        if (startsWith(i, end, "/*")) {
+            inBlock = !contains(i + 2, end, "*/");
+            return l;
+        }
+        if (inBlock && contains(i, end, "*/")) {
+            inBlock = false;
+            return l;
+        }
+        if (isRule(i, end)) return l;
+
+        l.leaderEnd = i + leaderLength(i, end, inBlock);
+        l.body = l.marker = skipBlanks(l.leaderEnd, end);
+        if (l.body == end) {
+            l.kind = LINE_EMPTY;
+        } else if (l.leaderEnd == i || !isRule(l.body, end)) {
+            l.kind = LINE_TEXT;
+            l.marker = listMarker(l.body, end);
+        }
+        return l;
+    }
+
+    bool sameSpan(size_t a, size_t aEnd, size_t b, size_t bEnd) const {
+        return aEnd - a == bEnd - b && text.compare(a, aEnd - a, text, b, bEnd - b) == 0;
+    }
+
+    bool joins(const Line& l) const {
+        if (l.marker != l.body) return false;
+        if (!sameSpan(l.leader, l.leaderEnd, head.leader, head.leaderEnd)) return false;
+        if (list) return columns(l.begin, l.body) > columns(head.begin, head.body);
+        if (l.leaderEnd != l.leader) return sameSpan(l.begin, l.leader, head.begin, head.leader);
+        return true;
+    }
+
+    void newLine() {
+        if (started) out += s.eol;
+        started = true;
+    }
+
+    void line(const Line& l, size_t next) {
+        bool hasCursor = cursor >= l.begin && cursor < next;
+        if (l.kind != LINE_TEXT) {
+            flush();
+            newLine();
+            if (hasCursor) cursorOut = out.size() + (std::min)(cursor - l.begin, l.end - l.begin);
+            out.append(text, l.begin, l.end - l.begin);
+            return;
+        }
+
+        if (open && joins(l)) {
+            if (!list && !second) {
+                cont.assign(text, l.begin, l.body - l.begin);
+                contWidth = columns(l.begin, l.body);
+            }
+            second = true;
+        } else {
+            flush();
+            open = true;
+            second = false;
+            head = l;
+            list = l.marker != l.body;
+            first.assign(text, l.begin, l.marker - l.begin);
+            firstWidth = columns(l.begin, l.marker);
+            cont.assign(text, l.begin, l.body - l.begin);
+            contWidth = columns(l.begin, l.body);
+            if (list) {
+                cont.append(firstWidth - contWidth, ' ');
+                contWidth = firstWidth;
+            }
+        }
+
+        size_t firstWord = words.size();
+        for (size_t i = l.marker; i < l.end;) {
+            size_t start = i;
+            int width = 0;
+            for (; i < l.end && !isBlank(text[i]); i++)
+                if (!s.utf8 || ((unsigned char)text[i] & 0xC0) != 0x80) width++;
+            words.push_back({ start, i - start, width });
+            if (hasCursor && cursorWord == std::string::npos && cursor < i) {
+                cursorWord = words.size() - 1;
+                cursorOffset = cursor > start ? cursor - start : 0;
+            }
+            i = skipBlanks(i, l.end);
+        }
+        if (hasCursor && cursorWord == std::string::npos && words.size() > firstWord) {
+            cursorWord = words.size() - 1;
+            cursorOffset = words.back().len;
+        }
+    }
+
+    void flush() {
+        if (!open) return;
+        open = false;
+
+        int firstAvail = (std::max)(s.width - firstWidth, 1);
+        int contAvail = (std::max)(s.width - contWidth, 1);
+        if (s.optimal) breakOptimal(firstAvail, contAvail);
+        else breakGreedy(firstAvail, contAvail);
+
+        for (size_t k = 0; k + 1 < breaks.size(); k++) {
+            newLine();
+            out += k == 0 ? first : cont;
+            for (size_t w = breaks[k]; w < breaks[k + 1]; w++) {
+                if (w > breaks[k]) out += ' ';
+                if (w == cursorWord) cursorOut = out.size() + cursorOffset;
+                out.append(text, words[w].pos, words[w].len);
+            }
+        }
+        words.clear();
+        cursorWord = std::string::npos;
+    }
+
+private:
+    struct Word {
+        size_t pos;
+        size_t len;
+        int width;
+    };
+
+    const std::string& text;
+    const Reflow::Settings& s;
+    std::string& out;
+    size_t cursor;
+
+    const char* fence = nullptr;
+    bool inBlock = false;
+    bool started = false;
+
+    bool open = false;
+    bool second = false;
+    bool list = false;
+    Line head = {};
+    std::string first;
+    std::string cont;
+    int firstWidth = 0;
+    int contWidth = 0;
+    std::vector<Word> words;
+    std::vector<size_t> breaks;     // where each output line starts, then words.size()
+    std::vector<long long> cost;
+    std::vector<size_t> from;
+    size_t cursorWord = std::string::npos;
+    size_t cursorOffset = 0;
+
+    void breakGreedy(int firstAvail, int contAvail) {
+        breaks.assign(1, 0);
+        int used = words[0].width;
+        for (size_t i = 1; i < words.size(); i++) {
+            int avail = breaks.size() == 1 ? firstAvail : contAvail;
+            if (used + 1 + words[i].width > avail) {
+                breaks.push_back(i);
+                used = words[i].width;
+            } else {
+                used += 1 + words[i].width;
+            }
+        }
+        breaks.push_back(words.size());
+    }
+
+    // Minimum raggedness: the sum of the squared space left at the end of
+    // every line but the last is the least possible. A word too long for
+    // any line gets one to itself.
+    void breakOptimal(int firstAvail, int contAvail) {
+        size_t n = words.size();
+        int widest = (std::max)(firstAvail, contAvail);
+        cost.assign(n + 1, 0);
+        from.assign(n + 1, 0);
+
+        for (size_t j = 1; j <= n; j++) {
+            long long best = -1;
+            long long used = -1;
+            for (size_t i = j; i-- > 0;) {
+                used += 1 + words[i].width;
+                int avail = i == 0 ? firstAvail : contAvail;
+                if (used > avail && i + 1 < j) {
+                    if (used > widest) break;
+                    continue;
+                }
+                long long slack = used > avail ? 0 : avail - used;
+                long long total = cost[i] + (j == n ? 0 : slack * slack);
+                if (best < 0 || total < best) {
+                    best = total;
+                    from[j] = i;
+                }
+            }
+            cost[j] = best;
+        }
+
+        breaks.assign(1, n);
+        for (size_t j = n; j > 0; j = from[j]) breaks.push_back(from[j]);
+        std::reverse(breaks.begin(), breaks.end());
+    }
+};
+
+}
+
+std::string Reflow::format(const std::string& text, const Settings& settings, size_t* cursor) {
+    std::string out;
+    out.reserve(text.size() + text.size() / 16 + 16);
+    Filler filler(text, settings, out, cursor ? *cursor : std::string::npos);
+
+    for (size_t pos = 0;;) {
+        size_t end = pos;
+        while (end < text.size() && text[end] != '\n' && text[end] != '\r') end++;
+        size_t next = end + 1;
+        if (end < text.size() && text[end] == '\r' && next < text.size() && text[next] == '\n') next++;
+        filler.line(filler.classify(pos, end), next);
+        if (end == text.size()) break;
+        pos = next;
+    }
+    filler.flush();
+
+    if (cursor) *cursor = filler.cursorOut;
+    return out;
+}
+
+void Reflow::apply(HWND hwnd, int firstLine, int lastLine, int keepPos) {
+    if (firstLine > lastLine) std::swap(firstLine, lastLine);
+    firstLine = (std::max)(firstLine, 0);
+    lastLine = (std::min)(lastLine, Utils::lineCount(hwnd) - 1);
+    int start = Utils::lineStart(hwnd, firstLine);
+    int end = Utils::lineEnd(hwnd, lastLine);
+    std::string text = Utils::getTextRange(hwnd, start, end);
+
+    // As in Vim, 'textwidth' 0 falls back to the margin, then to 79.
+    Settings settings;
+    settings.width = Options::textwidth.get();
+    if (settings.width <= 0 && ::SendMessage(hwnd, SCI_GETEDGEMODE, 0, 0) != EDGE_NONE)
+        settings.width = (int)::SendMessage(hwnd, SCI_GETEDGECOLUMN, 0, 0);
+    if (settings.width <= 0) settings.width = 79;
+    settings.tabWidth = (std::max)((int)::SendMessage(hwnd, SCI_GETTABWIDTH, 0, 0), 1);
+    settings.optimal = Options::optimalbreak.get();
+    settings.utf8 = ::SendMessage(hwnd, SCI_GETCODEPAGE, 0, 0) == SC_CP_UTF8;
+    settings.eol = Utils::eolString(hwnd);
+
+    size_t cursor = (size_t)((std::min)((std::max)(keepPos, start), end) - start);
+    std::string out = format(text, settings, &cursor);
+    if (out != text) {
+        ::SendMessage(hwnd, SCI_SETTARGETRANGE, start, end);
+        ::SendMessage(hwnd, SCI_REPLACETARGETMINIMAL, out.size(), (LPARAM)out.data());
+    }
+
+    int pos;
+    if (keepPos >= 0) {
+        pos = start + (cursor == std::string::npos ? 0 : (int)cursor);
+    } else {
+        int line = Utils::lineFromPosition(hwnd, start + (int)out.size());
+        pos = (int)::SendMessage(hwnd, SCI_GETLINEINDENTPOSITION, line, 0);
+    }
+    ::SendMessage(hwnd, SCI_SETEMPTYSELECTION, pos, 0);
+}
@@ -0,0 +1,89 @@
+#include "../include/Registers.h"
+
+RegisterStore& RegisterStore::getInstance() {
+    static RegisterStore instance;
+    return instance;
+}
+
+RegisterStore::Slot& RegisterStore::slotFor(char reg) {
+    if (reg >= '1' && reg <= '9') {
+        return numbered[(numberedHead + (reg - '1')) % NUMBERED_COUNT];
+    }
+    return slots[(unsigned char)reg];
+}
+
+const RegisterStore::Slot& RegisterStore::slotFor(char reg) const {
+    if (reg >= '1' && reg <= '9') {
+        return numbered[(numberedHead + (reg - '1')) % NUMBERED_COUNT];
+    }
+    return slots[(unsigned char)reg];
+}
+
+void RegisterStore::set(char reg, std::string text) {
+    set(reg, std::make_shared<const std::string>(std::move(text)));
+}
+
+void RegisterStore::set(char reg, const RegisterText& text) {
+    Slot& slot = slotFor(reg);
+    slot.chunks.clear();
+    slot.length = 0;
+    if (text && !text->empty()) {
+        slot.chunks.push_back(text);
+        slot.length = text->size();
+    }
+}
+
+void RegisterStore::append(char reg, const std::string& text) {
+    if (text.empty()) return;
+    Slot& slot = slotFor(reg);
+    slot.chunks.push_back(std::make_shared<const std::string>(text));
+    slot.length += text.size();
+}
+
+RegisterText RegisterStore::get(char reg) {
+    Slot& slot = slotFor(reg);
+    if (slot.chunks.empty()) return nullptr;
+    if (slot.chunks.size() == 1) return slot.chunks.front();
+
+    std::string joined;
+    joined.reserve(slot.length);
+    for (const auto& chunk : slot.chunks) {
+        joined += *chunk;
+    }
+    RegisterText flat = std::make_shared<const std::string>(std::move(joined));
+    slot.chunks.assign(1, flat);
+    return flat;
+}
+
+std::string_view RegisterStore::view(char reg) {
+    RegisterText text = get(reg);
+    if (!text) return {};
+    // The slot keeps the block alive until the register is overwritten.
+    return std::string_view(*text);
+}
+
+bool RegisterStore::empty(char reg) const {
+    return slotFor(reg).length == 0;
+}
+
+size_t RegisterStore::size(char reg) const {
+    return slotFor(reg).length;
+}
+
+void RegisterStore::shiftNumbered(const RegisterText& text) {
+    // Moving the head back makes the old "9 slot the new "1.
+    numberedHead = (numberedHead + NUMBERED_COUNT - 1) % NUMBERED_COUNT;
+    set('1', text);
+}
+
+void RegisterStore::clear() {
+    for (auto& slot : slots) {
+        slot.chunks.clear();
+        slot.length = 0;
+    }
+    for (auto& slot : numbered) {
+        slot.chunks.clear();
+        slot.length = 0;
+    }
+    numberedHead = 0;
+}
@@ -1,6 +1,10 @@
 // TextObject.cpp
 #include "../include/TextObject.h"
 #include "../include/Utils.h"
+#include "../include/BracketIndex.h"
+#include "../include/CharClass.h"
+#include "../include/Reflow.h"
+#include "../include/Indent.h"
 #include "../include/NormalMode.h"
 #include "../include/VisualMode.h"
 #include "../plugin/Scintilla.h"
@@ -90,16 +94,16 @@ void TextObject::apply(HWND hwndEdit, VimState& state, char op, char modifier, c
     }
 
     if (bracketChar != 0) {
-        char openChar, closeChar;
+        char openChar;
         switch (bracketChar) {
-        case '(': case ')': openChar = '('; closeChar = ')'; break;
-        case '[': case ']': openChar = '['; closeChar = ']'; break;
-        case '{': case '}': openChar = '{'; closeChar = '}'; break;
-        case '<': case '>': openChar = '<'; closeChar = '>'; break;
+        case '(': case ')': openChar = '('; break;
+        case '[': case ']': openChar = '['; break;
+        case '{': case '}': openChar = '{'; break;
+        case '<': case '>': openChar = '<'; break;
         default: return;
         }
 
-        auto bounds = findBracketBounds(hwndEdit, (int)::SendMessage(hwndEdit, SCI_GETCURRENTPOS, 0, 0), openChar, closeChar, inner);
+        auto bounds = findBracketBounds(hwndEdit, (int)::SendMessage(hwndEdit, SCI_GETCURRENTPOS, 0, 0), openChar, inner);
         if (bounds.first < bounds.second) {
             executeTextObjectOperation(hwndEdit, state, op, bounds.first, bounds.second, count);
             record();
@@ -121,15 +125,10 @@ std::pair<int, int> TextObject::getTextObjectBounds(HWND hwndEdit, TextObjectTyp
     
     switch (objType) {
     case TEXT_OBJECT_WORD:
-        bounds = Utils::findWordBounds(hwndEdit, pos);
-        bounds = inner ? trimWhitespaceBounds(hwndEdit, bounds) : expandToWordBoundaries(hwndEdit, bounds);
+        bounds = findWordBounds(hwndEdit, pos, inner, count, false);
         break;
     case TEXT_OBJECT_BIG_WORD:
-        bounds = std::make_pair(
-            (int)::SendMessage(hwndEdit, SCI_WORDSTARTPOSITION, pos, 1),
-            (int)::SendMessage(hwndEdit, SCI_WORDENDPOSITION, pos, 1)
-        );
-        bounds = inner ? trimWhitespaceBounds(hwndEdit, bounds) : expandToWordBoundaries(hwndEdit, bounds);
+        bounds = findWordBounds(hwndEdit, pos, inner, count, true);
         break;
     case TEXT_OBJECT_SENTENCE:
         bounds = findSentenceBounds(hwndEdit, pos, inner);
@@ -138,16 +137,16 @@ std::pair<int, int> TextObject::getTextObjectBounds(HWND hwndEdit, TextObjectTyp
         bounds = findParagraphBounds(hwndEdit, pos, inner);
         break;
     case TEXT_OBJECT_PAREN:
-        bounds = findBracketBounds(hwndEdit, pos, '(', ')', inner);
+        bounds = findBracketBounds(hwndEdit, pos, '(', inner);
         break;
     case TEXT_OBJECT_BRACKET:
-        bounds = findBracketBounds(hwndEdit, pos, '[', ']', inner);
+        bounds = findBracketBounds(hwndEdit, pos, '[', inner);
         break;
     case TEXT_OBJECT_BRACE:
-        bounds = findBracketBounds(hwndEdit, pos, '{', '}', inner);
+        bounds = findBracketBounds(hwndEdit, pos, '{', inner);
         break;
     case TEXT_OBJECT_ANGLE:
-        bounds = findBracketBounds(hwndEdit, pos, '<', '>', inner);
+        bounds = findBracketBounds(hwndEdit, pos, '<', inner);
         break;
     default:
         bounds = { pos, pos };
@@ -164,58 +163,17 @@ std::pair<int, int> TextObject::getTextObjectBounds(HWND hwndEdit, TextObjectTyp
     return bounds;
 }
 
-std::pair<int, int> TextObject::findBracketBounds(HWND hwndEdit, int pos, char openChar, char closeChar, bool inner) {
-    int docLen = (int)::SendMessage(hwndEdit, SCI_GETTEXTLENGTH, 0, 0);
-    int line = ::SendMessage(hwndEdit, SCI_LINEFROMPOSITION, pos, 0);
-    int lineStart = ::SendMessage(hwndEdit, SCI_POSITIONFROMLINE, line, 0);
-    int lineEnd = ::SendMessage(hwndEdit, SCI_GETLINEENDPOSITION, line, 0);
-
-    int startPos = -1;
-    int endPos = -1;
-    int minDistance = docLen;
-
-    for (int searchStart = lineStart; searchStart <= lineEnd; searchStart++) {
-        char ch = (char)::SendMessage(hwndEdit, SCI_GETCHARAT, searchStart, 0);
-        if (ch != openChar) continue;
-
-        int bracketCount = 1;
-        int searchPos = searchStart + 1;
+std::pair<int, int> TextObject::findBracketBounds(HWND hwndEdit, int pos, char openChar, bool inner) {
+    BracketIndex& index = BracketIndex::getInstance();
+    BracketPair pair = index.enclosing(hwndEdit, pos, openChar);
+    if (!pair.valid()) pair = index.nearestOnLine(hwndEdit, pos, openChar);
 
-        while (searchPos < docLen && bracketCount > 0) {
-            char ch2 = (char)::SendMessage(hwndEdit, SCI_GETCHARAT, searchPos, 0);
-            if (ch2 == openChar) {
-                bracketCount++;
-            }
-            else if (ch2 == closeChar) {
-                bracketCount--;
-                if (bracketCount == 0) {
-                    if (pos >= searchStart && pos <= searchPos) {
-                        startPos = searchStart;
-                        endPos = searchPos;
-                        break;
-                    } else {
-                        int distance = (std::min)(abs(pos - searchStart), abs(pos - searchPos));
-                        if (distance < minDistance) {
-                            minDistance = distance;
-                            startPos = searchStart;
-                            endPos = searchPos;
-                        }
-                    }
-                    break;
-                }
-            }
-            searchPos++;
-        }
-
-        if (startPos != -1 && pos >= startPos && pos <= endPos) {
-            break;
-        }
-    }
-
-    if (startPos == -1 || endPos == -1) {
+    if (!pair.valid()) {
         return { pos, pos };
     }
 
+    int startPos = pair.open;
+    int endPos = pair.close;
     if (inner) {
         startPos++;
     }
@@ -226,99 +184,60 @@ std::pair<int, int> TextObject::findBracketBounds(HWND hwndEdit, int pos, char o
     return { startPos, endPos };
 }
 
-void TextObject::handleWordTextObject(HWND hwndEdit, VimState& state, char op, bool inner, int count, bool bigWord) {
-    int pos = (int)::SendMessage(hwndEdit, SCI_GETCURRENTPOS, 0, 0);
-    int docLen = (int)::SendMessage(hwndEdit, SCI_GETTEXTLENGTH, 0, 0);
-
-    if (pos >= docLen) return;
-
-    if (bigWord) {
-        int len = docLen;
-        int start = pos;
-        int end = pos;
-
-        auto is_space = [&](int p) {
-            return std::isspace((unsigned char)::SendMessage(hwndEdit, SCI_GETCHARAT, p, 0));
-        };
-
-        while (start > 0 && !is_space(start - 1))
-            start--;
-
-        end = start;
-        while (end < len && !is_space(end))
-            end++;
-
-        if (count > 1) {
-            int remaining = count - 1;
-            while (remaining > 0 && end < len) {
-                int temp = end;
-                while (temp < len && is_space(temp))
-                    temp++;
-                
-                if (temp >= len) break;
-                
-                while (temp < len && !is_space(temp))
-                    temp++;
-                
-                end = temp;
-                remaining--;
-            }
-        }
-
-        if (inner) {
-            while (start < end && is_space(start)) start++;
-            while (end > start && is_space(end - 1)) end--;
-        }
+// iw / aw and their WORD forms, within the caret's line. A count takes that
+// many runs for iw, where the blanks between words count too, and that many
+// words with their white space for aw. aw takes the white space after the
+// word, or before it when there is none after.
+std::pair<int, int> TextObject::findWordBounds(HWND hwndEdit, int pos, bool inner, int count, bool bigWord) {
+    CharClasses classes(hwndEdit);
+    ClassScanner scan(hwndEdit, classes);
+    int line = Utils::lineFromPosition(hwndEdit, pos);
+    int lineStart = Utils::lineStart(hwndEdit, line);
+    int lineEnd = Utils::lineEnd(hwndEdit, line);
+    if (pos >= lineEnd) return { pos, pos };
+
+    auto runOf = [&](int p) {
+        CharClass c = scan.at(p);
+        return (bigWord && c != CC_SPACE) ? CLASS_NONBLANK : classBit(c);
+    };
+    auto runEnd = [&](int p) {
+        return p < lineEnd ? scan.skipForward(p, runOf(p), lineEnd) : p;
+    };
+    auto isSpace = [&](int p) {
+        return p < lineEnd && scan.at(p) == CC_SPACE;
+    };
 
-        executeTextObjectOperation(hwndEdit, state, op, start, end, count);
-        return;
-    }
+    int start = scan.skipBackward(pos, runOf(pos), lineStart);
+    int end = runEnd(pos);
 
-    int start = (int)::SendMessage(hwndEdit, SCI_WORDSTARTPOSITION, pos, 0);
-    int end = (int)::SendMessage(hwndEdit, SCI_WORDENDPOSITION, pos, 0);
-    
-    if (start == end && pos < docLen) {
-        int nextPos = (int)::SendMessage(hwndEdit, SCI_POSITIONAFTER, pos, 0);
-        if (nextPos < docLen) {
-            start = (int)::SendMessage(hwndEdit, SCI_WORDSTARTPOSITION, nextPos, 0);
-            end = (int)::SendMessage(hwndEdit, SCI_WORDENDPOSITION, nextPos, 0);
-        }
+    if (inner) {
+        for (int i = 1; i < count && end < lineEnd; i++) end = runEnd(end);
+        return { start, end };
     }
 
-    if (inner) {
-        while (start < end && std::isspace((unsigned char)::SendMessage(hwndEdit, SCI_GETCHARAT, start, 0))) start++;
-        while (end > start && std::isspace((unsigned char)::SendMessage(hwndEdit, SCI_GETCHARAT, end - 1, 0))) end--;
+    if (isSpace(pos)) {
+        end = runEnd(end);
+    } else if (isSpace(end)) {
+        end = runEnd(end);
     } else {
-        int origStart = start;
-        int origEnd = end;
-        
-        while (start > 0 && std::isspace((unsigned char)::SendMessage(hwndEdit, SCI_GETCHARAT, start - 1, 0))) start--;
-        while (end < docLen && std::isspace((unsigned char)::SendMessage(hwndEdit, SCI_GETCHARAT, end, 0))) end++;
-        
-        if (start == origStart && end == origEnd && start > 0) {
-            while (start > 0 && std::isspace((unsigned char)::SendMessage(hwndEdit, SCI_GETCHARAT, start - 1, 0))) start--;
-        }
+        start = scan.skipBackward(start, classBit(CC_SPACE), lineStart);
     }
-
-    for (int i = 1; i < count; i++) {
-        int nextPos = end;
-        while (nextPos < docLen && std::isspace((unsigned char)::SendMessage(hwndEdit, SCI_GETCHARAT, nextPos, 0))) nextPos++;
-        if (nextPos >= docLen) break;
-        
-        int nextStart = (int)::SendMessage(hwndEdit, SCI_WORDSTARTPOSITION, nextPos, 0);
-        int nextEnd = (int)::SendMessage(hwndEdit, SCI_WORDENDPOSITION, nextPos, 0);
-        
-        if (nextStart >= nextEnd) break;
-        
-        end = nextEnd;
-        
-        if (!inner) {
-            while (end < docLen && std::isspace((unsigned char)::SendMessage(hwndEdit, SCI_GETCHARAT, end, 0))) end++;
+    for (int i = 1; i < count && end < lineEnd; i++) {
+        if (isSpace(end)) {
+            end = runEnd(runEnd(end));
+        } else {
+            end = runEnd(end);
+            if (isSpace(end)) end = runEnd(end);
         }
     }
+    return { start, end };
+}
 
-    if (start < end) {
-        executeTextObjectOperation(hwndEdit, state, op, start, end, count);
+void TextObject::handleWordTextObject(HWND hwndEdit, VimState& state, char op, bool inner, int count, bool bigWord) {
+    int pos = (int)::SendMessage(hwndEdit, SCI_GETCURRENTPOS, 0, 0);
+    auto bounds = findWordBounds(hwndEdit, pos, inner, count, bigWord);
+    if (bounds.first < bounds.second) {
+        executeTextObjectOperation(hwndEdit, state, op, bounds.first, bounds.second, count);
     }
 }
 
@@ -370,22 +289,6 @@ std::pair<int, int> TextObject::findTagBounds(HWND hwndEdit, int pos, bool inner
     return inner ? std::make_pair(tagStart + 1, tagEnd) : std::make_pair(tagStart, tagEnd + 1);
 }
 
-std::pair<int, int> TextObject::trimWhitespaceBounds(HWND hwndEdit, std::pair<int, int> bounds) {
-    int start = bounds.first, end = bounds.second;
-    int docLen = (int)::SendMessage(hwndEdit, SCI_GETTEXTLENGTH, 0, 0);
-    while (start < end && std::isspace((unsigned char)::SendMessage(hwndEdit, SCI_GETCHARAT, start, 0))) start++;
-    while (end > start && std::isspace((unsigned char)::SendMessage(hwndEdit, SCI_GETCHARAT, end - 1, 0))) end--;
-    return { start, end };
-}
-
-std::pair<int, int> TextObject::expandToWordBoundaries(HWND hwndEdit, std::pair<int, int> bounds) {
-    int start = bounds.first, end = bounds.second;
-    int docLen = (int)::SendMessage(hwndEdit, SCI_GETTEXTLENGTH, 0, 0);
-    while (start > 0 && std::isspace((unsigned char)::SendMessage(hwndEdit, SCI_GETCHARAT, start - 1, 0))) start--;
-    while (end < docLen && std::isspace((unsigned char)::SendMessage(hwndEdit, SCI_GETCHARAT, end, 0))) end++;
-    return { start, end };
-}
-
 bool TextObject::handleCustomTextObject(HWND hwndEdit, VimState& state, char op, bool inner, char object) {
     if (object == 't') {
         auto bounds = findTagBounds(hwndEdit, (int)::SendMessage(hwndEdit, SCI_GETCURRENTPOS, 0, 0), inner);
@@ -400,6 +303,19 @@ bool TextObject::handleCustomTextObject(HWND hwndEdit, VimState& state, char op,
 void TextObject::executeTextObjectOperation(HWND h, VimState& state, char op, int start, int end, int count) {
     if (start >= end) return;
 
+    if (op == 'q' || op == 'w') {
+        int caret = (int)::SendMessage(h, SCI_GETCURRENTPOS, 0, 0);
+        Reflow::apply(h, (int)::SendMessage(h, SCI_LINEFROMPOSITION, start, 0),
+                      (int)::SendMessage(h, SCI_LINEFROMPOSITION, end - 1, 0), op == 'w' ? caret : -1);
+        return;
+    }
+
+    if (op == '=') {
+        Indent::apply(h, (int)::SendMessage(h, SCI_LINEFROMPOSITION, start, 0),
+                      (int)::SendMessage(h, SCI_LINEFROMPOSITION, end - 1, 0));
+        return;
+    }
+
     if (op == 'v') {
         if (state.mode != VISUAL) {
             state.mode = VISUAL;
@@ -0,0 +1,104 @@
+#include "../include/UiUpdates.h"
+#include "../include/Marks.h"
+#include "../plugin/PluginInterface.h"
+#include "../plugin/Scintilla.h"
+#include "../plugin/Notepad_plus_msgs.h"
+
+extern NppData nppData;
+void updateRelativeLineNumbers(HWND hwnd, bool force);
+
+UiUpdates& UiUpdates::getInstance() {
+    static UiUpdates instance;
+    return instance;
+}
+
+void UiUpdates::begin() {
+    depth++;
+}
+
+void UiUpdates::end() {
+    if (depth > 0 && --depth == 0) flush();
+}
+
+void UiUpdates::setStatus(const TCHAR* msg) {
+    if (!msg) return;
+    if (statusDirty) stats.statusSuppressed++;
+    pendingStatus = msg;
+    statusDirty = true;
+    if (depth == 0) flush();
+}
+
+void UiUpdates::setCaretStyle(HWND hwnd, int style) {
+    if (!hwnd) return;
+    auto it = pendingCaret.find(hwnd);
+    if (it != pendingCaret.end()) stats.caretSuppressed++;
+    pendingCaret[hwnd] = style;
+    if (depth == 0) flush();
+}
+
+void UiUpdates::requestMargin(HWND hwnd, bool force) {
+    if (!hwnd) return;
+    auto it = pendingMargin.find(hwnd);
+    if (it != pendingMargin.end()) {
+        stats.marginSuppressed++;
+        it->second = it->second || force;
+    } else {
+        pendingMargin[hwnd] = force;
+    }
+    if (depth == 0) flush();
+}
+
+void UiUpdates::requestMarkers(HWND hwnd) {
+    if (!hwnd) return;
+    if (pendingMarkers.count(hwnd)) stats.markerSuppressed++;
+    pendingMarkers[hwnd] = true;
+    if (depth == 0) flush();
+}
+
+void UiUpdates::flush() {
+    // Work done here can request more updates; with depth back at zero
+    // those apply straight away.
+    if (statusDirty) {
+        statusDirty = false;
+        if (statusKnown && pendingStatus == shownStatus) {
+            stats.statusSuppressed++;
+        } else {
+            ::SendMessage(nppData._nppHandle, NPPM_SETSTATUSBAR, STATUSBAR_DOC_TYPE, (LPARAM)pendingStatus.c_str());
+            shownStatus = pendingStatus;
+            statusKnown = true;
+            stats.statusSent++;
+        }
+    }
+
+    if (!pendingCaret.empty()) {
+        std::map<HWND, int> carets;
+        carets.swap(pendingCaret);
+        for (auto& caret : carets) {
+            if (!IsWindow(caret.first)) continue;
+            if (::SendMessage(caret.first, SCI_GETCARETSTYLE, 0, 0) == caret.second) {
+                stats.caretSuppressed++;
+                continue;
+            }
+            ::SendMessage(caret.first, SCI_SETCARETSTYLE, caret.second, 0);
+            stats.caretSent++;
+        }
+    }
+
+    if (!pendingMargin.empty()) {
+        std::map<HWND, bool> margins;
+        margins.swap(pendingMargin);
+        for (auto& margin : margins) {
+            updateRelativeLineNumbers(margin.first, margin.second);
+            stats.marginRuns++;
+        }
+    }
+
+    if (!pendingMarkers.empty()) {
+        std::map<HWND, bool> markers;
+        markers.swap(pendingMarkers);
+        for (auto& marker : markers) {
+            Marks::syncMarkers(marker.first);
+            stats.markerRuns++;
+        }
+    }
+}
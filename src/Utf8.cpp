@@ -0,0 +1,454 @@
+#include "../include/Utf8.h"
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__SSE2__)
+#include <emmintrin.h>
+#define NPPVIM_SSE2 1
+#endif
+
+namespace {
+
+enum CaseKind : unsigned char {
+    RANGE,      // every code point in the range moves by delta
+    PAIRS,      // first, first + 2, ... move by delta; the others stay
+    ONE_WAY,    // a RANGE whose result does not map back
+};
+
+struct CaseRange {
+    char32_t first;
+    char32_t last;
+    int delta;
+    CaseKind kind;
+};
+
+// Simple (one to one) lower-case mappings from UnicodeData.txt, upper or
+// title case to lower, sorted by first.
+const CaseRange LOWER[] = {
+    { 0x0041, 0x005A, 32, RANGE },
+    { 0x00C0, 0x00D6, 32, RANGE }, { 0x00D8, 0x00DE, 32, RANGE },
+    { 0x0100, 0x012F, 1, PAIRS }, { 0x0130, 0x0130, -199, ONE_WAY },
+    { 0x0132, 0x0137, 1, PAIRS }, { 0x0139, 0x0148, 1, PAIRS },
+    { 0x014A, 0x0177, 1, PAIRS }, { 0x0178, 0x0178, -121, RANGE },
+    { 0x0179, 0x017E, 1, PAIRS }, { 0x0181, 0x0181, 210, RANGE },
+    { 0x0182, 0x0185, 1, PAIRS }, { 0x0186, 0x0186, 206, RANGE },
+    { 0x0187, 0x0188, 1, PAIRS }, { 0x0189, 0x018A, 205, RANGE },
+    { 0x018B, 0x018C, 1, PAIRS }, { 0x018E, 0x018E, 79, RANGE },
+    { 0x018F, 0x018F, 202, RANGE }, { 0x0190, 0x0190, 203, RANGE },
+    { 0x0191, 0x0192, 1, PAIRS }, { 0x0193, 0x0193, 205, RANGE },
+    { 0x0194, 0x0194, 207, RANGE }, { 0x0196, 0x0196, 211, RANGE },
+    { 0x0197, 0x0197, 209, RANGE }, { 0x0198, 0x0199, 1, PAIRS },
+    { 0x019C, 0x019C, 211, RANGE }, { 0x019D, 0x019D, 213, RANGE },
+    { 0x019F, 0x019F, 214, RANGE }, { 0x01A0, 0x01A5, 1, PAIRS },
+    { 0x01A6, 0x01A6, 218, RANGE },
+    { 0x01A7, 0x01A8, 1, PAIRS }, { 0x01A9, 0x01A9, 218, RANGE },
+    { 0x01AC, 0x01AD, 1, PAIRS }, { 0x01AE, 0x01AE, 218, RANGE },
+    { 0x01AF, 0x01B0, 1, PAIRS }, { 0x01B1, 0x01B2, 217, RANGE },
+    { 0x01B3, 0x01B6, 1, PAIRS }, { 0x01B7, 0x01B7, 219, RANGE },
+    { 0x01B8, 0x01B9, 1, PAIRS }, { 0x01BC, 0x01BD, 1, PAIRS },
+    { 0x01C4, 0x01C4, 2, RANGE }, { 0x01C5, 0x01C5, 1, ONE_WAY },
+    { 0x01C7, 0x01C7, 2, RANGE }, { 0x01C8, 0x01C8, 1, ONE_WAY },
+    { 0x01CA, 0x01CA, 2, RANGE }, { 0x01CB, 0x01CB, 1, ONE_WAY },
+    { 0x01CD, 0x01DC, 1, PAIRS }, { 0x01DE, 0x01EF, 1, PAIRS },
+    { 0x01F1, 0x01F1, 2, RANGE }, { 0x01F2, 0x01F2, 1, ONE_WAY },
+    { 0x01F4, 0x01F5, 1, PAIRS }, { 0x01F6, 0x01F6, -97, RANGE },
+    { 0x01F7, 0x01F7, -56, RANGE }, { 0x01F8, 0x021F, 1, PAIRS },
+    { 0x0220, 0x0220, -130, RANGE }, { 0x0222, 0x0233, 1, PAIRS },
+    { 0x023A, 0x023A, 10795, RANGE }, { 0x023B, 0x023C, 1, PAIRS },
+    { 0x023D, 0x023D, -163, RANGE }, { 0x023E, 0x023E, 10792, RANGE },
+    { 0x0241, 0x0242, 1, PAIRS }, { 0x0243, 0x0243, -195, RANGE },
+    { 0x0244, 0x0244, 69, RANGE }, { 0x0245, 0x0245, 71, RANGE },
+    { 0x0246, 0x024F, 1, PAIRS },
+    { 0x0370, 0x0373, 1, PAIRS }, { 0x0376, 0x0377, 1, PAIRS },
+    { 0x037F, 0x037F, 116, RANGE }, { 0x0386, 0x0386, 38, RANGE },
+    { 0x0388, 0x038A, 37, RANGE }, { 0x038C, 0x038C, 64, RANGE },
+    { 0x038E, 0x038F, 63, RANGE }, { 0x0391, 0x03A1, 32, RANGE },
+    { 0x03A3, 0x03AB, 32, RANGE }, { 0x03CF, 0x03CF, 8, RANGE },
+    { 0x03D8, 0x03EF, 1, PAIRS }, { 0x03F4, 0x03F4, -60, ONE_WAY },
+    { 0x03F7, 0x03F8, 1, PAIRS }, { 0x03F9, 0x03F9, -7, RANGE },
+    { 0x03FA, 0x03FB, 1, PAIRS }, { 0x03FD, 0x03FF, -130, RANGE },
+    { 0x0400, 0x040F, 80, RANGE }, { 0x0410, 0x042F, 32, RANGE },
+    { 0x0460, 0x0481, 1, PAIRS }, { 0x048A, 0x04BF, 1, PAIRS },
+    { 0x04C0, 0x04C0, 15, RANGE }, { 0x04C1, 0x04CE, 1, PAIRS },
+    { 0x04D0, 0x052F, 1, PAIRS }, { 0x0531, 0x0556, 48, RANGE },
+    { 0x10A0, 0x10C5, 7264, RANGE }, { 0x10C7, 0x10C7, 7264, RANGE },
+    { 0x10CD, 0x10CD, 7264, RANGE }, { 0x13A0, 0x13EF, 38864, RANGE },
+    { 0x13F0, 0x13F5, 8, RANGE }, { 0x1C90, 0x1CBA, -3008, RANGE },
+    { 0x1CBD, 0x1CBF, -3008, RANGE },
+    { 0x1E00, 0x1E95, 1, PAIRS }, { 0x1E9E, 0x1E9E, -7615, ONE_WAY },
+    { 0x1EA0, 0x1EFF, 1, PAIRS },
+    { 0x1F08, 0x1F0F, -8, RANGE }, { 0x1F18, 0x1F1D, -8, RANGE },
+    { 0x1F28, 0x1F2F, -8, RANGE }, { 0x1F38, 0x1F3F, -8, RANGE },
+    { 0x1F48, 0x1F4D, -8, RANGE }, { 0x1F59, 0x1F59, -8, RANGE },
+    { 0x1F5B, 0x1F5B, -8, RANGE }, { 0x1F5D, 0x1F5D, -8, RANGE },
+    { 0x1F5F, 0x1F5F, -8, RANGE }, { 0x1F68, 0x1F6F, -8, RANGE },
+    { 0x1F88, 0x1F8F, -8, RANGE }, { 0x1F98, 0x1F9F, -8, RANGE },
+    { 0x1FA8, 0x1FAF, -8, RANGE }, { 0x1FB8, 0x1FB9, -8, RANGE },
+    { 0x1FBA, 0x1FBB, -74, RANGE }, { 0x1FBC, 0x1FBC, -9, RANGE },
+    { 0x1FC8, 0x1FCB, -86, RANGE }, { 0x1FCC, 0x1FCC, -9, RANGE },
+    { 0x1FD8, 0x1FD9, -8, RANGE }, { 0x1FDA, 0x1FDB, -100, RANGE },
+    { 0x1FE8, 0x1FE9, -8, RANGE }, { 0x1FEA, 0x1FEB, -112, RANGE },
+    { 0x1FEC, 0x1FEC, -7, RANGE }, { 0x1FF8, 0x1FF9, -128, RANGE },
+    { 0x1FFA, 0x1FFB, -126, RANGE }, { 0x1FFC, 0x1FFC, -9, RANGE },
+    { 0x2126, 0x2126, -7517, ONE_WAY }, { 0x212A, 0x212A, -8383, ONE_WAY },
+    { 0x212B, 0x212B, -8262, ONE_WAY }, { 0x2132, 0x2132, 28, RANGE },
+    { 0x2160, 0x216F, 16, RANGE }, { 0x2183, 0x2184, 1, PAIRS },
+    { 0x24B6, 0x24CF, 26, RANGE }, { 0x2C00, 0x2C2F, 48, RANGE },
+    { 0x2C60, 0x2C61, 1, PAIRS }, { 0x2C62, 0x2C62, -10743, RANGE },
+    { 0x2C63, 0x2C63, -3814, RANGE }, { 0x2C64, 0x2C64, -10727, RANGE },
+    { 0x2C67, 0x2C6C, 1, PAIRS }, { 0x2C6D, 0x2C6D, -10780, RANGE },
+    { 0x2C6E, 0x2C6E, -10749, RANGE }, { 0x2C6F, 0x2C6F, -10783, RANGE },
+    { 0x2C70, 0x2C70, -10782, RANGE }, { 0x2C72, 0x2C73, 1, PAIRS },
+    { 0x2C75, 0x2C76, 1, PAIRS }, { 0x2C7E, 0x2C7F, -10815, RANGE },
+    { 0x2C80, 0x2CE3, 1, PAIRS }, { 0x2CEB, 0x2CEE, 1, PAIRS },
+    { 0x2CF2, 0x2CF3, 1, PAIRS },
+    { 0xA640, 0xA66D, 1, PAIRS }, { 0xA680, 0xA69B, 1, PAIRS },
+    { 0xA722, 0xA72F, 1, PAIRS }, { 0xA732, 0xA76F, 1, PAIRS },
+    { 0xA779, 0xA77C, 1, PAIRS }, { 0xA77D, 0xA77D, -35332, RANGE },
+    { 0xA77E, 0xA787, 1, PAIRS }, { 0xA78B, 0xA78C, 1, PAIRS },
+    { 0xA78D, 0xA78D, -42280, RANGE }, { 0xA790, 0xA793, 1, PAIRS },
+    { 0xA796, 0xA7A9, 1, PAIRS },
+    { 0xA7AA, 0xA7AA, -42308, RANGE }, { 0xA7AB, 0xA7AB, -42319, RANGE },
+    { 0xA7AC, 0xA7AC, -42315, RANGE }, { 0xA7AD, 0xA7AD, -42305, RANGE },
+    { 0xA7AE, 0xA7AE, -42308, RANGE }, { 0xA7B0, 0xA7B0, -42258, RANGE },
+    { 0xA7B1, 0xA7B1, -42282, RANGE }, { 0xA7B2, 0xA7B2, -42261, RANGE },
+    { 0xA7B3, 0xA7B3, 928, RANGE }, { 0xA7B4, 0xA7C3, 1, PAIRS },
+    { 0xA7C4, 0xA7C4, -48, RANGE }, { 0xA7C5, 0xA7C5, -42307, RANGE },
+    { 0xA7C6, 0xA7C6, -35384, RANGE }, { 0xA7C7, 0xA7CA, 1, PAIRS },
+    { 0xA7D0, 0xA7D1, 1, PAIRS }, { 0xA7D6, 0xA7D9, 1, PAIRS },
+    { 0xA7F5, 0xA7F6, 1, PAIRS },
+    { 0xFF21, 0xFF3A, 32, RANGE },
+    { 0x10400, 0x10427, 40, RANGE }, { 0x104B0, 0x104D3, 40, RANGE },
+    { 0x10570, 0x1057A, 39, RANGE }, { 0x1057C, 0x1058A, 39, RANGE },
+    { 0x1058C, 0x10592, 39, RANGE }, { 0x10594, 0x10595, 39, RANGE },
+    { 0x10C80, 0x10CB2, 64, RANGE }, { 0x118A0, 0x118BF, 32, RANGE },
+    { 0x16E40, 0x16E5F, 32, RANGE },
+    { 0x1E900, 0x1E921, 34, RANGE },
+};
+
+// Upper-case mappings of lower-case letters the table above does not give
+// back: final sigma, dotless i, long s, symbol forms of Greek letters,
+// ypogegrammeni, the old Cyrillic letter forms and the title-case digraphs.
+const CaseRange UPPER_ONLY[] = {
+    { 0x00B5, 0x00B5, 743, RANGE }, { 0x0131, 0x0131, -232, RANGE },
+    { 0x017F, 0x017F, -300, RANGE }, { 0x01C5, 0x01C5, -1, RANGE },
+    { 0x01C8, 0x01C8, -1, RANGE }, { 0x01CB, 0x01CB, -1, RANGE },
+    { 0x01F2, 0x01F2, -1, RANGE }, { 0x03C2, 0x03C2, -31, RANGE },
+    { 0x03D0, 0x03D0, -62, RANGE }, { 0x03D1, 0x03D1, -57, RANGE },
+    { 0x03D5, 0x03D5, -47, RANGE }, { 0x03D6, 0x03D6, -54, RANGE },
+    { 0x03F0, 0x03F0, -86, RANGE }, { 0x03F1, 0x03F1, -80, RANGE },
+    { 0x03F5, 0x03F5, -96, RANGE }, { 0x1E9B, 0x1E9B, -59, RANGE },
+    { 0x1FBE, 0x1FBE, -7205, RANGE }, { 0x0345, 0x0345, 84, RANGE },
+    { 0x1C80, 0x1C80, -6254, RANGE }, { 0x1C81, 0x1C81, -6253, RANGE },
+    { 0x1C82, 0x1C82, -6244, RANGE }, { 0x1C83, 0x1C84, -6242, RANGE },
+    { 0x1C85, 0x1C85, -6243, RANGE }, { 0x1C86, 0x1C86, -6236, RANGE },
+    { 0x1C87, 0x1C87, -6181, RANGE }, { 0x1C88, 0x1C88, 35266, RANGE },
+};
+
+struct ClassRange {
+    char32_t first;
+    char32_t last;
+    CharClass cls;
+};
+
+// Classes of characters beyond ASCII after Vim's utf_class(); anything not
+// listed is a word character.
+const ClassRange CLASSES[] = {
+    { 0x0085, 0x0085, CC_SPACE }, { 0x00A0, 0x00A0, CC_SPACE },
+    { 0x00A1, 0x00BF, CC_PUNCT }, { 0x00D7, 0x00D7, CC_PUNCT },
+    { 0x00F7, 0x00F7, CC_PUNCT }, { 0x037E, 0x037E, CC_PUNCT },
+    { 0x0387, 0x0387, CC_PUNCT }, { 0x055A, 0x055F, CC_PUNCT },
+    { 0x0589, 0x0589, CC_PUNCT }, { 0x05BE, 0x05BE, CC_PUNCT },
+    { 0x05C0, 0x05C0, CC_PUNCT }, { 0x05C3, 0x05C3, CC_PUNCT },
+    { 0x05F3, 0x05F4, CC_PUNCT }, { 0x060C, 0x060C, CC_PUNCT },
+    { 0x061B, 0x061B, CC_PUNCT }, { 0x061F, 0x061F, CC_PUNCT },
+    { 0x066A, 0x066D, CC_PUNCT }, { 0x06D4, 0x06D4, CC_PUNCT },
+    { 0x0700, 0x070D, CC_PUNCT }, { 0x0964, 0x0965, CC_PUNCT },
+    { 0x0970, 0x0970, CC_PUNCT }, { 0x0DF4, 0x0DF4, CC_PUNCT },
+    { 0x0E4F, 0x0E4F, CC_PUNCT }, { 0x0E5A, 0x0E5B, CC_PUNCT },
+    { 0x0F04, 0x0F12, CC_PUNCT }, { 0x0F3A, 0x0F3D, CC_PUNCT },
+    { 0x0F85, 0x0F85, CC_PUNCT }, { 0x104A, 0x104F, CC_PUNCT },
+    { 0x10FB, 0x10FB, CC_PUNCT }, { 0x1100, 0x11FF, CC_CJK },
+    { 0x1361, 0x1368, CC_PUNCT }, { 0x166D, 0x166E, CC_PUNCT },
+    { 0x1680, 0x1680, CC_SPACE }, { 0x169B, 0x169C, CC_PUNCT },
+    { 0x16EB, 0x16ED, CC_PUNCT }, { 0x17D4, 0x17DC, CC_PUNCT },
+    { 0x1800, 0x180A, CC_PUNCT },
+    { 0x2000, 0x200B, CC_SPACE }, { 0x200C, 0x2027, CC_PUNCT },
+    { 0x2028, 0x2029, CC_SPACE }, { 0x202A, 0x202E, CC_PUNCT },
+    { 0x202F, 0x202F, CC_SPACE }, { 0x2030, 0x205E, CC_PUNCT },
+    { 0x205F, 0x205F, CC_SPACE }, { 0x2060, 0x206F, CC_PUNCT },
+    { 0x20A0, 0x27FF, CC_PUNCT }, { 0x2900, 0x2BFF, CC_PUNCT },
+    { 0x2E00, 0x2E7F, CC_PUNCT }, { 0x2E80, 0x2FDF, CC_CJK },
+    { 0x3000, 0x3000, CC_SPACE }, { 0x3001, 0x3020, CC_PUNCT },
+    { 0x3021, 0x302F, CC_CJK }, { 0x3030, 0x3030, CC_PUNCT },
+    { 0x3031, 0x303C, CC_CJK }, { 0x303D, 0x303D, CC_PUNCT },
+    { 0x303E, 0xA4CF, CC_CJK }, { 0xAC00, 0xD7AF, CC_CJK },
+    { 0xF900, 0xFAFF, CC_CJK }, { 0xFD3E, 0xFD3F, CC_PUNCT },
+    { 0xFE10, 0xFE19, CC_PUNCT }, { 0xFE30, 0xFE6B, CC_PUNCT },
+    { 0xFF00, 0xFF0F, CC_PUNCT }, { 0xFF1A, 0xFF20, CC_PUNCT },
+    { 0xFF3B, 0xFF40, CC_PUNCT }, { 0xFF5B, 0xFF65, CC_PUNCT },
+    { 0xFF66, 0xFFDC, CC_CJK }, { 0xFFE0, 0xFFEE, CC_PUNCT },
+    { 0x1F000, 0x1FAFF, CC_EMOJI }, { 0x20000, 0x3FFFF, CC_CJK },
+};
+
+template <typename Range, size_t N>
+const Range* findRange(const Range (&ranges)[N], char32_t cp) {
+    auto it = std::upper_bound(ranges, ranges + N, cp,
+        [](char32_t value, const Range& range) { return value < range.first; });
+    if (it == ranges) return nullptr;
+    --it;
+    return cp <= it->last ? it : nullptr;
+}
+
+char32_t applyCase(const CaseRange* range, char32_t cp) {
+    if (!range) return cp;
+    if (range->kind == PAIRS && (cp - range->first) % 2 != 0) return cp;
+    return (char32_t)((int)cp + range->delta);
+}
+
+// LOWER turned around, with UPPER_ONLY merged in.
+const std::vector<CaseRange>& upperTable() {
+    static const std::vector<CaseRange> table = [] {
+        std::vector<CaseRange> t;
+        for (const CaseRange& r : LOWER) {
+            if (r.kind == ONE_WAY) continue;
+            if (r.kind == PAIRS) t.push_back({ r.first + 1, r.last, -1, PAIRS });
+            else t.push_back({ (char32_t)((int)r.first + r.delta), (char32_t)((int)r.last + r.delta), -r.delta, RANGE });
+        }
+        for (const CaseRange& r : UPPER_ONLY) t.push_back(r);
+        std::sort(t.begin(), t.end(), [](const CaseRange& a, const CaseRange& b) { return a.first < b.first; });
+        return t;
+    }();
+    return table;
+}
+
+// Nothing from after Georgian up to Cyrillic Extended-B has case: CJK,
+// kana, hangul and most symbols.
+bool caseless(char32_t cp) {
+    return cp >= 0x2D30 && cp < 0xA640;
+}
+
+// Two-byte characters, which cover the alphabetic scripts, looked up directly.
+const CharClass* twoByteClasses() {
+    static const std::vector<CharClass> table = [] {
+        std::vector<CharClass> t(0x800, CC_WORD);
+        for (const ClassRange& r : CLASSES) {
+            for (char32_t cp = r.first; cp <= r.last && cp < 0x800; cp++) t[cp] = r.cls;
+        }
+        return t;
+    }();
+    return table.data();
+}
+
+}
+
+char32_t Utf8::decodeMultiByte(const char* text, size_t n, size_t& used) {
+    const unsigned char* s = (const unsigned char*)text;
+    size_t len = sequenceLength(s[0]);
+    used = 1;
+    if (len == 1 || len > n) return s[0];
+    for (size_t i = 1; i < len; i++) {
+        if (!isContinuation(s[i])) return s[0];
+    }
+
+    char32_t cp;
+    if (len == 2) {
+        cp = ((s[0] & 0x1F) << 6) | (s[1] & 0x3F);
+    } else if (len == 3) {
+        cp = ((s[0] & 0x0F) << 12) | ((s[1] & 0x3F) << 6) | (s[2] & 0x3F);
+        // Overlong forms and surrogates
+        if (cp < 0x800 || (cp >= 0xD800 && cp <= 0xDFFF)) return s[0];
+    } else {
+        cp = ((s[0] & 0x07) << 18) | ((s[1] & 0x3F) << 12) | ((s[2] & 0x3F) << 6) | (s[3] & 0x3F);
+        if (cp < 0x10000 || cp > 0x10FFFF) return s[0];
+    }
+    used = len;
+    return cp;
+}
+
+size_t Utf8::encodeTo(char32_t cp, char out[4]) {
+    if (cp < 0x80) {
+        out[0] = (char)cp;
+        return 1;
+    }
+    if (cp < 0x800) {
+        out[0] = (char)(0xC0 | (cp >> 6));
+        out[1] = (char)(0x80 | (cp & 0x3F));
+        return 2;
+    }
+    if (cp < 0x10000) {
+        out[0] = (char)(0xE0 | (cp >> 12));
+        out[1] = (char)(0x80 | ((cp >> 6) & 0x3F));
+        out[2] = (char)(0x80 | (cp & 0x3F));
+        return 3;
+    }
+    out[0] = (char)(0xF0 | (cp >> 18));
+    out[1] = (char)(0x80 | ((cp >> 12) & 0x3F));
+    out[2] = (char)(0x80 | ((cp >> 6) & 0x3F));
+    out[3] = (char)(0x80 | (cp & 0x3F));
+    return 4;
+}
+
+void Utf8::append(std::string& out, char32_t cp) {
+    char bytes[4];
+    out.append(bytes, encodeTo(cp, bytes));
+}
+
+std::string Utf8::encode(char32_t cp) {
+    std::string out;
+    append(out, cp);
+    return out;
+}
+
+char32_t Utf8::toLower(char32_t cp) {
+    if (cp < 0x80) return (cp >= 'A' && cp <= 'Z') ? cp + 32 : cp;
+    if (caseless(cp)) return cp;
+    return applyCase(findRange(LOWER, cp), cp);
+}
+
+char32_t Utf8::toUpper(char32_t cp) {
+    if (cp < 0x80) return (cp >= 'a' && cp <= 'z') ? cp - 32 : cp;
+    if (caseless(cp)) return cp;
+    const std::vector<CaseRange>& table = upperTable();
+    auto it = std::upper_bound(table.begin(), table.end(), cp,
+        [](char32_t value, const CaseRange& range) { return value < range.first; });
+    if (it == table.begin()) return cp;
+    --it;
+    return cp <= it->last ? applyCase(&*it, cp) : cp;
+}
+
+CharClass Utf8::classOf(char32_t cp) {
+    if (cp < 0x800) return twoByteClasses()[cp];
+    const ClassRange* range = findRange(CLASSES, cp);
+    return range ? range->cls : CC_WORD;
+}
+
+size_t Utf8::asciiPrefix(const char* text, size_t n) {
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        uint64_t word;
+        std::memcpy(&word, text + i, 8);
+        if (word & 0x8080808080808080ULL) break;
+    }
+    while (i < n && (unsigned char)text[i] < 0x80) i++;
+    return i;
+}
+
+bool Utf8::isAscii(const char* text, size_t n) {
+    return asciiPrefix(text, n) == n;
+}
+
+static char32_t changeCodePoint(char32_t cp, CaseChange change) {
+    switch (change) {
+    case CaseChange::Upper: return Utf8::toUpper(cp);
+    case CaseChange::Lower: return Utf8::toLower(cp);
+    case CaseChange::Toggle: {
+        char32_t lower = Utf8::toLower(cp);
+        return lower == cp ? Utf8::toUpper(cp) : lower;
+    }
+    default: return cp;
+    }
+}
+
+// Two-byte characters mapped directly, one table per change.
+static const char16_t* twoByteCases(CaseChange change) {
+    static const std::vector<char16_t> tables = [] {
+        std::vector<char16_t> t(3 * 0x800);
+        for (int k = 0; k < 3; k++) {
+            for (char32_t cp = 0; cp < 0x800; cp++) t[k * 0x800 + cp] = (char16_t)changeCodePoint(cp, (CaseChange)k);
+        }
+        return t;
+    }();
+    return tables.data() + (int)change * 0x800;
+}
+
+// The ASCII letters of text, whatever else it holds. A byte b is in
+// [low, low + span] exactly when (unsigned)(b - low) <= span, the same
+// range test CharClasses uses.
+static bool changeAscii(char* text, size_t n, CaseChange change) {
+    // Toggle and rot13 test the lower-case form, which b | 0x20 gives
+    bool folded = change == CaseChange::Toggle || change == CaseChange::Rot13;
+    char low = change == CaseChange::Lower ? 'A' : 'a';
+    size_t i = 0;
+    bool changed = false;
+#ifdef NPPVIM_SSE2
+    const __m128i fold = _mm_set1_epi8(folded ? 0x20 : 0);
+    const __m128i lowVec = _mm_set1_epi8(low);
+    const __m128i span = _mm_set1_epi8(25);
+    const __m128i half = _mm_set1_epi8(12);
+    const __m128i caseBit = _mm_set1_epi8(0x20);
+    __m128i any = _mm_setzero_si128();
+    for (; i + 16 <= n; i += 16) {
+        __m128i bytes = _mm_loadu_si128((const __m128i*)(text + i));
+        __m128i offset = _mm_sub_epi8(_mm_or_si128(bytes, fold), lowVec);
+        __m128i letter = _mm_cmpeq_epi8(_mm_min_epu8(offset, span), offset);
+        __m128i delta;
+        if (change == CaseChange::Rot13) {
+            // +13 in the first half of the alphabet, -13 (243) in the second
+            __m128i first = _mm_cmpeq_epi8(_mm_min_epu8(offset, half), offset);
+            delta = _mm_and_si128(letter, _mm_or_si128(_mm_and_si128(first, _mm_set1_epi8(13)),
+                                                       _mm_andnot_si128(first, _mm_set1_epi8((char)243))));
+            bytes = _mm_add_epi8(bytes, delta);
+        } else {
+            delta = _mm_and_si128(letter, caseBit);
+            bytes = _mm_xor_si128(bytes, delta);
+        }
+        any = _mm_or_si128(any, letter);
+        _mm_storeu_si128((__m128i*)(text + i), bytes);
+    }
+    changed = _mm_movemask_epi8(any) != 0;
+#endif
+    for (; i < n; i++) {
+        unsigned char c = (unsigned char)text[i];
+        unsigned char offset = (unsigned char)((folded ? c | 0x20 : c) - low);
+        if (offset > 25) continue;
+        if (change == CaseChange::Rot13) text[i] = (char)(c + (offset < 13 ? 13 : -13));
+        else text[i] = (char)(c ^ 0x20);
+        changed = true;
+    }
+    return changed;
+}
+
+bool Utf8::changeCase(std::string& text, CaseChange change, bool utf8) {
+    if (text.empty()) return false;
+    if (!utf8 || change == CaseChange::Rot13) return changeAscii(&text[0], text.size(), change);
+
+    const char16_t* twoByte = twoByteCases(change);
+    bool changed = false;
+    std::string rebuilt;
+    size_t copied = 0;    // text before this is already in rebuilt
+    size_t n = text.size();
+    for (size_t i = 0; i < n;) {
+        size_t run = asciiPrefix(text.data() + i, n - i);
+        if (run > 0) {
+            changed |= changeAscii(&text[i], run, change);
+            i += run;
+            continue;
+        }
+
+        size_t used;
+        char32_t cp = decodeMultiByte(text.data() + i, n - i, used);
+        char32_t mapped = used == 1 ? cp : cp < 0x800 ? twoByte[cp] : changeCodePoint(cp, change);
+        if (mapped != cp) {
+            char bytes[4];
+            size_t len = encodeTo(mapped, bytes);
+            if (len == used) {
+                std::memcpy(&text[i], bytes, used);
+            } else {
+                // A few letters change length, such as dotless i and Kelvin
+                rebuilt.append(text, copied, i - copied);
+                rebuilt.append(bytes, len);
+                copied = i + used;
+            }
+            changed = true;
+        }
+        i += used;
+    }
+    if (copied > 0) {
+        rebuilt.append(text, copied, std::string::npos);
+        text.swap(rebuilt);
+    }
+    return changed;
+}
@@ -1,6 +1,7 @@
 // Utils.cpp
 #include "Utils.h"
 #include <algorithm>
+#include <cctype>
 #include <fstream>
 #include <sstream>
 #include "NppVim.h"
@@ -8,7 +9,16 @@
 #include "VisualMode.h"
 #include "Notepad_plus_msgs.h"
 
+#include "Clipboard.h"
+#include "Paste.h"
 #include "ConfigManager.h"
+#include "Registers.h"
+#include "BracketIndex.h"
+#include "CharClass.h"
+#include "Utf8.h"
+#include "LineIndex.h"
+#include "UiUpdates.h"
+#include "CommandRegistry.h"
 
 NppData Utils::nppData;
 
@@ -30,7 +40,12 @@ void Utils::setStatus(const TCHAR *msg)
 {
   if (!ConfigManager::getInstance().isShowStatusBar())
     return;
-  ::SendMessage(nppData._nppHandle, NPPM_SETSTATUSBAR, STATUSBAR_DOC_TYPE, (LPARAM)msg);
+  UiUpdates::getInstance().setStatus(msg);
+}
+
+void Utils::setCaretStyle(HWND hwnd, int style)
+{
+  UiUpdates::getInstance().setCaretStyle(hwnd, style);
 }
 
 void Utils::clearSearchHighlights(HWND hwndEdit)
@@ -50,25 +65,21 @@ std::pair<int, int> Utils::findWordBounds(HWND hwndEdit, int pos)
 }
 
 std::pair<int, int> Utils::findWordBoundsEx(HWND hwndEdit, int pos, bool bigWord) {
-    int docLen = (int)::SendMessage(hwndEdit, SCI_GETTEXTLENGTH, 0, 0);
-    if (pos >= docLen) return {pos, pos};
-    
-    // Scintilla SCI_WORDSTARTPOSITION/ENDPOSITION:
-    // style (bool onlyWordCharacters):
-    // true: use only word characters (small word)
-    // false: use any non-whitespace characters (big word)
-    bool onlyWordChars = !bigWord;
-    
-    int wordStart = (int)::SendMessage(hwndEdit, SCI_WORDSTARTPOSITION, pos, onlyWordChars);
-    int wordEnd = (int)::SendMessage(hwndEdit, SCI_WORDENDPOSITION, pos, onlyWordChars);
-    
-    return {wordStart, wordEnd};
+    CharClasses classes(hwndEdit);
+    ClassScanner scan(hwndEdit, classes);
+    if (pos >= scan.length()) return {pos, pos};
+
+    // The run of word (or, for WORDs, non-blank) characters around pos;
+    // empty when pos touches none.
+    unsigned run = bigWord ? CLASS_NONBLANK : classBit(CC_WORD);
+    return {scan.skipBackward(pos, run), scan.skipForward(pos, run)};
 }
 
 int Utils::findMatchingBracket(HWND hwndEdit, int pos, char openChar, char closeChar) {
-    int m = (int)SendMessage(hwndEdit, SCI_BRACEMATCH, pos, 0);
-    if (m == -1)
-        m = (int)SendMessage(hwndEdit, SCI_BRACEMATCH, pos - 1, 0);
+    BracketIndex& index = BracketIndex::getInstance();
+    int m = index.match(hwndEdit, pos);
+    if (m == -1 && pos > 0)
+        m = index.match(hwndEdit, pos - 1);
     return m;
 }
 
@@ -235,55 +246,91 @@ int Utils::countSearchMatches(HWND hwndEdit, const std::string &searchTerm, int
   return count;
 }
 
-void Utils::handleIndent(HWND hwndEdit, int count) {
-    ::SendMessage(hwndEdit, SCI_BEGINUNDOACTION, 0, 0);
-
-    ::SendMessage(hwndEdit, SCI_TAB, 0, 0);
-
-    ::SendMessage(hwndEdit, SCI_ENDUNDOACTION, 0, 0);
-
+// Lines affected by >/<: the selected lines shifted count times, or count lines from the caret.
+static void shiftTargetLines(HWND hwnd, int count, int& first, int& last, int& levels) {
+    int selStart = (int)::SendMessage(hwnd, SCI_GETSELECTIONSTART, 0, 0);
+    int selEnd = (int)::SendMessage(hwnd, SCI_GETSELECTIONEND, 0, 0);
+    if (selStart != selEnd) {
+        first = (int)::SendMessage(hwnd, SCI_LINEFROMPOSITION, selStart, 0);
+        last = (int)::SendMessage(hwnd, SCI_LINEFROMPOSITION, selEnd, 0);
+        if (last > first && selEnd == Utils::lineStart(hwnd, last)) last--;
+        levels = count;
+    } else {
+        first = Utils::caretLine(hwnd);
+        last = (std::min)(first + count - 1, Utils::lineCount(hwnd) - 1);
+        levels = 1;
+    }
 }
 
-void Utils::handleUnindent(HWND hwndEdit, int count) {
-    ::SendMessage(hwndEdit, SCI_BEGINUNDOACTION, 0, 0);
-
-    ::SendMessage(hwndEdit, SCI_BACKTAB, 0, 0);
-
-    ::SendMessage(hwndEdit, SCI_ENDUNDOACTION, 0, 0);
-
+void Utils::appendIndent(std::string& out, int columns, bool useTabs, int tabWidth) {
+    if (useTabs && tabWidth > 0) {
+        out.append(columns / tabWidth, '\t');
+        columns %= tabWidth;
+    }
+    out.append(columns, ' ');
 }
 
-void Utils::handleAutoIndent(HWND hwndEdit, int count) {
-    ::SendMessage(hwndEdit, SCI_BEGINUNDOACTION, 0, 0);
+static void shiftLines(HWND hwnd, int count, int direction) {
+    int first, last, levels;
+    shiftTargetLines(hwnd, count, first, last, levels);
 
-    int lineStart = (int)::SendMessage(hwndEdit, SCI_LINEFROMPOSITION,
-                      (int)::SendMessage(hwndEdit, SCI_GETSELECTIONSTART, 0, 0), 0);
-    int lineEnd = (int)::SendMessage(hwndEdit, SCI_LINEFROMPOSITION,
-                    (int)::SendMessage(hwndEdit, SCI_GETSELECTIONEND, 0, 0), 0);
+    int tabWidth = (int)::SendMessage(hwnd, SCI_GETTABWIDTH, 0, 0);
+    int indentWidth = (int)::SendMessage(hwnd, SCI_GETINDENT, 0, 0);
+    if (indentWidth <= 0) indentWidth = tabWidth;
+    if (tabWidth <= 0) tabWidth = 8;
+    bool useTabs = ::SendMessage(hwnd, SCI_GETUSETABS, 0, 0) != 0;
+    int delta = direction * indentWidth * levels;
 
-    for (int line = lineStart; line <= lineEnd; line++) {
-        int lineStartPos = (int)::SendMessage(hwndEdit, SCI_POSITIONFROMLINE, line, 0);
-        int lineEndPos = (int)::SendMessage(hwndEdit, SCI_GETLINEENDPOSITION, line, 0);
+    int start = Utils::lineStart(hwnd, first);
+    int end = Utils::lineEnd(hwnd, last);
+    std::string text = Utils::getTextRange(hwnd, start, end);
 
-        int firstNonSpace = lineStartPos;
-        while (firstNonSpace < lineEndPos) {
-            char ch = (char)::SendMessage(hwndEdit, SCI_GETCHARAT, firstNonSpace, 0);
-            if (ch != ' ' && ch != '\t') break;
-            firstNonSpace++;
+    std::string out;
+    out.reserve(text.size() + (delta > 0 ? (size_t)(last - first + 1) * delta : 0));
+
+    size_t i = 0;
+    while (true) {
+        size_t eol = text.find_first_of("\r\n", i);
+        size_t contentEnd = (eol == std::string::npos) ? text.size() : eol;
+
+        size_t ws = i;
+        int col = 0;
+        while (ws < contentEnd && (text[ws] == ' ' || text[ws] == '\t')) {
+            col = (text[ws] == '\t') ? (col / tabWidth + 1) * tabWidth : col + 1;
+            ws++;
         }
 
-        if (firstNonSpace > lineStartPos) {
-            ::SendMessage(hwndEdit, SCI_DELETERANGE, lineStartPos, firstNonSpace - lineStartPos);
+        if (ws == contentEnd && delta > 0) {
+            // Blank lines are not indented
+            out.append(text, i, contentEnd - i);
+        } else {
+            Utils::appendIndent(out, (std::max)(0, col + delta), useTabs, tabWidth);
+            out.append(text, ws, contentEnd - ws);
         }
+
+        if (eol == std::string::npos) break;
+        size_t next = eol + 1;
+        if (text[eol] == '\r' && next < text.size() && text[next] == '\n') next++;
+        out.append(text, eol, next - eol);
+        i = next;
     }
 
-    ::SendMessage(hwndEdit, SCI_ENDUNDOACTION, 0, 0);
+    ::SendMessage(hwnd, SCI_BEGINUNDOACTION, 0, 0);
+    if (out != text) Utils::replaceTarget(hwnd, start, end, out);
+    int target = (int)::SendMessage(hwnd, SCI_GETLINEINDENTPOSITION, first, 0);
+    ::SendMessage(hwnd, SCI_SETEMPTYSELECTION, target, 0);
+    ::SendMessage(hwnd, SCI_ENDUNDOACTION, 0, 0);
+}
+
+void Utils::handleIndent(HWND hwndEdit, int count) {
+    shiftLines(hwndEdit, count, 1);
+}
 
-    if (state.mode == VISUAL && g_normalMode) {
-        g_normalMode->enter();
-    }
+void Utils::handleUnindent(HWND hwndEdit, int count) {
+    shiftLines(hwndEdit, count, -1);
 }
 
+
 int Utils::caretPos(HWND hwnd) {
     return (int)::SendMessage(hwnd, SCI_GETCURRENTPOS, 0, 0);
 }
@@ -293,20 +340,23 @@ int Utils::caretColumn(HWND hwnd) {
 }
 
 int Utils::caretLine(HWND hwnd) {
-    int pos = caretPos(hwnd);
-    return (int)::SendMessage(hwnd, SCI_LINEFROMPOSITION, pos, 0);
+    return lineFromPosition(hwnd, caretPos(hwnd));
+}
+
+int Utils::lineFromPosition(HWND hwnd, int pos) {
+    return LineIndex::getInstance().lineFromPosition(hwnd, pos);
 }
 
 int Utils::lineStart(HWND hwnd, int line) {
-    return (int)::SendMessage(hwnd, SCI_POSITIONFROMLINE, line, 0);
+    return LineIndex::getInstance().lineStart(hwnd, line);
 }
 
 int Utils::lineEnd(HWND hwnd, int line) {
-    return (int)::SendMessage(hwnd, SCI_GETLINEENDPOSITION, line, 0);
+    return LineIndex::getInstance().lineEnd(hwnd, line);
 }
 
 int Utils::lineCount(HWND hwnd) {
-    return (int)::SendMessage(hwnd, SCI_GETLINECOUNT, 0, 0);
+    return LineIndex::getInstance().lineCount(hwnd);
 }
 
 std::pair<int,int> Utils::lineRange(HWND hwnd, int line, bool includeNewline) {
@@ -320,8 +370,7 @@ std::pair<int,int> Utils::lineRange(HWND hwnd, int line, bool includeNewline) {
 }
 
 std::pair<int,int> Utils::lineRangeFromPos(HWND hwnd, int pos, bool includeNewline) {
-    int line = (int)::SendMessage(hwnd, SCI_LINEFROMPOSITION, pos, 0);
-    return lineRange(hwnd, line, includeNewline);
+    return lineRange(hwnd, lineFromPosition(hwnd, pos), includeNewline);
 }
 
 void Utils::beginUndo(HWND hwnd) {
@@ -352,27 +401,105 @@ void Utils::clear(HWND hwnd, int a, int b) {
 }
 
 void Utils::toUpper(HWND hwnd, int a, int b) {
-    select(hwnd, a, b);
-    SendMessage(hwnd, SCI_UPPERCASE, 0, 0);
+    changeCase(hwnd, a, b, CaseChange::Upper);
 }
 
 void Utils::toLower(HWND hwnd, int a, int b) {
-    select(hwnd, a, b);
-    SendMessage(hwnd, SCI_LOWERCASE, 0, 0);
+    changeCase(hwnd, a, b, CaseChange::Lower);
+}
+
+void Utils::toggleCase(HWND hwnd, int start, int end) {
+    changeCase(hwnd, start, end, CaseChange::Toggle);
+}
+
+// One fetch and one replace, which Scintilla trims to the changed bytes,
+// so the whole change is a single undo action.
+void Utils::changeCase(HWND hwnd, int start, int end, CaseChange change) {
+    if (start >= end) return;
+    std::string text = getTextRange(hwnd, start, end);
+    bool utf8 = ::SendMessage(hwnd, SCI_GETCODEPAGE, 0, 0) == SC_CP_UTF8;
+    if (!Utf8::changeCase(text, change, utf8)) return;
+    ::SendMessage(hwnd, SCI_SETTARGETRANGE, start, end);
+    ::SendMessage(hwnd, SCI_REPLACETARGETMINIMAL, text.size(), (LPARAM)text.data());
+}
+
+// The block's lines are fetched once and only the columns inside the block
+// change, then written back with one replace.
+void Utils::changeCaseBlock(HWND hwnd, const BlockSelection& blk, CaseChange change) {
+    int first = lineStart(hwnd, blk.startLine);
+    int last = lineEnd(hwnd, blk.endLine);
+    if (first >= last) return;
+
+    std::string text = getTextRange(hwnd, first, last);
+    bool utf8 = ::SendMessage(hwnd, SCI_GETCODEPAGE, 0, 0) == SC_CP_UTF8;
+    std::string out;
+    out.reserve(text.size());
+    size_t copied = 0;
+    bool changed = false;
+    std::string cell;
+    for (int line = blk.startLine; line <= blk.endLine; line++) {
+        int end = lineEnd(hwnd, line);
+        int a = (std::min)((int)::SendMessage(hwnd, SCI_FINDCOLUMN, line, blk.startCol), end);
+        int b = (std::min)((int)::SendMessage(hwnd, SCI_FINDCOLUMN, line, blk.endCol), end);
+        if (a >= b) continue;
+
+        cell.assign(text, a - first, b - a);
+        if (!Utf8::changeCase(cell, change, utf8)) continue;
+        out.append(text, copied, (a - first) - copied);
+        out += cell;
+        copied = b - first;
+        changed = true;
+    }
+    if (!changed) return;
+    out.append(text, copied, std::string::npos);
+    ::SendMessage(hwnd, SCI_SETTARGETRANGE, first, last);
+    ::SendMessage(hwnd, SCI_REPLACETARGETMINIMAL, out.size(), (LPARAM)out.data());
+}
+
+// Bytes in the character at text[i], in the document's code page.
+size_t Utils::charLength(const std::string& text, size_t i, int codePage) {
+    if (codePage == SC_CP_UTF8) {
+        size_t used;
+        Utf8::decode(text.data() + i, text.size() - i, used);
+        return used;
+    }
+    if (codePage != 0 && i + 1 < text.size() && IsDBCSLeadByteEx(codePage, (BYTE)text[i])) return 2;
+    return 1;
 }
 
-void Utils::replaceChar(HWND hwnd, int pos, char ch) {
-    ::SendMessage(hwnd, SCI_SETTARGETRANGE, pos, pos + 1);
-    ::SendMessage(hwnd, SCI_REPLACETARGET, 1, (LPARAM)&ch);
+void Utils::replaceChar(HWND hwnd, int pos, char32_t ch) {
+    std::string with = documentChar(hwnd, ch);
+    if (with.empty()) return;
+    int next = (int)::SendMessage(hwnd, SCI_POSITIONAFTER, pos, 0);
+    replaceTarget(hwnd, pos, next, with);
 }
 
-void Utils::replaceRange(HWND hwnd, int a, int b, char ch) {
-    for (int i = a; i < b; i++) {
-        char c = (char)::SendMessage(hwnd, SCI_GETCHARAT, i, 0);
-        if (c != '\r' && c != '\n') {
-            replaceChar(hwnd, i, ch);
+// Every character from a to b except line breaks becomes ch, in one edit.
+void Utils::replaceRange(HWND hwnd, int a, int b, char32_t ch) {
+    if (a >= b) return;
+    std::string with = documentChar(hwnd, ch);
+    if (with.empty()) return;
+
+    std::string text = getTextRange(hwnd, a, b);
+    int codePage = (int)::SendMessage(hwnd, SCI_GETCODEPAGE, 0, 0);
+    std::string out;
+    if (with.size() == 1 && (codePage == 0 || Utf8::isAscii(text.data(), text.size()))) {
+        out = text;
+        for (char& c : out) {
+            if (c != '\r' && c != '\n') c = with[0];
+        }
+    } else {
+        out.reserve(text.size() * with.size());
+        for (size_t i = 0; i < text.size();) {
+            if (text[i] == '\r' || text[i] == '\n') {
+                out += text[i++];
+                continue;
+            }
+            i += charLength(text, i, codePage);
+            out += with;
         }
     }
+    if (out != text) replaceTarget(hwnd, a, b, out);
 }
 
 BlockSelection Utils::blockSelection(HWND hwnd) {
@@ -404,57 +531,69 @@ void Utils::clearBlockSelection(HWND hwnd) {
     ::SendMessage(hwnd, SCI_SETSELECTIONMODE, SC_SEL_STREAM, 0);
 }
 
-void Utils::forEachBlockCell(HWND hwnd, const BlockSelection& blk, void (*fn)(HWND,int)) {
-    for (int line = blk.startLine; line <= blk.endLine; line++) {
-        int ls = lineStart(hwnd, line);
-        int le = lineEnd(hwnd, line);
-        int cs = (int)::SendMessage(hwnd, SCI_FINDCOLUMN, line, blk.startCol);
-        int ce = (int)::SendMessage(hwnd, SCI_FINDCOLUMN, line, blk.endCol);
-        if (cs > le) cs = le;
-        if (ce > le) ce = le;
-        for (int p = cs; p < ce; p++) fn(hwnd, p);
-    }
+void Utils::pasteAfter(HWND hwnd, int count, bool linewise) {
+    Paste::put(hwnd, getCurrentRegister(), count, linewise ? Paste::LINEWISE : Paste::CHARWISE, true);
 }
 
-void Utils::pasteAfter(HWND hwnd, int count, bool linewise) {
-    int pos = caretPos(hwnd);
-    int line = caretLine(hwnd);
-    if (linewise) {
-        auto r = lineRange(hwnd, line, true);
-        ::SendMessage(hwnd, SCI_GOTOPOS, r.second, 0);
-    } else {
-        ::SendMessage(hwnd, SCI_GOTOPOS, (int)::SendMessage(hwnd, SCI_POSITIONAFTER, pos, 0), 0);
+void Utils::pasteBefore(HWND hwnd, int count, bool linewise) {
+    Paste::put(hwnd, getCurrentRegister(), count, linewise ? Paste::LINEWISE : Paste::CHARWISE, false);
+}
+
+void Utils::joinLines(HWND hwnd, int startLine, int count, bool withSpace) {
+    // Like Vim, a count of N joins N lines (at least two)
+    int lastLine = (std::min)(startLine + (std::max)(count - 1, 1), lineCount(hwnd) - 1);
+    if (lastLine <= startLine) return;
+
+    int start = lineEnd(hwnd, startLine);
+    int end = lineEnd(hwnd, lastLine);
+    std::string text = getTextRange(hwnd, start, end);
+
+    std::string out;
+    out.reserve(text.size());
+    char prev = (start > 0) ? (char)::SendMessage(hwnd, SCI_GETCHARAT, start - 1, 0) : '\n';
+    size_t joinOffset = 0;
+
+    size_t i = 0;
+    while (i < text.size()) {
+        size_t next = i + 1;
+        if (text[i] == '\r' && next < text.size() && text[next] == '\n') next++;
+        size_t eol = text.find_first_of("\r\n", next);
+        size_t contentEnd = (eol == std::string::npos) ? text.size() : eol;
+
+        size_t content = next;
+        joinOffset = out.size();
+        if (withSpace) {
+            while (content < contentEnd && (text[content] == ' ' || text[content] == '\t')) content++;
+            if (content < contentEnd && text[content] != ')' &&
+                prev != ' ' && prev != '\t' && prev != '\n' && prev != '\r') {
+                out += ' ';
+            }
+        }
+        out.append(text, content, contentEnd - content);
+        if (contentEnd > content) prev = text[contentEnd - 1];
+        else if (!out.empty()) prev = out.back();
+
+        i = contentEnd;
     }
-    for (int i = 0; i < count; i++) { ::SendMessage(hwnd, SCI_PASTE, 0, 0); }
 
-     int newPos = caretPos(hwnd);
-    ::SendMessage(hwnd, SCI_SETSEL, newPos, newPos);
+    replaceTarget(hwnd, start, end, out);
+    ::SendMessage(hwnd, SCI_GOTOPOS, start + (int)joinOffset, 0);
 }
 
-void Utils::pasteBefore(HWND hwnd, int count, bool linewise) {
-    int pos = caretPos(hwnd);
-    int line = caretLine(hwnd);
-    if (linewise) {
-        ::SendMessage(hwnd, SCI_GOTOPOS, lineStart(hwnd, line), 0);
-    } else {
-        ::SendMessage(hwnd, SCI_GOTOPOS, pos, 0);
-    }
-    for (int i = 0; i < count; i++) {
-        ::SendMessage(hwnd, SCI_PASTE, 0, 0);
+std::string Utils::eolString(HWND hwnd) {
+    switch ((int)::SendMessage(hwnd, SCI_GETEOLMODE, 0, 0)) {
+    case SC_EOL_CRLF: return "\r\n";
+    case SC_EOL_CR: return "\r";
+    default: return "\n";
     }
 }
 
-void Utils::joinLines(HWND hwnd, int startLine, int count, bool withSpace) {
-    for (int i = 0; i < count; i++) {
-        int end = lineEnd(hwnd, startLine);
-        int next = lineStart(hwnd, startLine + 1);
-        if (startLine + i + 1 >= lineCount(hwnd)) break;
-        select(hwnd, end, next);
-        ::SendMessage(hwnd, SCI_REPLACESEL, 0, (LPARAM)(withSpace ? " " : ""));
-    }
+void Utils::replaceTarget(HWND hwnd, int start, int end, const std::string& text) {
+    ::SendMessage(hwnd, SCI_SETTARGETRANGE, start, end);
+    ::SendMessage(hwnd, SCI_REPLACETARGET, text.size(), (LPARAM)text.data());
 }
 
-void Utils::charSearch(HWND hwnd, VimState& state, char type, char ch, int count) {
+void Utils::charSearch(HWND hwnd, VimState& state, char type, char32_t ch, int count) {
     bool forward = (type == 'f' || type == 't');
     bool till = (type == 't' || type == 'T');
 
@@ -472,16 +611,11 @@ void Utils::charSearch(HWND hwnd, VimState& state, char type, char ch, int count
 }
 
 void Utils::setClipboardText(const std::string& text) {
-    if (!OpenClipboard(nullptr)) return;
-    EmptyClipboard();
-    HGLOBAL h = GlobalAlloc(GMEM_MOVEABLE, text.size() + 1);
-    if (h) {
-        char* p = (char*)GlobalLock(h);
-        memcpy(p, text.c_str(), text.size() + 1);
-        GlobalUnlock(h);
-        SetClipboardData(CF_TEXT, h);
-    }
-    CloseClipboard();
+    Clipboard::getInstance().setText(text);
+}
+
+std::string Utils::getClipboardText() {
+    return Clipboard::getInstance().getText();
 }
 
 static void appendSection(std::string& out, const std::string& title, const Keymap& km) {
@@ -512,18 +646,16 @@ std::string Utils::buildTutorText() {
     out += "============\n\n";
     out += "Welcome to NppVim! This tutor will guide you through the basics.\n\n";
 
-    auto append = [&](const char* title, const Keymap* km) {
-        if (!km) return;
-
+    auto append = [&](const char* title, const std::vector<KeyBinding>& bindings) {
         out += title;
         out += "\n";
         out += std::string(strlen(title), '-') + "\n";
 
         size_t pad = 0;
-        for (const auto& b : km->getBindings())
+        for (const auto& b : bindings)
             pad = (std::max)(pad, b.keys.size());
 
-        for (const auto& b : km->getBindings()) {
+        for (const auto& b : bindings) {
             out += "  ";
             out += b.keys;
             out += std::string(pad - b.keys.size() + 2, ' ');
@@ -534,9 +666,9 @@ std::string Utils::buildTutorText() {
         out += "\n";
     };
 
-    append("1. Normal Mode (Navigation & Editing)", g_normalKeymap.get());
-    append("2. Visual Mode (Selection)", g_visualKeymap.get());
-    append("3. Command Mode (System Commands)", g_commandKeymap.get());
+    if (g_normalKeymap) append("1. Normal Mode (Navigation & Editing)", g_normalKeymap->getBindings());
+    if (g_visualKeymap) append("2. Visual Mode (Selection)", g_visualKeymap->getBindings());
+    append("3. Command Mode (System Commands)", CommandRegistry::getInstance().listing());
 
     out += "4. Search and Replace\n";
     out += "---------------------\n";
@@ -606,6 +738,8 @@ std::string Utils::readPluginFile(const std::string& filename) {
 }
 
 int Utils::getCharBlocking() {
+    // Whatever prompt the caller set must be visible while we wait.
+    UiUpdates::getInstance().flushNow();
     MSG msg;
     while (GetMessage(&msg, NULL, 0, 0)) {
         if (msg.message == WM_CHAR)
@@ -617,22 +751,19 @@ int Utils::getCharBlocking() {
 }
 
 std::string Utils::getRegisterContent(char reg) {
-    if (state.registers.find(reg) != state.registers.end()) {
-        return state.registers[reg];
-    }
-    return "";
+    return std::string(RegisterStore::getInstance().view(reg));
+}
+
+RegisterText Utils::getRegisterText(char reg) {
+    return RegisterStore::getInstance().get(reg);
 }
 
 void Utils::setRegisterContent(char reg, const std::string& content) {
-    state.registers[reg] = content;
+    RegisterStore::getInstance().set(reg, content);
 }
 
 void Utils::appendToRegister(char reg, const std::string& content) {
-    if (state.registers.find(reg) != state.registers.end()) {
-        state.registers[reg] += content;
-    } else {
-        state.registers[reg] = content;
-    }
+    RegisterStore::getInstance().append(reg, content);
 }
 
 bool Utils::isValidRegister(char c) {
@@ -662,7 +793,8 @@ void Utils::storeRegister(char reg, const std::string& text, bool syncClipboard)
     Utils::setRegisterContent(reg, text);
 
     if (syncClipboard && reg == '"') {
-        Utils::setClipboardText(text);
+        // Published lazily; repeated deletes only replace the pending block
+        Clipboard::getInstance().setDeferred(Utils::getRegisterText(reg));
     }
 }
 
@@ -732,6 +864,27 @@ std::string Utils::toUtf8(const std::wstring& wstr) {
     return str;
 }
 
+// A character as the document stores it: UTF-8, or the document's code page.
+std::string Utils::documentChar(HWND hwnd, char32_t cp) {
+    int codePage = (int)::SendMessage(hwnd, SCI_GETCODEPAGE, 0, 0);
+    if (codePage == SC_CP_UTF8 || cp < 0x80) return Utf8::encode(cp);
+
+    wchar_t wide[2];
+    int units = 1;
+    if (cp >= 0x10000) {
+        wide[0] = (wchar_t)(0xD800 + ((cp - 0x10000) >> 10));
+        wide[1] = (wchar_t)(0xDC00 + ((cp - 0x10000) & 0x3FF));
+        units = 2;
+    } else {
+        wide[0] = (wchar_t)cp;
+    }
+    char buf[8];
+    BOOL lossy = FALSE;
+    int n = WideCharToMultiByte(codePage ? codePage : CP_ACP, 0, wide, units, buf, sizeof(buf), NULL, &lossy);
+    if (n <= 0 || lossy) return "";
+    return std::string(buf, n);
+}
+
 std::string Utils::trim(const std::string& s) {
     size_t first = s.find_first_not_of(" \t\r\n");
     if (std::string::npos == first) return "";
@@ -751,15 +904,7 @@ std::string Utils::getTextRange(HWND h, int start, int end) {
 }
 
 void Utils::rot13(HWND hwnd, int start, int end) {
-    if (start >= end) return;
-    std::string text = getTextRange(hwnd, start, end);
-    for (char &c : text) {
-        if (c >= 'a' && c <= 'z') c = 'a' + (c - 'a' + 13) % 26;
-        else if (c >= 'A' && c <= 'Z') c = 'A' + (c - 'A' + 13) % 26;
-    }
-    ::SendMessage(hwnd, SCI_SETTARGETSTART, start, 0);
-    ::SendMessage(hwnd, SCI_SETTARGETEND, end, 0);
-    ::SendMessage(hwnd, SCI_REPLACETARGET, text.size(), (LPARAM)text.c_str());
+    changeCase(hwnd, start, end, CaseChange::Rot13);
 }
 
 char Utils::applyLangmap(wchar_t c) {
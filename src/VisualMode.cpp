@@ -3,7 +3,16 @@
 #include "../include/CommandMode.h"
 #include "../include/Keymap.h"
 #include "../include/NppVim.h"
+#include "../include/Registers.h"
+#include "../include/BracketIndex.h"
+#include "../include/Marks.h"
 #include "../include/TextObject.h"
+#include "../include/CharClass.h"
+#include "../include/Increment.h"
+#include "../include/BlockEdit.h"
+#include "../include/Reflow.h"
+#include "../include/Indent.h"
+#include "../include/Paste.h"
 #include "../include/Utils.h"
 #include "../plugin/menuCmdID.h"
 #include "../plugin/Scintilla.h"
@@ -29,11 +38,14 @@ std::string VisualMode::getSelectedText(HWND h) {
     return std::string(buffer.data());
 }
 
-void VisualMode::updateBlockAfterMove(HWND h, int newCaret) {
+// Only j and k keep the column the block aims for, including the end of
+// every line after $.
+void VisualMode::updateBlockAfterMove(HWND h, int newCaret, bool vertical) {
     int anchor = ::SendMessage(h, SCI_GETRECTANGULARSELECTIONANCHOR, 0, 0);
     ::SendMessage(h, SCI_SETCURRENTPOS, newCaret, 0);
     ::SendMessage(h, SCI_SETRECTANGULARSELECTIONANCHOR, anchor, 0);
     ::SendMessage(h, SCI_SETRECTANGULARSELECTIONCARET, newCaret, 0);
+    if (!vertical) state.visualPreferredColumn = ::SendMessage(h, SCI_GETCOLUMN, newCaret, 0);
 }
 
 void VisualMode::setupKeyMaps() {
@@ -55,6 +67,8 @@ void VisualMode::setupKeyMaps() {
                 if (!content.empty()) {
                     Utils::storeRegister(reg, content, g_config.dStoreClipboard);
                 }
+                state.lastYankLinewise = false;
+                state.lastYankBlockwise = true;
             }
 
             // Clear the block selection
@@ -76,6 +90,7 @@ void VisualMode::setupKeyMaps() {
                     Utils::storeRegister(reg, content, g_config.dStoreClipboard);
                 }
                 state.lastYankLinewise = true;
+                state.lastYankBlockwise = false;
             }
 
             Utils::clear(h, startPos, endPos);
@@ -93,6 +108,7 @@ void VisualMode::setupKeyMaps() {
                     Utils::storeRegister(reg, content, g_config.dStoreClipboard);
                 }
                 state.lastYankLinewise = false;
+                state.lastYankBlockwise = false;
             }
 
             Utils::clear(h, startPos, endPos);
@@ -115,6 +131,8 @@ void VisualMode::setupKeyMaps() {
                 if (!content.empty()) {
                     Utils::storeRegister(reg, content, g_config.xStoreClipboard);
                 }
+                state.lastYankLinewise = false;
+                state.lastYankBlockwise = true;
             }
             ::SendMessage(h, SCI_CLEAR, 0, 0);
             Utils::clearBlockSelection(h);
@@ -132,6 +150,8 @@ void VisualMode::setupKeyMaps() {
                 }
 
                 state.lastYankLinewise = state.isLineVisual;
+
+                state.lastYankBlockwise = false;
             }
 
             Utils::clear(h, startPos, endPos);
@@ -164,6 +184,8 @@ void VisualMode::setupKeyMaps() {
             if (!content.empty() && reg != '_') {
                 Utils::storeRegister(reg, content, true);
             }
+            state.lastYankLinewise = false;
+            state.lastYankBlockwise = true;
         }
         else if (state.isLineVisual) {
             int startPos = ::SendMessage(h, SCI_GETSELECTIONSTART, 0, 0);
@@ -174,6 +196,7 @@ void VisualMode::setupKeyMaps() {
                 Utils::storeRegister(reg, content, true);
             }
             state.lastYankLinewise = true;
+            state.lastYankBlockwise = false;
         }
         else {
             int startPos = ::SendMessage(h, SCI_GETSELECTIONSTART, 0, 0);
@@ -184,6 +207,7 @@ void VisualMode::setupKeyMaps() {
                 Utils::storeRegister(reg, content, true);
             }
             state.lastYankLinewise = false;
+            state.lastYankBlockwise = false;
         }
 
         Utils::setCurrentRegister('"');
@@ -200,8 +224,6 @@ void VisualMode::setupKeyMaps() {
         Utils::beginUndo(h);
 
         if (state.isBlockVisual) {
-            BlockSelection blk = Utils::blockSelection(h);
-
             // Store in register unless it's blackhole
             if (!toBlackhole) {
                 std::string content = getSelectedText(h);
@@ -209,27 +231,11 @@ void VisualMode::setupKeyMaps() {
                 if (!content.empty()) {
                     Utils::storeRegister(reg, content, g_config.cStoreClipboard);
                 }
+                state.lastYankLinewise = false;
+                state.lastYankBlockwise = true;
             }
 
-            // Clear the block selection
-            ::SendMessage(h, SCI_CLEAR, 0, 0);
-            Utils::clearBlockSelection(h);
-            ::SendMessage(h, SCI_CLEARSELECTIONS, 0, 0);
-
-            // Set up multiple cursors at the start of each line in the block
-            bool first = true;
-            for (int line = blk.startLine; line <= blk.endLine; line++) {
-                int lineEnd = Utils::lineEnd(h, line);
-                int pos = (int)::SendMessage(h, SCI_FINDCOLUMN, line, blk.startCol);
-                if (pos > lineEnd) pos = lineEnd;
-
-                if (first) {
-                    Utils::select(h, pos, pos);
-                    first = false;
-                } else {
-                    ::SendMessage(h, SCI_ADDSELECTION, pos, pos);
-                }
-            }
+            startBlockInsert(h, 'c');
         }
         else {
             int startPos = ::SendMessage(h, SCI_GETSELECTIONSTART, 0, 0);
@@ -321,9 +327,7 @@ void VisualMode::setupKeyMaps() {
      });
 
     k.set("g?", "Rot13 selection", [this](HWND h, int c) {
-        int s = ::SendMessage(h, SCI_GETSELECTIONSTART, 0, 0);
-        int e = ::SendMessage(h, SCI_GETSELECTIONEND, 0, 0);
-        Utils::rot13(h, s, e);
+        changeSelectionCase(h, CaseChange::Rot13);
 
         saveVisualSelection(h);
         exitToNormal(h);
@@ -358,69 +362,9 @@ void VisualMode::setupKeyMaps() {
         extendSelection(h, pos);
     })
     .motion("ge", 'e', [this](HWND h, int c) {
-        for (int i = 0; i < c; i++) {
-            int pos = Utils::caretPos(h);
-
-            if (pos > 0)
-                pos = ::SendMessage(h, SCI_POSITIONBEFORE, pos, 0);
-
-            while (pos > 0) {
-                char ch = ::SendMessage(h, SCI_GETCHARAT, pos, 0);
-                if (!isspace(ch)) break;
-                pos = ::SendMessage(h, SCI_POSITIONBEFORE, pos, 0);
-            }
-
-            while (pos > 0) {
-                char ch = ::SendMessage(h, SCI_GETCHARAT, pos - 1, 0);
-                if (isspace(ch)) break;
-                pos = ::SendMessage(h, SCI_POSITIONBEFORE, pos, 0);
-            }
-
-            while (true) {
-                char ch = ::SendMessage(h, SCI_GETCHARAT, pos, 0);
-                if (isspace(ch)) break;
-
-                int next = ::SendMessage(h, SCI_POSITIONAFTER, pos, 0);
-                if (next == pos) break;
-                pos = next;
-            }
-
-            pos = ::SendMessage(h, SCI_POSITIONBEFORE, pos, 0);
-
-            extendSelection(h, pos);
-        }
+        extendSelection(h, Motion::wordEndPrevTarget(h, Utils::caretPos(h), c, false));
     }).motion("gE", 'E', [this](HWND h, int c) {
-        for (int i = 0; i < c; i++) {
-            int pos = Utils::caretPos(h);
-
-            if (pos > 0)
-                pos = ::SendMessage(h, SCI_POSITIONBEFORE, pos, 0);
-
-            while (pos > 0) {
-                char ch = ::SendMessage(h, SCI_GETCHARAT, pos, 0);
-                if (ch != ' ' && ch != '\t' && ch != '\n') break;
-                pos = ::SendMessage(h, SCI_POSITIONBEFORE, pos, 0);
-            }
-
-            while (pos > 0) {
-                char ch = ::SendMessage(h, SCI_GETCHARAT, pos - 1, 0);
-                if (ch == ' ' || ch == '\t' || ch == '\n') break;
-                pos = ::SendMessage(h, SCI_POSITIONBEFORE, pos, 0);
-            }
-
-            while (true) {
-                char ch = ::SendMessage(h, SCI_GETCHARAT, pos, 0);
-                if (ch == ' ' || ch == '\t' || ch == '\n') break;
-
-                int next = ::SendMessage(h, SCI_POSITIONAFTER, pos, 0);
-                if (next == pos) break;
-                pos = next;
-            }
-
-            pos = ::SendMessage(h, SCI_POSITIONBEFORE, pos, 0);
-
-            extendSelection(h, pos);
-        }
+        extendSelection(h, Motion::wordEndPrevTarget(h, Utils::caretPos(h), c, true));
     }).motion("gm", 'm', [this](HWND h, int c) {
         int first = ::SendMessage(h, SCI_GETFIRSTVISIBLELINE, 0, 0);
         int lines = ::SendMessage(h, SCI_LINESONSCREEN, 0, 0);
@@ -430,36 +374,7 @@ void VisualMode::setupKeyMaps() {
 
     k.set("I", "Insert before", [this](HWND h, int c) {
         if (state.isBlockVisual) {
-            int anchor = ::SendMessage(h, SCI_GETRECTANGULARSELECTIONANCHOR, 0, 0);
-            int caret = ::SendMessage(h, SCI_GETRECTANGULARSELECTIONCARET, 0, 0);
-            int anchorLine = ::SendMessage(h, SCI_LINEFROMPOSITION, anchor, 0);
-            int caretLine = ::SendMessage(h, SCI_LINEFROMPOSITION, caret, 0);
-            int anchorCol = anchor - ::SendMessage(h, SCI_POSITIONFROMLINE, anchorLine, 0);
-            int caretCol = caret - ::SendMessage(h, SCI_POSITIONFROMLINE, caretLine, 0);
-
-            int startLine = (std::min)(anchorLine, caretLine);
-            int endLine = (std::max)(anchorLine, caretLine);
-            int startCol = (std::min)(anchorCol, caretCol);
-
-            ::SendMessage(h, SCI_SETSELECTIONMODE, SC_SEL_STREAM, 0);
-            ::SendMessage(h, SCI_CLEARSELECTIONS, 0, 0);
-
-            bool first = true;
-            for (int line = startLine; line <= endLine; line++) {
-                int lineStart = Utils::lineStart(h, line);
-                int lineEnd = Utils::lineEnd(h, line);
-                int pos = lineStart + startCol;
-                if (pos > lineEnd) pos = lineEnd;
-
-                if (first) {
-                    ::SendMessage(h, SCI_SETCURRENTPOS, pos, 0);
-                    ::SendMessage(h, SCI_SETANCHOR, pos, 0);
-                    first = false;
-                } else {
-                    ::SendMessage(h, SCI_ADDSELECTION, pos, pos);
-                }
-            }
-            state.isBlockVisual = false;
+            startBlockInsert(h, 'I');
         } else {
             int start = ::SendMessage(h, SCI_GETSELECTIONSTART, 0, 0);
             ::SendMessage(h, SCI_SETCURRENTPOS, start, 0);
@@ -469,36 +384,7 @@ void VisualMode::setupKeyMaps() {
     })
     .set("A", "Insert after", [this](HWND h, int c) {
         if (state.isBlockVisual) {
-            int anchor = ::SendMessage(h, SCI_GETRECTANGULARSELECTIONANCHOR, 0, 0);
-            int caret = ::SendMessage(h, SCI_GETRECTANGULARSELECTIONCARET, 0, 0);
-            int anchorLine = ::SendMessage(h, SCI_LINEFROMPOSITION, anchor, 0);
-            int caretLine = ::SendMessage(h, SCI_LINEFROMPOSITION, caret, 0);
-            int anchorCol = anchor - ::SendMessage(h, SCI_POSITIONFROMLINE, anchorLine, 0);
-            int caretCol = caret - ::SendMessage(h, SCI_POSITIONFROMLINE, caretLine, 0);
-
-            int startLine = (std::min)(anchorLine, caretLine);
-            int endLine = (std::max)(anchorLine, caretLine);
-            int endCol = (std::max)(anchorCol, caretCol);
-
-            ::SendMessage(h, SCI_SETSELECTIONMODE, SC_SEL_STREAM, 0);
-            ::SendMessage(h, SCI_CLEARSELECTIONS, 0, 0);
-
-            bool first = true;
-            for (int line = startLine; line <= endLine; line++) {
-                int lineStart = Utils::lineStart(h, line);
-                int lineEnd = Utils::lineEnd(h, line);
-                int pos = lineStart + endCol;
-                if (pos > lineEnd) pos = lineEnd;
-
-                if (first) {
-                    ::SendMessage(h, SCI_SETCURRENTPOS, pos, 0);
-                    ::SendMessage(h, SCI_SETANCHOR, pos, 0);
-                    first = false;
-                } else {
-                    ::SendMessage(h, SCI_ADDSELECTION, pos, pos);
-                }
-            }
-            state.isBlockVisual = false;
+            startBlockInsert(h, 'A');
         } else {
             int end = ::SendMessage(h, SCI_GETSELECTIONEND, 0, 0);
             ::SendMessage(h, SCI_SETCURRENTPOS, end, 0);
@@ -576,7 +462,7 @@ void VisualMode::setupKeyMaps() {
             if (newLine >= total) newLine = total - 1;
 
             int newPos = (int)::SendMessage(h, SCI_FINDCOLUMN, newLine, state.visualPreferredColumn);
-            updateBlockAfterMove(h, newPos);
+            updateBlockAfterMove(h, newPos, true);
         }
         else if (state.isLineVisual) {
             int anchorLine = state.visualAnchorLine;
@@ -623,7 +509,7 @@ void VisualMode::setupKeyMaps() {
             if (newLine < 0) newLine = 0;
 
             int newPos = (int)::SendMessage(h, SCI_FINDCOLUMN, newLine, state.visualPreferredColumn);
-            updateBlockAfterMove(h, newPos);
+            updateBlockAfterMove(h, newPos, true);
         } 
         else if (state.isLineVisual) {
             int anchorLine = state.visualAnchorLine;
@@ -677,60 +563,48 @@ void VisualMode::setupKeyMaps() {
     })
     .motion("w", 'w', [this](HWND h, int c) {
         if (state.isBlockVisual) {
-            for (int i = 0; i < c; i++) {
-                handleBlockWordRight(h, false);
-                updateBlockAfterMove(h, Utils::caretPos(h));
-            }
+            handleBlockWordRight(h, false, c);
+            updateBlockAfterMove(h, Utils::caretPos(h));
         } else {
             Motion::wordRight(h, c);
         }
     })
     .motion("W", 'W', [this](HWND h, int c) {
         if (state.isBlockVisual) {
-            for (int i = 0; i < c; i++) {
-                handleBlockWordRight(h, true);
-                updateBlockAfterMove(h, Utils::caretPos(h));
-            }
+            handleBlockWordRight(h, true, c);
+            updateBlockAfterMove(h, Utils::caretPos(h));
         } else {
             Motion::wordRightBig(h, c);
         }
     })
     .motion("b", 'b', [this](HWND h, int c) {
         if (state.isBlockVisual) {
-            for (int i = 0; i < c; i++) {
-                handleBlockWordLeft(h, false);
-                updateBlockAfterMove(h, Utils::caretPos(h));
-            }
+            handleBlockWordLeft(h, false, c);
+            updateBlockAfterMove(h, Utils::caretPos(h));
         } else {
             Motion::wordLeft(h, c);
         }
     })
     .motion("B", 'B', [this](HWND h, int c) {
         if (state.isBlockVisual) {
-            for (int i = 0; i < c; i++) {
-                handleBlockWordLeft(h, true);
-                updateBlockAfterMove(h, Utils::caretPos(h));
-            }
+            handleBlockWordLeft(h, true, c);
+            updateBlockAfterMove(h, Utils::caretPos(h));
         } else {
             Motion::wordLeftBig(h, c);
         }
     })
     .motion("e", 'e', [this](HWND h, int c) {
         if (state.isBlockVisual) {
-            for (int i = 0; i < c; i++) {
-                handleBlockWordEnd(h, false);
-                updateBlockAfterMove(h, Utils::caretPos(h));
-            }
+            handleBlockWordEnd(h, false, c);
+            updateBlockAfterMove(h, Utils::caretPos(h));
         } else {
             Motion::wordEnd(h, c);
         }
     })
     .motion("E", 'E', [this](HWND h, int c) {
         if (state.isBlockVisual) {
-            for (int i = 0; i < c; i++) {
-                handleBlockWordEnd(h, true);
-                updateBlockAfterMove(h, Utils::caretPos(h));
-            }
+            handleBlockWordEnd(h, true, c);
+            updateBlockAfterMove(h, Utils::caretPos(h));
         } else {
             Motion::wordEndBig(h, c);
         }
@@ -740,6 +614,7 @@ void VisualMode::setupKeyMaps() {
             int line = Utils::caretLine(h);
             int lineEnd = Utils::lineEnd(h, line);
             updateBlockAfterMove(h, lineEnd);
+            state.visualPreferredColumn = COLUMN_LINE_END;
         } else {
             Motion::lineEnd(h, c);
         }
@@ -764,31 +639,27 @@ void VisualMode::setupKeyMaps() {
     })
     .motion("{", '{', [this](HWND h, int c) {
         if (state.isBlockVisual) {
-            for (int i = 0; i < c; i++) {
-                ::SendMessage(h, SCI_PARAUP, 0, 0);
-                updateBlockAfterMove(h, Utils::caretPos(h));
-            }
+            for (int i = 0; i < c; i++) ::SendMessage(h, SCI_PARAUP, 0, 0);
+            updateBlockAfterMove(h, Utils::caretPos(h));
         } else {
             Motion::paragraphUp(h, c);
         }
     })
     .motion("}", '}', [this](HWND h, int c) {
         if (state.isBlockVisual) {
-            for (int i = 0; i < c; i++) {
-                ::SendMessage(h, SCI_PARADOWN, 0, 0);
-                updateBlockAfterMove(h, Utils::caretPos(h));
-            }
+            for (int i = 0; i < c; i++) ::SendMessage(h, SCI_PARADOWN, 0, 0);
+            updateBlockAfterMove(h, Utils::caretPos(h));
         } else {
             Motion::paragraphDown(h, c);
         }
     })
     .motion("%", '%', [this](HWND h, int c) {
         if (state.isBlockVisual) {
-            int match = ::SendMessage(h, SCI_BRACEMATCH, Utils::caretPos(h), 0);
+            int match = BracketIndex::getInstance().match(h, Utils::caretPos(h));
             if (match != -1) updateBlockAfterMove(h, match);
         } else {
             int pos = Utils::caretPos(h);
-            int match = ::SendMessage(h, SCI_BRACEMATCH, pos, 0);
+            int match = BracketIndex::getInstance().match(h, pos);
             if (match != -1) {
                 ::SendMessage(h, SCI_GOTOPOS, match, 0);
             }
@@ -831,7 +702,7 @@ void VisualMode::setupKeyMaps() {
         }
     })
      .set("~", [this](HWND h, int c) {
-         motion.toggleCase(h, c);
+         changeSelectionCase(h, CaseChange::Toggle);
          exitToNormal(h);
      });
 
@@ -888,7 +759,7 @@ void VisualMode::setupKeyMaps() {
         if (state.lastSearchChar == 0) return;
         bool fwd = state.lastSearchForward;
         bool till = state.lastSearchTill;
-        char ch = state.lastSearchChar;
+        char32_t ch = state.lastSearchChar;
             
         int before = Utils::caretPos(h);
         int anchor = state.visualAnchor;
@@ -918,7 +789,7 @@ void VisualMode::setupKeyMaps() {
         if (state.lastSearchChar == 0) return;
         bool fwd = !state.lastSearchForward;
         bool till = state.lastSearchTill;
-        char ch = state.lastSearchChar;
+        char32_t ch = state.lastSearchChar;
 
         int before = Utils::caretPos(h);
         int anchor = state.visualAnchor;
@@ -962,11 +833,11 @@ void VisualMode::setupKeyMaps() {
     .set("\x19", [](HWND h, int c) { ::SendMessage(h, SCI_LINESCROLL, 0, -c); })
     .set("\x04", [](HWND h, int c) {
         int lines = ::SendMessage(h, SCI_LINESONSCREEN, 0, 0) / 2;
-        for (int i = 0; i < c; i++) Motion::lineDown(h, lines);
+        Motion::lineDown(h, lines * c);
     })
     .set("\x15", [](HWND h, int c) {
         int lines = ::SendMessage(h, SCI_LINESONSCREEN, 0, 0) / 2;
-        for (int i = 0; i < c; i++) Motion::lineUp(h, lines);
+        Motion::lineUp(h, lines * c);
     })
     .set("\x06", [](HWND h, int c) {
         for (int i = 0; i < c; i++) Motion::pageDown(h);
@@ -982,53 +853,26 @@ void VisualMode::setupKeyMaps() {
 
         char reg = Utils::getCurrentRegister();
 
-        std::string content;
-        std::string originalContent;
-
-        if (reg == '+' || reg == '*') {
-
-            if (OpenClipboard(h)) {
-
-                HANDLE hData = GetClipboardData(CF_TEXT);
-
-                if (hData) {
-
-                    char* pszText =
-                        (char*)GlobalLock(hData);
-
-                    if (pszText) {
-                        content = pszText;
-                        GlobalUnlock(hData);
-                    }
-                }
-
-                CloseClipboard();
-            }
+        RegisterText text = Paste::source(reg);
 
-        } else {
-            content = Utils::getRegisterContent(reg);
-        }
-
-        originalContent = content;
-
-        if (content.empty())
+        if (!text || text->empty())
             return;
 
+        // Keep the original block alive; restoring "" later shares it instead of copying
+        const std::string& content = *text;
+
         if (state.isBlockVisual) {
             std::string replaced = getSelectedText(h);
             Utils::beginUndo(h);
             if (!replaced.empty() && reg != '"') {
                 Utils::storeRegister('"', replaced, false);
             }
-            std::string repeatedContent = "";
-            for (int i = 0; i < c; i++) {
-                repeatedContent += content;
-            }
-            ::SendMessage(h, SCI_REPLACESEL, 0, (LPARAM)repeatedContent.c_str());
+            std::string repeated = Paste::repeat(content, c);
+            ::SendMessage(h, SCI_REPLACESEL, 0, (LPARAM)repeated.c_str());
             Utils::clearBlockSelection(h);
             Utils::endUndo(h);
             if (reg == '"') {
-                Utils::storeRegister('"', originalContent, false);
+                RegisterStore::getInstance().set('"', text);
             }
             exitToNormal(h);
             return;
@@ -1049,24 +893,15 @@ void VisualMode::setupKeyMaps() {
             Utils::storeRegister('"', replaced, false);
         }
 
-        Utils::clear(h, start, end);
-
-        for (int i = 0; i < c; i++) {
-
-            ::SendMessage(
-                h,
-                SCI_INSERTTEXT,
-                start,
-                (LPARAM)content.c_str()
-            );
-        }
+        std::string repeated = Paste::repeat(content, c);
+        Utils::replaceTarget(h, start, end, repeated);
 
         if (reg == '"') {
-            Utils::storeRegister('"', originalContent, false);
+            RegisterStore::getInstance().set('"', text);
         }
 
         int newEnd =
-            start + ((int)content.size() * c);
+            start + (int)repeated.size();
 
         Utils::select(h, start, newEnd);
 
@@ -1078,53 +913,26 @@ void VisualMode::setupKeyMaps() {
 
         char reg = Utils::getCurrentRegister();
 
-        std::string content;
-        std::string originalContent;
-
-        if (reg == '+' || reg == '*') {
-
-            if (OpenClipboard(h)) {
-
-                HANDLE hData = GetClipboardData(CF_TEXT);
+        RegisterText text = Paste::source(reg);
 
-                if (hData) {
-
-                    char* pszText =
-                        (char*)GlobalLock(hData);
-
-                    if (pszText) {
-                        content = pszText;
-                        GlobalUnlock(hData);
-                    }
-                }
-
-                CloseClipboard();
-            }
-
-        } else {
-            content = Utils::getRegisterContent(reg);
-        }
-
-        originalContent = content;
-
-        if (content.empty())
+        if (!text || text->empty())
             return;
 
+        // Keep the original block alive; restoring "" later shares it instead of copying
+        const std::string& content = *text;
+
         if (state.isBlockVisual) {
             std::string replaced = getSelectedText(h);
             Utils::beginUndo(h);
             if (!replaced.empty() && reg != '"') {
                 Utils::storeRegister('"', replaced, false);
             }
-            std::string repeatedContent = "";
-            for (int i = 0; i < c; i++) {
-                repeatedContent += content;
-            }
-            ::SendMessage(h, SCI_REPLACESEL, 0, (LPARAM)repeatedContent.c_str());
+            std::string repeated = Paste::repeat(content, c);
+            ::SendMessage(h, SCI_REPLACESEL, 0, (LPARAM)repeated.c_str());
             Utils::clearBlockSelection(h);
             Utils::endUndo(h);
             if (reg == '"') {
-                Utils::storeRegister('"', originalContent, false);
+                RegisterStore::getInstance().set('"', text);
             }
             exitToNormal(h);
             return;
@@ -1145,20 +953,11 @@ void VisualMode::setupKeyMaps() {
             Utils::storeRegister('"', replaced, false);
         }
 
-        Utils::clear(h, start, end);
-
-        for (int i = 0; i < c; i++) {
-
-            ::SendMessage(
-                h,
-                SCI_INSERTTEXT,
-                start,
-                (LPARAM)content.c_str()
-            );
-        }
+        std::string repeated = Paste::repeat(content, c);
+        Utils::replaceTarget(h, start, end, repeated);
 
         if (reg == '"') {
-            Utils::storeRegister('"', originalContent, false);
+            RegisterStore::getInstance().set('"', text);
         }
 
         Utils::select(h, start, start);
@@ -1191,17 +990,13 @@ void VisualMode::setupKeyMaps() {
     
     k.set("\x04", [this](HWND h, int c) {
         int lines = ::SendMessage(h, SCI_LINESONSCREEN, 0, 0) / 2;
-        for (int i = 0; i < c; i++) {
-            Motion::lineDown(h, lines);
-            extendSelection(h, Utils::caretPos(h));
-        }
+        Motion::lineDown(h, lines * c);
+        extendSelection(h, Utils::caretPos(h));
     })
     .set("\x15", [this](HWND h, int c) {
         int lines = ::SendMessage(h, SCI_LINESONSCREEN, 0, 0) / 2;
-        for (int i = 0; i < c; i++) {
-            Motion::lineUp(h, lines);
-            extendSelection(h, Utils::caretPos(h));
-        }
+        Motion::lineUp(h, lines * c);
+        extendSelection(h, Utils::caretPos(h));
     });
 
     k.set("<", [this](HWND h, int c) {
@@ -1214,7 +1009,12 @@ void VisualMode::setupKeyMaps() {
         state.recordLastOp(OP_INDENT, c, '>');
         exitToNormal(h);
     })
-     .set("=", [](HWND h, int c) { Utils::handleAutoIndent(h, c); });
+     .set("=", [this](HWND h, int c) {
+        int startLine, endLine;
+        selectionLines(h, startLine, endLine);
+        exitToNormal(h);
+        Indent::apply(h, startLine, endLine);
+    });
 
     k.set("gcc", [this](HWND h, int c) {
          ::SendMessage(nppData._nppHandle, WM_COMMAND, IDM_EDIT_BLOCK_COMMENT, 0);
@@ -1223,96 +1023,33 @@ void VisualMode::setupKeyMaps() {
      });
 
      k.set("gq", [this](HWND h, int c) {
-        int selStart = ::SendMessage(h, SCI_GETSELECTIONSTART, 0, 0);
-        int selEnd = ::SendMessage(h, SCI_GETSELECTIONEND, 0, 0);
-
-        if (selStart == selEnd) {
-            exitToNormal(h);
-            return;
-        }
-
-        int startLine = ::SendMessage(h, SCI_LINEFROMPOSITION, selStart, 0);
-        int endLine = ::SendMessage(h, SCI_LINEFROMPOSITION, selEnd, 0);
-
-        int textWidth = ::SendMessage(h, SCI_GETEDGECOLUMN, 0, 0);
-        if (textWidth <= 0) textWidth = 80;
-
-        Utils::beginUndo(h);
-
-        for (int line = startLine; line <= endLine; line++) {
-            int lineStart = Utils::lineStart(h, line);
-            int lineEnd = Utils::lineEnd(h, line);
-            int lineLength = lineEnd - lineStart;
-
-            if (lineLength > textWidth) {
-                std::vector<char> buffer(lineLength + 1);
-                Sci_TextRangeFull tr;
-                tr.chrg.cpMin = lineStart;
-                tr.chrg.cpMax = lineEnd;
-                tr.lpstrText = buffer.data();
-                ::SendMessage(h, SCI_GETTEXTRANGEFULL, 0, (LPARAM)&tr);
-
-                std::string lineText(buffer.data());
-
-                size_t breakPos = lineText.rfind(' ', textWidth);
-                if (breakPos != std::string::npos && breakPos > 0) {
-                    ::SendMessage(h, SCI_SETTARGETRANGE, lineStart + breakPos, lineStart + breakPos + 1);
-                    ::SendMessage(h, SCI_REPLACETARGET, 1, (LPARAM)"\n");
-
-                    endLine++;
-                }
-            }
-        }
-
-        Utils::endUndo(h);
-
         state.recordLastOp(OP_MOTION, c, 'g', 'q');
-        exitToNormal(h);
+        formatSelection(h, false);
     })
     .set("gw", [this](HWND h, int c) {
-        int selStart = ::SendMessage(h, SCI_GETSELECTIONSTART, 0, 0);
-        int selEnd = ::SendMessage(h, SCI_GETSELECTIONEND, 0, 0);
-
-        if (selStart == selEnd) {
-            exitToNormal(h);
-            return;
-        }
-
-        int cursorPos = Utils::caretPos(h);
-
-        g_visualKeymap->handleKey(h, 'g');
-        g_visualKeymap->handleKey(h, 'q');
-
-        ::SendMessage(h, SCI_SETCURRENTPOS, cursorPos, 0);
-        ::SendMessage(h, SCI_SETSEL, cursorPos, cursorPos);
+        formatSelection(h, true);
     });
 
     k.set("U", [this](HWND h, int c) {
-        int start = ::SendMessage(h, SCI_GETSELECTIONSTART, 0, 0);
-        int end = ::SendMessage(h, SCI_GETSELECTIONEND, 0, 0);
-        for (int pos = start; pos < end; pos++) {
-            char ch = ::SendMessage(h, SCI_GETCHARAT, pos, 0);
-            if (std::islower(ch)) {
-                ::SendMessage(h, SCI_SETTARGETRANGE, pos, pos + 1);
-                std::string upper(1, std::toupper(ch));
-                ::SendMessage(h, SCI_REPLACETARGET, 1, (LPARAM)upper.c_str());
-            }
-        }
+        changeSelectionCase(h, CaseChange::Upper);
         exitToNormal(h);
     })
     .set("u", [this](HWND h, int c) {
-        int start = ::SendMessage(h, SCI_GETSELECTIONSTART, 0, 0);
-        int end = ::SendMessage(h, SCI_GETSELECTIONEND, 0, 0);
-        for (int pos = start; pos < end; pos++) {
-            char ch = ::SendMessage(h, SCI_GETCHARAT, pos, 0);
-            if (std::isupper(ch)) {
-                ::SendMessage(h, SCI_SETTARGETRANGE, pos, pos + 1);
-                std::string lower(1, std::tolower(ch));
-                ::SendMessage(h, SCI_REPLACETARGET, 1, (LPARAM)lower.c_str());
-            }
-        }
+        changeSelectionCase(h, CaseChange::Lower);
         exitToNormal(h);
     })
+    .set("\x01", [this](HWND h, int c) {
+        changeSelectionNumbers(h, c, false);
+    })
+    .set("\x18", [this](HWND h, int c) {
+        changeSelectionNumbers(h, -(long long)c, false);
+    })
+    .set("g\x01", [this](HWND h, int c) {
+        changeSelectionNumbers(h, c, true);
+    })
+    .set("g\x18", [this](HWND h, int c) {
+        changeSelectionNumbers(h, -(long long)c, true);
+    })
     .set("J", [this](HWND h, int c) {
         int startLine = ::SendMessage(h, SCI_LINEFROMPOSITION, ::SendMessage(h, SCI_GETSELECTIONSTART, 0, 0), 0);
         int endLine = ::SendMessage(h, SCI_LINEFROMPOSITION, ::SendMessage(h, SCI_GETSELECTIONEND, 0, 0), 0);
@@ -1448,6 +1185,7 @@ void VisualMode::exitToNormal(HWND h) {
             state.lastVisualCaret =
                 ::SendMessage(h, SCI_GETCURRENTPOS, 0, 0);
         }
+        Marks::setVisualMarks(h, state.lastVisualAnchor, state.lastVisualCaret);
 
         state.lastVisualWasLine  = state.isLineVisual;
         state.lastVisualWasBlock = state.isBlockVisual;
@@ -1514,7 +1252,18 @@ void VisualMode::handleKey(HWND hwnd, char c) {
     state.textObjectPending = 0;
 }
 
-void VisualMode::handleCharSearchInput(HWND hwnd, char searchChar, char searchType, int count) {
+// Non-ASCII input reaches visual mode only as the character for f, t or r.
+void VisualMode::handleCharArgument(HWND hwnd, char32_t c) {
+    if (state.opPending == 'f' || state.opPending == 'F' ||
+        state.opPending == 't' || state.opPending == 'T') {
+        int count = state.repeatCount > 0 ? state.repeatCount : 1;
+        handleCharSearchInput(hwnd, c, state.opPending, count);
+    } else if (state.visualReplacePending) {
+        handleVisualReplaceInput(hwnd, c);
+    }
+}
+
+void VisualMode::handleCharSearchInput(HWND hwnd, char32_t searchChar, char searchType, int count) {
     bool isTill = (searchType == 't' || searchType == 'T');
     bool isForward = (searchType == 'f' || searchType == 't');
 
@@ -1550,84 +1299,59 @@ void VisualMode::handleCharSearchInput(HWND hwnd, char searchChar, char searchTy
     Utils::setStatus(TEXT(""));
 }
 
-void VisualMode::handleBlockWordRight(HWND hwnd, bool bigWord) {
+// Block-visual word motions stop at the line ends, so the block keeps its
+// rows; at an end they step onto the neighbouring line like l and h.
+void VisualMode::handleBlockWordRight(HWND hwnd, bool bigWord, int count) {
+    CharClasses classes(hwnd);
+    ClassScanner scan(hwnd, classes);
     int pos = Utils::caretPos(hwnd);
-    int line = ::SendMessage(hwnd, SCI_LINEFROMPOSITION, pos, 0);
-    int lineEnd = ::SendMessage(hwnd, SCI_GETLINEENDPOSITION, line, 0);
-
-    if (pos >= lineEnd) {
-        int nextLine = line + 1;
-        int lineCount = ::SendMessage(hwnd, SCI_GETLINECOUNT, 0, 0);
-        if (nextLine < lineCount) {
-            int nextLineStart = ::SendMessage(hwnd, SCI_POSITIONFROMLINE, nextLine, 0);
-            ::SendMessage(hwnd, SCI_SETCURRENTPOS, nextLineStart, 0);
-        }
-        return;
-    }
-
-    while (pos < lineEnd) {
-        char ch = ::SendMessage(hwnd, SCI_GETCHARAT, pos, 0);
-        if (bigWord ? (ch == ' ' || ch == '\t') : !std::isalnum((unsigned char)ch)) break;
-        pos++;
+    for (int i = 0; i < count; i++) {
+        int line = Utils::lineFromPosition(hwnd, pos);
+        int lineEnd = Utils::lineEnd(hwnd, line);
+        if (pos >= lineEnd) {
+            if (line + 1 >= Utils::lineCount(hwnd)) break;
+            pos = Utils::lineStart(hwnd, line + 1);
+            continue;
+        }
+        unsigned run = bigWord ? CLASS_NONBLANK : classBit(scan.at(pos));
+        pos = scan.skipForward(pos, run, lineEnd);
+        pos = scan.skipForward(pos, classBit(CC_SPACE), lineEnd);
     }
-
-    while (pos < lineEnd) {
-        char ch = ::SendMessage(hwnd, SCI_GETCHARAT, pos, 0);
-        if (!(ch == ' ' || ch == '\t')) break;
-        pos++;
-    }
-
     ::SendMessage(hwnd, SCI_SETCURRENTPOS, pos, 0);
 }
 
-void VisualMode::handleBlockWordLeft(HWND hwnd, bool bigWord) {
+void VisualMode::handleBlockWordLeft(HWND hwnd, bool bigWord, int count) {
+    CharClasses classes(hwnd);
+    ClassScanner scan(hwnd, classes);
     int pos = Utils::caretPos(hwnd);
-    int line = ::SendMessage(hwnd, SCI_LINEFROMPOSITION, pos, 0);
-    int lineStart = ::SendMessage(hwnd, SCI_POSITIONFROMLINE, line, 0);
-
-    if (pos <= lineStart) {
-        int prevLine = line - 1;
-        if (prevLine >= 0) {
-            int prevLineEnd = ::SendMessage(hwnd, SCI_GETLINEENDPOSITION, prevLine, 0);
-            ::SendMessage(hwnd, SCI_SETCURRENTPOS, prevLineEnd, 0);
+    for (int i = 0; i < count; i++) {
+        int line = Utils::lineFromPosition(hwnd, pos);
+        int lineStart = Utils::lineStart(hwnd, line);
+        if (pos <= lineStart) {
+            if (line == 0) break;
+            pos = Utils::lineEnd(hwnd, line - 1);
+            continue;
+        }
+        pos = scan.skipBackward(pos, classBit(CC_SPACE), lineStart);
+        if (pos > lineStart) {
+            unsigned run = bigWord ? CLASS_NONBLANK : classBit(scan.at(pos - 1));
+            pos = scan.skipBackward(pos, run, lineStart);
         }
-        return;
-    }
-
-    pos--;
-
-    while (pos > lineStart) {
-        char ch = ::SendMessage(hwnd, SCI_GETCHARAT, pos, 0);
-        if (!(ch == ' ' || ch == '\t')) break;
-        pos--;
-    }
-
-    while (pos > lineStart) {
-        char ch = ::SendMessage(hwnd, SCI_GETCHARAT, pos - 1, 0);
-        if (bigWord ? (ch == ' ' || ch == '\t') : !std::isalnum((unsigned char)ch)) break;
-        pos--;
     }
-
     ::SendMessage(hwnd, SCI_SETCURRENTPOS, pos, 0);
 }
 
-void VisualMode::handleBlockWordEnd(HWND hwnd, bool bigWord) {
+void VisualMode::handleBlockWordEnd(HWND hwnd, bool bigWord, int count) {
+    CharClasses classes(hwnd);
+    ClassScanner scan(hwnd, classes);
     int pos = Utils::caretPos(hwnd);
-    int line = ::SendMessage(hwnd, SCI_LINEFROMPOSITION, pos, 0);
-    int lineEnd = ::SendMessage(hwnd, SCI_GETLINEENDPOSITION, line, 0);
-
-    if (pos >= lineEnd) return;
-
-    pos++;
-
-    while (pos < lineEnd) {
-        char ch = ::SendMessage(hwnd, SCI_GETCHARAT, pos, 0);
-        if (bigWord ? (ch == ' ' || ch == '\t') : !std::isalnum((unsigned char)ch)) break;
-        pos++;
+    for (int i = 0; i < count; i++) {
+        int lineEnd = Utils::lineEnd(hwnd, Utils::lineFromPosition(hwnd, pos));
+        int next = scan.skipForward(pos + 1, classBit(CC_SPACE), lineEnd);
+        if (next >= lineEnd) break;
+        unsigned run = bigWord ? CLASS_NONBLANK : classBit(scan.at(next));
+        pos = (int)::SendMessage(hwnd, SCI_POSITIONBEFORE, scan.skipForward(next, run, lineEnd), 0);
     }
-
-    if (pos > 0) pos--;
-
     ::SendMessage(hwnd, SCI_SETCURRENTPOS, pos, 0);
 }
 
@@ -1683,7 +1407,7 @@ void VisualMode::extendSelection(HWND h, int newPos) {
     }
 }
 
-void VisualMode::handleVisualReplaceInput(HWND hwnd, char replaceChar) {
+void VisualMode::handleVisualReplaceInput(HWND hwnd, char32_t replaceChar) {
     if (state.isBlockVisual) {
         int anchor = ::SendMessage(hwnd, SCI_GETRECTANGULARSELECTIONANCHOR, 0, 0);
         int caret = ::SendMessage(hwnd, SCI_GETRECTANGULARSELECTIONCARET, 0, 0);
@@ -1695,46 +1419,20 @@ void VisualMode::handleVisualReplaceInput(HWND hwnd, char replaceChar) {
             return;
         }
 
-        int anchorLine = ::SendMessage(hwnd, SCI_LINEFROMPOSITION, anchor, 0);
-        int caretLine = ::SendMessage(hwnd, SCI_LINEFROMPOSITION, caret, 0);
-
-        int anchorVirtualCol = ::SendMessage(hwnd, SCI_GETCOLUMN, anchor, 0);
-        int caretVirtualCol = ::SendMessage(hwnd, SCI_GETCOLUMN, caret, 0);
+        BlockSelection blk = Utils::blockSelection(hwnd);
+        bool toLineEnd = state.visualPreferredColumn == COLUMN_LINE_END;
 
-        int startLine = (std::min)(anchorLine, caretLine);
-        int endLine = (std::max)(anchorLine, caretLine);
-        int startCol = (std::min)(anchorVirtualCol, caretVirtualCol);
-        int endCol = (std::max)(anchorVirtualCol, caretVirtualCol);
-
-        if (startCol == endCol) {
+        if (blk.startCol == blk.endCol && !toLineEnd) {
             Utils::setStatus(TEXT("No selection to replace"));
             state.visualReplacePending = false;
             exitToNormal(hwnd);
             return;
         }
 
-        Utils::beginUndo(hwnd);
-
-        for (int line = startLine; line <= endLine; line++) {
-            int lineStart = ::SendMessage(hwnd, SCI_POSITIONFROMLINE, line, 0);
-            int lineEnd = ::SendMessage(hwnd, SCI_GETLINEENDPOSITION, line, 0);
-
-            int colStart = ::SendMessage(hwnd, SCI_FINDCOLUMN, line, startCol);
-            int colEnd = ::SendMessage(hwnd, SCI_FINDCOLUMN, line, endCol);
-
-            if (colStart > lineEnd) colStart = lineEnd;
-            if (colEnd > lineEnd) colEnd = lineEnd;
-
-            for (int pos = colStart; pos < colEnd; pos++) {
-                char ch = ::SendMessage(hwnd, SCI_GETCHARAT, pos, 0);
-                if (ch != '\r' && ch != '\n') {
-                    ::SendMessage(hwnd, SCI_SETTARGETRANGE, pos, pos + 1);
-                    ::SendMessage(hwnd, SCI_REPLACETARGET, 1, (LPARAM)&replaceChar);
-                }
-            }
+        std::string with = Utils::documentChar(hwnd, replaceChar);
+        if (!with.empty()) {
+            BlockEdit(hwnd, blk.startLine, blk.endLine, blk.startCol, blk.endCol, toLineEnd).fill(with);
         }
-
-        Utils::endUndo(hwnd);
         Utils::setStatus(TEXT("Block selection replaced"));
 
     } else if (state.isLineVisual) {
@@ -1749,15 +1447,7 @@ void VisualMode::handleVisualReplaceInput(HWND hwnd, char replaceChar) {
         }
 
         Utils::beginUndo(hwnd);
-
-        for (int pos = startPos; pos < endPos; pos++) {
-            char ch = ::SendMessage(hwnd, SCI_GETCHARAT, pos, 0);
-            if (ch != '\r' && ch != '\n') {
-                ::SendMessage(hwnd, SCI_SETTARGETRANGE, pos, pos + 1);
-                ::SendMessage(hwnd, SCI_REPLACETARGET, 1, (LPARAM)&replaceChar);
-            }
-        }
-
+        Utils::replaceRange(hwnd, startPos, endPos, replaceChar);
         Utils::endUndo(hwnd);
         Utils::setStatus(TEXT("Line selection replaced"));
 
@@ -1773,12 +1463,7 @@ void VisualMode::handleVisualReplaceInput(HWND hwnd, char replaceChar) {
         }
 
         Utils::beginUndo(hwnd);
-
-        for (int pos = startPos; pos < endPos; pos++) {
-            ::SendMessage(hwnd, SCI_SETTARGETRANGE, pos, pos + 1);
-            ::SendMessage(hwnd, SCI_REPLACETARGET, 1, (LPARAM)&replaceChar);
-        }
-
+        Utils::replaceRange(hwnd, startPos, endPos, replaceChar);
         Utils::endUndo(hwnd);
         Utils::setStatus(TEXT("Selection replaced"));
     }
@@ -1788,6 +1473,67 @@ void VisualMode::handleVisualReplaceInput(HWND hwnd, char replaceChar) {
     exitToNormal(hwnd);
 }
 
+void VisualMode::changeSelectionCase(HWND h, CaseChange change) {
+    if (state.isBlockVisual) {
+        Utils::changeCaseBlock(h, Utils::blockSelection(h), change);
+    } else {
+        int start = ::SendMessage(h, SCI_GETSELECTIONSTART, 0, 0);
+        int end = ::SendMessage(h, SCI_GETSELECTIONEND, 0, 0);
+        Utils::changeCase(h, start, end, change);
+    }
+}
+
+void VisualMode::startBlockInsert(HWND h, char op) {
+    BlockSelection blk = Utils::blockSelection(h);
+    bool toLineEnd = state.visualPreferredColumn == COLUMN_LINE_END;
+    saveVisualSelection(h);
+
+    Utils::clearBlockSelection(h);
+    ::SendMessage(h, SCI_CLEARSELECTIONS, 0, 0);
+    int pos = BlockEdit::beginInsert(h, state.blockInsert, op, blk, toLineEnd);
+    ::SendMessage(h, SCI_SETEMPTYSELECTION, pos, 0);
+    state.isBlockVisual = false;
+}
+
+// Vim leaves the caret at the start of the selection.
+void VisualMode::changeSelectionNumbers(HWND h, long long delta, bool progressive) {
+    int start;
+    if (state.isBlockVisual) {
+        BlockSelection blk = Utils::blockSelection(h);
+        start = ::SendMessage(h, SCI_FINDCOLUMN, blk.startLine, blk.startCol);
+        Increment::inBlock(h, blk, delta, progressive);
+    } else {
+        start = ::SendMessage(h, SCI_GETSELECTIONSTART, 0, 0);
+        Increment::inRange(h, start, ::SendMessage(h, SCI_GETSELECTIONEND, 0, 0), delta, progressive);
+    }
+    exitToNormal(h);
+    ::SendMessage(h, SCI_SETEMPTYSELECTION, start, 0);
+}
+
+// The lines gq, gw and = work on.
+void VisualMode::selectionLines(HWND h, int& startLine, int& endLine) {
+    if (state.isBlockVisual) {
+        BlockSelection blk = Utils::blockSelection(h);
+        startLine = blk.startLine;
+        endLine = blk.endLine;
+    } else {
+        int selStart = ::SendMessage(h, SCI_GETSELECTIONSTART, 0, 0);
+        int selEnd = ::SendMessage(h, SCI_GETSELECTIONEND, 0, 0);
+        startLine = Utils::lineFromPosition(h, selStart);
+        endLine = Utils::lineFromPosition(h, selEnd);
+        if (endLine > startLine && selEnd == Utils::lineStart(h, endLine)) endLine--;
+    }
+}
+
+// gw keeps the caret where it is.
+void VisualMode::formatSelection(HWND h, bool keepCursor) {
+    int startLine, endLine;
+    selectionLines(h, startLine, endLine);
+    int caret = Utils::caretPos(h);
+    exitToNormal(h);
+    Reflow::apply(h, startLine, endLine, keepCursor ? caret : -1);
+}
+
 void VisualMode::saveVisualSelection(HWND h) {
     if (state.isBlockVisual) {
         state.lastVisualAnchor = ::SendMessage(h, SCI_GETRECTANGULARSELECTIONANCHOR, 0, 0);
@@ -1796,6 +1542,7 @@ void VisualMode::saveVisualSelection(HWND h) {
         state.lastVisualAnchor = ::SendMessage(h, SCI_GETANCHOR, 0, 0);
         state.lastVisualCaret = ::SendMessage(h, SCI_GETCURRENTPOS, 0, 0);
     }
+    Marks::setVisualMarks(h, state.lastVisualAnchor, state.lastVisualCaret);
 
     state.lastVisualWasLine = state.isLineVisual;
     state.lastVisualWasBlock = state.isBlockVisual;
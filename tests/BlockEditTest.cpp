@@ -0,0 +1,146 @@
+#include "Test.h"
+#include "FakeScintilla.h"
+#include "../include/BlockEdit.h"
+#include "../include/NppVim.h"
+#include "../include/Utils.h"
+#include "../plugin/Scintilla.h"
+
+// Columns run from startCol up to endCol, not including it; tabs are 4 wide.
+struct Block {
+    FakeScintilla sci;
+    BlockEdit edit;
+
+    Block(const char* text, int startLine, int endLine, int startCol, int endCol, bool toLineEnd = false)
+        : sci(text), edit(sci.hwnd(), startLine, endLine, startCol, endCol, toLineEnd) {
+        sci.resetCounters();
+    }
+
+    void checkOneEdit(const char* expected) {
+        CHECK_EQ(sci.text(), std::string(expected));
+        CHECK_EQ(sci.edits(), 1);
+        CHECK_EQ(sci.undoSteps(), 1);
+    }
+};
+
+TEST(BlockEdit, InsertSkipsShortLines) {
+    Block b("abcdef\nab\nabcdef\n", 0, 2, 3, 5);
+    CHECK_EQ(b.edit.insert("X"), 3);
+    b.checkOneEdit("abcXdef\nab\nabcXdef\n");
+}
+
+TEST(BlockEdit, AppendPadsShortLines) {
+    Block b("abcdef\nab\nabcdef\n", 0, 2, 3, 5);
+    b.edit.append("X");
+    b.checkOneEdit("abcdeXf\nab   X\nabcdeXf\n");
+}
+
+TEST(BlockEdit, AppendAfterDollarGoesToEachLineEnd) {
+    Block b("abcdef\nab\nabcd\n", 0, 2, 1, 0, true);
+    b.edit.append("X");
+    b.checkOneEdit("abcdefX\nabX\nabcdX\n");
+}
+
+// A tab across the left edge turns into spaces on both sides of the text.
+TEST(BlockEdit, InsertSplitsTabAtLeftEdge) {
+    Block b("\tabc\nxy\tz\n", 0, 1, 2, 5);
+    CHECK_EQ(b.edit.insert("I"), 2);
+    b.checkOneEdit("  I  abc\nxyI\tz\n");
+}
+
+TEST(BlockEdit, AppendSplitsTabAtRightEdge) {
+    Block b("ab\tc\nabcdefg\n", 0, 1, 0, 3);
+    b.edit.append("A");
+    b.checkOneEdit("ab A c\nabcAdefg\n");
+}
+
+TEST(BlockEdit, ChangeAcrossTabs) {
+    Block b("\tabc\nxy\tz\nq\n", 0, 2, 2, 5);
+    CHECK_EQ(b.edit.change("C"), 2);
+    b.checkOneEdit("  Cbc\nxyC\nq\n");
+
+    Block right("\tab\n", 0, 0, 0, 2);
+    right.edit.change("C");
+    right.checkOneEdit("C  ab\n");
+}
+
+TEST(BlockEdit, FillAcrossTabsAndRaggedLines) {
+    Block b("\tabc\nxy\tz\nq\nabcdefg\n", 0, 3, 2, 5);
+    b.edit.fill("r");
+    b.checkOneEdit("  rrrbc\nxyrrr\nq\nabrrrfg\n");
+}
+
+TEST(BlockEdit, FillWithMultiByteCharacter) {
+    Block b("abcd\nab\n", 0, 1, 1, 3);
+    b.edit.fill("\xC3\xA9");
+    b.checkOneEdit("a\xC3\xA9\xC3\xA9" "d\na\xC3\xA9\n");
+}
+
+TEST(BlockEdit, PutPadsAndAddsLines) {
+    Block b("ab\nabcdef", 0, 1, 4, 4);
+    CHECK_EQ(b.edit.put({ "X", "Y", "Z" }, "\n"), 4);
+    b.checkOneEdit("ab  X\nabcdYef\n    Z");
+}
+
+// An edit that leaves every line as it was sends nothing.
+TEST(BlockEdit, NoChangeNoEdit) {
+    Block b("abc\nabc\n", 0, 1, 1, 2);
+    b.edit.fill("b");
+    CHECK_EQ(b.sci.edits(), 0);
+}
+
+// Block I, A and c type on the first line; finishInsert then copies it to
+// the other lines in one edit.
+static void typeAndFinish(FakeScintilla& sci, BlockInsert& pending, int pos, const char* typed) {
+    ::SendMessage(sci.hwnd(), SCI_INSERTTEXT, pos, (LPARAM)typed);
+    sci.setCaret(pos + (int)std::char_traits<char>::length(typed));
+    sci.resetCounters();
+    BlockEdit::finishInsert(sci.hwnd(), pending);
+}
+
+TEST(BlockEdit, FinishInsertCopiesTypedText) {
+    FakeScintilla sci("abcd\nab\n\tcd\nabcd\n");
+    BlockInsert pending;
+    BlockSelection blk = { 0, 3, 3, 4 };
+    int pos = BlockEdit::beginInsert(sci.hwnd(), pending, 'I', blk, false);
+    CHECK_EQ(pos, 3);
+    typeAndFinish(sci, pending, pos, "XY");
+    CHECK_EQ(sci.text(), std::string("abcXYd\nab\n   XY cd\nabcXYd\n"));
+    CHECK_EQ(sci.edits(), 1);
+    CHECK_EQ(sci.undoSteps(), 1);
+    CHECK(!pending.op);
+}
+
+TEST(BlockEdit, FinishAppendPadsShortLines) {
+    FakeScintilla sci("abcd\nab\nabcd\n");
+    BlockInsert pending;
+    BlockSelection blk = { 0, 2, 1, 3 };
+    int pos = BlockEdit::beginInsert(sci.hwnd(), pending, 'A', blk, false);
+    CHECK_EQ(pos, 3);
+    typeAndFinish(sci, pending, pos, "-");
+    CHECK_EQ(sci.text(), std::string("abc-d\nab -\nabc-d\n"));
+    CHECK_EQ(sci.edits(), 1);
+}
+
+TEST(BlockEdit, FinishChangeReplacesBlock) {
+    FakeScintilla sci("abcd\nabcd\nab\n");
+    BlockInsert pending;
+    BlockSelection blk = { 0, 2, 1, 3 };
+    sci.resetCounters();
+    int pos = BlockEdit::beginInsert(sci.hwnd(), pending, 'c', blk, false);
+    CHECK_EQ(sci.text(), std::string("ad\nad\na\n"));
+    CHECK_EQ(sci.edits(), 1);
+    typeAndFinish(sci, pending, pos, "__");
+    CHECK_EQ(sci.text(), std::string("a__d\na__d\na__\n"));
+    CHECK_EQ(sci.edits(), 1);
+}
+
+// Nothing is copied when the typing broke the first line.
+TEST(BlockEdit, FinishInsertAfterNewLineDoesNothing) {
+    FakeScintilla sci("abcd\nabcd\n");
+    BlockInsert pending;
+    BlockSelection blk = { 0, 1, 1, 2 };
+    int pos = BlockEdit::beginInsert(sci.hwnd(), pending, 'I', blk, false);
+    typeAndFinish(sci, pending, pos, "x\ny");
+    CHECK_EQ(sci.edits(), 0);
+    CHECK_EQ(sci.text(), std::string("ax\nybcd\nabcd\n"));
+}
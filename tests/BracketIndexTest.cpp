@@ -0,0 +1,182 @@
+#include "Test.h"
+#include "FakeScintilla.h"
+#include "../include/BracketIndex.h"
+#include "../include/NormalMode.h"
+#include "../include/NppVim.h"
+#include "../plugin/Scintilla.h"
+#include <chrono>
+#include <cstdio>
+#include <random>
+
+static void replaceUnnoticed(FakeScintilla& sci, int start, int end, const char* text) {
+    ::SendMessage(sci.hwnd(), SCI_SETTARGETRANGE, start, end);
+    ::SendMessage(sci.hwnd(), SCI_REPLACETARGET, (WPARAM)-1, (LPARAM)text);
+}
+
+TEST(BracketIndex, MatchesNestedPairs) {
+    FakeScintilla sci("f(a[1], (b)) {x}");
+    BracketIndex& index = BracketIndex::getInstance();
+
+    CHECK_EQ(index.match(sci.hwnd(), 1), 11);
+    CHECK_EQ(index.match(sci.hwnd(), 11), 1);
+    CHECK_EQ(index.match(sci.hwnd(), 8), 10);
+    CHECK_EQ(index.match(sci.hwnd(), 13), 15);
+    CHECK_EQ(index.enclosing(sci.hwnd(), 9, '(').open, 8);
+    CHECK_EQ(index.enclosing(sci.hwnd(), 5, '(').open, 1);
+}
+
+TEST(BracketIndex, SameLengthEditOutsideViewIsNoticed) {
+    FakeScintilla sci("f(a) g[b]\nh{c}\n");
+    BracketIndex& index = BracketIndex::getInstance();
+    CHECK_EQ(index.match(sci.hwnd(), 1), 3);
+
+    // Same length and line count, made without SCN_MODIFIED reaching us
+    replaceUnnoticed(sci, 1, 4, "a()");
+    index.viewsChanged();
+
+    CHECK_EQ(index.match(sci.hwnd(), 1), -1);
+    CHECK_EQ(index.match(sci.hwnd(), 2), 3);
+}
+
+TEST(BracketIndex, ForgottenDocumentIsRebuilt) {
+    FakeScintilla sci("(a)");
+    BracketIndex& index = BracketIndex::getInstance();
+    CHECK_EQ(index.match(sci.hwnd(), 0), 2);
+
+    void* doc = (void*)::SendMessage(sci.hwnd(), SCI_GETDOCPOINTER, 0, 0);
+    replaceUnnoticed(sci, 0, 3, "a()");
+    index.forget(doc);
+
+    CHECK_EQ(index.match(sci.hwnd(), 1), 2);
+}
+
+TEST(BracketIndex, DocumentBackInViewIsRebuilt) {
+    std::string text;
+    for (int i = 0; i < 100; i++) text += "(a) ";
+    FakeScintilla sci(text);
+    BracketIndex& index = BracketIndex::getInstance();
+    CHECK_EQ(index.match(sci.hwnd(), 40), 42);
+
+    // One pair moved by a character, everything else where it was
+    replaceUnnoticed(sci, 40, 43, "a()");
+    index.viewsChanged();
+
+    CHECK_EQ(index.match(sci.hwnd(), 40), -1);
+    CHECK_EQ(index.match(sci.hwnd(), 41), 42);
+    CHECK_EQ(index.match(sci.hwnd(), 44), 46);
+}
+
+// Partners found by a plain scan of the whole text.
+static std::vector<int> partners(const std::string& text) {
+    std::vector<int> partner(text.size(), -1);
+    const std::string open = "([{<", close = ")]}>";
+    std::vector<int> stacks[4];
+    for (int pos = 0; pos < (int)text.size(); pos++) {
+        size_t k = open.find(text[pos]);
+        if (k != std::string::npos) {
+            stacks[k].push_back(pos);
+        } else if ((k = close.find(text[pos])) != std::string::npos && !stacks[k].empty()) {
+            partner[pos] = stacks[k].back();
+            partner[stacks[k].back()] = pos;
+            stacks[k].pop_back();
+        }
+    }
+    return partner;
+}
+
+static bool matchesEverywhere(FakeScintilla& sci) {
+    std::vector<int> expected = partners(sci.text());
+    for (int pos = 0; pos < (int)expected.size(); pos++) {
+        if (BracketIndex::getInstance().match(sci.hwnd(), pos) != expected[pos]) return false;
+    }
+    return true;
+}
+
+TEST(BracketIndex, BracketEditsKeepPairsRight) {
+    FakeScintilla sci("f(a[1], (b)) {x; g(y)}\n<(c)>\n");
+    sci.attachToPlugin();
+    CHECK(matchesEverywhere(sci));
+
+    const char* pieces[] = { "(", ")", "()", "(a)", ")(", "[x]", "{", "}", "{(})", "<>", "z" };
+    std::mt19937 random(30);
+    for (int i = 0; i < 400; i++) {
+        int length = (int)sci.text().size();
+        int pos = (int)(random() % (length + 1));
+        if (random() % 2 && pos < length) {
+            int count = (std::min)(length - pos, (int)(random() % 4) + 1);
+            ::SendMessage(sci.hwnd(), SCI_DELETERANGE, pos, count);
+        } else {
+            ::SendMessage(sci.hwnd(), SCI_INSERTTEXT, pos, (LPARAM)pieces[random() % 11]);
+        }
+        if (!matchesEverywhere(sci)) {
+            test::fail(__FILE__, __LINE__, "edit " + std::to_string(i) + ": [" + sci.text() + "]");
+            break;
+        }
+    }
+}
+
+// Balanced brackets typed inside a pair leave the rest of the index alone.
+// A pair far away changed without a notification shows that nothing else
+// was rescanned.
+TEST(BracketIndex, BalancedEditRescansOnlyTheEnclosingPair) {
+    FakeScintilla sci("f(a, b) g(c)\n");
+    sci.attachToPlugin();
+    BracketIndex& index = BracketIndex::getInstance();
+    CHECK_EQ(index.match(sci.hwnd(), 9), 11);
+
+    sci.editUnnoticed(9, 3, "c()");
+    ::SendMessage(sci.hwnd(), SCI_INSERTTEXT, 3, (LPARAM)"[x(y)]");
+    CHECK_EQ(index.match(sci.hwnd(), 1), 12);
+    CHECK_EQ(index.match(sci.hwnd(), 5), 7);
+    CHECK_EQ(index.enclosing(sci.hwnd(), 16, '(').open, 15);
+
+    // An opener with nothing to close it changes pairs after it, so the
+    // index is built again.
+    ::SendMessage(sci.hwnd(), SCI_INSERTTEXT, 0, (LPARAM)"(");
+    CHECK(matchesEverywhere(sci));
+}
+
+template <typename F>
+static double millis(F&& run) {
+    auto start = std::chrono::steady_clock::now();
+    run();
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+// ci( and a balanced call typed back in, on 200 lines of 40k, against the
+// same edits with the index rebuilt after each. Both pay the same for the
+// fake's own bookkeeping.
+TEST(BracketIndex, ChangeInnerParenBenchmark) {
+    std::string text;
+    for (int i = 0; i < 40000; i++) text += "    call(f(a), [b], {c});\n";
+    const int edits = 200;
+
+    if (!g_normalMode) g_normalMode = new NormalMode(state);
+    BracketIndex& index = BracketIndex::getInstance();
+    auto run = [&](FakeScintilla& sci, bool rebuild) {
+        for (int i = 0; i < edits; i++) {
+            state.mode = NORMAL;
+            sci.setCaret((int)::SendMessage(sci.hwnd(), SCI_POSITIONFROMLINE, i * 200, 0) + 9);
+            for (char c : std::string("ci(")) g_normalMode->handleKey(sci.hwnd(), c);
+            ::SendMessage(sci.hwnd(), SCI_REPLACESEL, 0, (LPARAM)"g(h)");
+            ::SendMessage(sci.hwnd(), SCI_EMPTYUNDOBUFFER, 0, 0);
+            if (rebuild) index.viewsChanged();
+            index.match(sci.hwnd(), 8);
+        }
+        state.mode = NORMAL;
+    };
+
+    FakeScintilla local(text);
+    local.attachToPlugin();
+    double repaired = millis([&] { run(local, false); });
+
+    FakeScintilla rebuilt(text);
+    rebuilt.attachToPlugin();
+    double scanned = millis([&] { run(rebuilt, true); });
+
+    std::printf("  %d x ci(: %.2f ms rescanning the pair, %.2f ms rebuilding\n", edits, repaired, scanned);
+    CHECK(local.text() == rebuilt.text());
+    CHECK_EQ(local.line(200), std::string("    call(g(h));"));
+    int open = (int)::SendMessage(local.hwnd(), SCI_POSITIONFROMLINE, 200, 0) + 8;
+    CHECK_EQ(index.match(local.hwnd(), open), open + 5);
+}
@@ -0,0 +1,82 @@
+#include "Test.h"
+#include "FakeScintilla.h"
+#include "../include/BufferStates.h"
+#include "../include/NormalMode.h"
+#include "../include/VisualMode.h"
+#include "../include/Utils.h"
+
+// BufferStates is a singleton; each test uses its own buffer IDs and closes
+// them again.
+TEST(BufferStates, SwitchingBringsBackParkedState) {
+    BufferStates& buffers = BufferStates::getInstance();
+    VimState vim;
+    buffers.activate(101, vim);
+    vim.lastInsertPos = 11;
+
+    buffers.activate(102, vim);
+    CHECK_EQ(vim.lastInsertPos, -1);
+    vim.lastInsertPos = 22;
+
+    buffers.activate(101, vim);
+    CHECK_EQ(vim.lastInsertPos, 11);
+    buffers.activate(102, vim);
+    CHECK_EQ(vim.lastInsertPos, 22);
+
+    buffers.close(101, vim);
+    buffers.close(102, vim);
+}
+
+TEST(BufferStates, ClosingActiveFirstKeepsNextBufferState) {
+    BufferStates& buffers = BufferStates::getInstance();
+    VimState vim;
+    buffers.activate(201, vim);
+    vim.lastInsertPos = 11;
+    buffers.activate(202, vim);
+    vim.lastInsertPos = 22;
+
+    // FILECLOSED for the active buffer before BUFFERACTIVATED for the next
+    buffers.close(202, vim);
+    buffers.activate(201, vim);
+    CHECK_EQ(vim.lastInsertPos, 11);
+
+    // 201 must not linger as a parked copy next to the live one
+    buffers.activate(203, vim);
+    buffers.close(201, vim);
+    buffers.activate(201, vim);
+    CHECK_EQ(vim.lastInsertPos, -1);
+
+    buffers.close(201, vim);
+    buffers.close(203, vim);
+}
+
+// The shape p goes by is the last yank's, wherever it was made.
+TEST(BufferStates, BlockYankPastesBlockwiseInOtherBuffer) {
+    if (!g_normalMode) g_normalMode = new NormalMode(state);
+    if (!g_visualMode) g_visualMode = new VisualMode(state);
+    BufferStates& buffers = BufferStates::getInstance();
+
+    FakeScintilla a("abc\ndef\n");
+    buffers.activate(301, state);
+    state.mode = VISUAL;
+    state.isBlockVisual = true;
+    Utils::setBlockSelection(a.hwnd(), 0, 6);
+    g_visualMode->handleKey(a.hwnd(), 'y');
+    CHECK(state.mode == NORMAL);
+
+    FakeScintilla b("12\n34\n");
+    buffers.activate(302, state);
+    b.setCaret(0);
+    g_normalMode->handleKey(b.hwnd(), 'p');
+    CHECK_EQ(b.text(), std::string("1ab2\n3de4\n"));
+
+    // A line yank here makes the next paste back in the first buffer linewise
+    g_normalMode->handleKey(b.hwnd(), 'y');
+    g_normalMode->handleKey(b.hwnd(), 'y');
+    buffers.activate(301, state);
+    a.setCaret(0);
+    g_normalMode->handleKey(a.hwnd(), 'p');
+    CHECK_EQ(a.text(), std::string("abc\n1ab2\ndef\n"));
+
+    buffers.close(301, state);
+    buffers.close(302, state);
+}
@@ -0,0 +1,88 @@
+#include "Test.h"
+#include "FakeScintilla.h"
+#include "../include/NppVim.h"
+#include "../include/Utf8.h"
+#include "../include/Utils.h"
+#include "../include/VisualMode.h"
+#include "../plugin/Scintilla.h"
+
+static const CaseChange CASE_CHANGES[] = { CaseChange::Upper, CaseChange::Lower, CaseChange::Toggle, CaseChange::Rot13 };
+
+static std::string changedByteByByte(const std::string& text, CaseChange change) {
+    std::string out;
+    for (char c : text) {
+        std::string one(1, c);
+        Utf8::changeCase(one, change, true);
+        out += one;
+    }
+    return out;
+}
+
+// Ragged lines under a 20-column block, so full lines take a 16-byte step
+// and a tail while short ones stop inside the block or before it.
+TEST(ChangeCase, BlockMatchesByteLoop) {
+    const std::string edges = "@AMNZ[`amnz{~ Hello, World";
+    std::vector<std::string> lines;
+    for (size_t length : { 40, 10, 0, 2, 23, 40 }) {
+        std::string line;
+        for (size_t i = 0; i < length; i++) line += edges[(i + lines.size()) % edges.size()];
+        lines.push_back(line);
+    }
+    std::string text;
+    for (const std::string& line : lines) text += line + "\n";
+    const BlockSelection blk = { 0, (int)lines.size() - 1, 3, 23 };
+
+    for (CaseChange change : CASE_CHANGES) {
+        std::string expected;
+        for (const std::string& line : lines) {
+            size_t a = (std::min)(line.size(), (size_t)blk.startCol);
+            size_t b = (std::min)(line.size(), (size_t)blk.endCol);
+            expected += line.substr(0, a) + changedByteByByte(line.substr(a, b - a), change) + line.substr(b) + "\n";
+        }
+
+        FakeScintilla sci(text);
+        sci.resetCounters();
+        Utils::changeCaseBlock(sci.hwnd(), blk, change);
+        if (sci.text() != expected) {
+            test::fail(__FILE__, __LINE__, "change " + std::to_string((int)change) + ": got [" + sci.text() + "]");
+        }
+        CHECK_EQ(sci.edits(), 1);
+        CHECK_EQ(sci.undoSteps(), 1);
+    }
+}
+
+// U, u, ~ and g? on a block selection: one edit and one undo step each,
+// and the text outside the block stays as it was.
+TEST(ChangeCase, BlockVisualIsOneUndoStep) {
+    if (!g_visualMode) g_visualMode = new VisualMode(state);
+    const std::string text = "abcdefghij\nKLMNOPQRST\nuv\nwxyzabcdef\n";
+    struct Case {
+        const char* keys;
+        const char* expected;
+    };
+    const Case cases[] = {
+        { "U", "abCDEFghij\nKLMNOPQRST\nuv\nwxYZABcdef\n" },
+        { "u", "abcdefghij\nKLmnopQRST\nuv\nwxyzabcdef\n" },
+        { "~", "abCDEFghij\nKLmnopQRST\nuv\nwxYZABcdef\n" },
+        { "g?", "abpqrsghij\nKLZABCQRST\nuv\nwxlmnocdef\n" },
+    };
+
+    for (const Case& c : cases) {
+        FakeScintilla sci(text);
+        state.mode = VISUAL;
+        state.isLineVisual = false;
+        state.isBlockVisual = true;
+        // Lines 0 to 3, columns 2 to 5
+        Utils::setBlockSelection(sci.hwnd(), 2, 31);
+        sci.resetCounters();
+        for (const char* k = c.keys; *k; k++) g_visualMode->handleKey(sci.hwnd(), *k);
+
+        CHECK_EQ(sci.text(), std::string(c.expected));
+        CHECK_EQ(sci.edits(), 1);
+        CHECK_EQ(sci.undoSteps(), 1);
+        CHECK(state.mode == NORMAL);
+
+        ::SendMessage(sci.hwnd(), SCI_UNDO, 0, 0);
+        CHECK_EQ(sci.text(), text);
+    }
+}
@@ -0,0 +1,139 @@
+#include "Test.h"
+#include "FakeScintilla.h"
+#include "../include/CharClass.h"
+#include "../include/NormalMode.h"
+#include "../include/NppVim.h"
+#include "../include/OptionRegistry.h"
+#include "../plugin/Scintilla.h"
+#include <chrono>
+#include <cstdio>
+#include <random>
+
+static void setKeywords(const std::string& spec) {
+    OptionRegistry::getInstance().setOption(OptionId::IsKeyword, spec);
+}
+
+// classify against classifyScalar at every length up to 64 from every
+// offset, so each byte lands in a 16-byte step and in the tail after them.
+static bool sameAsScalar(const CharClasses& classes, const std::string& text) {
+    for (size_t start = 0; start < text.size(); start++) {
+        for (size_t n = 0; n <= 64 && start + n <= text.size(); n++) {
+            uint64_t fast[CC_COUNT], slow[CC_COUNT];
+            uint64_t fastHigh = classes.classify(text.data() + start, n, fast);
+            uint64_t slowHigh = classes.classifyScalar(text.data() + start, n, slow);
+            if (fastHigh != slowHigh) return false;
+            for (int k = 0; k < CC_COUNT; k++) {
+                if (fast[k] != slow[k]) return false;
+            }
+        }
+    }
+    return true;
+}
+
+static std::string sampleBytes() {
+    std::string text;
+    for (int c = 0; c < 256; c++) text += (char)c;
+    std::mt19937 random(43);
+    for (int i = 0; i < 512; i++) text += (char)(random() & 0xFF);
+    text += "int x_1 = f(a, b);\r\n\t// caf\xC3\xA9 \xE4\xB8\xAD\xE6\x96\x87\n";
+    return text;
+}
+
+TEST(CharClass, VectorMatchesScalar) {
+    FakeScintilla sci("");
+    std::string text = sampleBytes();
+    for (const char* spec : { "", "@,48-57,_,192-255", "@,^x,^128-255", "33-126" }) {
+        setKeywords(spec);
+        CharClasses classes(sci.hwnd());
+        if (!sameAsScalar(classes, text)) test::fail(__FILE__, __LINE__, std::string("iskeyword=") + spec);
+    }
+    setKeywords("");
+}
+
+// Every other letter a range of its own: more than MAX_RANGES, so classify
+// runs the scalar loop and still gets every byte right.
+TEST(CharClass, FallbackPastMaxRanges) {
+    FakeScintilla sci("");
+    setKeywords("a,c,e,g,i,k,m,o,q,s,u,w,y,A,C,E,G");
+    CharClasses classes(sci.hwnd());
+    CHECK(sameAsScalar(classes, sampleBytes()));
+    CHECK(classes('a') == CC_WORD);
+    CHECK(classes('b') == CC_PUNCT);
+    CHECK(classes('G') == CC_WORD);
+    CHECK(classes(' ') == CC_SPACE);
+    CHECK(classes('\n') == CC_NEWLINE);
+    setKeywords("");
+}
+
+static std::string wordChars(const std::string& spec) {
+    bool word[256];
+    if (!CharClasses::parseKeywordSpec(spec, word)) return "error";
+    std::string chars;
+    for (int c = 1; c < 0x80; c++) {
+        if (word[c]) chars += (char)c;
+    }
+    if (word[0x80] && word[0xFF]) chars += "+high";
+    return chars;
+}
+
+TEST(CharClass, KeywordSpec) {
+    const std::string lower = "abcdefghijklmnopqrstuvwxyz";
+    const std::string upper = "ABCDEFGHIJKLMNOPQRSTUVWXYZ";
+    CHECK_EQ(wordChars("@"), upper + lower + "+high");
+    CHECK_EQ(wordChars("48-57,_"), std::string("0123456789_+high"));
+    CHECK_EQ(wordChars("a-c,x"), std::string("abcx+high"));
+    CHECK_EQ(wordChars("@-@"), std::string("@+high"));
+    CHECK_EQ(wordChars("^128-255"), std::string(""));
+    CHECK_EQ(wordChars("@,^a-x"), upper + "yz+high");
+    CHECK_EQ(wordChars("@,^@"), std::string("+high"));
+    // A lone ^ or - is the character itself
+    CHECK_EQ(wordChars("^,-"), std::string("-^+high"));
+    CHECK_EQ(wordChars("a,,b"), std::string("ab+high"));
+    CHECK_EQ(wordChars(""), std::string("+high"));
+
+    for (const char* bad : { "a-", "z-a", "256", "1-300", "ab", "a-b-c", "^48-" }) {
+        bool word[256];
+        if (CharClasses::parseKeywordSpec(bad, word)) test::fail(__FILE__, __LINE__, std::string("accepted ") + bad);
+    }
+}
+
+template <typename F>
+static double millis(F&& run) {
+    auto start = std::chrono::steady_clock::now();
+    run();
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+// 1000w at the start and near the end of a 100 MB line. The motion reads
+// only the blocks it passes, so neither end of the line costs more.
+TEST(CharClass, WordMotionOnHugeLineBenchmark) {
+    const size_t size = 100 * 1024 * 1024;
+    const std::string unit = "word, ";
+    std::string text;
+    text.reserve(size + unit.size());
+    while (text.size() < size) text += unit;
+    FakeScintilla sci(text);
+
+    if (!g_normalMode) g_normalMode = new NormalMode(state);
+    state.mode = NORMAL;
+    auto words = [&](int from) {
+        sci.setCaret(from);
+        sci.resetCounters();
+        return millis([&] {
+            for (char c : std::string("1000w")) g_normalMode->handleKey(sci.hwnd(), c);
+        });
+    };
+
+    double atStart = words(0);
+    int startMessages = sci.messages();
+    CHECK_EQ(sci.caretPos(), 3000);
+
+    int late = (int)(text.size() - 60000);
+    double nearEnd = words(late);
+    std::printf("  1000w on a %zu MB line: %.2f ms from the start, %d messages; %.2f ms near the end, %d messages\n",
+        size >> 20, atStart, startMessages, nearEnd, sci.messages());
+    CHECK_EQ(sci.caretPos(), late + 3000);
+    CHECK(startMessages < 100);
+    CHECK(sci.messages() < 100);
+    CHECK_EQ(sci.messages(SCI_GETTEXT) + sci.messages(SCI_GETLINE) + sci.messages(SCI_GETCHARACTERPOINTER), 0);
+}
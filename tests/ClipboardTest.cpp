@@ -0,0 +1,102 @@
+#include "Test.h"
+#include "FakeScintilla.h"
+#include "../include/Clipboard.h"
+#include "../include/NormalMode.h"
+#include "../include/NppVim.h"
+#include "../include/Registers.h"
+#include "../include/Utils.h"
+
+// Counts what reaches the platform. Claims succeed, as they do with an
+// owner window, so text stays pending until it is rendered or flushed.
+struct ClipboardCalls {
+    int claims = 0;
+    int renders = 0;
+    int writes = 0;
+    int reads = 0;
+    std::string contents;
+};
+
+class CountingClipboardBackend : public ClipboardBackend {
+public:
+    explicit CountingClipboardBackend(ClipboardCalls& calls) : calls(calls) {}
+
+    bool claim() override { calls.claims++; return true; }
+    void render(const std::string& text) override { calls.renders++; calls.contents = text; }
+    void write(const std::string& text) override { calls.writes++; calls.contents = text; }
+    std::string read() override { calls.reads++; return calls.contents; }
+
+private:
+    ClipboardCalls& calls;
+};
+
+static void useCountingBackend(ClipboardCalls& calls) {
+    if (!g_normalMode) g_normalMode = new NormalMode(state);
+    state.mode = NORMAL;
+    Utils::setCurrentRegister('"');
+    Clipboard::getInstance().setBackend(std::make_unique<CountingClipboardBackend>(calls));
+}
+
+static void keys(HWND hwnd, const char* typed) {
+    for (const char* c = typed; *c; c++) g_normalMode->handleKey(hwnd, *c);
+}
+
+static std::string numberedLines(int count) {
+    std::string text;
+    for (int i = 0; i < count; i++) text += "line " + std::to_string(i) + "\n";
+    return text;
+}
+
+TEST(Clipboard, TenThousandDeletesClaimOnce) {
+    ClipboardCalls calls;
+    useCountingBackend(calls);
+    FakeScintilla sci(numberedLines(20000));
+
+    keys(sci.hwnd(), "10000dd");
+    CHECK_EQ(sci.line(0), std::string("line 10000"));
+    for (int i = 0; i < 100; i++) keys(sci.hwnd(), "dd");
+    CHECK_EQ(sci.line(0), std::string("line 10100"));
+
+    CHECK_EQ(calls.claims, 1);
+    CHECK_EQ(calls.writes + calls.renders + calls.reads, 0);
+
+    // Losing activation publishes the last delete only
+    Clipboard::getInstance().flush();
+    CHECK_EQ(calls.writes, 1);
+    CHECK_EQ(calls.contents, std::string("line 10099\n"));
+    Clipboard::getInstance().setBackend(std::make_unique<MemoryClipboardBackend>());
+}
+
+// "+p of our own pending text shares the register block: nothing is read
+// back from the platform or written out for it.
+TEST(Clipboard, PlusPasteOfPendingTextPublishesNothing) {
+    ClipboardCalls calls;
+    useCountingBackend(calls);
+    FakeScintilla sci("a\nb\nc\nd\n");
+
+    keys(sci.hwnd(), "3dd");
+    CHECK_EQ(sci.text(), std::string("d\n"));
+    keys(sci.hwnd(), "\"+p");
+    CHECK_EQ(sci.text(), std::string("d\na\nb\nc\n"));
+
+    CHECK_EQ(calls.claims, 1);
+    CHECK_EQ(calls.writes + calls.renders + calls.reads, 0);
+    CHECK(RegisterStore::getInstance().get('"') == Clipboard::getInstance().getShared());
+    Clipboard::getInstance().setBackend(std::make_unique<MemoryClipboardBackend>());
+}
+
+// A yank to "+ is published at once. With no owner window nothing tells us
+// when another application replaces it, so "+P reads it back.
+TEST(Clipboard, PlusYankWritesOnce) {
+    ClipboardCalls calls;
+    useCountingBackend(calls);
+    FakeScintilla sci("one\ntwo\n");
+
+    keys(sci.hwnd(), "\"+yy");
+    CHECK_EQ(calls.writes, 1);
+    CHECK_EQ(calls.contents, std::string("one\n"));
+    keys(sci.hwnd(), "\"+P");
+    CHECK_EQ(sci.text(), std::string("one\none\ntwo\n"));
+    CHECK_EQ(calls.writes, 1);
+    CHECK_EQ(calls.reads, 1);
+    Clipboard::getInstance().setBackend(std::make_unique<MemoryClipboardBackend>());
+}
@@ -0,0 +1,103 @@
+#include "Test.h"
+#include "../include/CommandHistory.h"
+#include <deque>
+#include <random>
+
+// Every match for prefix, newest first, by stepping older from the end.
+static std::vector<std::string> olderMatches(const HistoryRing& history, std::string_view prefix) {
+    std::vector<std::string> found;
+    unsigned long long cursor = history.end();
+    std::string line;
+    while (history.older(prefix, cursor, line)) found.push_back(line);
+    return found;
+}
+
+TEST(CommandHistory, PrefixRecallNewestFirst) {
+    HistoryRing history(50);
+    for (const char* line : { "set nu", "s/a/b/", "set rnu", "sort", "w", "set list" }) history.add(line);
+
+    std::vector<std::string> set = { "set list", "set rnu", "set nu" };
+    CHECK(olderMatches(history, "set") == set);
+    std::vector<std::string> s = { "set list", "sort", "set rnu", "s/a/b/", "set nu" };
+    CHECK(olderMatches(history, "s") == s);
+    CHECK_EQ(olderMatches(history, "").size(), (size_t)6);
+    CHECK(olderMatches(history, "x").empty());
+    CHECK(olderMatches(history, "set nux").empty());
+}
+
+TEST(CommandHistory, NewerReturnsToEnd) {
+    HistoryRing history(50);
+    for (const char* line : { "e one", "w", "e two", "e three" }) history.add(line);
+
+    unsigned long long cursor = history.end();
+    std::string line;
+    CHECK(history.older("e", cursor, line));
+    CHECK(history.older("e", cursor, line));
+    CHECK_EQ(line, std::string("e two"));
+    CHECK(history.newer("e", cursor, line));
+    CHECK_EQ(line, std::string("e three"));
+    CHECK(!history.newer("e", cursor, line));
+    CHECK_EQ(cursor, history.end());
+}
+
+TEST(CommandHistory, ReenteredLineMovesToNewest) {
+    HistoryRing history(50);
+    for (const char* line : { "set nu", "set rnu", "set nu" }) history.add(line);
+
+    CHECK_EQ(history.size(), (size_t)2);
+    std::vector<std::string> set = { "set nu", "set rnu" };
+    CHECK(olderMatches(history, "set") == set);
+}
+
+TEST(CommandHistory, CapacityDropsOldest) {
+    HistoryRing history(3);
+    for (const char* line : { "a1", "a2", "b1", "a3" }) history.add(line);
+
+    std::vector<std::string> a = { "a3", "a2" };
+    CHECK(olderMatches(history, "a") == a);
+
+    history.setCapacity(1);
+    std::vector<std::string> newest = { "a3" };
+    CHECK(olderMatches(history, "") == newest);
+}
+
+// Prefixes past the trie's depth share its deepest node and are compared in full.
+TEST(CommandHistory, LongPrefixComparedInFull) {
+    HistoryRing history(50);
+    std::string common(40, 'x');
+    history.add(common + "a");
+    history.add(common + "b");
+
+    std::vector<std::string> a = { common + "a" };
+    CHECK(olderMatches(history, common + "a") == a);
+    CHECK_EQ(olderMatches(history, common).size(), (size_t)2);
+}
+
+// Random adds checked against a plain list, enough of them that retired
+// sequence numbers pile up and the trie is rebuilt several times.
+TEST(CommandHistory, MatchesPlainList) {
+    const size_t capacity = 20;
+    HistoryRing history(capacity);
+    std::deque<std::string> plain;     // newest first
+
+    std::mt19937 rng(7);
+    const char* words[] = { "s", "se", "set", "sort", "w", "wq" };
+    for (int i = 0; i < 5000; i++) {
+        std::string line = std::string(words[rng() % 6]) + " " + std::to_string(rng() % 30);
+        history.add(line);
+        for (auto it = plain.begin(); it != plain.end(); ++it) {
+            if (*it == line) { plain.erase(it); break; }
+        }
+        plain.push_front(line);
+        if (plain.size() > capacity) plain.pop_back();
+
+        if (i % 250 != 0) continue;
+        for (const char* prefix : { "", "s", "se", "set ", "w", "wq 1" }) {
+            std::vector<std::string> expected;
+            for (const std::string& entry : plain) {
+                if (entry.compare(0, std::string_view(prefix).size(), prefix) == 0) expected.push_back(entry);
+            }
+            CHECK(olderMatches(history, prefix) == expected);
+        }
+    }
+}
@@ -0,0 +1,76 @@
+#include "Test.h"
+#include "FakeScintilla.h"
+#include "../include/CommandRegistry.h"
+#include "../include/CommandMode.h"
+#include "../include/NppVim.h"
+#include "../plugin/Scintilla.h"
+
+extern CommandMode* g_commandMode;
+
+static void registerCommands() {
+    if (!g_commandMode) g_commandMode = new CommandMode(state);
+}
+
+static const ColonCommand* resolve(const char* line, CommandCall& call) {
+    if (!CommandRegistry::parse(line, call)) return nullptr;
+    return CommandRegistry::getInstance().find(call.name);
+}
+
+// Every spelling the keymap and comparison chain dispatcher accepted, and
+// the command it reaches now. :t is Vim's :copy rather than the tutor.
+TEST(CommandRegistry, OldSpellingsResolveAsBefore) {
+    registerCommands();
+    static const std::pair<const char*, const char*> spellings[] = {
+        { "w", "write" }, { "e", "edit" }, { "q", "quit" }, { "qa", "qall" },
+        { "wq", "wq" }, { "wqa", "wqall" }, { "bn", "bnext" }, { "bp", "bprevious" },
+        { "bd", "bdelete" }, { "vsplit", "vsplit" }, { "vs", "vsplit" }, { "split", "split" },
+        { "sp", "split" }, { "gh", "gh" }, { "paypal", "paypal" }, { "donate", "donate" },
+        { "about", "about" }, { "config", "config" }, { "noh", "nohlsearch" }, { "nohl", "nohlsearch" },
+        { "nohlsearch", "nohlsearch" }, { "m", "move" }, { "reg", "registers" }, { "registers", "registers" },
+        { "di", "display" }, { "display", "display" }, { "h", "help" }, { "help", "help" },
+        { "tutor", "tutor" }, { "tut", "tutor" }, { "set", "set" }, { "map", "map" },
+        { "nmap", "nmap" }, { "imap", "imap" }, { "vmap", "vmap" }, { "noremap", "noremap" },
+        { "nnoremap", "nnoremap" }, { "inoremap", "inoremap" }, { "vnoremap", "vnoremap" },
+        { "so", "source" }, { "source", "source" }, { "NppVimReload", "NppVimReload" },
+        { "ver", "version" }, { "version", "version" }, { "edit", "edit" }, { "editrc", "editrc" },
+        { "erc", "erc" }, { "editini", "editini" }, { "eini", "eini" }, { "sort", "sort" },
+        { "wrap", "wrap" }, { "wrapmode", "wrapmode" }, { "nowrap", "nowrap" },
+    };
+    for (const auto& [typed, name] : spellings) {
+        CommandCall call;
+        const ColonCommand* command = resolve(typed, call);
+        CHECK(command != nullptr);
+        if (command) CHECK_EQ(command->name, std::string(name));
+    }
+}
+
+// Vim's spellings with ! of the commands that save or close files, which
+// the old dispatcher never reached and the registry refused with E477.
+TEST(CommandRegistry, SaveAndQuitTakeBang) {
+    registerCommands();
+    static const std::pair<const char*, const char*> spellings[] = {
+        { "w!", "write" }, { "write!", "write" }, { "q!", "quit" }, { "quit!", "quit" },
+        { "qa!", "qall" }, { "qall!", "qall" }, { "quitall!", "quitall" }, { "wq!", "wq" },
+        { "x!", "xit" }, { "xit!", "xit" }, { "wqa!", "wqall" }, { "wqall!", "wqall" },
+        { "sort!", "sort" },
+    };
+    for (const auto& [typed, name] : spellings) {
+        CommandCall call;
+        const ColonCommand* command = resolve(typed, call);
+        CHECK(command != nullptr);
+        if (!command) continue;
+        CHECK_EQ(command->name, std::string(name));
+        CHECK(call.bang);
+        CHECK(command->bang);
+    }
+}
+
+TEST(CommandRegistry, QuitBangDiscardsChanges) {
+    registerCommands();
+    FakeScintilla sci("changed\n");
+
+    g_commandMode->handleColonCommand(sci.hwnd(), "q");
+    CHECK_EQ(sci.messages(SCI_SETSAVEPOINT), 0);
+    g_commandMode->handleColonCommand(sci.hwnd(), "q!");
+    CHECK_EQ(sci.messages(SCI_SETSAVEPOINT), 1);
+}
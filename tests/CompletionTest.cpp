@@ -0,0 +1,195 @@
+#include "Test.h"
+#include "FakeScintilla.h"
+#include "../include/CommandMode.h"
+#include "../include/DirectoryCache.h"
+#include "../include/NppVim.h"
+#include "../include/Utils.h"
+#include <chrono>
+#include <cstdio>
+
+extern CommandMode* g_commandMode;
+
+// Every candidate Tab offers for typed, in order, read off the command line.
+static std::vector<std::string> candidates(HWND hwnd, const std::string& typed) {
+    if (!g_commandMode) g_commandMode = new CommandMode(state);
+    g_commandMode->enter(':', typed);
+    std::vector<std::string> found;
+    for (int i = 0; i < 200; i++) {
+        g_commandMode->completeCommandLine(hwnd, true);
+        std::string line = state.commandBuffer.substr(1);
+        if (line == typed || (!found.empty() && line == found[0])) break;
+        found.push_back(line);
+    }
+    g_commandMode->exit();
+    return found;
+}
+
+// A directory under the temp directory, removed again with what it holds.
+struct TempDirectory {
+    std::string path;
+    std::vector<std::string> files;
+    std::vector<std::string> directories;
+
+    explicit TempDirectory(const char* name) {
+        char temp[MAX_PATH];
+        GetTempPathA(MAX_PATH, temp);
+        path = std::string(temp) + name + "/";
+        CreateDirectoryA(path.c_str(), NULL);
+    }
+
+    ~TempDirectory() {
+        for (const std::string& file : files) DeleteFileA((path + file).c_str());
+        for (const std::string& dir : directories) RemoveDirectoryA((path + dir).c_str());
+        RemoveDirectoryA(path.c_str());
+    }
+
+    void addFile(const std::string& name) {
+        HANDLE file = CreateFileA((path + name).c_str(), GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+        if (file != INVALID_HANDLE_VALUE) CloseHandle(file);
+        files.push_back(name);
+    }
+
+    void addDirectory(const std::string& name) {
+        CreateDirectoryA((path + name).c_str(), NULL);
+        directories.push_back(name);
+    }
+
+    // The first read runs on a worker thread.
+    std::shared_ptr<const DirectoryListing> listing() const {
+        for (int i = 0; i < 1000; i++) {
+            if (auto listing = DirectoryCache::getInstance().lookup(path)) return listing;
+            Sleep(10);
+        }
+        return nullptr;
+    }
+};
+
+TEST(Completion, CommandNames) {
+    FakeScintilla sci("");
+    std::vector<std::string> so = { "sort", "source" };
+    CHECK(candidates(sci.hwnd(), "so") == so);
+    std::vector<std::string> sou = { "source" };
+    CHECK(candidates(sci.hwnd(), "sou") == sou);
+    // The range stays in front of the name
+    std::vector<std::string> ranged = { "1,3sort", "1,3source" };
+    CHECK(candidates(sci.hwnd(), "1,3so") == ranged);
+    CHECK(candidates(sci.hwnd(), "zzz").empty());
+}
+
+TEST(Completion, OptionNames) {
+    FakeScintilla sci("");
+    std::vector<std::string> t = { "set tabstop", "set textwidth" };
+    CHECK(candidates(sci.hwnd(), "set t") == t);
+    std::vector<std::string> nohl = { "set nohlsearch" };
+    CHECK(candidates(sci.hwnd(), "set nohl") == nohl);
+    // Only the last word is completed
+    std::vector<std::string> second = { "set list relativenumber" };
+    CHECK(candidates(sci.hwnd(), "set list rel") == second);
+    // Not values
+    CHECK(candidates(sci.hwnd(), "set ts=").empty());
+}
+
+TEST(Completion, RegisterNames) {
+    FakeScintilla sci("");
+    Utils::setRegisterContent('q', "text");
+    Utils::setRegisterContent('x', "text");
+
+    std::vector<std::string> found = candidates(sci.hwnd(), "reg q");
+    CHECK(!found.empty());
+    // Registers already listed are not offered again; + and * always are
+    CHECK_EQ(found.front(), std::string("reg qx"));
+    CHECK_EQ(found[found.size() - 2], std::string("reg q+"));
+    CHECK_EQ(found.back(), std::string("reg q*"));
+    for (const std::string& line : found) CHECK(line.find('q', 5) == std::string::npos);
+}
+
+TEST(Completion, DirectoryListing) {
+    TempDirectory dir("nppvim-completion");
+    for (const char* name : { "beta.md", "Alpha.txt", "alpine.c" }) dir.addFile(name);
+    dir.addDirectory("Sub");
+
+    auto listing = dir.listing();
+    CHECK(listing != nullptr);
+    if (!listing) return;
+    std::vector<std::string> names = { "Alpha.txt", "alpine.c", "beta.md", "Sub\\" };
+    CHECK(listing->names == names);
+
+    using Range = std::pair<size_t, size_t>;
+    CHECK(DirectoryCache::matching(*listing, "AL") == Range(0, 2));
+    CHECK(DirectoryCache::matching(*listing, "alpi") == Range(1, 2));
+    CHECK(DirectoryCache::matching(*listing, "s") == Range(3, 4));
+    CHECK(DirectoryCache::matching(*listing, "") == Range(0, 4));
+    CHECK(DirectoryCache::matching(*listing, "z").first == DirectoryCache::matching(*listing, "z").second);
+
+    FakeScintilla sci("");
+    std::vector<std::string> al = { "e " + dir.path + "Alpha.txt", "e " + dir.path + "alpine.c" };
+    CHECK(candidates(sci.hwnd(), "e " + dir.path + "al") == al);
+}
+
+template <typename F>
+static double millis(F&& run) {
+    auto start = std::chrono::steady_clock::now();
+    run();
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+// One Tab or Up, averaged over repeats, with 10k lines of history and a
+// directory of 100k files already listed.
+TEST(Completion, Benchmark) {
+    const int files = 100000;
+    const int historyLines = 10000;
+    const int repeats = 100;
+
+    TempDirectory dir("nppvim-completion-large");
+    char name[32];
+    for (int i = 0; i < files; i++) {
+        std::snprintf(name, sizeof(name), "file%05d.txt", i);
+        dir.addFile(name);
+    }
+    auto listing = dir.listing();
+    CHECK(listing != nullptr && listing->names.size() == (size_t)files);
+
+    FakeScintilla sci("a\nb\nc\n");
+    if (!g_commandMode) g_commandMode = new CommandMode(state);
+    g_commandMode->setHistoryCapacity(historyLines);
+    for (int i = 0; i < historyLines; i++) {
+        g_commandMode->enter(':', std::to_string(i));
+        g_commandMode->handleEnter(sci.hwnd());
+    }
+
+    // Each returns the time per key and checks the line it left.
+    auto tab = [&](const std::string& typed, const std::string& expected) {
+        double total = 0;
+        for (int i = 0; i < repeats; i++) {
+            g_commandMode->enter(':', typed);
+            total += millis([&] { g_commandMode->completeCommandLine(sci.hwnd(), true); });
+        }
+        CHECK_EQ(state.commandBuffer, ":" + expected);
+        g_commandMode->exit();
+        return total / repeats;
+    };
+    auto up = [&](const std::string& typed, const std::string& expected) {
+        double total = 0;
+        for (int i = 0; i < repeats; i++) {
+            g_commandMode->enter(':', typed);
+            total += millis([&] { g_commandMode->recallHistory(sci.hwnd(), true); });
+        }
+        CHECK_EQ(state.commandBuffer, ":" + expected);
+        g_commandMode->exit();
+        return total / repeats;
+    };
+
+    double command = tab("so", "sort");
+    double option = tab("set t", "set tabstop");
+    double registers = tab("reg ", candidates(sci.hwnd(), "reg ").front());
+    double file = tab("e " + dir.path + "file5", "e " + dir.path + "file50000.txt");
+    double history = up("99", "9999");
+    std::printf("  per key: command %.3f ms, option %.3f ms, register %.3f ms, %d-file directory %.3f ms, "
+        "%d-line history %.3f ms\n", command, option, registers, files, file, historyLines, history);
+
+    CHECK(command < 1.0);
+    CHECK(option < 1.0);
+    CHECK(registers < 1.0);
+    CHECK(file < 1.0);
+    CHECK(history < 1.0);
+}
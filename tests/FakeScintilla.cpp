@@ -0,0 +1,476 @@
+#include "FakeScintilla.h"
+#include "../plugin/PluginInterface.h"
+#include "../plugin/Scintilla.h"
+#include "../include/LineIndex.h"
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+
+extern NppData nppData;
+extern "C" void beNotified(SCNotification* notifyCode);
+
+static const TCHAR* FAKE_CLASS = TEXT("NppVimFakeScintilla");
+
+// Documents are told apart by pointer, so every fake gets one that is never
+// reused even when a later fake lands at the same address.
+static void* nextDocPointer() {
+    static uintptr_t serial = 0;
+    return (void*)(++serial * 0x1000);
+}
+
+FakeScintilla::FakeScintilla(const std::string& text) {
+    static bool registered = false;
+    if (!registered) {
+        WNDCLASSEX wc = {};
+        wc.cbSize = sizeof(wc);
+        wc.lpfnWndProc = proc;
+        wc.hInstance = ::GetModuleHandle(nullptr);
+        wc.lpszClassName = FAKE_CLASS;
+        ::RegisterClassEx(&wc);
+        registered = true;
+    }
+    docPointer = nextDocPointer();
+    window = ::CreateWindowEx(0, FAKE_CLASS, TEXT(""), 0, 0, 0, 0, 0,
+        HWND_MESSAGE, nullptr, ::GetModuleHandle(nullptr), nullptr);
+    ::SetWindowLongPtr(window, GWLP_USERDATA, (LONG_PTR)this);
+    setText(text);
+}
+
+FakeScintilla::~FakeScintilla() {
+    if (attached) {
+        (secondView ? nppData._scintillaSecondHandle : nppData._scintillaMainHandle) = nullptr;
+        LineIndex::getInstance().viewsChanged();
+    }
+    ::DestroyWindow(window);
+}
+
+void FakeScintilla::attachToPlugin(bool second) {
+    secondView = second;
+    (secondView ? nppData._scintillaSecondHandle : nppData._scintillaMainHandle) = window;
+    attached = true;
+    LineIndex::getInstance().viewsChanged();
+}
+
+void FakeScintilla::editUnnoticed(int pos, int length, const std::string& text) {
+    bool wasAttached = attached;
+    attached = false;
+    replace(pos, length, text);
+    attached = wasAttached;
+}
+
+void FakeScintilla::setText(const std::string& text) {
+    doc = text;
+    indexLines();
+    caret = anchor = 0;
+    undoStack.clear();
+    docPointer = nextDocPointer();
+    if (attached) LineIndex::getInstance().viewsChanged();
+}
+
+std::string FakeScintilla::line(int line) const {
+    if (line < 0 || line >= lineCount()) return "";
+    return doc.substr(starts[line], lineEndPosition(line) - starts[line]);
+}
+
+int FakeScintilla::messages(UINT msg) const {
+    auto it = received.find(msg);
+    return (it == received.end()) ? 0 : it->second;
+}
+
+void FakeScintilla::resetCounters() {
+    editCount = 0;
+    undoStack.clear();
+    messageCount = 0;
+    received.clear();
+}
+
+LRESULT CALLBACK FakeScintilla::proc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam) {
+    auto* self = (FakeScintilla*)::GetWindowLongPtr(hwnd, GWLP_USERDATA);
+    if (self && msg >= 2000 && msg < 3000) return self->handle(msg, wParam, lParam);
+    return ::DefWindowProc(hwnd, msg, wParam, lParam);
+}
+
+void FakeScintilla::indexLines() {
+    starts.assign(1, 0);
+    for (size_t i = 0; i < doc.size(); i++) {
+        if (doc[i] == '\r' && i + 1 < doc.size() && doc[i + 1] == '\n') i++;
+        if (doc[i] == '\r' || doc[i] == '\n') starts.push_back((int)i + 1);
+    }
+}
+
+int FakeScintilla::lineFromPosition(int pos) const {
+    pos = (std::max)(0, (std::min)(pos, (int)doc.size()));
+    return (int)(std::upper_bound(starts.begin(), starts.end(), pos) - starts.begin()) - 1;
+}
+
+int FakeScintilla::lineEndPosition(int line) const {
+    if (line < 0) return 0;
+    if (line + 1 >= lineCount()) return (int)doc.size();
+    int end = starts[line + 1];
+    if (end >= 1 && doc[end - 1] == '\n') end--;
+    if (end >= 1 && doc[end - 1] == '\r') end--;
+    return end;
+}
+
+int FakeScintilla::positionAfter(int pos) const {
+    int length = (int)doc.size();
+    if (pos >= length) return length;
+    if (doc[pos] == '\r' && pos + 1 < length && doc[pos + 1] == '\n') return pos + 2;
+    unsigned char lead = (unsigned char)doc[pos];
+    int width = (lead >= 0xF0) ? 4 : (lead >= 0xE0) ? 3 : (lead >= 0xC0) ? 2 : 1;
+    return (std::min)(pos + width, length);
+}
+
+int FakeScintilla::positionBefore(int pos) const {
+    if (pos <= 0) return 0;
+    pos = (std::min)(pos, (int)doc.size());
+    if (pos >= 2 && doc[pos - 1] == '\n' && doc[pos - 2] == '\r') return pos - 2;
+    pos--;
+    for (int i = 0; i < 3 && pos > 0 && ((unsigned char)doc[pos] & 0xC0) == 0x80; i++) pos--;
+    return pos;
+}
+
+int FakeScintilla::column(int pos) const {
+    int line = lineFromPosition(pos);
+    int col = 0;
+    for (int p = starts[line]; p < pos; p = positionAfter(p)) {
+        col = (doc[p] == '\t') ? (col / tabWidth + 1) * tabWidth : col + 1;
+    }
+    return col;
+}
+
+int FakeScintilla::findColumn(int line, int target) const {
+    if (line < 0 || line >= lineCount()) return (int)doc.size();
+    int end = lineEndPosition(line);
+    int col = 0;
+    int pos = starts[line];
+    while (pos < end) {
+        int next = (doc[pos] == '\t') ? (col / tabWidth + 1) * tabWidth : col + 1;
+        if (next > target) break;
+        col = next;
+        pos = positionAfter(pos);
+    }
+    return pos;
+}
+
+int FakeScintilla::indentPosition(int line) const {
+    if (line < 0 || line >= lineCount()) return (int)doc.size();
+    int pos = starts[line];
+    int end = lineEndPosition(line);
+    while (pos < end && (doc[pos] == ' ' || doc[pos] == '\t')) pos++;
+    return pos;
+}
+
+// A rectangular selection copies each of its lines followed by a line end.
+std::string FakeScintilla::selectedText() const {
+    if (selectionMode != SC_SEL_RECTANGLE) {
+        int start = (std::min)(caret, anchor);
+        return doc.substr(start, (std::max)(caret, anchor) - start);
+    }
+    static const char* const EOLS[] = { "\r\n", "\r", "\n" };
+    int first = (std::min)(lineFromPosition(rectAnchor), lineFromPosition(rectCaret));
+    int last = (std::max)(lineFromPosition(rectAnchor), lineFromPosition(rectCaret));
+    int left = (std::min)(column(rectAnchor), column(rectCaret));
+    int right = (std::max)(column(rectAnchor), column(rectCaret));
+    std::string text;
+    for (int line = first; line <= last; line++) {
+        int start = findColumn(line, left);
+        text.append(doc, start, findColumn(line, right) - start);
+        text += EOLS[eolMode];
+    }
+    return text;
+}
+
+void FakeScintilla::replace(int pos, int length, const std::string& text) {
+    pos = (std::max)(0, (std::min)(pos, (int)doc.size()));
+    length = (std::max)(0, (std::min)(length, (int)doc.size() - pos));
+    if (length == 0 && text.empty()) return;
+
+    if (undoDepth == 0 || !groupOpen) undoStack.push_back(doc);
+    if (undoDepth > 0) groupOpen = true;
+    editCount++;
+
+    auto shift = [&](int& p) {
+        if (p > pos + length) p -= length;
+        else if (p > pos) p = pos;
+        if (p > pos) p += (int)text.size();
+    };
+
+    if (length > 0) {
+        std::string removed = doc.substr(pos, length);
+        int linesBefore = lineCount();
+        doc.erase(pos, length);
+        indexLines();
+        notify(false, pos, removed, lineCount() - linesBefore);
+    }
+    if (!text.empty()) {
+        int linesBefore = lineCount();
+        doc.insert(pos, text);
+        indexLines();
+        notify(true, pos, text, lineCount() - linesBefore);
+    }
+    shift(caret);
+    shift(anchor);
+}
+
+void FakeScintilla::notify(bool inserted, int pos, const std::string& text, int linesAdded) {
+    if (!attached) return;
+    SCNotification scn = {};
+    scn.nmhdr.hwndFrom = window;
+    scn.nmhdr.code = SCN_MODIFIED;
+    scn.modificationType = (inserted ? SC_MOD_INSERTTEXT : SC_MOD_DELETETEXT) | SC_PERFORMED_USER;
+    scn.position = pos;
+    scn.length = (Sci_Position)text.size();
+    scn.linesAdded = linesAdded;
+    scn.text = text.c_str();
+    beNotified(&scn);
+}
+
+LRESULT FakeScintilla::handle(UINT msg, WPARAM wParam, LPARAM lParam) {
+    messageCount++;
+    received[msg]++;
+    int length = (int)doc.size();
+    int w = (int)wParam;
+    int l = (int)lParam;
+    switch (msg) {
+    case SCI_GETLENGTH:
+    case SCI_GETTEXTLENGTH:
+        return length;
+    case SCI_GETCHARAT:
+        return (w >= 0 && w < length) ? (LRESULT)(signed char)doc[w] : 0;
+    case SCI_GETCHARACTERPOINTER:
+        return (LRESULT)doc.c_str();
+    case SCI_GETRANGEPOINTER:
+        return (LRESULT)(doc.c_str() + (std::min)(w, length));
+    case SCI_GETGAPPOSITION:
+        return length;
+    case SCI_GETTEXTRANGEFULL: {
+        auto* tr = (Sci_TextRangeFull*)lParam;
+        int from = (std::max)(0, (int)tr->chrg.cpMin);
+        int to = (tr->chrg.cpMax < 0) ? length : (std::min)((int)tr->chrg.cpMax, length);
+        if (to < from) to = from;
+        std::memcpy(tr->lpstrText, doc.data() + from, to - from);
+        tr->lpstrText[to - from] = '\0';
+        return to - from;
+    }
+    case SCI_GETTEXT: {
+        if (!lParam) return length;
+        int n = (std::min)(w, length);
+        std::memcpy((char*)lParam, doc.data(), n);
+        ((char*)lParam)[n] = '\0';
+        return n;
+    }
+    case SCI_GETLINE: {
+        if (w < 0 || w >= lineCount()) return 0;
+        int end = (w + 1 < lineCount()) ? starts[w + 1] : length;
+        if (lParam) std::memcpy((char*)lParam, doc.data() + starts[w], end - starts[w]);
+        return end - starts[w];
+    }
+    case SCI_GETLINECOUNT:
+        return lineCount();
+    case SCI_POSITIONFROMLINE:
+        if (w < 0) return starts[lineFromPosition(caret)];
+        if (w == lineCount()) return length;
+        return (w > lineCount()) ? -1 : starts[w];
+    case SCI_GETLINEENDPOSITION:
+        return lineEndPosition(w);
+    case SCI_LINEFROMPOSITION:
+        return lineFromPosition(w);
+    case SCI_LINELENGTH:
+        if (w < 0 || w >= lineCount()) return 0;
+        return ((w + 1 < lineCount()) ? starts[w + 1] : length) - starts[w];
+    case SCI_GETLINEINDENTPOSITION:
+        return indentPosition(w);
+    case SCI_GETLINEINDENTATION:
+        return column(indentPosition(w));
+    case SCI_GETCOLUMN:
+        return column(w);
+    case SCI_FINDCOLUMN:
+        return findColumn(w, l);
+    case SCI_POSITIONBEFORE:
+        return positionBefore(w);
+    case SCI_POSITIONAFTER:
+        return positionAfter(w);
+    case SCI_POSITIONRELATIVE: {
+        int pos = w;
+        for (int i = 0; i < l; i++) {
+            if (pos >= length) return 0;
+            pos = positionAfter(pos);
+        }
+        for (int i = 0; i > l; i--) {
+            if (pos <= 0) return 0;
+            pos = positionBefore(pos);
+        }
+        return pos;
+    }
+
+    case SCI_GETCODEPAGE:
+        return SC_CP_UTF8;
+    case SCI_GETTABWIDTH:
+        return tabWidth;
+    case SCI_GETINDENT:
+    case SCI_GETUSETABS:
+        return 0;
+    case SCI_GETEOLMODE:
+        return eolMode;
+    case SCI_GETWORDCHARS: {
+        std::string chars;
+        for (int c = 1; c < 256; c++) {
+            if (c >= 0x80 || isalnum(c) || c == '_') chars += (char)c;
+        }
+        if (lParam) std::memcpy((char*)lParam, chars.c_str(), chars.size() + 1);
+        return (LRESULT)chars.size();
+    }
+    case SCI_GETDOCPOINTER:
+        return (LRESULT)docPointer;
+
+    case SCI_GETCURRENTPOS:
+        return caret;
+    case SCI_GETANCHOR:
+        return anchor;
+    case SCI_GETSELECTIONSTART:
+        return (std::min)(caret, anchor);
+    case SCI_GETSELECTIONEND:
+        return (std::max)(caret, anchor);
+    case SCI_GETSELECTIONEMPTY:
+        return caret == anchor;
+    case SCI_GETSELECTIONS:
+        return 1;
+    case SCI_GETSELECTIONNCARET:
+        return caret;
+    case SCI_GETSELECTIONNANCHOR:
+        return anchor;
+    case SCI_GETSELTEXT: {
+        std::string text = selectedText();
+        if (lParam) std::memcpy((char*)lParam, text.c_str(), text.size() + 1);
+        return (LRESULT)text.size();
+    }
+    case SCI_SETSELECTIONMODE:
+        selectionMode = w;
+        return 0;
+    case SCI_GETSELECTIONMODE:
+        return selectionMode;
+    case SCI_SETRECTANGULARSELECTIONANCHOR:
+        selectionMode = SC_SEL_RECTANGLE;
+        rectAnchor = (std::max)(0, (std::min)(w, length));
+        return 0;
+    case SCI_SETRECTANGULARSELECTIONCARET:
+        selectionMode = SC_SEL_RECTANGLE;
+        rectCaret = (std::max)(0, (std::min)(w, length));
+        return 0;
+    case SCI_GETRECTANGULARSELECTIONANCHOR:
+        return rectAnchor;
+    case SCI_GETRECTANGULARSELECTIONCARET:
+        return rectCaret;
+    case SCI_SETSEL:
+        selectionMode = SC_SEL_STREAM;
+        anchor = (std::min)(w, length);
+        caret = (l < 0) ? length : (std::min)(l, length);
+        return 0;
+    case SCI_GOTOPOS:
+    case SCI_SETEMPTYSELECTION:
+        selectionMode = SC_SEL_STREAM;
+        caret = anchor = (std::max)(0, (std::min)(w, length));
+        return 0;
+    case SCI_SETCURRENTPOS:
+        caret = (std::max)(0, (std::min)(w, length));
+        return 0;
+    case SCI_SETANCHOR:
+        anchor = (std::max)(0, (std::min)(w, length));
+        return 0;
+    case SCI_DOCUMENTSTART:
+        caret = anchor = 0;
+        return 0;
+    case SCI_DOCUMENTEND:
+        caret = anchor = length;
+        return 0;
+    case SCI_DOCUMENTSTARTEXTEND:
+        caret = 0;
+        return 0;
+    case SCI_DOCUMENTENDEXTEND:
+        caret = length;
+        return 0;
+
+    case SCI_SETTARGETSTART:
+        targetStart = w;
+        return 0;
+    case SCI_SETTARGETEND:
+        targetEnd = w;
+        return 0;
+    case SCI_SETTARGETRANGE:
+        targetStart = w;
+        targetEnd = l;
+        return 0;
+    case SCI_GETTARGETSTART:
+        return targetStart;
+    case SCI_GETTARGETEND:
+        return targetEnd;
+    case SCI_TARGETFROMSELECTION:
+        targetStart = (std::min)(caret, anchor);
+        targetEnd = (std::max)(caret, anchor);
+        return 0;
+    case SCI_TARGETWHOLEDOCUMENT:
+        targetStart = 0;
+        targetEnd = length;
+        return 0;
+    case SCI_REPLACETARGET:
+    case SCI_REPLACETARGETMINIMAL: {
+        std::string text = (w < 0) ? std::string((const char*)lParam) : std::string((const char*)lParam, w);
+        replace(targetStart, targetEnd - targetStart, text);
+        targetEnd = targetStart + (int)text.size();
+        return (LRESULT)text.size();
+    }
+
+    case SCI_INSERTTEXT:
+        replace((w < 0) ? caret : w, 0, (const char*)lParam);
+        return 0;
+    case SCI_ADDTEXT: {
+        int at = caret;
+        replace(at, 0, std::string((const char*)lParam, w));
+        caret = anchor = at + w;
+        return 0;
+    }
+    case SCI_APPENDTEXT:
+        replace(length, 0, std::string((const char*)lParam, w));
+        return 0;
+    case SCI_DELETERANGE:
+        replace(w, l, "");
+        return 0;
+    case SCI_REPLACESEL: {
+        int start = (std::min)(caret, anchor);
+        std::string text((const char*)lParam);
+        replace(start, (std::max)(caret, anchor) - start, text);
+        caret = anchor = start + (int)text.size();
+        return 0;
+    }
+    case SCI_SETTEXT:
+        replace(0, length, (const char*)lParam);
+        caret = anchor = 0;
+        return 0;
+    case SCI_CLEARALL:
+        replace(0, length, "");
+        return 0;
+
+    case SCI_BEGINUNDOACTION:
+        if (undoDepth++ == 0) groupOpen = false;
+        return 0;
+    case SCI_ENDUNDOACTION:
+        if (undoDepth > 0) undoDepth--;
+        return 0;
+    case SCI_CANUNDO:
+        return !undoStack.empty();
+    case SCI_UNDO: {
+        if (undoStack.empty()) return 0;
+        std::string previous = undoStack.back();
+        undoStack.pop_back();
+        size_t keep = undoStack.size();
+        replace(0, length, previous);
+        undoStack.resize(keep);
+        return 0;
+    }
+    case SCI_EMPTYUNDOBUFFER:
+        undoStack.clear();
+        return 0;
+    }
+    return 0;
+}
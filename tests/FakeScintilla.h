@@ -0,0 +1,90 @@
+#pragma once
+#include <windows.h>
+#include <map>
+#include <string>
+#include <vector>
+
+// A message-only window that answers the Scintilla messages the plugin sends,
+// over a plain std::string. Enough of Scintilla for the modules that only
+// talk to the editor through SendMessage to run without Notepad++.
+class FakeScintilla {
+public:
+    explicit FakeScintilla(const std::string& text = "");
+    ~FakeScintilla();
+    FakeScintilla(const FakeScintilla&) = delete;
+    FakeScintilla& operator=(const FakeScintilla&) = delete;
+
+    HWND hwnd() const { return window; }
+
+    void setText(const std::string& text);
+    const std::string& text() const { return doc; }
+    std::string line(int line) const;
+
+    void setCaret(int pos) { anchor = caret = pos; }
+    int caretPos() const { return caret; }
+    int anchorPos() const { return anchor; }
+
+    void setTabWidth(int width) { tabWidth = width; }
+    void setEolMode(int mode) { eolMode = mode; }
+    void setDocPointer(void* doc) { docPointer = doc; }
+
+    // Make this one of the two Scintilla views and report every change
+    // through beNotified, the way Notepad++ forwards SCN_MODIFIED.
+    void attachToPlugin(bool secondView = false);
+    // An edit the plugin never hears about, like one made while the document
+    // was out of every view.
+    void editUnnoticed(int pos, int length, const std::string& text);
+
+    // Changes made so far and the undo steps they form: an edit outside
+    // BEGINUNDOACTION/ENDUNDOACTION is a step of its own.
+    int edits() const { return editCount; }
+    int undoSteps() const { return (int)undoStack.size(); }
+
+    // Messages received since the last reset, all of them or of one kind.
+    int messages() const { return messageCount; }
+    int messages(UINT msg) const;
+    void resetCounters();
+
+private:
+    static LRESULT CALLBACK proc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam);
+    LRESULT handle(UINT msg, WPARAM wParam, LPARAM lParam);
+
+    int lineCount() const { return (int)starts.size(); }
+    int lineFromPosition(int pos) const;
+    int lineEndPosition(int line) const;
+    int positionBefore(int pos) const;
+    int positionAfter(int pos) const;
+    int column(int pos) const;
+    int findColumn(int line, int column) const;
+    int indentPosition(int line) const;
+    std::string selectedText() const;
+
+    void replace(int pos, int length, const std::string& text);
+    void indexLines();
+    void notify(bool inserted, int pos, const std::string& text, int linesAdded);
+
+    HWND window = nullptr;
+    std::string doc;
+    std::vector<int> starts;
+
+    int caret = 0;
+    int anchor = 0;
+    int selectionMode = 0;
+    int rectAnchor = 0;
+    int rectCaret = 0;
+    int targetStart = 0;
+    int targetEnd = 0;
+    int tabWidth = 4;
+    int eolMode = 2;
+    void* docPointer = this;
+    bool attached = false;
+    bool secondView = false;
+
+    int undoDepth = 0;
+    bool groupOpen = false;
+    int editCount = 0;
+    std::vector<std::string> undoStack;
+
+    int messageCount = 0;
+    std::map<UINT, int> received;
+};
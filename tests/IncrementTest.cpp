@@ -0,0 +1,128 @@
+#include "Test.h"
+#include "FakeScintilla.h"
+#include "../include/Increment.h"
+#include "../include/Utils.h"
+#include "../plugin/Scintilla.h"
+#include <climits>
+
+using F = Increment::Format;
+
+// The line with its first number from `from` on changed, or "none".
+static std::string adjusted(const char* line, long long delta, unsigned formats = F::FORMAT_BIN | F::FORMAT_HEX,
+                            size_t from = 0) {
+    Increment::Edit edit;
+    if (!Increment::adjust(line, from, delta, formats, edit)) return "none";
+    std::string out = line;
+    return out.replace(edit.start, edit.end - edit.start, edit.text);
+}
+
+TEST(Increment, HexBinOctalWrapAtTheirWidth) {
+    CHECK_EQ(adjusted("0x00", -1), std::string("0xff"));
+    CHECK_EQ(adjusted("0xff", 1), std::string("0x00"));
+    CHECK_EQ(adjusted("0x0a", 6), std::string("0x10"));
+    CHECK_EQ(adjusted("0xFE", 1), std::string("0xFF"));
+    CHECK_EQ(adjusted("0xfff", 1), std::string("0x000"));
+    CHECK_EQ(adjusted("0b000", -1), std::string("0b111"));
+    CHECK_EQ(adjusted("0b111", 1), std::string("0b000"));
+    CHECK_EQ(adjusted("0b01", 1), std::string("0b10"));
+
+    unsigned octal = F::FORMAT_OCTAL;
+    CHECK_EQ(adjusted("007", 1, octal), std::string("010"));
+    CHECK_EQ(adjusted("000", -1, octal), std::string("077"));
+    CHECK_EQ(adjusted("077", 1, octal), std::string("000"));
+    // Not octal: an 8 in it, or octal not in 'nrformats'
+    CHECK_EQ(adjusted("008", 1, octal), std::string("009"));
+    CHECK_EQ(adjusted("007", 1), std::string("008"));
+    // Without hex, 0x10 is 0, an x and 10
+    CHECK_EQ(adjusted("0x10", 1, 0), std::string("1x10"));
+}
+
+TEST(Increment, DecimalCrossesZero) {
+    CHECK_EQ(adjusted("5", -7), std::string("-2"));
+    CHECK_EQ(adjusted("-2", 5), std::string("3"));
+    CHECK_EQ(adjusted("1", -1), std::string("0"));
+    CHECK_EQ(adjusted("-1", 1), std::string("0"));
+    CHECK_EQ(adjusted("x = -10;", -5), std::string("x = -15;"));
+    CHECK_EQ(adjusted("0", LLONG_MIN), std::string("-9223372036854775808"));
+    CHECK_EQ(adjusted("0", LLONG_MAX), std::string("9223372036854775807"));
+}
+
+TEST(Increment, DecimalKeepsLeadingZeros) {
+    CHECK_EQ(adjusted("007", 5), std::string("012"));
+    CHECK_EQ(adjusted("099", 1), std::string("100"));
+    CHECK_EQ(adjusted("099", 901), std::string("1000"));
+    CHECK_EQ(adjusted("010", -20), std::string("-010"));
+    CHECK_EQ(adjusted("-010", 10), std::string("000"));
+    // A lone 0 is no leading zero
+    CHECK_EQ(adjusted("0", 12), std::string("12"));
+}
+
+TEST(Increment, UnsignedAndBlank) {
+    unsigned plain = F::FORMAT_UNSIGNED;
+    CHECK_EQ(adjusted("x-5", 1, plain), std::string("x-6"));
+    CHECK_EQ(adjusted("3", -5, plain), std::string("0"));
+    CHECK_EQ(adjusted("03", -5, plain), std::string("00"));
+
+    unsigned blank = F::FORMAT_BLANK;
+    CHECK_EQ(adjusted("a-5", 1, blank), std::string("a-6"));
+    CHECK_EQ(adjusted("a -5", 1, blank), std::string("a -4"));
+    CHECK_EQ(adjusted("-5", 1, blank), std::string("-4"));
+    CHECK_EQ(adjusted("a-5", 1), std::string("a-4"));
+}
+
+TEST(Increment, AlphaSaturates) {
+    unsigned alpha = F::FORMAT_ALPHA;
+    CHECK_EQ(adjusted("y", 5, alpha), std::string("z"));
+    CHECK_EQ(adjusted("b", -5, alpha), std::string("a"));
+    CHECK_EQ(adjusted("Y", 1, alpha), std::string("Z"));
+    CHECK_EQ(adjusted("Z", 1, alpha), std::string("Z"));
+    CHECK_EQ(adjusted("a", LLONG_MIN, alpha), std::string("a"));
+    CHECK_EQ(adjusted("a", LLONG_MAX, alpha), std::string("z"));
+    // A number ahead of the caret comes before any letter
+    CHECK_EQ(adjusted("ab 7", 1, alpha, 1), std::string("ac 7"));
+    CHECK_EQ(adjusted("ab 7", 1, 0, 1), std::string("ab 8"));
+}
+
+TEST(Increment, ManyDigits) {
+    std::string nines(25, '9');
+    CHECK_EQ(adjusted(nines.c_str(), 1), "1" + std::string(25, '0'));
+    std::string big = "-1" + std::string(26, '0');
+    CHECK_EQ(adjusted(big.c_str(), 1), "-" + std::string(26, '9'));
+    std::string hex = "0x" + std::string(30, 'f');
+    CHECK_EQ(adjusted(hex.c_str(), 1), "0x" + std::string(30, '0'));
+    std::string sum = "12345678901234567890123456789";
+    CHECK_EQ(adjusted(sum.c_str(), LLONG_MAX), std::string("12345678910457939926978232596"));
+}
+
+TEST(Increment, FindsNumberFromCaret) {
+    CHECK_EQ(adjusted("1 2 3", 1, 0, 2), std::string("1 3 3"));
+    CHECK_EQ(adjusted("1 2 3", 1, 0, 1), std::string("1 3 3"));
+    // On the sign or the x of 0x the whole number changes
+    CHECK_EQ(adjusted("a -5", 1, 0, 2), std::string("a -4"));
+    CHECK_EQ(adjusted("0x0f", 1, F::FORMAT_HEX, 1), std::string("0x10"));
+    CHECK_EQ(adjusted("12 ab", 1, 0, 3), std::string("none"));
+}
+
+// g CTRL-A over a range gives the n-th number n times the count, in one
+// replacement.
+TEST(Increment, ProgressiveRangeIsOneUndoStep) {
+    FakeScintilla sci("0\nx\n0 0\n-1\n007\n");
+    sci.resetCounters();
+    Increment::inRange(sci.hwnd(), 0, (int)sci.text().size(), 2, true);
+    CHECK_EQ(sci.text(), std::string("2\nx\n4 0\n5\n015\n"));
+    CHECK_EQ(sci.edits(), 1);
+    CHECK_EQ(sci.undoSteps(), 1);
+
+    ::SendMessage(sci.hwnd(), SCI_UNDO, 0, 0);
+    CHECK_EQ(sci.text(), std::string("0\nx\n0 0\n-1\n007\n"));
+}
+
+TEST(Increment, ProgressiveBlockChangesColumnOnly) {
+    FakeScintilla sci("1 1\n1 1\n1\n1 1\n");
+    sci.resetCounters();
+    BlockSelection blk = { 0, 3, 2, 3 };
+    Increment::inBlock(sci.hwnd(), blk, 1, true);
+    CHECK_EQ(sci.text(), std::string("1 2\n1 3\n1\n1 4\n"));
+    CHECK_EQ(sci.edits(), 1);
+    CHECK_EQ(sci.undoSteps(), 1);
+}
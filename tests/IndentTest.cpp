@@ -0,0 +1,153 @@
+#include "Test.h"
+#include "FakeScintilla.h"
+#include "../include/Indent.h"
+#include "../include/NormalMode.h"
+#include "../include/NppVim.h"
+#include "../plugin/Scintilla.h"
+#include <chrono>
+#include <cstdio>
+
+static Indent::Settings settings(Indent::Language language, bool useTabs = false) {
+    return { 4, 4, useTabs, language };
+}
+
+struct Golden {
+    const char* name;
+    Indent::Language language;
+    const char* input;
+    const char* expected;
+};
+
+// Shiftwidth 4, spaces.
+static const Golden GOLDEN[] = {
+    { "braces", Indent::LANG_C,
+      "int f() {\nif (x) {\ny();\n}\nreturn 0;\n}\n",
+      "int f() {\n    if (x) {\n        y();\n    }\n    return 0;\n}\n" },
+    { "brace on its own line", Indent::LANG_C,
+      "if (x)\n{\ny();\n}\n",
+      "if (x)\n{\n    y();\n}\n" },
+    { "wrong indent is fixed", Indent::LANG_C,
+      "      int a;\n  int b;\n",
+      "int a;\nint b;\n" },
+    { "braces in strings and comments", Indent::LANG_C,
+      "s = \"{\";\nc = '{';\n// {\nx;\n",
+      "s = \"{\";\nc = '{';\n// {\nx;\n" },
+    { "case labels", Indent::LANG_C,
+      "switch (x) {\ncase 1:\nfoo();\nbreak;\ndefault:\nbar();\n}\n",
+      "switch (x) {\n    case 1:\n        foo();\n        break;\n    default:\n        bar();\n}\n" },
+    { "access labels", Indent::LANG_C,
+      "class A {\npublic:\nint x;\nprivate:\nint y;\n};\n",
+      "class A {\npublic:\n    int x;\nprivate:\n    int y;\n};\n" },
+    { "unfinished statement continues", Indent::LANG_C,
+      "int x = a +\nb;\nint y;\n",
+      "int x = a +\n    b;\nint y;\n" },
+    { "arguments line up after the paren", Indent::LANG_C,
+      "foo(a,\nb);\nbar(\nc);\n",
+      "foo(a,\n    b);\nbar(\n    c);\n" },
+    { "block comment", Indent::LANG_C,
+      "  /*\n* x\n   */\n",
+      "/*\n * x\n */\n" },
+    { "preprocessor at column 0", Indent::LANG_C,
+      "void f() {\n    #ifdef X\ng();\n  #endif\n}\n",
+      "void f() {\n#ifdef X\n    g();\n#endif\n}\n" },
+    { "python levels are renumbered", Indent::LANG_PYTHON,
+      "def f():\n  if x:\n      y()\n  z()\n",
+      "def f():\n    if x:\n        y()\n    z()\n" },
+    { "python brackets and backslashes", Indent::LANG_PYTHON,
+      "x = foo(a,\nb)\ny = 1 + \\\n2\n",
+      "x = foo(a,\n        b)\ny = 1 + \\\n    2\n" },
+    { "python triple-quoted string is kept", Indent::LANG_PYTHON,
+      "def f():\n  \"\"\"doc\n text\n  \"\"\"\n",
+      "def f():\n    \"\"\"doc\n text\n  \"\"\"\n" },
+    { "html void elements", Indent::LANG_HTML,
+      "<ul>\n<li>a</li>\n<br>\n<IMG src=x>\n</ul>\n",
+      "<ul>\n    <li>a</li>\n    <br>\n    <IMG src=x>\n</ul>\n" },
+    { "html pre content is kept", Indent::LANG_HTML,
+      "<div>\n<pre>\n  keep\n</pre>\n<p>x</p>\n</div>\n",
+      "<div>\n    <pre>\n  keep\n    </pre>\n    <p>x</p>\n</div>\n" },
+    { "html script content is kept", Indent::LANG_HTML,
+      "<script>\nif (a) {\n  b();\n}\n</script>\n",
+      "<script>\nif (a) {\n  b();\n}\n</script>\n" },
+    { "tag split over lines", Indent::LANG_HTML,
+      "<div\nclass=x>\ntext\n</div>\n",
+      "<div\n    class=x>\n    text\n</div>\n" },
+    { "xml has no void elements", Indent::LANG_XML,
+      "<a>\n<br>\n<b/>\n</br>\n</a>\n",
+      "<a>\n    <br>\n        <b/>\n    </br>\n</a>\n" },
+    { "markup comment is kept", Indent::LANG_XML,
+      "<a>\n<!--\n x\n-->\n</a>\n",
+      "<a>\n    <!--\n x\n-->\n</a>\n" },
+};
+
+TEST(Indent, Golden) {
+    for (const Golden& golden : GOLDEN) {
+        std::string out = Indent::format(golden.input, 0, settings(golden.language));
+        if (out != golden.expected) {
+            test::fail(__FILE__, __LINE__, std::string(golden.name) + ": got [" + out + "]");
+        }
+    }
+}
+
+TEST(Indent, TabsAndBlankLines) {
+    CHECK_EQ(Indent::format("{\n{\nx;\n  \n}\n}\n", 0, settings(Indent::LANG_C, true)),
+             std::string("{\n\t{\n\t\tx;\n\n\t}\n}\n"));
+    CHECK_EQ(Indent::format("if (x) {\r\ny;\r\n}", 0, settings(Indent::LANG_C)),
+             std::string("if (x) {\r\n    y;\r\n}"));
+}
+
+// Lines before from are context: they set the level but are not returned.
+TEST(Indent, ContextLinesAreNotReturned) {
+    std::string text = "if (x) {\nfoo();\n}\n";
+    CHECK_EQ(Indent::format(text, text.find("foo"), settings(Indent::LANG_C)), std::string("    foo();\n}\n"));
+}
+
+TEST(Indent, ApplyIsOneEdit) {
+    FakeScintilla sci("int f() {\nint a;\n  int b;\n}\n");
+    sci.resetCounters();
+
+    Indent::apply(sci.hwnd(), 1, 2);
+    CHECK_EQ(sci.text(), std::string("int f() {\n    int a;\n    int b;\n}\n"));
+    CHECK_EQ(sci.edits(), 1);
+    CHECK_EQ(sci.undoSteps(), 1);
+    CHECK_EQ(sci.caretPos(), 14);
+
+    sci.resetCounters();
+    Indent::apply(sci.hwnd(), 0, 3);
+    CHECK_EQ(sci.edits(), 0);
+}
+
+template <typename F>
+static double millis(F&& run) {
+    auto start = std::chrono::steady_clock::now();
+    run();
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+// gg=G over 220k lines of C with every line at column 0.
+TEST(Indent, WholeFileBenchmark) {
+    const int functions = 20000;
+    std::string text, expected;
+    for (int i = 0; i < functions; i++) {
+        std::string n = std::to_string(i);
+        text += "int f" + n + "(int a,\nint b) {\nif (a) {\nreturn b +\n" + n + ";\n}\nswitch (b) {\ncase 1:\nbreak;\n}\n";
+        expected += "int f" + n + "(int a,\n" + std::string(6 + n.size(), ' ') + "int b) {\n    if (a) {\n        return b +\n            " + n +
+                    ";\n    }\n    switch (b) {\n        case 1:\n            break;\n    }\n";
+        text += "}\n";
+        expected += "}\n";
+    }
+
+    if (!g_normalMode) g_normalMode = new NormalMode(state);
+    state.mode = NORMAL;
+    FakeScintilla sci(text);
+    sci.setCaret((int)text.size() / 2);
+    sci.resetCounters();
+    double elapsed = millis([&] {
+        for (char c : std::string("gg=G")) g_normalMode->handleKey(sci.hwnd(), c);
+    });
+
+    std::printf("  gg=G on %d lines: %.2f ms, %d edit, %d messages\n",
+        functions * 11, elapsed, sci.edits(), sci.messages());
+    CHECK(sci.text() == expected);
+    CHECK_EQ(sci.edits(), 1);
+    CHECK_EQ(sci.undoSteps(), 1);
+}
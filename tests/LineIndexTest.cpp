@@ -0,0 +1,154 @@
+#include "Test.h"
+#include "FakeScintilla.h"
+#include "../include/LineIndex.h"
+#include "../plugin/Scintilla.h"
+#include <chrono>
+#include <cstdio>
+#include <random>
+
+static void checkAgainstScintilla(FakeScintilla& sci) {
+    LineIndex& index = LineIndex::getInstance();
+    HWND h = sci.hwnd();
+    int lines = (int)::SendMessage(h, SCI_GETLINECOUNT, 0, 0);
+    CHECK_EQ(index.lineCount(h), lines);
+    for (int line = 0; line < lines; line++) {
+        CHECK_EQ(index.lineStart(h, line), (int)::SendMessage(h, SCI_POSITIONFROMLINE, line, 0));
+        CHECK_EQ(index.lineEnd(h, line), (int)::SendMessage(h, SCI_GETLINEENDPOSITION, line, 0));
+    }
+    for (int pos = 0; pos <= (int)sci.text().size(); pos++) {
+        CHECK_EQ(index.lineFromPosition(h, pos), (int)::SendMessage(h, SCI_LINEFROMPOSITION, pos, 0));
+    }
+}
+
+TEST(LineIndex, FollowsEdits) {
+    FakeScintilla sci("one\ntwo\r\nthree\rfour");
+    sci.attachToPlugin();
+    checkAgainstScintilla(sci);
+
+    ::SendMessage(sci.hwnd(), SCI_INSERTTEXT, 4, (LPARAM)"new\nlines\n");
+    checkAgainstScintilla(sci);
+    ::SendMessage(sci.hwnd(), SCI_DELETERANGE, 2, 6);
+    checkAgainstScintilla(sci);
+    // Joins the lone CR with a new LF into one line end
+    ::SendMessage(sci.hwnd(), SCI_INSERTTEXT, (int)sci.text().find("\rfour") + 1, (LPARAM)"\n");
+    checkAgainstScintilla(sci);
+}
+
+TEST(LineIndex, SameLengthEditOutOfViewIsNoticed) {
+    FakeScintilla sci("ab\ncd\nef\n");
+    sci.attachToPlugin();
+    LineIndex& index = LineIndex::getInstance();
+    CHECK_EQ(index.lineStart(sci.hwnd(), 1), 3);
+
+    // Moves a line end: same length, same line count
+    sci.editUnnoticed(2, 2, "c\n");
+    index.viewsChanged();
+
+    checkAgainstScintilla(sci);
+}
+
+// Replace All in all open documents edits the ones out of view through
+// another Scintilla, so nothing about those edits reaches us.
+TEST(LineIndex, DocumentBackInViewIsRebuilt) {
+    std::string text;
+    for (int i = 0; i < 100; i++) text += "ab\ncd\n";
+    FakeScintilla sci(text);
+    sci.attachToPlugin();
+    LineIndex& index = LineIndex::getInstance();
+    CHECK_EQ(index.lineCount(sci.hwnd()), 201);
+
+    void* doc = (void*)::SendMessage(sci.hwnd(), SCI_GETDOCPOINTER, 0, 0);
+    sci.setDocPointer((void*)0x7FFF0000);
+    index.viewsChanged();
+    // Moves one line end by a character: same length, same line count
+    sci.editUnnoticed(31, 3, "bc\n");
+    sci.setDocPointer(doc);
+    index.viewsChanged();
+
+    checkAgainstScintilla(sci);
+}
+
+TEST(LineIndex, ForgottenDocumentIsRebuilt) {
+    FakeScintilla sci("a\nb\n");
+    sci.attachToPlugin();
+    LineIndex& index = LineIndex::getInstance();
+    CHECK_EQ(index.lineCount(sci.hwnd()), 3);
+
+    void* doc = (void*)::SendMessage(sci.hwnd(), SCI_GETDOCPOINTER, 0, 0);
+    index.forget(doc);
+    sci.resetCounters();
+
+    CHECK_EQ(index.lineCount(sci.hwnd()), 3);
+    CHECK_EQ(sci.messages(SCI_GETCHARACTERPOINTER), 1);
+}
+
+template <typename F>
+static double millis(F&& run) {
+    auto start = std::chrono::steady_clock::now();
+    run();
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+// A million line lookups on a 5M-line file from the table, against asking
+// Scintilla each time, then lookups with a character typed before each.
+// The fake answers a message with a plain call, so the times come out close
+// here; in Notepad++ each of those messages goes through the window
+// procedure.
+TEST(LineIndex, LookupBenchmark) {
+    const int lineCount = 5000000;
+    const int lookups = 1000000;
+    std::string text;
+    text.reserve(lineCount * 8);
+    for (int i = 0; i < lineCount; i++) text += (i % 3) ? "line\n" : "line\r\n";
+    FakeScintilla sci(text);
+    sci.attachToPlugin();
+    HWND h = sci.hwnd();
+    LineIndex& index = LineIndex::getInstance();
+
+    std::mt19937 random(31);
+    std::vector<int> positions(lookups);
+    for (int& pos : positions) pos = (int)(random() % text.size());
+
+    double built = millis([&] { index.lineCount(h); });
+    sci.resetCounters();
+    long long cachedSum = 0;
+    double cached = millis([&] {
+        for (int pos : positions) cachedSum += index.lineStart(h, index.lineFromPosition(h, pos));
+    });
+    int cachedMessages = sci.messages();
+
+    sci.resetCounters();
+    long long sentSum = 0;
+    double sent = millis([&] {
+        for (int pos : positions) {
+            int line = (int)::SendMessage(h, SCI_LINEFROMPOSITION, pos, 0);
+            sentSum += (int)::SendMessage(h, SCI_POSITIONFROMLINE, line, 0);
+        }
+    });
+    int sentMessages = sci.messages();
+
+    std::printf("  %d lines: built in %.2f ms; %d lookups %.2f ms, %d messages; SendMessage %.2f ms, %d messages\n",
+        lineCount, built, lookups, cached, cachedMessages, sent, sentMessages);
+    CHECK_EQ(cachedSum, sentSum);
+    CHECK_EQ(cachedMessages, 0);
+
+    // Typing on one line moves every later line start; the table catches up
+    // only when a lookup passes the edit. The fake's own work on each edit
+    // is left out of the time.
+    const int typed = 100;
+    int middle = (int)::SendMessage(h, SCI_POSITIONFROMLINE, lineCount / 2, 0);
+    double typing = 0;
+    int typingMessages = 0;
+    for (int i = 0; i < typed; i++) {
+        ::SendMessage(h, SCI_INSERTTEXT, middle + i, (LPARAM)"x");
+        ::SendMessage(h, SCI_EMPTYUNDOBUFFER, 0, 0);
+        sci.resetCounters();
+        typing += millis([&] { index.lineFromPosition(h, positions[i]); });
+        typingMessages += sci.messages();
+    }
+    std::printf("  %d characters typed with a lookup after each: %.2f ms in lookups, %d messages\n",
+        typed, typing, typingMessages);
+    CHECK_EQ(typingMessages, 0);
+    CHECK_EQ(index.lineStart(h, lineCount / 2 + 1), (int)::SendMessage(h, SCI_POSITIONFROMLINE, lineCount / 2 + 1, 0));
+    CHECK_EQ(index.lineFromPosition(h, (int)sci.text().size()), lineCount);
+}
@@ -0,0 +1,60 @@
+#include "Test.h"
+#include "FakeScintilla.h"
+#include "../include/MarkTracker.h"
+#include "../plugin/Scintilla.h"
+
+TEST(MarkTracker, PositionsFollowEdits) {
+    FakeScintilla sci("0123456789");
+    sci.attachToPlugin();
+    MarkTracker& tracker = MarkTracker::getInstance();
+    int a = tracker.track(sci.hwnd(), 2);
+    int b = tracker.track(sci.hwnd(), 5);
+    int c = tracker.track(sci.hwnd(), 8);
+
+    ::SendMessage(sci.hwnd(), SCI_INSERTTEXT, 3, (LPARAM)"xx");
+    CHECK_EQ(tracker.position(sci.hwnd(), a), 2);
+    CHECK_EQ(tracker.position(sci.hwnd(), b), 7);
+    CHECK_EQ(tracker.position(sci.hwnd(), c), 10);
+
+    // Marks inside deleted text collapse onto its start
+    ::SendMessage(sci.hwnd(), SCI_DELETERANGE, 6, 3);
+    CHECK_EQ(tracker.position(sci.hwnd(), b), 6);
+    CHECK_EQ(tracker.position(sci.hwnd(), c), 7);
+
+    tracker.forget(a);
+    tracker.forget(b);
+    tracker.forget(c);
+}
+
+TEST(MarkTracker, MoveKeepsOrder) {
+    FakeScintilla sci("abcdefghijklmnopqrstuvwxyz");
+    MarkTracker& tracker = MarkTracker::getInstance();
+    int handles[5];
+    for (int i = 0; i < 5; i++) handles[i] = tracker.track(sci.hwnd(), i * 5);
+
+    tracker.move(sci.hwnd(), handles[1], 7);
+    tracker.move(sci.hwnd(), handles[0], 22);
+
+    std::vector<std::pair<int, int>> found;
+    tracker.collect(sci.hwnd(), 0, 100, found);
+    CHECK_EQ(found.size(), (size_t)5);
+    for (size_t i = 1; i < found.size(); i++) CHECK(found[i - 1].second <= found[i].second);
+    CHECK_EQ(tracker.position(sci.hwnd(), handles[0]), 22);
+    CHECK_EQ(tracker.position(sci.hwnd(), handles[1]), 7);
+    CHECK_EQ(tracker.position(sci.hwnd(), handles[4]), 20);
+
+    for (int handle : handles) tracker.forget(handle);
+}
+
+TEST(MarkTracker, ClosedDocumentLosesItsHandles) {
+    FakeScintilla sci("text");
+    MarkTracker& tracker = MarkTracker::getInstance();
+    int handle = tracker.track(sci.hwnd(), 2);
+
+    tracker.forgetDocument(MarkTracker::documentOf(sci.hwnd()));
+
+    CHECK_EQ(tracker.position(sci.hwnd(), handle), -1);
+    std::vector<std::pair<int, int>> found;
+    tracker.collect(sci.hwnd(), 0, 100, found);
+    CHECK(found.empty());
+}
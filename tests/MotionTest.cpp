@@ -0,0 +1,211 @@
+#include "Test.h"
+#include "FakeScintilla.h"
+#include "../include/Motion.h"
+#include "../include/NppVim.h"
+#include "../plugin/Scintilla.h"
+#include <chrono>
+#include <cstdio>
+
+static std::string numberedLines(int count) {
+    std::string text;
+    for (int i = 0; i < count; i++) text += "line " + std::to_string(i) + "\n";
+    return text;
+}
+
+static void normalMode() {
+    state.mode = NORMAL;
+    state.isLineVisual = false;
+    state.isBlockVisual = false;
+}
+
+TEST(Motion, LineDownCountIsOneSelectionUpdate) {
+    normalMode();
+    FakeScintilla sci(numberedLines(200));
+    sci.setCaret(2);
+    sci.resetCounters();
+
+    Motion::lineDown(sci.hwnd(), 100000);
+
+    CHECK_EQ(sci.caretPos(), (int)sci.text().size());
+    CHECK_EQ(sci.messages(SCI_LINEDOWN), 0);
+    CHECK_EQ(sci.messages(SCI_GOTOPOS), 1);
+    CHECK(sci.messages() < 20);
+}
+
+TEST(Motion, LineDownKeepsColumn) {
+    normalMode();
+    FakeScintilla sci("abcdef\nxy\nabcdef\n");
+    sci.setCaret(4);
+
+    Motion::lineDown(sci.hwnd(), 1);
+    CHECK_EQ(sci.caretPos(), 9);
+    Motion::lineDown(sci.hwnd(), 1);
+    CHECK_EQ(sci.caretPos(), 14);
+}
+
+TEST(Motion, VisualLineDownExtendsFromAnchor) {
+    FakeScintilla sci(numberedLines(10));
+    state.mode = VISUAL;
+    state.isLineVisual = false;
+    state.isBlockVisual = false;
+    state.visualAnchor = 1;
+    state.visualPreferredColumn = 1;
+    sci.setCaret(1);
+    sci.resetCounters();
+
+    Motion::lineDown(sci.hwnd(), 3);
+
+    CHECK_EQ(sci.anchorPos(), 1);
+    CHECK_EQ(sci.caretPos(), 7 * 3 + 1);
+    CHECK_EQ(sci.messages(SCI_SETSEL), 1);
+    normalMode();
+}
+
+TEST(Motion, WordRightCountDoesNotScaleMessages) {
+    normalMode();
+    FakeScintilla sci("one two three four five");
+    sci.resetCounters();
+
+    Motion::wordRight(sci.hwnd(), 2);
+    CHECK_EQ(sci.caretPos(), 8);
+    int few = sci.messages();
+
+    sci.setCaret(0);
+    sci.resetCounters();
+    Motion::wordRight(sci.hwnd(), 10000);
+    CHECK_EQ(sci.caretPos(), (int)sci.text().size());
+    CHECK_EQ(sci.messages(SCI_WORDRIGHT), 0);
+    CHECK(sci.messages() <= few + 2);
+}
+
+TEST(Motion, WordLeftStopsOnPunctuation) {
+    normalMode();
+    FakeScintilla sci("foo.bar baz");
+    sci.setCaret(8);
+
+    Motion::wordLeft(sci.hwnd(), 1);
+    CHECK_EQ(sci.caretPos(), 4);
+    Motion::wordLeft(sci.hwnd(), 1);
+    CHECK_EQ(sci.caretPos(), 3);
+    Motion::wordLeft(sci.hwnd(), 1);
+    CHECK_EQ(sci.caretPos(), 0);
+}
+
+TEST(Motion, CharRightStopsAtDocumentEnd) {
+    normalMode();
+    FakeScintilla sci("h\xC3\xA9llo");
+    sci.setCaret(0);
+
+    Motion::charRight(sci.hwnd(), 2);
+    CHECK_EQ(sci.caretPos(), 3);
+    Motion::charRight(sci.hwnd(), 1000);
+    CHECK_EQ(sci.caretPos(), 6);
+    Motion::charLeft(sci.hwnd(), 4);
+    CHECK_EQ(sci.caretPos(), 1);
+}
+
+TEST(Motion, LineEndCountMovesDown) {
+    normalMode();
+    FakeScintilla sci("ab\ncde\nfghi\n");
+    sci.setCaret(0);
+
+    Motion::lineEnd(sci.hwnd(), 3);
+    CHECK_EQ(sci.caretPos(), 11);
+}
+
+TEST(Motion, LineStartAlternatesWithCount) {
+    normalMode();
+    FakeScintilla sci("    text here");
+    sci.setCaret(8);
+
+    Motion::lineStart(sci.hwnd(), 1);
+    CHECK_EQ(sci.caretPos(), 4);
+    Motion::lineStart(sci.hwnd(), 1);
+    CHECK_EQ(sci.caretPos(), 0);
+
+    sci.setCaret(8);
+    Motion::lineStart(sci.hwnd(), 2);
+    CHECK_EQ(sci.caretPos(), 0);
+    sci.setCaret(8);
+    Motion::lineStart(sci.hwnd(), 3);
+    CHECK_EQ(sci.caretPos(), 4);
+    CHECK_EQ(sci.messages(SCI_VCHOME), 0);
+}
+
+TEST(Motion, LineStartWithoutIndent) {
+    normalMode();
+    FakeScintilla sci("text");
+    sci.setCaret(3);
+
+    Motion::lineStart(sci.hwnd(), 2);
+    CHECK_EQ(sci.caretPos(), 0);
+}
+
+TEST(Motion, NextCharFindsMultiByteTarget) {
+    normalMode();
+    FakeScintilla sci("a\xC3\xA9" "b\xC3\xA9" "c");
+    sci.setCaret(0);
+
+    Motion::nextChar(sci.hwnd(), 2, U'\u00E9');
+    CHECK_EQ(sci.caretPos(), 4);
+}
+
+template <typename F>
+static double millis(F&& run) {
+    auto start = std::chrono::steady_clock::now();
+    run();
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Word motions with a count over Latin, Greek, Cyrillic, CJK, kana,
+// hangul, emoji and combining marks, against the same motion repeated one
+// word at a time. Both must land on the same byte.
+TEST(Motion, MixedScriptCountBenchmark) {
+    normalMode();
+    const std::string unit =
+        "na\xC3\xAFve caf\xC3\xA9, \xCE\x95\xCE\xBB\xCE\xBB\xCE\xAC\xCE\xB4\xCE\xB1 "
+        "\xD1\x80\xD1\x83\xD1\x81\xD1\x81\xD0\xBA\xD0\xB8\xD0\xB9 "
+        "\xE4\xB8\xAD\xE6\x96\x87\xE5\xAD\x97\xE3\x83\x86\xE3\x82\xB9\xE3\x83\x88 "
+        "\xED\x95\x9C\xEA\xB5\xAD\xEC\x96\xB4 \xF0\x9F\x98\x80\xF0\x9F\x91\x8D "
+        "x\xCC\x83y\xE2\x80\x94z;\n";
+    std::string text;
+    for (int i = 0; i < 5000; i++) text += unit;
+    const int count = 10000;
+
+    struct Run {
+        const char* name;
+        void (*motion)(HWND, int);
+        int from;
+    };
+    const int end = (int)text.size() - 1;
+    const Run runs[] = {
+        { "w", Motion::wordRight, 0 },
+        { "W", Motion::wordRightBig, 0 },
+        { "e", Motion::wordEnd, 0 },
+        { "b", Motion::wordLeft, end },
+        { "B", Motion::wordLeftBig, end },
+    };
+
+    for (const Run& run : runs) {
+        FakeScintilla counted(text);
+        counted.setCaret(run.from);
+        counted.resetCounters();
+        double once = millis([&] { run.motion(counted.hwnd(), count); });
+
+        FakeScintilla looped(text);
+        looped.setCaret(run.from);
+        looped.resetCounters();
+        double repeated = millis([&] {
+            for (int i = 0; i < count; i++) run.motion(looped.hwnd(), 1);
+        });
+
+        std::printf("  %d%s: counted %.2f ms, %d messages; one at a time %.2f ms, %d messages\n",
+            count, run.name, once, counted.messages(), repeated, looped.messages());
+        if (counted.caretPos() != looped.caretPos()) {
+            test::fail(__FILE__, __LINE__, std::string(run.name) + ": counted " + std::to_string(counted.caretPos()) +
+                ", one at a time " + std::to_string(looped.caretPos()));
+        }
+        CHECK(counted.caretPos() != run.from);
+        CHECK(counted.messages() < 100);
+    }
+}
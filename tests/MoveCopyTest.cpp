@@ -0,0 +1,108 @@
+#include "Test.h"
+#include "FakeScintilla.h"
+#include "../include/CommandMode.h"
+#include "../include/Marks.h"
+#include "../include/NppVim.h"
+#include "../plugin/Scintilla.h"
+
+extern CommandMode* g_commandMode;
+
+// :m and :t on a fresh document; every change is one undo step.
+static std::string run(const char* text, const char* command, int* edits = nullptr) {
+    if (!g_commandMode) g_commandMode = new CommandMode(state);
+    FakeScintilla sci(text);
+    sci.resetCounters();
+    g_commandMode->handleColonCommand(sci.hwnd(), command);
+    if (edits) *edits = sci.edits();
+    if (sci.edits() > 0) CHECK_EQ(sci.undoSteps(), 1);
+    return sci.text();
+}
+
+TEST(MoveCopy, MoveToTopAndBottom) {
+    CHECK_EQ(run("a\nb\nc\n", "3m0"), std::string("c\na\nb\n"));
+    CHECK_EQ(run("a\nb\nc\n", "1m$"), std::string("b\nc\na\n"));
+    CHECK_EQ(run("a\nb\nc\nd\n", "1,2m$"), std::string("c\nd\na\nb\n"));
+    CHECK_EQ(run("a\nb\nc\nd\n", "3,4m0"), std::string("c\nd\na\nb\n"));
+}
+
+// The last line has no line end of its own; it takes one along wherever it
+// goes and leaves the new last line without one.
+TEST(MoveCopy, LastLineWithoutLineEnd) {
+    CHECK_EQ(run("a\nb\nc", "3m0"), std::string("c\na\nb"));
+    CHECK_EQ(run("a\nb\nc", "1m$"), std::string("b\nc\na"));
+    CHECK_EQ(run("a\nb\nc", "2,3m0"), std::string("b\nc\na"));
+
+    FakeScintilla crlf("a\r\nb\r\nc");
+    crlf.setEolMode(SC_EOL_CRLF);
+    g_commandMode->handleColonCommand(crlf.hwnd(), "1t$");
+    CHECK_EQ(crlf.text(), std::string("a\r\nb\r\nc\r\na"));
+}
+
+// Moving down inserts before deleting, moving up deletes before inserting;
+// both keep the earlier position valid for the later edit.
+TEST(MoveCopy, BothEditOrders) {
+    int edits = 0;
+    CHECK_EQ(run("1\n2\n3\n4\n5\n", "2,3m4", &edits), std::string("1\n4\n2\n3\n5\n"));
+    CHECK_EQ(edits, 2);
+    CHECK_EQ(run("1\n2\n3\n4\n5\n", "4,5m1", &edits), std::string("1\n4\n5\n2\n3\n"));
+    CHECK_EQ(edits, 2);
+}
+
+TEST(MoveCopy, IntoItselfIsRefused) {
+    int edits = -1;
+    CHECK_EQ(run("a\nb\nc\nd\n", "1,3m2", &edits), std::string("a\nb\nc\nd\n"));
+    CHECK_EQ(edits, 0);
+    // Right after itself or just before it changes nothing either
+    CHECK_EQ(run("a\nb\nc\nd\n", "2,3m3", &edits), std::string("a\nb\nc\nd\n"));
+    CHECK_EQ(edits, 0);
+    CHECK_EQ(run("a\nb\nc\nd\n", "2,3m1", &edits), std::string("a\nb\nc\nd\n"));
+    CHECK_EQ(edits, 0);
+}
+
+TEST(MoveCopy, CopyLeavesSource) {
+    int edits = 0;
+    CHECK_EQ(run("a\nb\nc\n", "1,2t3", &edits), std::string("a\nb\nc\na\nb\n"));
+    CHECK_EQ(edits, 1);
+    CHECK_EQ(run("a\nb\nc\n", "3t0"), std::string("c\na\nb\nc\n"));
+    CHECK_EQ(run("a\nb\nc\n", "2t2"), std::string("a\nb\nb\nc\n"));
+}
+
+TEST(MoveCopy, MarksMoveWithTheLines) {
+    if (!g_commandMode) g_commandMode = new CommandMode(state);
+    FakeScintilla sci("one\ntwo\nthree\nfour\n");
+    sci.attachToPlugin();
+    sci.setCaret(5);
+    Marks::setMark(sci.hwnd(), 'a');
+    sci.setCaret(14);
+    Marks::setMark(sci.hwnd(), 'b');
+
+    g_commandMode->handleColonCommand(sci.hwnd(), "2m$");
+    CHECK_EQ(sci.text(), std::string("one\nthree\nfour\ntwo\n"));
+    CHECK_EQ(Marks::position(sci.hwnd(), 'a'), 16);
+    CHECK_EQ(Marks::position(sci.hwnd(), 'b'), 10);
+
+    g_commandMode->handleColonCommand(sci.hwnd(), "4m0");
+    CHECK_EQ(sci.text(), std::string("two\none\nthree\nfour\n"));
+    CHECK_EQ(Marks::position(sci.hwnd(), 'a'), 1);
+    CHECK_EQ(Marks::position(sci.hwnd(), 'b'), 14);
+}
+
+// Two edits and a fixed number of messages however far the lines go.
+TEST(MoveCopy, CostDoesNotGrowWithDistance) {
+    if (!g_commandMode) g_commandMode = new CommandMode(state);
+    std::string text;
+    for (int i = 0; i < 20000; i++) text += "line " + std::to_string(i) + "\n";
+
+    FakeScintilla sci(text);
+    sci.attachToPlugin();
+    sci.resetCounters();
+    g_commandMode->handleColonCommand(sci.hwnd(), "1,3m10");
+    int near = sci.messages();
+    CHECK_EQ(sci.edits(), 2);
+
+    sci.resetCounters();
+    g_commandMode->handleColonCommand(sci.hwnd(), "1,3m19000");
+    CHECK_EQ(sci.edits(), 2);
+    CHECK_EQ(sci.messages(), near);
+    CHECK_EQ(sci.line(18997), std::string("line 3"));
+}
@@ -0,0 +1,118 @@
+#include "Test.h"
+#include "FakeScintilla.h"
+#include "../include/Paste.h"
+#include "../plugin/Scintilla.h"
+#include <chrono>
+#include <cstdio>
+
+TEST(Paste, CharwiseCountIsOneEdit) {
+    FakeScintilla sci("abc");
+    sci.setCaret(0);
+    sci.resetCounters();
+
+    Paste::put(sci.hwnd(), "xy", 3, Paste::CHARWISE, true);
+    CHECK_EQ(sci.text(), std::string("axyxyxybc"));
+    CHECK_EQ(sci.edits(), 1);
+    CHECK_EQ(sci.undoSteps(), 1);
+    CHECK_EQ(sci.caretPos(), 6);
+
+    ::SendMessage(sci.hwnd(), SCI_UNDO, 0, 0);
+    CHECK_EQ(sci.text(), std::string("abc"));
+}
+
+TEST(Paste, LinewiseBefore) {
+    FakeScintilla sci("a\nb\n");
+    sci.setCaret(2);
+    sci.resetCounters();
+
+    Paste::put(sci.hwnd(), "x\n", 2, Paste::LINEWISE, false);
+    CHECK_EQ(sci.text(), std::string("a\nx\nx\nb\n"));
+    CHECK_EQ(sci.edits(), 1);
+    CHECK_EQ(sci.undoSteps(), 1);
+    CHECK_EQ(sci.caretPos(), 2);
+}
+
+// After a last line with no line end the copies open a new line, and the
+// document still ends without one.
+TEST(Paste, LinewiseAfterLastLine) {
+    FakeScintilla sci("one\ntwo");
+    sci.setCaret(5);
+    sci.resetCounters();
+
+    Paste::put(sci.hwnd(), "new\n", 2, Paste::LINEWISE, true);
+    CHECK_EQ(sci.text(), std::string("one\ntwo\nnew\nnew"));
+    CHECK_EQ(sci.edits(), 1);
+    CHECK_EQ(sci.undoSteps(), 1);
+    CHECK_EQ(sci.caretPos(), 8);
+}
+
+TEST(Paste, BlockwiseCopiesLineUp) {
+    FakeScintilla sci("ab\ncd\n");
+    sci.setCaret(0);
+    sci.resetCounters();
+
+    Paste::put(sci.hwnd(), "1\n22", 2, Paste::BLOCKWISE, true);
+    CHECK_EQ(sci.text(), std::string("a1 1b\nc2222d\n"));
+    CHECK_EQ(sci.undoSteps(), 1);
+
+    ::SendMessage(sci.hwnd(), SCI_UNDO, 0, 0);
+    CHECK_EQ(sci.text(), std::string("ab\ncd\n"));
+}
+
+template <typename F>
+static double millis(F&& run) {
+    auto start = std::chrono::steady_clock::now();
+    run();
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+// A count put once against the same register put count times, the way a
+// count used to be handled. The loop empties the undo buffer after each put
+// so the fake's per-edit snapshots of a growing document stay small.
+static void countBenchmark(const char* name, const std::string& text, int caret, const std::string& reg,
+    Paste::Shape shape, bool after) {
+    const int count = 10000;
+
+    FakeScintilla once(text);
+    once.setCaret(caret);
+    once.resetCounters();
+    double counted = millis([&] { Paste::put(once.hwnd(), reg, count, shape, after); });
+    int countedMessages = once.messages();
+
+    FakeScintilla looped(text);
+    looped.setCaret(caret);
+    looped.resetCounters();
+    double repeated = millis([&] {
+        for (int i = 0; i < count; i++) {
+            Paste::put(looped.hwnd(), reg, 1, shape, after);
+            ::SendMessage(looped.hwnd(), SCI_EMPTYUNDOBUFFER, 0, 0);
+        }
+    });
+
+    std::printf("  %d%s %s: counted %.2f ms, %d edit, %d messages; one at a time %.2f ms, %d edits, %d messages\n",
+        count, after ? "p" : "P", name, counted, once.edits(), countedMessages, repeated, looped.edits(),
+        looped.messages() - looped.messages(SCI_EMPTYUNDOBUFFER));
+    CHECK(once.text() == looped.text());
+    CHECK_EQ(once.edits(), 1);
+    CHECK_EQ(once.undoSteps(), 1);
+
+    ::SendMessage(once.hwnd(), SCI_UNDO, 0, 0);
+    CHECK(once.text() == text);
+}
+
+// 10000p of a line into a 1000-line document.
+TEST(Paste, LinewiseCountBenchmark) {
+    std::string text;
+    for (int i = 0; i < 1000; i++) text += "line " + std::to_string(i) + "\n";
+    countBenchmark("linewise", text, 0, "pasted line of text\n", Paste::LINEWISE, true);
+}
+
+// 10000P of a three-line block at column 10, where the second and third
+// lines are too short and get padded. Each P leaves the caret on the top
+// left of what it put, so repeating it stacks the copies the same way a
+// count does.
+TEST(Paste, BlockwiseCountBenchmark) {
+    std::string text = "a long first line\nab\n\n";
+    for (int i = 0; i < 1000; i++) text += "line " + std::to_string(i) + "\n";
+    countBenchmark("blockwise", text, 10, "abc\ndef\nghi", Paste::BLOCKWISE, false);
+}
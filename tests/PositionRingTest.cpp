@@ -0,0 +1,107 @@
+#include "Test.h"
+#include "FakeScintilla.h"
+#include "../include/PositionRing.h"
+#include "../include/Utils.h"
+#include <sstream>
+
+static std::string numberedLines(int count) {
+    std::string text;
+    for (int i = 0; i < count; i++) text += "line " + std::to_string(i) + "\n";
+    return text;
+}
+
+static void pushLine(PositionRing& ring, FakeScintilla& sci, int line) {
+    ring.push(sci.hwnd(), Utils::lineStart(sci.hwnd(), line), line);
+}
+
+// Recorded lines, oldest first.
+static std::string lines(PositionRing& ring, FakeScintilla& sci) {
+    std::istringstream in(ring.serialize(sci.hwnd()));
+    std::string out;
+    long pos;
+    int line;
+    while (in >> pos >> line) out += (out.empty() ? "" : " ") + std::to_string(line);
+    return out;
+}
+
+TEST(PositionRing, WrapsAroundAtCapacity) {
+    FakeScintilla sci(numberedLines(20));
+    PositionRing ring(3, false);
+    for (int line = 1; line <= 5; line++) pushLine(ring, sci, line);
+
+    CHECK_EQ(ring.size(), (size_t)3);
+    CHECK_EQ(lines(ring, sci), "3 4 5");
+
+    for (int line = 6; line <= 10; line++) pushLine(ring, sci, line);
+    CHECK_EQ(lines(ring, sci), "8 9 10");
+    ring.clear();
+}
+
+TEST(PositionRing, BackAndForwardAcrossWrap) {
+    FakeScintilla sci(numberedLines(20));
+    PositionRing ring(4, false);
+    for (int line = 1; line <= 6; line++) pushLine(ring, sci, line);
+
+    long target = -1;
+    CHECK(ring.back(sci.hwnd(), Utils::lineStart(sci.hwnd(), 12), 12, 1, target));
+    CHECK_EQ(Utils::lineFromPosition(sci.hwnd(), (int)target), 6);
+    // The current position was pushed, evicting line 3
+    CHECK_EQ(lines(ring, sci), "4 5 6 12");
+
+    CHECK(ring.back(sci.hwnd(), 0, 0, 2, target));
+    CHECK_EQ(Utils::lineFromPosition(sci.hwnd(), (int)target), 4);
+    CHECK(!ring.back(sci.hwnd(), 0, 0, 1, target));
+
+    CHECK(ring.forward(sci.hwnd(), 3, target));
+    CHECK_EQ(Utils::lineFromPosition(sci.hwnd(), (int)target), 12);
+    CHECK(!ring.forward(sci.hwnd(), 1, target));
+    ring.clear();
+}
+
+TEST(PositionRing, SameLineReplacesOlderEntryWithoutLosingCapacity) {
+    FakeScintilla sci(numberedLines(20));
+    PositionRing ring(3, false);
+    pushLine(ring, sci, 1);
+    pushLine(ring, sci, 2);
+    pushLine(ring, sci, 3);
+    pushLine(ring, sci, 2);
+
+    CHECK_EQ(ring.size(), (size_t)3);
+    CHECK_EQ(lines(ring, sci), "1 3 2");
+
+    pushLine(ring, sci, 4);
+    CHECK_EQ(lines(ring, sci), "3 2 4");
+    ring.clear();
+}
+
+TEST(PositionRing, DedupeIsPerDocument) {
+    FakeScintilla a(numberedLines(10));
+    FakeScintilla b(numberedLines(10));
+    PositionRing ring(10, false);
+
+    pushLine(ring, a, 1);
+    pushLine(ring, b, 1);
+    CHECK_EQ(ring.size(), (size_t)2);
+
+    // Line 1 of b took the newest key for line 1; a's entry is still found
+    pushLine(ring, a, 1);
+    CHECK_EQ(ring.size(), (size_t)2);
+    ring.clear();
+}
+
+TEST(PositionRing, BackSkipsEntriesOnCurrentLine) {
+    FakeScintilla sci(numberedLines(20));
+    PositionRing ring(5, false);
+    pushLine(ring, sci, 2);
+    pushLine(ring, sci, 7);
+    pushLine(ring, sci, 9);
+
+    long target = -1;
+    CHECK(ring.back(sci.hwnd(), Utils::lineStart(sci.hwnd(), 9), 9, 1, target));
+    CHECK_EQ(Utils::lineFromPosition(sci.hwnd(), (int)target), 7);
+    CHECK_EQ(lines(ring, sci), "2 7 9");
+
+    CHECK(ring.forward(sci.hwnd(), 1, target));
+    CHECK_EQ(Utils::lineFromPosition(sci.hwnd(), (int)target), 9);
+    ring.clear();
+}
@@ -0,0 +1,49 @@
+#include "Test.h"
+#include "../include/Process.h"
+
+// Commands that copy stdin to stdout, exit with a code and take a while.
+#ifdef _WIN32
+static const char* const COPY = "findstr \"^\"";
+static const char* const EXIT_3 = "exit 3";
+static const char* const SLOW = "ping -n 30 127.0.0.1 >nul";
+static const char* const EOL = "\r\n";
+#else
+static const char* const COPY = "cat";
+static const char* const EXIT_3 = "exit 3";
+static const char* const SLOW = "sleep 30";
+static const char* const EOL = "\n";
+#endif
+
+// Well past any pipe buffer, so the command blocks on its output unless it
+// is read while the input is still being written.
+TEST(Process, FilterRoundTrip) {
+    std::string input;
+    for (int i = 0; input.size() < 4 * 1024 * 1024; i++) input += "line " + std::to_string(i) + EOL;
+
+    std::string output;
+    int exitCode = -1;
+    ProcessResult result = Process::filter(Process::defaultShell(), COPY, input, output, exitCode);
+    CHECK(result == ProcessResult::Finished);
+    CHECK_EQ(exitCode, 0);
+    CHECK_EQ(output.size(), input.size());
+    CHECK(output == input);
+}
+
+TEST(Process, ExitCode) {
+    std::string output;
+    int exitCode = -1;
+    ProcessResult result = Process::filter(Process::defaultShell(), EXIT_3, "ignored", output, exitCode);
+    CHECK(result == ProcessResult::Finished);
+    CHECK_EQ(exitCode, 3);
+    CHECK(output.empty());
+}
+
+TEST(Process, ProgressCancels) {
+    std::string output;
+    int exitCode = -1;
+    int calls = 0;
+    ProcessResult result = Process::filter(Process::defaultShell(), SLOW, "", output, exitCode,
+        [&calls](size_t, size_t) { return ++calls < 3; });
+    CHECK(result == ProcessResult::Cancelled);
+    CHECK_EQ(calls, 3);
+}
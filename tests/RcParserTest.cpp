@@ -0,0 +1,143 @@
+#include "Test.h"
+#include "../include/RcParser.h"
+#include "../include/CommandMode.h"
+#include "../include/OptionRegistry.h"
+#include "../include/NppVim.h"
+#include "../plugin/PluginInterface.h"
+#include "../plugin/Notepad_plus_msgs.h"
+#include <chrono>
+#include <cstdio>
+#include <cwchar>
+#include <fstream>
+
+extern NppData nppData;
+extern CommandMode* g_commandMode;
+
+static std::string configDir() {
+    char temp[MAX_PATH] = {};
+    ::GetTempPathA(MAX_PATH, temp);
+    return std::string(temp) + "NppVimTests";
+}
+
+// Notepad++ as far as the rc loader asks it anything: where the cache goes.
+static LRESULT CALLBACK fakeNpp(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam) {
+    if (msg == NPPM_GETPLUGINSCONFIGDIR) {
+        std::string dir = configDir();
+        std::wcsncpy((TCHAR*)lParam, std::wstring(dir.begin(), dir.end()).c_str(), wParam);
+        return TRUE;
+    }
+    return ::DefWindowProc(hwnd, msg, wParam, lParam);
+}
+
+static void setUpPlugin() {
+    static bool done = false;
+    if (done) return;
+    done = true;
+
+    ::CreateDirectoryA(configDir().c_str(), NULL);
+    ::CreateDirectoryA((configDir() + "\\NppVim").c_str(), NULL);
+
+    WNDCLASSEX wc = {};
+    wc.cbSize = sizeof(wc);
+    wc.lpfnWndProc = fakeNpp;
+    wc.hInstance = ::GetModuleHandle(nullptr);
+    wc.lpszClassName = TEXT("NppVimTestNpp");
+    ::RegisterClassEx(&wc);
+    nppData._nppHandle = ::CreateWindowEx(0, wc.lpszClassName, TEXT(""), 0, 0, 0, 0, 0,
+        HWND_MESSAGE, nullptr, wc.hInstance, nullptr);
+
+    if (!g_commandMode) g_commandMode = new CommandMode(state);
+}
+
+static std::string writeRc(const std::string& text, const char* name = "test.nppvimrc") {
+    std::string path = configDir() + "\\" + name;
+    std::ofstream(path, std::ios::binary) << text;
+    return path;
+}
+
+// Leaves options, mappings and commands as an empty rc file has them.
+static void unload() {
+    RcParser::getInstance().loadRc(writeRc(""));
+}
+
+TEST(RcParser, ColonCommandsRunInSourceOrder) {
+    setUpPlugin();
+    RcParser& parser = RcParser::getInstance();
+
+    // The option line after the colon command must win.
+    parser.loadRc(writeRc("command Wide set shiftwidth=6\nWide\nset shiftwidth=2\n"));
+    CHECK_EQ(Options::shiftwidth.get(), 2);
+
+    // And the colon command must win over the option line before it.
+    unload();
+    parser.loadRc(writeRc("set shiftwidth=2\ncommand Wide set shiftwidth=6\nWide\n"));
+    CHECK_EQ(Options::shiftwidth.get(), 6);
+
+    unload();
+    CHECK_EQ(Options::shiftwidth.get(), 4);
+}
+
+TEST(RcParser, ReloadFollowsTheFile) {
+    setUpPlugin();
+    RcParser& parser = RcParser::getInstance();
+
+    parser.loadRc(writeRc("set tabstop=3\nset tabstop=5\nset textwidth=70\nnnoremap Q gq\n"));
+    CHECK_EQ(Options::tabstop.get(), 5);
+    CHECK_EQ(Options::textwidth.get(), 70);
+
+    // Values set by hand since are brought back in line, and what the file
+    // no longer sets goes back to its default.
+    OptionRegistry::getInstance().setOption(OptionId::TabStop, 9);
+    parser.loadRc(writeRc("set tabstop=3\nset tabstop=5\n"));
+    CHECK_EQ(Options::tabstop.get(), 5);
+    CHECK_EQ(Options::textwidth.get(), 0);
+
+    unload();
+    CHECK_EQ(Options::tabstop.get(), 4);
+}
+
+static std::string largeRc(int lines) {
+    std::string text;
+    for (int i = 0; i < lines; i++) {
+        switch (i % 4) {
+        case 0: text += "\" comment " + std::to_string(i) + "\n"; break;
+        case 1: text += "set tabstop=" + std::to_string(i % 8 + 1) + " shiftwidth=4\n"; break;
+        case 2: text += "nnoremap <leader>" + std::to_string(i) + " :echo " + std::to_string(i) + "<CR>\n"; break;
+        case 3: text += "command Cmd" + std::to_string(i) + " set textwidth=" + std::to_string(i % 100) + "\n"; break;
+        }
+    }
+    return text;
+}
+
+template <typename F>
+static double millis(F&& run) {
+    auto start = std::chrono::steady_clock::now();
+    run();
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Startup cost of a large rc file: compiled from source, read back from the
+// cache, and reloaded unchanged.
+TEST(RcParser, StartupBenchmark) {
+    setUpPlugin();
+    RcParser& parser = RcParser::getInstance();
+    std::string path = writeRc(largeRc(4000), "large.nppvimrc");
+    std::string cache = configDir() + "\\NppVim\\nppvim.rc.cache";
+    std::string saved = configDir() + "\\large.cache";
+    ::DeleteFileA(cache.c_str());
+
+    double compiled = millis([&] { parser.loadRc(path); });
+    ::CopyFileA(cache.c_str(), saved.c_str(), FALSE);
+
+    // A fresh start with the cache written by the run before.
+    unload();
+    ::CopyFileA(saved.c_str(), cache.c_str(), FALSE);
+    double cached = millis([&] { parser.loadRc(path); });
+    double unchanged = millis([&] { parser.loadRc(path); });
+    std::printf("  rc startup, 4000 lines: compiled %.2f ms, cached %.2f ms, unchanged reload %.2f ms\n",
+        compiled, cached, unchanged);
+
+    // The last :set is on line 3997.
+    CHECK_EQ(Options::tabstop.get(), 6);
+    unload();
+}
@@ -0,0 +1,182 @@
+#include "Test.h"
+#include "FakeScintilla.h"
+#include "../include/Reflow.h"
+#include "../include/OptionRegistry.h"
+#include "../plugin/Scintilla.h"
+#include <chrono>
+#include <cstdio>
+
+static Reflow::Settings settings(int width, bool optimal = false) {
+    return { width, 4, optimal, true, "\n" };
+}
+
+struct Golden {
+    const char* name;
+    const char* input;
+    const char* expected;
+};
+
+// Width 20, first fit.
+static const Golden GOLDEN[] = {
+    { "plain",
+      "the quick brown fox jumps over the lazy dog",
+      "the quick brown fox\njumps over the lazy\ndog" },
+    { "joins lines, keeps blank line",
+      "one\ntwo three\n\nfour\nfive",
+      "one two three\n\nfour five" },
+    { "indent",
+      "  alpha beta gamma delta epsilon",
+      "  alpha beta gamma\n  delta epsilon" },
+    { "second line sets the continuation indent",
+      "    alpha beta gamma delta\n  epsilon zeta",
+      "    alpha beta gamma\n  delta epsilon zeta" },
+    { "line comment",
+      "// one two three four five six seven",
+      "// one two three\n// four five six\n// seven" },
+    { "different leaders do not join",
+      "// one two\n# three four",
+      "// one two\n# three four" },
+    { "block comment",
+      "/*\n * one two three four five six\n */",
+      "/*\n * one two three\n * four five six\n */" },
+    { "bullet list",
+      "- item one is long enough to wrap\n- second",
+      "- item one is long\n  enough to wrap\n- second" },
+    { "numbered list takes indented lines",
+      "1. first item\n   continues here and wraps\n2) next",
+      "1. first item\n   continues here\n   and wraps\n2) next" },
+    { "fenced code is kept",
+      "```\nkeep   this   as is\n```\nwrap me\nplease",
+      "```\nkeep   this   as is\n```\nwrap me please" },
+    { "rule is kept",
+      "text one\n---\ntext two",
+      "text one\n---\ntext two" },
+    { "word longer than the width",
+      "a verylongwordthatwontfit b",
+      "a\nverylongwordthatwontfit\nb" },
+    { "mail quote",
+      "> quoted text that goes on and on",
+      "> quoted text that\n> goes on and on" },
+    { "blanks collapse",
+      "a   b\t\tc",
+      "a b c" },
+};
+
+TEST(Reflow, Golden) {
+    for (const Golden& golden : GOLDEN) {
+        std::string out = Reflow::format(golden.input, settings(20));
+        if (out != golden.expected) {
+            test::fail(__FILE__, __LINE__, std::string(golden.name) + ": got [" + out + "]");
+        }
+    }
+}
+
+// Minimum raggedness moves a word down where first fit would leave one
+// line nearly empty.
+TEST(Reflow, OptimalBreaks) {
+    CHECK_EQ(Reflow::format("aaa bb cc ddddd", settings(6)), std::string("aaa bb\ncc\nddddd"));
+    CHECK_EQ(Reflow::format("aaa bb cc ddddd", settings(6, true)), std::string("aaa\nbb cc\nddddd"));
+}
+
+TEST(Reflow, Utf8WidthsCountCharacters) {
+    Reflow::Settings chars = settings(11);
+    CHECK_EQ(Reflow::format("h\xC3\xA9llo w\xC3\xB6rld \xC3\xBCn", chars), std::string("h\xC3\xA9llo w\xC3\xB6rld\n\xC3\xBCn"));
+    Reflow::Settings bytes = chars;
+    bytes.utf8 = false;
+    CHECK_EQ(Reflow::format("h\xC3\xA9llo w\xC3\xB6rld \xC3\xBCn", bytes), std::string("h\xC3\xA9llo\nw\xC3\xB6rld \xC3\xBCn"));
+}
+
+TEST(Reflow, KeepsLineEnds) {
+    Reflow::Settings crlf = settings(20);
+    crlf.eol = "\r\n";
+    CHECK_EQ(Reflow::format("one\r\ntwo\r\n\r\nthree", crlf), std::string("one two\r\n\r\nthree"));
+}
+
+TEST(Reflow, CursorFollowsItsCharacter) {
+    std::string input = "the quick brown fox jumps over the lazy dog";
+    size_t cursor = input.find("lazy") + 2;
+    std::string out = Reflow::format(input, settings(20), &cursor);
+    CHECK_EQ(cursor, out.find("lazy") + 2);
+}
+
+TEST(Reflow, ApplyIsOneEdit) {
+    OptionRegistry::getInstance().setOption(OptionId::TextWidth, 20);
+    FakeScintilla sci("keep\nthe quick brown fox jumps over the lazy dog\nkeep\n");
+    sci.resetCounters();
+
+    Reflow::apply(sci.hwnd(), 1, 1);
+    CHECK_EQ(sci.text(), std::string("keep\nthe quick brown fox\njumps over the lazy\ndog\nkeep\n"));
+    CHECK_EQ(sci.edits(), 1);
+    CHECK_EQ(sci.undoSteps(), 1);
+    // gq leaves the caret on the last line formatted
+    CHECK_EQ(sci.caretPos(), (int)sci.text().find("dog"));
+    OptionRegistry::getInstance().setOption(OptionId::TextWidth, 0);
+}
+
+template <typename F>
+static double millis(F&& run) {
+    auto start = std::chrono::steady_clock::now();
+    run();
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+static std::string withoutBlanks(const std::string& text) {
+    std::string out;
+    for (char c : text) {
+        if (c != ' ' && c != '\t' && c != '\n') out += c;
+    }
+    return out;
+}
+
+// gqG over a 50 MB markdown file: headings, short ragged lines to join,
+// long lines to split, list items and fenced code.
+TEST(Reflow, MarkdownBenchmark) {
+    const std::string section =
+        "## Section heading\n"
+        "\n"
+        "Short lines\nthat should be\njoined into one paragraph with the rest of the text that follows them\n"
+        "and a line long enough that it has to be broken somewhere well before the end of it because of the width\n"
+        "\n"
+        "- a list item whose text runs past the text width and wraps under the marker\n"
+        "- second item\n"
+        "  with a continuation line\n"
+        "1. numbered item that is also quite long and will need to wrap at least once\n"
+        "\n"
+        "```\n"
+        "code    stays   exactly     as it is even when it is much longer than the text width allows\n"
+        "```\n"
+        "\n";
+    std::string text;
+    while (text.size() < 50u * 1024 * 1024) text += section;
+
+    std::string out;
+    double formatted = millis([&] { out = Reflow::format(text, settings(40, true)); });
+
+    bool inFence = false;
+    size_t longLines = 0;
+    size_t lines = 0;
+    for (size_t start = 0; start < out.size();) {
+        size_t end = out.find('\n', start);
+        if (end == std::string::npos) end = out.size();
+        std::string line = out.substr(start, end - start);
+        if (line.compare(0, 3, "```") == 0) inFence = !inFence;
+        else if (!inFence && line.size() > 40) longLines++;
+        lines++;
+        start = end + 1;
+    }
+    CHECK_EQ(longLines, (size_t)0);
+    CHECK(withoutBlanks(out) == withoutBlanks(text));
+
+    OptionRegistry::getInstance().setOption(OptionId::TextWidth, 40);
+    FakeScintilla sci(text);
+    int lastLine = (int)::SendMessage(sci.hwnd(), SCI_GETLINECOUNT, 0, 0) - 1;
+    sci.resetCounters();
+    double applied = millis([&] { Reflow::apply(sci.hwnd(), 0, lastLine); });
+    OptionRegistry::getInstance().setOption(OptionId::TextWidth, 0);
+
+    std::printf("  %zu MB, %zu lines out: format %.0f ms; gqG %.0f ms, %d edit, %d messages\n",
+        text.size() >> 20, lines, formatted, applied, sci.edits(), sci.messages());
+    CHECK(sci.text() == out);
+    CHECK_EQ(sci.edits(), 1);
+    CHECK_EQ(sci.undoSteps(), 1);
+}
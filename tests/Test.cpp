@@ -0,0 +1,51 @@
+#include "Test.h"
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+namespace {
+
+struct Case {
+    const char* suite;
+    const char* name;
+    void (*run)();
+};
+
+std::vector<Case>& cases() {
+    static std::vector<Case> all;
+    return all;
+}
+
+int failures = 0;
+
+}
+
+int test::add(const char* suite, const char* name, void (*run)()) {
+    cases().push_back({ suite, name, run });
+    return (int)cases().size();
+}
+
+void test::fail(const char* file, int line, const std::string& what) {
+    std::printf("  %s:%d: %s\n", file, line, what.c_str());
+    failures++;
+}
+
+// Registered by setInfo in the plugin; the modules read option defaults.
+void initializeOptions();
+
+int main(int argc, char** argv) {
+    initializeOptions();
+    const char* only = (argc > 1) ? argv[1] : nullptr;
+    int run = 0, failed = 0;
+    for (const Case& c : cases()) {
+        if (only && std::strcmp(only, c.suite) != 0) continue;
+        int before = failures;
+        c.run();
+        run++;
+        bool ok = (failures == before);
+        if (!ok) failed++;
+        std::printf("%s %s.%s\n", ok ? "[  OK  ]" : "[ FAIL ]", c.suite, c.name);
+    }
+    std::printf("%d of %d tests passed\n", run - failed, run);
+    return (failed == 0 && run > 0) ? 0 : 1;
+}
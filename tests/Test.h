@@ -0,0 +1,31 @@
+#pragma once
+#include <sstream>
+#include <string>
+
+// A small registry of test cases. Each case belongs to a suite so ctest can
+// run the suites one by one: NppVimTests <suite>.
+namespace test {
+
+int add(const char* suite, const char* name, void (*run)());
+void fail(const char* file, int line, const std::string& what);
+
+template <class A, class B>
+void checkEqual(const A& actual, const B& expected, const char* text, const char* file, int line) {
+    if (actual == expected) return;
+    std::ostringstream out;
+    out << text << ": got [" << actual << "], expected [" << expected << "]";
+    fail(file, line, out.str());
+}
+
+}
+
+#define TEST(suite, name) \
+    static void suite##_##name(); \
+    static int suite##_##name##_registered = test::add(#suite, #name, suite##_##name); \
+    static void suite##_##name()
+
+#define CHECK(cond) \
+    do { if (!(cond)) test::fail(__FILE__, __LINE__, #cond); } while (0)
+
+#define CHECK_EQ(actual, expected) \
+    test::checkEqual((actual), (expected), #actual, __FILE__, __LINE__)
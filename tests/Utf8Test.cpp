@@ -0,0 +1,134 @@
+#include "Test.h"
+#include "UnicodeCaseData.h"
+#include "../include/Utf8.h"
+#include <iterator>
+
+static char32_t expectedUpper(const UnicodeCase* entry, char32_t cp) {
+    return (entry && entry->upper) ? entry->upper : cp;
+}
+
+static char32_t expectedLower(const UnicodeCase* entry, char32_t cp) {
+    return (entry && entry->lower) ? entry->lower : cp;
+}
+
+// Every code point up to the last with a mapping, which is in Adlam.
+TEST(Utf8, CaseTablesMatchUnicodeData) {
+    for (char32_t cp = 0; cp < 0x80; cp++) {
+        CHECK_EQ((int)Utf8::toUpper(cp), (cp >= 'a' && cp <= 'z') ? (int)cp - 32 : (int)cp);
+        CHECK_EQ((int)Utf8::toLower(cp), (cp >= 'A' && cp <= 'Z') ? (int)cp + 32 : (int)cp);
+    }
+
+    const UnicodeCase* next = std::begin(UNICODE_CASES);
+    int mismatches = 0;
+    for (char32_t cp = 0x80; cp < 0x20000; cp++) {
+        const UnicodeCase* entry = nullptr;
+        if (next != std::end(UNICODE_CASES) && next->cp == cp) entry = next++;
+        if (Utf8::toUpper(cp) != expectedUpper(entry, cp) || Utf8::toLower(cp) != expectedLower(entry, cp)) {
+            if (mismatches++ < 10) {
+                CHECK_EQ((int)Utf8::toUpper(cp), (int)expectedUpper(entry, cp));
+                CHECK_EQ((int)Utf8::toLower(cp), (int)expectedLower(entry, cp));
+            }
+        }
+    }
+    CHECK_EQ(mismatches, 0);
+}
+
+// The same through changeCase, whose two-byte table and length-changing
+// path (dotless i, Kelvin sign) are separate from toUpper and toLower.
+TEST(Utf8, ChangeCaseMatchesUnicodeData) {
+    std::string text, upper, lower;
+    for (const UnicodeCase& entry : UNICODE_CASES) {
+        text += "a" + Utf8::encode(entry.cp);
+        upper += "A" + Utf8::encode(expectedUpper(&entry, entry.cp));
+        lower += "a" + Utf8::encode(expectedLower(&entry, entry.cp));
+    }
+
+    std::string changed = text;
+    CHECK(Utf8::changeCase(changed, CaseChange::Upper, true));
+    CHECK(changed == upper);
+    changed = text;
+    CHECK(Utf8::changeCase(changed, CaseChange::Lower, true));
+    CHECK(changed == lower);
+}
+
+TEST(Utf8, ChangeCaseLeavesMalformedBytes) {
+    std::string text = "\xC3" "a\xE2\x82" "b\xED\xA0\x80\xF8";
+    CHECK(Utf8::changeCase(text, CaseChange::Upper, true));
+    CHECK(text == "\xC3" "A\xE2\x82" "B\xED\xA0\x80\xF8");
+}
+
+static const CaseChange CASE_CHANGES[] = { CaseChange::Upper, CaseChange::Lower, CaseChange::Toggle, CaseChange::Rot13 };
+
+// A byte at a time, which only the scalar loop after the 16-byte steps sees.
+static std::string changedByteByByte(const std::string& text, CaseChange change, bool utf8) {
+    std::string out;
+    for (char c : text) {
+        std::string one(1, c);
+        Utf8::changeCase(one, change, utf8);
+        out += one;
+    }
+    return out;
+}
+
+// The SSE2 steps of the ASCII path against its byte loop, with every byte
+// value at every position of runs just short of, on and just past 16-byte
+// boundaries. The rest of each run sits on the edges of the letter ranges.
+TEST(Utf8, AsciiStepsMatchByteLoop) {
+    const std::string edges = "@AMNZ[`amnz{\x7F ~";
+    for (CaseChange change : CASE_CHANGES) {
+        for (bool utf8 : { false, true }) {
+            for (size_t n : { 15, 16, 17, 31, 32, 33, 48 }) {
+                for (size_t at = 0; at < n; at++) {
+                    for (int c = 0; c < (utf8 ? 0x80 : 0x100); c++) {
+                        std::string text;
+                        for (size_t i = 0; i < n; i++) text += edges[i % edges.size()];
+                        text[at] = (char)c;
+                        std::string expected = changedByteByByte(text, change, utf8);
+                        std::string changed = text;
+                        bool reported = Utf8::changeCase(changed, change, utf8);
+                        if (changed != expected || reported != (expected != text)) {
+                            test::fail(__FILE__, __LINE__, "change " + std::to_string((int)change) + ", length " +
+                                std::to_string(n) + ", byte " + std::to_string(c) + " at " + std::to_string(at));
+                            return;
+                        }
+                    }
+                }
+            }
+        }
+    }
+}
+
+TEST(Utf8, EncodeDecodeRoundTrip) {
+    for (char32_t cp = 0; cp <= 0x10FFFF; cp++) {
+        if (cp >= 0xD800 && cp <= 0xDFFF) continue;
+        std::string bytes = Utf8::encode(cp);
+        size_t used = 0;
+        char32_t decoded = Utf8::decode(bytes.data(), bytes.size(), used);
+        if (decoded != cp || used != bytes.size()) {
+            CHECK_EQ((int)decoded, (int)cp);
+            return;
+        }
+    }
+}
+
+// Overlong forms, surrogates, code points past U+10FFFF and cut-off
+// sequences decode as their first byte alone.
+TEST(Utf8, MalformedDecodesOneByte) {
+    const char* malformed[] = {
+        "\xC0\x80", "\xE0\x80\x80", "\xF0\x80\x80\x80", "\xED\xA0\x80", "\xED\xBF\xBF",
+        "\xF4\x90\x80\x80", "\xE2\x82", "\x80", "\xFF",
+    };
+    for (const char* text : malformed) {
+        size_t used = 0;
+        char32_t cp = Utf8::decode(text, std::char_traits<char>::length(text), used);
+        CHECK_EQ(used, (size_t)1);
+        CHECK_EQ((int)cp, (int)(unsigned char)text[0]);
+    }
+}
+
+// General category Zs, which Vim's classes treat as blanks.
+TEST(Utf8, SpaceSeparatorsAreBlank) {
+    const char32_t spaces[] = { 0x00A0, 0x1680, 0x2000, 0x2001, 0x2002, 0x2003, 0x2004, 0x2005,
+                                0x2006, 0x2007, 0x2008, 0x2009, 0x200A, 0x202F, 0x205F, 0x3000 };
+    for (char32_t cp : spaces) CHECK_EQ((int)Utf8::classOf(cp), (int)CC_SPACE);
+}